@@ -2,7 +2,9 @@
 *           David Tandetnik (tandetnik.da@husky.neu.edu) */
 #pragma once
 #include "../store/store.h"
+#include "../utils/bitmap.h"
 #include "arguments.h"
+#include "iteration.h"
 #include "sorer.h"
 
 // Application represents the top layer of the distributed system.
@@ -24,6 +26,53 @@ class Application {
         return store->num_nodes();
     }
 
+    // Collective operations, see Store. Every node must call the same
+    // collectives in the same order.
+    void barrier() {
+        store->barrier();
+    }
+
+    char* broadcast(Key* k, char* value) {
+        return store->broadcast(k, value);
+    }
+
+    char** gather(Key* k, char* value) {
+        return store->gather(k, value);
+    }
+
+    char* allreduce(char* value, Combiner* combiner) {
+        return store->allreduce(value, combiner);
+    }
+
+    // Runs the given delta iteration until no node derives a new value, or
+    // until max_iterations iterations have run. The working set and delta
+    // start as copies of initial. Each iteration, every node's step() results
+    // are merged across the cluster, so every node holds the same working set
+    // and delta. An empty merged delta means the computation has converged.
+    // Must be called by every node. Returns the final working set (caller owns it).
+    Bitmap* iterate(DeltaIteration& iteration, Bitmap* initial, size_t max_iterations) {
+        Bitmap* working = new Bitmap(initial);
+        Bitmap* delta = new Bitmap(initial);
+
+        for (size_t i = 0; i < max_iterations && !delta->is_empty(); i++) {
+            Bitmap* derived = iteration.step(delta, working);
+            // Only values new to the working set need to cross the network
+            derived->subtract(working);
+
+            Bitmap* merged = store->merge_bitmap(derived);
+            working->union_with(merged);
+
+            delete derived;
+            delete delta;
+            delta = merged;
+
+            iteration.iteration_done(i, delta, working);
+        }
+
+        delete delta;
+        return working;
+    }
+
     // OVERRIDE
     // Called on application start
     virtual void run_() = 0;
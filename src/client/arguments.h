@@ -6,8 +6,9 @@
 #include "../utils/helper.h"
 
 /* Arguments class to process command-line arguments for Linus application.
- * Processes arguments for node ports, addresses, number of nodes, and how
- * many degrees of linus to compute. */
+ * Processes arguments for node ports, addresses, number of nodes, how
+ * many degrees of linus to compute, and how much memory a node's store may
+ * use before spilling values to disk. */
 class Arguments {
     public:
         bool start_server;
@@ -24,6 +25,16 @@ class Arguments {
         char* users_file;
         char* commits_file;
 
+        size_t memory_budget_mb; // 0 for no limit
+        char* spill_dir;
+        char* snapshot_dir; // nullptr to always ingest the input files
+        size_t cache_mb; // 0 to never cache other nodes' values
+        char* stats_dir; // nullptr to not write metrics at shutdown
+        size_t replicas; // Copies of each input dataframe's chunks
+        bool text_chunks; // Whether to store chunks as text, for debugging
+        bool plain_chunks; // Whether to store binary chunks without encoding them
+        bool verify_chunks; // Whether to check chunks' checksums as they are read
+
         Arguments(int argc, char** argv) {
             // defaults
             start_server = 0;
@@ -40,6 +51,16 @@ class Arguments {
             users_file = (char*) "data/users_med.sor";
             commits_file = (char*) "data/commits_med.sor";
 
+            memory_budget_mb = 0;
+            spill_dir = (char*) "/tmp";
+            snapshot_dir = nullptr;
+            cache_mb = 64;
+            stats_dir = nullptr;
+            replicas = 1;
+            text_chunks = false;
+            plain_chunks = false;
+            verify_chunks = false;
+
             for (int i = 1; i < argc; i++) {
                 char* flag_name = argv[i];
                 char* flag_value = argv[i+1];
@@ -79,6 +100,34 @@ class Arguments {
                 } else if (equal_strings(flag_name, "-commits_file")) {
                     commits_file = commits_file;
 
+                } else if (equal_strings(flag_name, "-memory_budget_mb")) {
+                    memory_budget_mb = atoi(flag_value);
+
+                } else if (equal_strings(flag_name, "-spill_dir")) {
+                    spill_dir = flag_value;
+
+                } else if (equal_strings(flag_name, "-snapshot_dir")) {
+                    snapshot_dir = flag_value;
+
+                } else if (equal_strings(flag_name, "-cache_mb")) {
+                    cache_mb = atoi(flag_value);
+
+                } else if (equal_strings(flag_name, "-stats_dir")) {
+                    stats_dir = flag_value;
+
+                } else if (equal_strings(flag_name, "-replicas")) {
+                    replicas = atoi(flag_value);
+                    if (replicas == 0) exit_with_msg("ERROR: invalid replicas");
+
+                } else if (equal_strings(flag_name, "-text_chunks")) {
+                    text_chunks = atoi(flag_value) != 0;
+
+                } else if (equal_strings(flag_name, "-plain_chunks")) {
+                    plain_chunks = atoi(flag_value) != 0;
+
+                } else if (equal_strings(flag_name, "-verify_chunks")) {
+                    verify_chunks = atoi(flag_value) != 0;
+
                 } else {
                     exit_with_msg("ERROR: Unknown flag given");
                 }
@@ -0,0 +1,112 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include "../store/dataframe/dataframe.h"
+#include "../store/dataframe/rower.h"
+#include "../utils/bitmap.h"
+
+/*******************************************************************************
+ *  DeltaIteration::
+ *  A fixpoint computation over a growing set of values (the working set),
+ *  driven by Application::iterate(). Each iteration only sees the values
+ *  added by the previous iteration (the delta), so work is proportional to
+ *  what changed rather than to everything found so far. Subclasses give
+ *  step() a meaningful implementation.
+ */
+class DeltaIteration : public Object {
+   public:
+    /** Called on every node once per iteration with the same delta and
+      working set on every node. Returns a new heap-allocated Bitmap of the
+      values this node derived from the delta. Returned values that are
+      already in the working set are dropped, so they need not be filtered.
+      Must not modify or retain delta or working. */
+    virtual Bitmap* step(Bitmap* delta, Bitmap* working) = 0;
+
+    /** Called on every node after each iteration with the values the
+      iteration added to the working set (the next delta). */
+    virtual void iteration_done(size_t iteration, Bitmap* delta, Bitmap* working) {}
+};
+
+/*******************************************************************************
+ *  LocalIndex::
+ *  Maps each value of an int column to the rows of a DistributedDataFrame,
+ *  stored on this node, holding that value. Built once and kept resident, so
+ *  an iteration can visit just the rows matching its delta instead of
+ *  scanning the whole frame. Only indexes non-negative, non-missing values.
+ */
+class LocalIndex : public Rower {
+   public:
+    size_t col;        // Column being indexed
+    Bitmap** rows_;    // owned; rows_[value] is the rows holding value, or nullptr
+    size_t capacity;   // Number of slots in rows_
+
+    // Builds an index over the local rows of the given frame's column
+    LocalIndex(DataFrame* df, size_t col) {
+        this->col = col;
+        capacity = 16;
+        rows_ = new Bitmap*[capacity]();
+
+        df->local_map(*this);
+    }
+
+    ~LocalIndex() {
+        for (size_t i = 0; i < capacity; i++) {
+            delete rows_[i];
+        }
+        delete[] rows_;
+    }
+
+    // Records the row under its value. Used while building the index.
+    bool accept(Row& row) {
+        if (row.is_missing(col) || row.get_int(col) < 0) {
+            return false;
+        }
+
+        size_t value = row.get_int(col);
+        if (value >= capacity) {
+            grow_(value + 1);
+        }
+
+        if (rows_[value] == nullptr) {
+            rows_[value] = new Bitmap();
+        }
+        rows_[value]->add(row.get_idx());
+
+        return false;
+    }
+
+    void grow_(size_t min_capacity) {
+        size_t new_capacity = capacity;
+        while (new_capacity < min_capacity) {
+            new_capacity *= 2;
+        }
+
+        Bitmap** grown = new Bitmap*[new_capacity]();
+        for (size_t i = 0; i < capacity; i++) {
+            grown[i] = rows_[i];
+        }
+
+        delete[] rows_;
+        rows_ = grown;
+        capacity = new_capacity;
+    }
+
+    // Returns a new Bitmap of the local rows holding any of the given values
+    Bitmap* rows_for(Bitmap* values) {
+        Bitmap* rows = new Bitmap();
+
+        BitmapIterator it(values);
+        while (it.has_next()) {
+            size_t value = it.next();
+            if (value >= capacity) {
+                break;  // values are ascending, so none of the rest are indexed
+            }
+
+            if (rows_[value] != nullptr) {
+                rows->union_with(rows_[value]);
+            }
+        }
+
+        return rows;
+    }
+};
@@ -0,0 +1,169 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../utils/crc32c.h"
+#include "../utils/object.h"
+
+// Bytes before the values of a binary chunk
+#define CHUNK_HEADER_LEN (size_t)20
+// First bytes of every binary chunk. A text chunk never starts with a NUL,
+// so the two can be told apart. Chunks from before versioned headers
+// started with a NUL too, but then held their type, not this magic.
+#define CHUNK_MAGIC "\0CKH"
+#define CHUNK_MAGIC_LEN (size_t)4
+// Version of the header and encodings written. Readers refuse chunks of a
+// later version, whose fields they may not understand.
+#define CHUNK_VERSION (char)1
+// No flags are defined yet; readers ignore the ones they do not know
+#define CHUNK_FLAGS_NONE (char)0
+// Offset of the checksum, which covers the header bytes before it and the
+// values
+#define CHUNK_CRC_OFFSET (size_t)16
+
+// Encodings of the values of a chunk; see ChunkCodec in codec.h
+#define CHUNK_PLAIN (char)0          // Any type, laid out as below
+#define CHUNK_DELTA_VARINT (char)1   // ints
+#define CHUNK_BITPACK (char)2        // ints, bools
+#define CHUNK_RLE (char)3            // bools
+#define CHUNK_XOR (char)4            // floats
+#define CHUNK_LZ (char)5             // strings: the plain values, compressed
+
+/*************************************************************************
+ * ChunkHeader::
+ * The start of a chunk of column values in binary form, as the Serializer
+ * writes them into the Store:
+ *   bytes 0-3:    CHUNK_MAGIC
+ *   byte 4:       CHUNK_VERSION
+ *   byte 5:       element type, one of INT_TYPE, BOOL_TYPE, FLOAT_TYPE or
+ *                 STRING_TYPE
+ *   byte 6:       encoding of the elements, CHUNK_PLAIN unless the
+ *                 Serializer found a smaller one
+ *   byte 7:       flags
+ *   bytes 8-11:   number of elements
+ *   bytes 12-15:  number of bytes of elements after the header
+ *   bytes 16-19:  CRC-32C of bytes 0-15 and the elements
+ * followed by the elements. Plain, they are:
+ *   ints, floats: 4 bytes each, the float's IEEE bits
+ *   bools:        1 byte each, 0 or 1
+ *   strings:      count + 1 offsets of 4 bytes each, from the end of the
+ *                 offsets, then the bytes of each string with a NUL after
+ *                 it; string i runs from offset i to offset i + 1, less
+ *                 its NUL
+ * Every other encoding is described in codec.h. Every integer is
+ * little-endian, so chunks mean the same on every node.
+ * Values start 20 bytes into the buffer, so a buffer from new[] or the
+ * SlabAllocator holds 4 byte values aligned.
+ */
+class ChunkHeader {
+   public:
+    char version;
+    char type;
+    char encoding;
+    char flags;
+    uint32_t count;
+    uint32_t length;  // Bytes of elements
+    uint32_t crc;
+
+    ChunkHeader() {
+        version = CHUNK_VERSION;
+        type = 0;
+        encoding = CHUNK_PLAIN;
+        flags = CHUNK_FLAGS_NONE;
+        count = 0;
+        length = 0;
+        crc = 0;
+    }
+
+    ChunkHeader(char type, size_t count, char encoding = CHUNK_PLAIN) {
+        version = CHUNK_VERSION;
+        this->type = type;
+        this->encoding = encoding;
+        flags = CHUNK_FLAGS_NONE;
+        this->count = (uint32_t)count;
+        length = 0;
+        crc = 0;
+    }
+
+    // Whether the len bytes at bytes are a binary chunk rather than text,
+    // of this header or of the unversioned one before it
+    static bool is_binary(const char* bytes, size_t len) {
+        return len > 0 && bytes[0] == '\0';
+    }
+
+    // Whether the len bytes at bytes start with a header of this layout
+    static bool has_magic(const char* bytes, size_t len) {
+        return len >= CHUNK_HEADER_LEN && memcmp(bytes, CHUNK_MAGIC, CHUNK_MAGIC_LEN) == 0;
+    }
+
+    // Writes this header to the first CHUNK_HEADER_LEN bytes of dst, whose
+    // length bytes of elements after it must already be written, so they
+    // can be checksummed
+    void write(char* dst, size_t length) {
+        this->length = (uint32_t)length;
+        memcpy(dst, CHUNK_MAGIC, CHUNK_MAGIC_LEN);
+        dst[4] = version;
+        dst[5] = type;
+        dst[6] = encoding;
+        dst[7] = flags;
+        store_le32(dst + 8, count);
+        store_le32(dst + 12, this->length);
+        crc = checksum(dst);
+        store_le32(dst + CHUNK_CRC_OFFSET, crc);
+    }
+
+    // Reads the header of the binary chunk at src
+    void read(const char* src) {
+        version = src[4];
+        type = src[5];
+        encoding = src[6];
+        flags = src[7];
+        count = load_le32(src + 8);
+        length = load_le32(src + 12);
+        crc = load_le32(src + CHUNK_CRC_OFFSET);
+    }
+
+    // The checksum of the header of the chunk at src, up to the checksum,
+    // and of the elements its header says follow
+    static uint32_t checksum(const char* src) {
+        uint32_t crc = Crc32c::compute(src, CHUNK_CRC_OFFSET);
+        return Crc32c::extend(crc, src + CHUNK_HEADER_LEN, load_le32(src + 12));
+    }
+
+    // Whether the len bytes at src are a whole binary chunk of a version
+    // this reader knows, with elements matching its checksum
+    static bool verify(const char* src, size_t len) {
+        if (!has_magic(src, len) || src[4] < 1 || src[4] > CHUNK_VERSION) {
+            return false;
+        }
+        return load_le32(src + 12) == len - CHUNK_HEADER_LEN && checksum(src) == load_le32(src + CHUNK_CRC_OFFSET);
+    }
+
+    static void store_le32(char* dst, uint32_t v) {
+        for (size_t i = 0; i < 4; i++) {
+            dst[i] = (char)(v >> (8 * i));
+        }
+    }
+
+    static uint32_t load_le32(const char* src) {
+        const unsigned char* s = (const unsigned char*)src;
+        return (uint32_t)s[0] | ((uint32_t)s[1] << 8) | ((uint32_t)s[2] << 16) | ((uint32_t)s[3] << 24);
+    }
+
+    // Copies n 4 byte values from src to dst, turning host order to
+    // little-endian or back. Just a memcpy on little-endian hosts.
+    static void copy_le32(void* dst, const void* src, size_t n) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        memcpy(dst, src, 4 * n);
+#else
+        for (size_t i = 0; i < n; i++) {
+            uint32_t v;
+            memcpy(&v, (const char*)src + 4 * i, 4);
+            store_le32((char*)dst + 4 * i, v);
+        }
+#endif
+    }
+};
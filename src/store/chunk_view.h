@@ -0,0 +1,180 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../utils/object.h"
+#include "chunk.h"
+#include "value.h"
+
+/*************************************************************************
+ * ChunkView::
+ * A read-only view of the values of a chunk as an array of T, for T int,
+ * float or bool. A plain binary chunk of ints or floats is read in place:
+ * the view holds a reference to its Value, so the bytes live as long as
+ * the view looks at them, and nothing is copied. Any other chunk is
+ * decoded into an array the view keeps and reuses for the next chunk, so a
+ * view pointed at chunk after chunk only allocates when one is bigger than
+ * any before. Serializer::view_chunk() points a view at a chunk.
+ */
+template <class T>
+class ChunkView : public Object {
+   public:
+    Value* chunk;     // Retained while its bytes are viewed, or nullptr
+    const T* values;  // count values, in chunk's bytes or in decoded
+    size_t count;
+    T* decoded;       // owned; reused from chunk to chunk
+    size_t decoded_capacity;
+
+    ChunkView() {
+        chunk = nullptr;
+        values = nullptr;
+        count = 0;
+        decoded = nullptr;
+        decoded_capacity = 0;
+    }
+
+    ~ChunkView() {
+        clear();
+        delete[] decoded;
+    }
+
+    size_t size() { return count; }
+
+    // Returns value i; i must be less than size()
+    T get(size_t i) { return values[i]; }
+
+    const T* data() { return values; }
+
+    // Whether the values are read straight from the chunk's bytes
+    bool in_place() { return chunk != nullptr; }
+
+    // Whether plain values at bytes can be read as T where they lie: they
+    // must be in host order and aligned for T. Plain bools are bytes that
+    // need not hold 0 or 1, and reading any other byte as a bool is
+    // undefined, so they are always decoded.
+    static bool can_view_in_place(const char* bytes) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return sizeof(T) == 4 && (uintptr_t)bytes % alignof(T) == 0;
+#else
+        return false;
+#endif
+    }
+
+    // Views the count values at values, which lie in chunk's bytes
+    void view_in_place(Value* chunk, const T* values, size_t count) {
+        chunk->retain();
+        clear();
+        this->chunk = chunk;
+        this->values = values;
+        this->count = count;
+    }
+
+    // Returns room for count values, which the view shows once the caller
+    // has decoded them there
+    T* decode_into(size_t count) {
+        clear();
+        if (count > decoded_capacity) {
+            delete[] decoded;
+            decoded = new T[count];
+            decoded_capacity = count;
+        }
+        values = decoded;
+        this->count = count;
+        return decoded;
+    }
+
+    // Stops viewing, releasing the chunk if it was viewed in place
+    void clear() {
+        if (chunk != nullptr) {
+            chunk->release();
+        }
+        chunk = nullptr;
+        values = nullptr;
+        count = 0;
+    }
+};
+
+/*************************************************************************
+ * StringChunkView::
+ * A read-only view of the strings of a chunk, laid out as in a plain
+ * binary chunk: count + 1 offsets, then each string with a NUL after it.
+ * String i is found by its offset without scanning those before it. As
+ * with ChunkView, a plain binary chunk is read in place and holds its
+ * Value, and any other chunk is decoded into bytes the view reuses.
+ */
+class StringChunkView : public Object {
+   public:
+    Value* chunk;         // Retained while its bytes are viewed, or nullptr
+    const char* offsets;  // count + 1 little-endian offsets into blob
+    const char* blob;
+    size_t count;
+    char* decoded;        // owned; reused from chunk to chunk
+    size_t decoded_capacity;
+
+    StringChunkView() {
+        chunk = nullptr;
+        offsets = nullptr;
+        blob = nullptr;
+        count = 0;
+        decoded = nullptr;
+        decoded_capacity = 0;
+    }
+
+    ~StringChunkView() {
+        clear();
+        delete[] decoded;
+    }
+
+    size_t size() { return count; }
+
+    // Returns string i, NUL-terminated; i must be less than size()
+    const char* c_str(size_t i) {
+        return blob + ChunkHeader::load_le32(offsets + 4 * i);
+    }
+
+    // Returns the length of string i, less its NUL
+    size_t length(size_t i) {
+        return ChunkHeader::load_le32(offsets + 4 * (i + 1)) - ChunkHeader::load_le32(offsets + 4 * i) - 1;
+    }
+
+    bool in_place() { return chunk != nullptr; }
+
+    // Views the count strings laid out at plain, which lies in chunk's bytes
+    void view_in_place(Value* chunk, const char* plain, size_t count) {
+        chunk->retain();
+        clear();
+        this->chunk = chunk;
+        show_(plain, count);
+    }
+
+    // Returns room for len bytes of count strings laid out as above, which
+    // the view shows once the caller has decoded them there
+    char* decode_into(size_t len, size_t count) {
+        clear();
+        if (len > decoded_capacity) {
+            delete[] decoded;
+            decoded = new char[len];
+            decoded_capacity = len;
+        }
+        show_(decoded, count);
+        return decoded;
+    }
+
+    void clear() {
+        if (chunk != nullptr) {
+            chunk->release();
+        }
+        chunk = nullptr;
+        offsets = nullptr;
+        blob = nullptr;
+        count = 0;
+    }
+
+    void show_(const char* plain, size_t count) {
+        offsets = plain;
+        blob = plain + 4 * (count + 1);
+        this->count = count;
+    }
+};
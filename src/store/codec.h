@@ -0,0 +1,460 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../utils/object.h"
+#include "chunk.h"
+
+// The LZ codec looks for repeats through a table of 2^LZ_HASH_BITS entries
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH (size_t)4
+// Farthest back a repeat may be found
+#define LZ_MAX_OFFSET (size_t)0xFFFF
+
+/*************************************************************************
+ * ChunkCodec::
+ * The encodings a binary chunk's values may be written in, as listed in
+ * chunk.h. Each writes into a buffer the caller sized with the matching
+ * _len() function, and each read checks it stays within the bytes it was
+ * given, returning false if the chunk is cut short or corrupt.
+ *   Delta varint (ints):  each value less the one before it, zig-zagged so
+ *                         small differences either way are small, in 7 bit
+ *                         groups with the high bit set on all but the last
+ *   Bitpack (ints):       the least value as 4 bytes, one byte giving how
+ *                         many bits each value less the least needs, then
+ *                         those bits for each value, least significant first
+ *   Bitpack (bools):      one bit per value, least significant first
+ *   RLE (bools):          the first value as a byte, then the length of
+ *                         each run of equal values as a varint
+ *   XOR (floats):         each value's bits XORed with those before it. A
+ *                         byte gives how many of the 4 bytes of the result
+ *                         are zero at the top (high nibble) and at the
+ *                         bottom (low nibble), and the bytes between follow
+ *   LZ (any bytes):       LZ77 sequences: a token byte whose high nibble is
+ *                         the number of literal bytes and low nibble the
+ *                         repeat length less LZ_MIN_MATCH, 15 in either
+ *                         meaning more length bytes follow, then the
+ *                         literals, then the 2 byte distance back to copy
+ *                         the repeat from. The last sequence has literals
+ *                         only.
+ * Every multi-byte integer is little-endian.
+ */
+class ChunkCodec {
+   public:
+    static uint32_t zigzag(int32_t v) {
+        return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+    }
+
+    static int32_t unzigzag(uint32_t v) {
+        return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+    }
+
+    static size_t varint_len(uint32_t v) {
+        size_t n = 1;
+        while (v >= 0x80) {
+            v >>= 7;
+            n++;
+        }
+        return n;
+    }
+
+    static char* write_varint(char* dst, uint32_t v) {
+        while (v >= 0x80) {
+            *dst++ = (char)(v | 0x80);
+            v >>= 7;
+        }
+        *dst++ = (char)v;
+        return dst;
+    }
+
+    // Reads a varint at *src, before end, into v and moves *src past it
+    static bool read_varint(const char** src, const char* end, uint32_t* v) {
+        uint32_t result = 0;
+        for (size_t shift = 0; shift < 35 && *src < end; shift += 7) {
+            unsigned char b = (unsigned char)*(*src)++;
+            result |= (uint32_t)(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) {
+                *v = result;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* Delta varint, for ints */
+    static size_t delta_varint_len(const int* ints, size_t n) {
+        size_t len = 0;
+        uint32_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            len += varint_len(zigzag((int32_t)((uint32_t)ints[i] - prev)));
+            prev = (uint32_t)ints[i];
+        }
+        return len;
+    }
+
+    static size_t write_delta_varint(char* dst, const int* ints, size_t n) {
+        char* out = dst;
+        uint32_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            out = write_varint(out, zigzag((int32_t)((uint32_t)ints[i] - prev)));
+            prev = (uint32_t)ints[i];
+        }
+        return out - dst;
+    }
+
+    static bool read_delta_varint(int* ints, size_t n, const char* src, size_t len) {
+        const char* end = src + len;
+        uint32_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t v;
+            if (!read_varint(&src, end, &v)) {
+                return false;
+            }
+            prev += (uint32_t)unzigzag(v);
+            ints[i] = (int)prev;
+        }
+        return true;
+    }
+
+    /* Bitpack, for ints */
+    // Returns the length of ints bitpacked, and the least value and the
+    // bits per value to write them with
+    static size_t bitpack_len(const int* ints, size_t n, int32_t* least, size_t* width) {
+        int32_t lo = n > 0 ? ints[0] : 0;
+        int32_t hi = lo;
+        for (size_t i = 1; i < n; i++) {
+            lo = ints[i] < lo ? ints[i] : lo;
+            hi = ints[i] > hi ? ints[i] : hi;
+        }
+        uint32_t range = (uint32_t)hi - (uint32_t)lo;
+        size_t bits = 0;
+        while (bits < 32 && (range >> bits) != 0) {
+            bits++;
+        }
+        *least = lo;
+        *width = bits;
+        return 5 + (n * bits + 7) / 8;
+    }
+
+    static size_t write_bitpack(char* dst, const int* ints, size_t n, int32_t least, size_t width) {
+        ChunkHeader::store_le32(dst, (uint32_t)least);
+        dst[4] = (char)width;
+        char* out = dst + 5;
+        uint64_t acc = 0;
+        size_t acc_bits = 0;
+        for (size_t i = 0; i < n; i++) {
+            acc |= (uint64_t)((uint32_t)ints[i] - (uint32_t)least) << acc_bits;
+            acc_bits += width;
+            while (acc_bits >= 8) {
+                *out++ = (char)acc;
+                acc >>= 8;
+                acc_bits -= 8;
+            }
+        }
+        if (acc_bits > 0) {
+            *out++ = (char)acc;
+        }
+        return out - dst;
+    }
+
+    static bool read_bitpack(int* ints, size_t n, const char* src, size_t len) {
+        if (len < 5 || (unsigned char)src[4] > 32) {
+            return false;
+        }
+        uint32_t least = ChunkHeader::load_le32(src);
+        size_t width = (unsigned char)src[4];
+        if (len < 5 + (n * width + 7) / 8) {
+            return false;
+        }
+        const unsigned char* in = (const unsigned char*)src + 5;
+        uint64_t mask = width == 32 ? 0xFFFFFFFFull : ((uint64_t)1 << width) - 1;
+        uint64_t acc = 0;
+        size_t acc_bits = 0;
+        for (size_t i = 0; i < n; i++) {
+            while (acc_bits < width) {
+                acc |= (uint64_t)*in++ << acc_bits;
+                acc_bits += 8;
+            }
+            ints[i] = (int)(least + (uint32_t)(acc & mask));
+            acc >>= width;
+            acc_bits -= width;
+        }
+        return true;
+    }
+
+    /* Bitpack and RLE, for bools */
+    static size_t bits_len(size_t n) {
+        return (n + 7) / 8;
+    }
+
+    static size_t write_bits(char* dst, const bool* bools, size_t n) {
+        memset(dst, 0, bits_len(n));
+        for (size_t i = 0; i < n; i++) {
+            if (bools[i]) {
+                dst[i / 8] |= (char)(1 << (i % 8));
+            }
+        }
+        return bits_len(n);
+    }
+
+    static bool read_bits(bool* bools, size_t n, const char* src, size_t len) {
+        if (len < bits_len(n)) {
+            return false;
+        }
+        for (size_t i = 0; i < n; i++) {
+            bools[i] = (src[i / 8] >> (i % 8)) & 1;
+        }
+        return true;
+    }
+
+    static size_t rle_len(const bool* bools, size_t n) {
+        size_t len = 1;
+        size_t run = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (i > 0 && bools[i] != bools[i - 1]) {
+                len += varint_len((uint32_t)run);
+                run = 0;
+            }
+            run++;
+        }
+        return n > 0 ? len + varint_len((uint32_t)run) : len;
+    }
+
+    static size_t write_rle(char* dst, const bool* bools, size_t n) {
+        char* out = dst;
+        *out++ = n > 0 && bools[0] ? 1 : 0;
+        size_t run = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (i > 0 && bools[i] != bools[i - 1]) {
+                out = write_varint(out, (uint32_t)run);
+                run = 0;
+            }
+            run++;
+        }
+        if (n > 0) {
+            out = write_varint(out, (uint32_t)run);
+        }
+        return out - dst;
+    }
+
+    static bool read_rle(bool* bools, size_t n, const char* src, size_t len) {
+        if (len < 1) {
+            return false;
+        }
+        const char* end = src + len;
+        bool value = *src++ != 0;
+        size_t i = 0;
+        while (i < n) {
+            uint32_t run;
+            if (!read_varint(&src, end, &run) || run == 0 || run > n - i) {
+                return false;
+            }
+            memset(bools + i, value, run);
+            i += run;
+            value = !value;
+        }
+        return true;
+    }
+
+    /* XOR, for floats */
+    // Bytes of v that are zero above and below the rest
+    static void zero_bytes_(uint32_t v, size_t* lead, size_t* trail) {
+        if (v == 0) {
+            *lead = 4;
+            *trail = 0;
+            return;
+        }
+        *lead = 0;
+        while ((v >> (24 - 8 * *lead)) == 0) {
+            (*lead)++;
+        }
+        *trail = 0;
+        while (((v >> (8 * *trail)) & 0xFF) == 0) {
+            (*trail)++;
+        }
+    }
+
+    static size_t xor_len(const float* floats, size_t n) {
+        size_t len = 0;
+        uint32_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t bits;
+            memcpy(&bits, floats + i, 4);
+            size_t lead, trail;
+            zero_bytes_(bits ^ prev, &lead, &trail);
+            len += 1 + 4 - lead - trail;
+            prev = bits;
+        }
+        return len;
+    }
+
+    static size_t write_xor(char* dst, const float* floats, size_t n) {
+        char* out = dst;
+        uint32_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t bits;
+            memcpy(&bits, floats + i, 4);
+            uint32_t x = bits ^ prev;
+            size_t lead, trail;
+            zero_bytes_(x, &lead, &trail);
+            *out++ = (char)((lead << 4) | trail);
+            for (size_t b = trail; b < 4 - lead; b++) {
+                *out++ = (char)(x >> (8 * b));
+            }
+            prev = bits;
+        }
+        return out - dst;
+    }
+
+    static bool read_xor(float* floats, size_t n, const char* src, size_t len) {
+        const char* end = src + len;
+        uint32_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (src >= end) {
+                return false;
+            }
+            size_t lead = (unsigned char)*src >> 4;
+            size_t trail = *src++ & 0xF;
+            if (lead + trail > 4 || (size_t)(end - src) < 4 - lead - trail) {
+                return false;
+            }
+            uint32_t x = 0;
+            for (size_t b = trail; b < 4 - lead; b++) {
+                x |= (uint32_t)(unsigned char)*src++ << (8 * b);
+            }
+            prev ^= x;
+            memcpy(floats + i, &prev, 4);
+        }
+        return true;
+    }
+
+    /* LZ, for string blobs */
+    // Most bytes n bytes can take compressed
+    static size_t lz_bound(size_t n) {
+        return n + n / 255 + 16;
+    }
+
+    static uint32_t load32_(const char* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    // Writes a length of 15 or more as the bytes after a token nibble
+    static char* write_lz_len_(char* out, size_t len) {
+        for (len -= 15; len >= 255; len -= 255) {
+            *out++ = (char)255;
+        }
+        *out++ = (char)len;
+        return out;
+    }
+
+    static bool read_lz_len_(const unsigned char** src, const unsigned char* end, size_t* len) {
+        unsigned char b;
+        do {
+            if (*src >= end) {
+                return false;
+            }
+            b = *(*src)++;
+            *len += b;
+        } while (b == 255);
+        return true;
+    }
+
+    // Writes one sequence of literals followed by a repeat, or the literals
+    // alone if match_len is 0
+    static char* write_lz_sequence_(char* out, const char* literals, size_t literal_len,
+                                    size_t offset, size_t match_len) {
+        size_t match_code = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+        char* token = out++;
+        *token = (char)(((literal_len < 15 ? literal_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+        if (literal_len >= 15) {
+            out = write_lz_len_(out, literal_len);
+        }
+        memcpy(out, literals, literal_len);
+        out += literal_len;
+        if (match_len > 0) {
+            *out++ = (char)offset;
+            *out++ = (char)(offset >> 8);
+            if (match_code >= 15) {
+                out = write_lz_len_(out, match_code);
+            }
+        }
+        return out;
+    }
+
+    // Compresses the n bytes at src into dst, which holds lz_bound(n)
+    // bytes, and returns the compressed length
+    static size_t lz_compress(char* dst, const char* src, size_t n) {
+        uint32_t table[1 << LZ_HASH_BITS];  // Position + 1 each hash was last seen at
+        memset(table, 0, sizeof(table));
+        char* out = dst;
+        size_t anchor = 0;
+        size_t pos = 0;
+        while (pos + LZ_MIN_MATCH <= n) {
+            uint32_t seq = load32_(src + pos);
+            uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+            size_t candidate = table[h];
+            table[h] = (uint32_t)(pos + 1);
+            if (candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET || load32_(src + candidate - 1) != seq) {
+                pos++;
+                continue;
+            }
+            candidate--;
+            size_t match_len = LZ_MIN_MATCH;
+            while (pos + match_len < n && src[candidate + match_len] == src[pos + match_len]) {
+                match_len++;
+            }
+            out = write_lz_sequence_(out, src + anchor, pos - anchor, pos - candidate, match_len);
+            pos += match_len;
+            anchor = pos;
+        }
+        out = write_lz_sequence_(out, src + anchor, n - anchor, 0, 0);
+        return out - dst;
+    }
+
+    // Decompresses the len bytes at src into exactly n bytes at dst
+    static bool lz_decompress(char* dst, size_t n, const char* src, size_t len) {
+        const unsigned char* in = (const unsigned char*)src;
+        const unsigned char* end = in + len;
+        size_t pos = 0;
+        while (in < end) {
+            unsigned char token = *in++;
+            size_t literal_len = token >> 4;
+            if (literal_len == 15 && !read_lz_len_(&in, end, &literal_len)) {
+                return false;
+            }
+            if (literal_len > (size_t)(end - in) || literal_len > n - pos) {
+                return false;
+            }
+            memcpy(dst + pos, in, literal_len);
+            in += literal_len;
+            pos += literal_len;
+            if (in == end) {
+                break;  // The last sequence
+            }
+
+            if (end - in < 2) {
+                return false;
+            }
+            size_t offset = in[0] | (in[1] << 8);
+            in += 2;
+            size_t match_len = token & 0xF;
+            if (match_len == 15 && !read_lz_len_(&in, end, &match_len)) {
+                return false;
+            }
+            match_len += LZ_MIN_MATCH;
+            if (offset == 0 || offset > pos || match_len > n - pos) {
+                return false;
+            }
+            // Byte by byte, as a repeat may overlap what it copies
+            for (size_t i = 0; i < match_len; i++, pos++) {
+                dst[pos] = dst[pos - offset];
+            }
+        }
+        return pos == n;
+    }
+};
@@ -1,19 +1,28 @@
 /* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
 *           David Tandetnik (tandetnik.da@husky.neu.edu) */
 #pragma once
+#include <inttypes.h>
 #include <stdarg.h>  // va_arg
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
 
+#include "../../utils/arena.h"
 #include "../../utils/object.h"
 #include "../../utils/string.h"
+#include "../chunk_view.h"
 #include "../key.h"
 #include "../store.h"
+#include "../value.h"
 
 #define INT_TYPE 'I'
 #define BOOL_TYPE 'B'
 #define FLOAT_TYPE 'F'
 #define STRING_TYPE 'S'
 #define INTERNAL_CHUNK_SIZE (size_t)100
+// Chunks a column copy moves per batched get and put
+#define COPY_BATCH_CHUNKS (size_t)64
 
 class IntColumn;
 class BoolColumn;
@@ -388,9 +397,7 @@ class DistributedColumn : virtual public Column {
             missings_chunk[j] = false;
         }
 
-        for (size_t i = 0; i < num_chunks; i++) {
-            store->put_(missings_keys[i], missings_chunk, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(missings_keys, num_chunks, missings_chunk, INTERNAL_CHUNK_SIZE);
     }
 
     // Initialize all keys. After this method. Both Key lists should be
@@ -448,30 +455,24 @@ class DistributedColumn : virtual public Column {
         }
     }
 
-    // Generate a random number, and turn it in to a char* to be used in a Key
-    // Ensure that the generated Key does not already exist in our lists of
-    // Keys
+    // Generate a Key for a new chunk, unique across nodes, processes and
+    // runs: the name is this node's id, a random number drawn once per
+    // process, and a count of keys made so far. Names drawn from rand()
+    // alone collide, since every process draws the same sequence, and
+    // chunks restored from a snapshot outlive the process that named them.
     virtual Key* generate_key_dist(size_t corresponding_chunk_id) {
-        size_t rand_key = rand();  // random number as key
+        static const uint64_t process_nonce = mix64(((uint64_t)time(nullptr) << 32) ^ (uint64_t)getpid());
+        static std::atomic<size_t> keys_made(0);
+        size_t count = keys_made++;
 
         // Do a fake write to check how much space we need
-        size_t buf_size = snprintf(nullptr, 0, "%zu", rand_key) + 1;
+        const char* fmt = "%zu-%" PRIx64 "-%zu";
+        size_t buf_size = snprintf(nullptr, 0, fmt, store->this_node(), process_nonce, count) + 1;
 
         // Do a real write with proper amount of space
         char key[buf_size];
-        snprintf(key, buf_size, "%zu", rand_key);
-
-        // Check this key against all existing keys in this column
-        for (size_t i = 0; i < num_chunks; i++) {
-            if (chunk_keys[i] && chunk_keys[i]->get_name() && strcmp(key, chunk_keys[i]->get_name()) == 0) {
-                return generate_key_dist(i);  // Start over, need unique key
-            }
-            if (missings_keys[i] && missings_keys[i]->get_name() && strcmp(key, missings_keys[i]->get_name()) == 0) {
-                return generate_key_dist(i);  // Start over, need unique key
-            }
-        }
+        snprintf(key, buf_size, fmt, store->this_node(), process_nonce, count);
 
-        // We have a unique key, make a Key and return it
         size_t chunk_node = corresponding_chunk_id % store->num_nodes();
         return new Key(key, chunk_node);
     }
@@ -485,21 +486,68 @@ class DistributedColumn : virtual public Column {
         }
 
         // Put default missings chunk under each new key
-        for (size_t i = (length / INTERNAL_CHUNK_SIZE); i < num_chunks; i++) {
-            store->put_(missings_keys[i], missings_chunk, INTERNAL_CHUNK_SIZE);
+        size_t first_chunk = length / INTERNAL_CHUNK_SIZE;
+        store->put_(missings_keys + first_chunk, num_chunks - first_chunk, missings_chunk, INTERNAL_CHUNK_SIZE);
+    }
+
+    // Makes this new column a copy of col by copying each of col's chunks and
+    // missings chunks as they are stored, COPY_BATCH_CHUNKS chunks per batched
+    // get and put, instead of pushing back its values one at a time. The
+    // copies belong to this column alone, so they are not replicated, even
+    // if col's chunks are: reading a replicated frame writes each chunk once.
+    void copy_chunks_dist(DistributedColumn* col) {
+        while (num_chunks < col->num_chunks) {
+            resize_keys_dist();
+        }
+
+        Key* from[2 * COPY_BATCH_CHUNKS];
+        Key* to[2 * COPY_BATCH_CHUNKS];
+        for (size_t start = 0; start < col->num_chunks; start += COPY_BATCH_CHUNKS) {
+            size_t n = 0;
+            for (size_t i = start; i < col->num_chunks && i < start + COPY_BATCH_CHUNKS; i++) {
+                from[n] = col->chunk_keys[i];
+                to[n++] = chunk_keys[i]->set_replicas(1);
+                from[n] = col->missings_keys[i];
+                to[n++] = missings_keys[i]->set_replicas(1);
+            }
+
+            Value** values = get_chunks_dist(store, from, n);
+            // Values never change, so local chunks are shared, not copied
+            store->put_many(to, values, n);
+            delete[] values;
+        }
+
+        length = col->size();
+        cached_chunk_idx = num_chunks;
+        cached_missings_idx = num_chunks;
+    }
+
+    // Gets the n chunks under the given keys from the store with one batched
+    // get. Every chunk must exist. The caller must release() each and
+    // delete[] the array.
+    static Value** get_chunks_dist(Store* store, Key** keys, size_t n) {
+        Value** values = store->get_many(keys, n);
+        for (size_t i = 0; i < n; i++) {
+            if (values[i] == nullptr) {
+                printf("ERROR: Chunk %s of a column is not in the store\n", keys[i]->get_name());
+                exit(1);
+            }
         }
+        return values;
     }
 
+    // Caches the given serialized chunk as chunk chunk_idx of this column
+    virtual void cache_chunk_dist(size_t chunk_idx, Value* chunk) = 0;
+
     // Return whether the element at the given value is a missing value
     // Undefined behavior if the idx is out of bounds
     virtual bool is_missing_dist(size_t idx) {
         size_t array_idx = idx / INTERNAL_CHUNK_SIZE;  // Will round down (floor)
         size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
         Key* k = missings_keys[array_idx];
-        bool* this_missings = store->get_bool_array_(k);
-        bool val = this_missings[local_idx];
-        delete[] this_missings;
-        return val;
+        Arena arena;
+        bool* this_missings = store->get_bool_array_(k, &arena);
+        return this_missings[local_idx];
 
         // TODO fix missings caching (currently has memory leak)
         // Cache this chunk if its not already
@@ -522,12 +570,12 @@ class DistributedColumn : virtual public Column {
         size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
 
         Key* k = missings_keys[array_idx];
-        bool* missings = store->get_bool_array_(k);
+        Arena arena;
+        bool* missings = store->get_bool_array_(k, &arena);
         missings[local_idx] = is_missing;
 
         store->put_(k, missings, INTERNAL_CHUNK_SIZE);
 
-        delete[] missings;
         // Force cache to be reset
         cached_missings_idx = num_chunks;
     }
@@ -547,32 +595,23 @@ class DistributedColumn : virtual public Column {
  */
 class DistributedIntColumn : public DistributedColumn, public IntColumn {
    public:
+    // The chunk gets read from, viewed in place when the store holds it
+    // plain. cells_ keeps the default values new chunks are put with.
+    ChunkView<int> cached_cells_;
+
     // Create empty int column
     DistributedIntColumn(Store* s) : DistributedColumn(s), IntColumn() {
         // Put default integer array for each chunk
-        for (size_t i = 0; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(chunk_keys, num_chunks, cells_, INTERNAL_CHUNK_SIZE);
     }
 
     // Copy constructor. Assumes other column is the same type as this one
     DistributedIntColumn(Store* s, DistributedIntColumn* col) 
         : DistributedColumn(s), IntColumn() {
         // Put default integer array for each chunk
-        for (size_t i = 0; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(chunk_keys, num_chunks, cells_, INTERNAL_CHUNK_SIZE);
 
-        // Copy over data from other column
-        for (size_t row_idx = 0; row_idx < col->size(); row_idx++) {
-            int row_val = col->as_int()->get(row_idx);
-            push_back(row_val);
-
-            if (col->is_missing_dist(row_idx)) {
-                // row_val we pushed above is fake, mark this cell as missing
-                set_missing_dist(row_idx, true);
-            }
-        }
+        copy_chunks_dist(col);
     }
 
     // Generic constructor that specifies all values
@@ -598,10 +637,8 @@ class DistributedIntColumn : public DistributedColumn, public IntColumn {
         size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
         // Load chunk into cache if its not
         if (array_idx != cached_chunk_idx) {
-            // Free old cache
-            delete[] cells_;
             Key* k = chunk_keys[array_idx];
-            cells_ = store->get_int_array_(k);
+            store->get_view_(k, &cached_cells_);
             cached_chunk_idx = array_idx;
         } 
         // Get value from cache
@@ -612,7 +649,14 @@ class DistributedIntColumn : public DistributedColumn, public IntColumn {
     // Assumes the local cache is populated
     // Input index out of bounds will cause out of bounds error
     int get_local(size_t idx) {
-        return cells_[idx];
+        return cached_cells_.get(idx);
+    }
+
+    // Caches the given serialized chunk of int values as chunk chunk_idx,
+    // so gets from it need not ask the store
+    void cache_chunk_dist(size_t chunk_idx, Value* chunk) {
+        store->serializer->view_chunk(chunk, &cached_cells_);
+        cached_chunk_idx = chunk_idx;
     }
 
     /** Set value at idx. An out of bound idx is undefined.  */
@@ -624,12 +668,11 @@ class DistributedIntColumn : public DistributedColumn, public IntColumn {
         size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
         Key* k = chunk_keys[array_idx];
 
-        int* cells = store->get_int_array_(k);
+        Arena arena;
+        int* cells = store->get_int_array_(k, &arena);
         cells[local_idx] = val;
         store->put_(k, cells, INTERNAL_CHUNK_SIZE);
 
-        delete[] cells;
-
         // We may be overwriting a missing, so mark cell as not-missing
         set_missing_dist(idx, false);
 
@@ -645,9 +688,7 @@ class DistributedIntColumn : public DistributedColumn, public IntColumn {
         resize_missings_dist();
 
         // add default int array to new chunks
-        for (size_t i = old_num_chunks; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(chunk_keys + old_num_chunks, num_chunks - old_num_chunks, cells_, INTERNAL_CHUNK_SIZE);
     }
 
     // Add integer to "bottom" of column
@@ -659,14 +700,14 @@ class DistributedIntColumn : public DistributedColumn, public IntColumn {
         size_t local_idx = length % INTERNAL_CHUNK_SIZE;
 
         Key* k = chunk_keys[array_idx];
-        int* cells = store->get_int_array_(k);
+        Arena arena;
+        int* cells = store->get_int_array_(k, &arena);
 
         cells[local_idx] = val;
         store->put_(k, cells, INTERNAL_CHUNK_SIZE);
         // No need to call set_missing_dist because default is false
 
         length++;
-        delete[] cells;
 
         // force cache refresh
         cached_chunk_idx = num_chunks;
@@ -693,32 +734,23 @@ class DistributedIntColumn : public DistributedColumn, public IntColumn {
  */
 class DistributedBoolColumn : public DistributedColumn, public BoolColumn {
    public:
+    // The chunk gets read from, viewed in place when the store holds it
+    // plain. cells_ keeps the default values new chunks are put with.
+    ChunkView<bool> cached_cells_;
+
     // Create empty bool column
     DistributedBoolColumn(Store* s) : DistributedColumn(s), BoolColumn() {
         // Put default bool array for each chunk
-        for (size_t i = 0; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(chunk_keys, num_chunks, cells_, INTERNAL_CHUNK_SIZE);
     }
 
     // Copy constructor. Assumes other column is the same type as this one
     DistributedBoolColumn(Store* s, DistributedBoolColumn* col) 
         : DistributedColumn(s), BoolColumn() {
         // Put default bool array for each chunk
-        for (size_t i = 0; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
-
-        // Copy over data from other column
-        for (size_t row_idx = 0; row_idx < col->size(); row_idx++) {
-            bool row_val = col->as_bool()->get(row_idx);
-            push_back(row_val);
+        store->put_(chunk_keys, num_chunks, cells_, INTERNAL_CHUNK_SIZE);
 
-            if (col->is_missing_dist(row_idx)) {
-                // row_val we pushed above is fake, mark this cell as missing
-                set_missing_dist(row_idx, true);
-            }
-        }
+        copy_chunks_dist(col);
     }
 
     // Generic constructor that specifies all values
@@ -742,10 +774,8 @@ class DistributedBoolColumn : public DistributedColumn, public BoolColumn {
         size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
         // Load chunk into cache if its not
         if (array_idx != cached_chunk_idx) {
-            // Free old cache
-            delete[] cells_;
             Key* k = chunk_keys[array_idx];
-            cells_ = store->get_bool_array_(k);
+            store->get_view_(k, &cached_cells_);
             cached_chunk_idx = array_idx;
         }
         // Get value from cache
@@ -756,11 +786,18 @@ class DistributedBoolColumn : public DistributedColumn, public BoolColumn {
     // Assumes the local cache is populated
     // Input index out of bounds will cause out of bounds error
     bool get_local(size_t idx) {
-        return cells_[idx];
+        return cached_cells_.get(idx);
+    }
+
+    // Caches the given serialized chunk of bool values as chunk chunk_idx,
+    // so gets from it need not ask the store
+    void cache_chunk_dist(size_t chunk_idx, Value* chunk) {
+        store->serializer->view_chunk(chunk, &cached_cells_);
+        cached_chunk_idx = chunk_idx;
     }
 
     /** Set value at idx. An out of bound idx is undefined.  */
-    void set(size_t idx, int val) {
+    void set(size_t idx, bool val) {
         if (idx >= length) {
             return;
         }
@@ -768,12 +805,11 @@ class DistributedBoolColumn : public DistributedColumn, public BoolColumn {
         size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
         Key* k = chunk_keys[array_idx];
 
-        int* cells = store->get_int_array_(k);
+        Arena arena;
+        bool* cells = store->get_bool_array_(k, &arena);
         cells[local_idx] = val;
         store->put_(k, cells, INTERNAL_CHUNK_SIZE);
 
-        delete[] cells;
-
         // We may be overwriting a missing, so mark cell as not-missing
         set_missing_dist(idx, false);
 
@@ -789,13 +825,11 @@ class DistributedBoolColumn : public DistributedColumn, public BoolColumn {
         resize_missings_dist();
 
         // add default int array to new chunks
-        for (size_t i = old_num_chunks; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(chunk_keys + old_num_chunks, num_chunks - old_num_chunks, cells_, INTERNAL_CHUNK_SIZE);
     }
 
-    // Add integer to "bottom" of column
-    void push_back(int val) {
+    // Add bool to "bottom" of column
+    void push_back(bool val) {
         if (length == capacity) {
             resize();
         }
@@ -803,14 +837,14 @@ class DistributedBoolColumn : public DistributedColumn, public BoolColumn {
         size_t local_idx = length % INTERNAL_CHUNK_SIZE;
 
         Key* k = chunk_keys[array_idx];
-        int* cells = store->get_int_array_(k);
+        Arena arena;
+        bool* cells = store->get_bool_array_(k, &arena);
 
         cells[local_idx] = val;
         store->put_(k, cells, INTERNAL_CHUNK_SIZE);
 
         // No need to call set_missing_dist because default is false
         length++;
-        delete[] cells;
 
         // force cache refresh
         cached_chunk_idx = num_chunks;
@@ -837,32 +871,23 @@ class DistributedBoolColumn : public DistributedColumn, public BoolColumn {
  */
 class DistributedFloatColumn : public DistributedColumn, public FloatColumn {
    public:
+    // The chunk gets read from, viewed in place when the store holds it
+    // plain. cells_ keeps the default values new chunks are put with.
+    ChunkView<float> cached_cells_;
+
     // Create empty float column
     DistributedFloatColumn(Store* s) : DistributedColumn(s), FloatColumn() {
         // Put default float array for each chunk
-        for (size_t i = 0; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(chunk_keys, num_chunks, cells_, INTERNAL_CHUNK_SIZE);
     }
 
     // Copy constructor. Assumes other column is the same type as this one
     DistributedFloatColumn(Store* s, DistributedFloatColumn* col) 
         : DistributedColumn(s), FloatColumn() {
         // Put default float array for each chunk
-        for (size_t i = 0; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
-
-        // Copy over data from other column
-        for (size_t row_idx = 0; row_idx < col->size(); row_idx++) {
-            float row_val = col->as_float()->get(row_idx);
-            push_back(row_val);
+        store->put_(chunk_keys, num_chunks, cells_, INTERNAL_CHUNK_SIZE);
 
-            if (col->is_missing_dist(row_idx)) {
-                // row_val we pushed above is fake, mark this cell as missing
-                set_missing_dist(row_idx, true);
-            }
-        }
+        copy_chunks_dist(col);
     }
 
     // Generic constructor that specifies all values
@@ -886,10 +911,8 @@ class DistributedFloatColumn : public DistributedColumn, public FloatColumn {
         size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
         // Load chunk into cache if its not
         if (array_idx != cached_chunk_idx) {
-            // Free old cache
-            delete[] cells_;
             Key* k = chunk_keys[array_idx];
-            cells_ = store->get_float_array_(k);
+            store->get_view_(k, &cached_cells_);
             cached_chunk_idx = array_idx;
         }
 
@@ -901,7 +924,14 @@ class DistributedFloatColumn : public DistributedColumn, public FloatColumn {
     // Assumes the local cache is populated
     // Input index out of bounds will cause out of bounds error
     float get_local(size_t idx) {
-        return cells_[idx];
+        return cached_cells_.get(idx);
+    }
+
+    // Caches the given serialized chunk of float values as chunk chunk_idx,
+    // so gets from it need not ask the store
+    void cache_chunk_dist(size_t chunk_idx, Value* chunk) {
+        store->serializer->view_chunk(chunk, &cached_cells_);
+        cached_chunk_idx = chunk_idx;
     }
 
     /** Set value at idx. An out of bound idx is undefined.  */
@@ -913,12 +943,11 @@ class DistributedFloatColumn : public DistributedColumn, public FloatColumn {
         size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
         Key* k = chunk_keys[array_idx];
 
-        float* cells = store->get_float_array_(k);
+        Arena arena;
+        float* cells = store->get_float_array_(k, &arena);
         cells[local_idx] = val;
         store->put_(k, cells, INTERNAL_CHUNK_SIZE);
 
-        delete[] cells;
-
         // We may be overwriting a missing, so mark cell as not-missing
         set_missing_dist(idx, false);
         // To avoid read/write conflicts with local cache:
@@ -933,9 +962,7 @@ class DistributedFloatColumn : public DistributedColumn, public FloatColumn {
         resize_missings_dist();
 
         // Put default float array for each chunk
-        for (size_t i = old_num_chunks; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(chunk_keys + old_num_chunks, num_chunks - old_num_chunks, cells_, INTERNAL_CHUNK_SIZE);
     }
 
     // Add float to "bottom" of column
@@ -947,13 +974,13 @@ class DistributedFloatColumn : public DistributedColumn, public FloatColumn {
         size_t local_idx = length % INTERNAL_CHUNK_SIZE;
 
         Key* k = chunk_keys[array_idx];
-        float* cells = store->get_float_array_(k);
+        Arena arena;
+        float* cells = store->get_float_array_(k, &arena);
 
         cells[local_idx] = val;
         store->put_(k, cells, INTERNAL_CHUNK_SIZE);
         // No need to call set_missing_dist because default is false
         length++;
-        delete[] cells;
 
         // force cache refresh
         cached_chunk_idx = num_chunks;
@@ -980,33 +1007,29 @@ class DistributedFloatColumn : public DistributedColumn, public FloatColumn {
  */
 class DistributedStringColumn : public DistributedColumn, public StringColumn {
    public:
+    // The chunk gets read from, viewed in place when the store holds it
+    // plain, and a String for each of its values. The Strings are made in
+    // cached_strings_ around the view's characters rather than copies, and
+    // last until the next chunk is cached. cells_ keeps the default values
+    // new chunks are put with.
+    StringChunkView cached_view_;
+    Arena cached_strings_;
+    String** cached_cells_ = nullptr;
+
     // Create empty String* column
     DistributedStringColumn(Store* s) 
     : DistributedColumn(s), StringColumn() {
         // Put default string array for each chunk
-        for (size_t i = 0; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(chunk_keys, num_chunks, cells_, INTERNAL_CHUNK_SIZE);
     }
 
     // Copy constructor. Assumes other column is the same type as this one
     DistributedStringColumn(Store* s, DistributedStringColumn* col) 
         : DistributedColumn(s), StringColumn() {
         // Put default string array for each chunk
-        for (size_t i = 0; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(chunk_keys, num_chunks, cells_, INTERNAL_CHUNK_SIZE);
 
-        // Copy over data from other column
-        for (size_t row_idx = 0; row_idx < col->size(); row_idx++) {
-            String* row_val = col->as_string()->get(row_idx);
-            push_back(row_val);
-
-            if (col->is_missing_dist(row_idx)) {
-                // row_val we pushed above is fake, mark this cell as missing
-                set_missing_dist(row_idx, true);
-            }
-        }
+        copy_chunks_dist(col);
     }
 
     // Generic constructor that specifies all values
@@ -1018,14 +1041,7 @@ class DistributedStringColumn : public DistributedColumn, public StringColumn {
         // Memory associated with keys is deleted in DistributedColumn
         // Memory associated with values of keys in store are deleted in Store destructor
         // Memory associated with cells/missing is deleted in normal StringColumn
-
-        // Normal string column does not delete String* it owns, but Distributed needs to
-        // because they represent the cache, not external strings.
-        for (size_t i = 0; i < INTERNAL_CHUNK_SIZE; i++) {
-            delete cells_[i]; // delete String*
-        }
-
-        // delete[] cells_ handled in StringColumn destructor
+        // The cached Strings are freed with cached_strings_
     }
 
     // Return this column as a StringColumn
@@ -1038,10 +1054,9 @@ class DistributedStringColumn : public DistributedColumn, public StringColumn {
         size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
         // Load chunk into cache if its not
         if (array_idx != cached_chunk_idx) {
-            // Free old cache
-            delete_string_cells_(cells_);
             Key* k = chunk_keys[array_idx];
-            cells_ = store->get_string_array_(k);
+            store->get_view_(k, &cached_view_);
+            cache_strings_();
             cached_chunk_idx = array_idx;
         }
         // Get value from cache
@@ -1052,7 +1067,15 @@ class DistributedStringColumn : public DistributedColumn, public StringColumn {
     // Assumes the local cache is populated
     // Input index out of bounds will cause out of bounds error
     String* get_local(size_t idx) {
-        return cells_[idx];
+        return cached_cells_[idx];
+    }
+
+    // Caches the given serialized chunk of String* values as chunk chunk_idx,
+    // so gets from it need not ask the store
+    void cache_chunk_dist(size_t chunk_idx, Value* chunk) {
+        store->serializer->view_chunk(chunk, &cached_view_);
+        cache_strings_();
+        cached_chunk_idx = chunk_idx;
     }
 
     /** Set value at idx. An out of bound idx is undefined.  */
@@ -1066,16 +1089,13 @@ class DistributedStringColumn : public DistributedColumn, public StringColumn {
         size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
         Key* k = chunk_keys[array_idx];
 
-        // Get current cells and set new value in store
-        String** cells = store->get_string_array_(k);
-        String* replaced_value = cells[local_idx];
+        // Get current cells and set new value in store. The cells are made
+        // in the arena, which frees them all at once.
+        Arena arena;
+        String** cells = store->get_string_array_(k, &arena);
         cells[local_idx] = val;
         store->put_(k, cells, INTERNAL_CHUNK_SIZE);
 
-        // Put old value back into cells and delete the list
-        cells[local_idx] = replaced_value;
-        delete_string_cells_(cells); 
-
         // We may be overwriting a missing, so mark cell as not-missing
         set_missing_dist(idx, false);
 
@@ -1092,9 +1112,7 @@ class DistributedStringColumn : public DistributedColumn, public StringColumn {
         resize_missings_dist();
 
         // Put default string array for each chunk
-        for (size_t i = old_num_chunks; i < num_chunks; i++) {
-            store->put_(chunk_keys[i], cells_, INTERNAL_CHUNK_SIZE);
-        }
+        store->put_(chunk_keys + old_num_chunks, num_chunks - old_num_chunks, cells_, INTERNAL_CHUNK_SIZE);
     }
 
     // Add String* to "bottom" of column
@@ -1107,16 +1125,13 @@ class DistributedStringColumn : public DistributedColumn, public StringColumn {
         size_t local_idx = length % INTERNAL_CHUNK_SIZE;
         Key* k = chunk_keys[array_idx];
 
-        // Get current cells and set new value in store
-        String** cells = store->get_string_array_(k);
-        String* replaced_value = cells[local_idx];
+        // Get current cells and set new value in store. The cells are made
+        // in the arena, which frees them all at once.
+        Arena arena;
+        String** cells = store->get_string_array_(k, &arena);
         cells[local_idx] = val;
         store->put_(k, cells, INTERNAL_CHUNK_SIZE);
 
-        // Put old value back into cells and delete the list
-        cells[local_idx] = replaced_value;
-        delete_string_cells_(cells); 
-
         // No need to call set_missing_dist because default is false
 
         // To avoid read/write conflicts with local cache:
@@ -1141,11 +1156,15 @@ class DistributedStringColumn : public DistributedColumn, public StringColumn {
     }
 
     // Deletes array of string pointers
-    void delete_string_cells_(String** cells) {
-        for (size_t i = 0; i < INTERNAL_CHUNK_SIZE; i++) {
-            delete cells[i]; // delete String*
+    // Makes a String around each value of cached_view_, in place of those
+    // of the chunk cached before. Strings in an arena are never deleted, so
+    // never free the characters they point at.
+    void cache_strings_() {
+        cached_strings_.reset();
+        size_t count = cached_view_.size();
+        cached_cells_ = cached_strings_.alloc_array<String*>(count);
+        for (size_t i = 0; i < count; i++) {
+            cached_cells_[i] = cached_strings_.make<String>(true, (char*)cached_view_.c_str(i), cached_view_.length(i));
         }
-
-        delete[] cells;
     }
 };
@@ -1,13 +1,18 @@
 /* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
 *           David Tandetnik (tandetnik.da@husky.neu.edu) */
 #pragma once
+#include <stdint.h>
+#include <future>
 #include <thread>
 
+#include "../../utils/bitmap.h"
 #include "../../utils/object.h"
 #include "../../utils/string.h"
 #include "../key.h"
 #include "../store.h"
+#include "../value.h"
 #include "column.h"
+#include "expression.h"
 #include "row.h"
 #include "rower.h"
 #include "schema.h"
@@ -331,6 +336,25 @@ class DataFrame : public Object {
         map_chunk(0, nrows() - 1, r);
     }
 
+    /** Visits only the given rows, in ascending order. Rows out of bounds are
+     * ignored. Lets iterative jobs touch just the rows affected by a change. **/
+    void map_rows(Bitmap* rows, Rower& r) {
+        Row row(*schema);
+
+        BitmapIterator it(rows);
+        while (it.has_next()) {
+            size_t row_idx = it.next();
+            if (row_idx >= nrows()) {
+                break;  // values are ascending, so the rest are out of bounds too
+            }
+
+            fill_row(row_idx, row);
+            row.set_idx(row_idx);
+
+            r.accept(row);
+        }
+    }
+
     /** This method clones the Rower and executes the map in parallel. Join
     used at the end to merge the results */
     virtual void pmap(Rower& r) {
@@ -384,6 +408,143 @@ class DataFrame : public Object {
         return new_df;
     }
 
+    /** Visits the rows in chunks of INTERNAL_CHUNK_SIZE, evaluating the
+    * expression over each chunk at once instead of row by row. Exits unless
+    * the expression produces values of the given type. For each chunk, the
+    * given function receives the batch and the expression's values. **/
+    template <class F>
+    void eval_chunks_(Expression& expr, char type, F f) {
+        if (expr.expr->bind(*schema) != type) {
+            printf("ERROR expression does not produce values of type %c\n", type);
+            exit(1);
+        }
+
+        bool* used = new bool[ncols()]();
+        expr.expr->columns_used(used);
+        Batch batch(*schema, used);
+        delete[] used;
+
+        for (size_t start = 0; start < nrows(); start += INTERNAL_CHUNK_SIZE) {
+            load_batch_(batch, start);
+            // Let the next chunk arrive while this one is evaluated
+            if (start + INTERNAL_CHUNK_SIZE < nrows()) {
+                prefetch_batch_(batch, start + INTERNAL_CHUNK_SIZE);
+            }
+            f(batch, expr.expr->eval(batch));
+        }
+        flush_chunks_();
+    }
+
+    // Loads the columns used by the batch for the chunk of rows at start
+    void load_batch_(Batch& batch, size_t start) {
+        batch.start = start;
+        batch.size = nrows() - start < INTERNAL_CHUNK_SIZE ? nrows() - start : INTERNAL_CHUNK_SIZE;
+
+        for (size_t col_idx = 0; col_idx < batch.width; col_idx++) {
+            Vector* vec = batch.cols[col_idx];
+            if (vec != nullptr) {
+                vec->size = batch.size;
+                load_chunk_(col_idx, start, *vec);
+            }
+        }
+    }
+
+    // Starts loading the columns used by the batch for the chunk of rows at
+    // start, for load_batch_() to pick up later
+    void prefetch_batch_(Batch& batch, size_t start) {
+        for (size_t col_idx = 0; col_idx < batch.width; col_idx++) {
+            if (batch.cols[col_idx] != nullptr) {
+                prefetch_chunk_(col_idx, start);
+            }
+        }
+    }
+
+    // Starts loading the chunk of a column at start. Columns held in memory
+    // have nothing to wait for, so this does nothing.
+    virtual void prefetch_chunk_(size_t col, size_t start) {}
+
+    // Waits until chunks written by store_chunk_() are stored. Does nothing
+    // for columns held in memory.
+    virtual void flush_chunks_() {}
+
+    // Copies out.size values and missings of a column, starting at row
+    // start, into out
+    virtual void load_chunk_(size_t col, size_t start, Vector& out) {
+        for (size_t i = 0; i < out.size; i++) {
+            if (out.type == INT_TYPE) {
+                out.data<int>()[i] = get_int(col, start + i);
+            } else if (out.type == FLOAT_TYPE) {
+                out.data<float>()[i] = get_float(col, start + i);
+            } else {
+                out.data<bool>()[i] = get_bool(col, start + i);
+            }
+            out.valid[i] = !is_missing(col, start + i);
+        }
+    }
+
+    // Writes in.size values of a column, starting at row start
+    virtual void store_chunk_(size_t col, size_t start, Vector& in) {
+        for (size_t i = 0; i < in.size; i++) {
+            if (!in.valid[i]) {
+                set_missing(col, start + i);
+            } else if (in.type == INT_TYPE) {
+                set(col, start + i, in.data<int>()[i]);
+            } else if (in.type == FLOAT_TYPE) {
+                set(col, start + i, in.data<float>()[i]);
+            } else {
+                set(col, start + i, in.data<bool>()[i]);
+            }
+        }
+    }
+
+    /** Returns the rows for which the bool expression is true and not
+    * missing, e.g. where(col(0) + col(1) * 2 > lit(5)). **/
+    Bitmap* where(Expression pred) {
+        Bitmap* rows = new Bitmap();
+
+        eval_chunks_(pred, BOOL_TYPE, [rows](Batch& batch, Vector* result) {
+            bool* vals = result->data<bool>();
+            for (size_t i = 0; i < batch.size; i++) {
+                if (vals[i] && result->valid[i]) {
+                    rows->add(batch.start + i);
+                }
+            }
+        });
+
+        return rows;
+    }
+
+    /** Replaces the values of the given column with those of the expression,
+    * e.g. map(2, col(0) * col(1)). The expression must produce the column's
+    * type. Rows where the expression is missing become missing. **/
+    void map(size_t col, Expression expr) {
+        eval_chunks_(expr, schema->col_type(col), [this, col](Batch& batch, Vector* result) {
+            store_chunk_(col, batch.start, *result);
+        });
+    }
+
+    /** Create a new dataframe, constructed from rows for which the given bool
+    * expression is true and not missing. */
+    virtual DataFrame* filter(Expression pred) {
+        DataFrame* new_df = new DataFrame(get_schema());
+        add_rows_(pred, new_df);
+        return new_df;
+    }
+
+    // Adds the rows for which pred holds to the given frame
+    void add_rows_(Expression& pred, DataFrame* df) {
+        Bitmap* rows = where(pred);
+
+        Row row(*schema);
+        BitmapIterator it(rows);
+        while (it.has_next()) {
+            fill_row(it.next(), row);
+            df->add_row(row);
+        }
+
+        delete rows;
+    }
+
     /** Print the dataframe in SoR format to standard output. */
     virtual void print() {
         // Use helper for printing
@@ -435,6 +596,7 @@ class DataFrame : public Object {
     static DistributedDataFrame* fromArray(Key* key, Store* store, size_t count, int* vals);
     static DistributedDataFrame* fromArray(Key* key, Store* store, size_t count, String** vals);
     static DistributedDataFrame* fromDistributedColumn(Key* key, Store* store, DistributedColumn* col);
+    static DistributedDataFrame* fromTemporaryColumn_(Key* key, Store* store, DistributedColumn* col);
     static DistributedDataFrame* fromSorFile(Key* key, Store* store, char *file_path); 
 
     static DistributedDataFrame* fromScalar(Key* key, Store* store, float val);
@@ -445,21 +607,69 @@ class DataFrame : public Object {
     static DistributedDataFrame* fromWriter(Key* key, Store* store, char* schema, Writer& writer);
 };
 
+/****************************************************************************
+ * ChunkFetch::
+ * A fetch under way of one column's chunk of values and chunk of missings,
+ * so a DistributedDataFrame can evaluate one chunk while the next arrives.
+ */
+class ChunkFetch : public Object {
+   public:
+    size_t start;                  // First row of the chunk, or SIZE_MAX if idle
+    std::future<Value*> values;
+    std::future<Value*> missings;
+
+    ChunkFetch() {
+        start = SIZE_MAX;
+    }
+
+    ~ChunkFetch() {
+        drop();
+    }
+
+    // Waits for the fetch under way, if any, and drops what it got
+    void drop() {
+        if (start == SIZE_MAX) {
+            return;
+        }
+        Value* got[2] = {values.get(), missings.get()};
+        for (size_t i = 0; i < 2; i++) {
+            if (got[i] != nullptr) {
+                got[i]->release();
+            }
+        }
+        start = SIZE_MAX;
+    }
+};
+
 // DistributedDataFrame is a DataFrame that has all of its data in DistributedColumns
 class DistributedDataFrame : public DataFrame {
    public:
     Store* store;
+    ChunkFetch* fetches;  // One per column, for the chunk after the one evaluated; owned
+    size_t num_fetches;
+    // Puts of the chunk store_chunk_() wrote last, which may be under way
+    std::future<void> stored_values;
+    std::future<void> stored_missings;
 
     DistributedDataFrame(Store* store, DataFrame& df) : DataFrame(df) {
         this->store = store;
+        fetches = nullptr;
+        num_fetches = 0;
         set_empty_dist_cols_(schema);
     }
 
     DistributedDataFrame(Store* store, Schema& scm) : DataFrame(scm) {
         this->store = store;
+        fetches = nullptr;
+        num_fetches = 0;
         set_empty_dist_cols_(schema);
     }
 
+    ~DistributedDataFrame() {
+        delete[] fetches;
+        flush_chunks_();
+    }
+
     // Overrides normal columns in this dataframe with distributed versions
     void set_empty_dist_cols_(Schema* schema) {
         for (size_t col_idx = 0; col_idx < schema->width(); col_idx++) {
@@ -553,6 +763,176 @@ class DistributedDataFrame : public DataFrame {
         return new_df;
     }
 
+    using DataFrame::filter;
+
+    /** Create a new dataframe, constructed from rows for which the given bool
+    * expression is true and not missing. */
+    DataFrame* filter(Expression pred) {
+        DistributedDataFrame* new_df = new DistributedDataFrame(store, get_schema());
+        add_rows_(pred, new_df);
+        return new_df;
+    }
+
+    // Starts getting the chunk at start and its missings without waiting for
+    // them, for load_chunk_() to pick up
+    void prefetch_chunk_(size_t col, size_t start) {
+        if (num_fetches != ncols()) {
+            delete[] fetches;
+            fetches = new ChunkFetch[ncols()];
+            num_fetches = ncols();
+        }
+
+        DistributedColumn* c = dynamic_cast<DistributedColumn*>(columns[col]);
+        size_t chunk_idx = start / INTERNAL_CHUNK_SIZE;
+        ChunkFetch& fetch = fetches[col];
+        fetch.drop();
+        fetch.values = store->get_async(c->chunk_keys[chunk_idx]);
+        fetch.missings = store->get_async(c->missings_keys[chunk_idx]);
+        fetch.start = start;
+    }
+
+    // Fetches the whole chunk at start and its missings, with one batched get
+    // per column unless prefetch_chunk_() already started getting them, and
+    // decodes them straight into the vector without allocating
+    void load_chunk_(size_t col, size_t start, Vector& out) {
+        DistributedColumn* c = dynamic_cast<DistributedColumn*>(columns[col]);
+        size_t chunk_idx = start / INTERNAL_CHUNK_SIZE;
+        Key* keys[2] = {c->chunk_keys[chunk_idx], c->missings_keys[chunk_idx]};
+        Value* values[2];
+        if (col < num_fetches && fetches[col].start == start) {
+            values[0] = fetches[col].values.get();
+            values[1] = fetches[col].missings.get();
+            fetches[col].start = SIZE_MAX;
+            for (size_t i = 0; i < 2; i++) {
+                if (values[i] == nullptr) {
+                    printf("ERROR: Chunk %s of a column is not in the store\n", keys[i]->get_name());
+                    exit(1);
+                }
+            }
+        } else {
+            Value** fetched = DistributedColumn::get_chunks_dist(store, keys, 2);
+            values[0] = fetched[0];
+            values[1] = fetched[1];
+            delete[] fetched;
+        }
+        Serializer* serializer = store->serializer;
+
+        if (out.type == INT_TYPE) {
+            serializer->deserialize_chunk_into(values[0], out.data<int>(), INTERNAL_CHUNK_SIZE);
+        } else if (out.type == FLOAT_TYPE) {
+            serializer->deserialize_chunk_into(values[0], out.data<float>(), INTERNAL_CHUNK_SIZE);
+        } else {
+            serializer->deserialize_chunk_into(values[0], out.data<bool>(), INTERNAL_CHUNK_SIZE);
+        }
+
+        bool missings[INTERNAL_CHUNK_SIZE];
+        serializer->deserialize_chunk_into(values[1], missings, INTERNAL_CHUNK_SIZE);
+        for (size_t i = 0; i < INTERNAL_CHUNK_SIZE; i++) {
+            out.valid[i] = !missings[i];
+        }
+
+        values[0]->release();
+        values[1]->release();
+    }
+
+    // Writes the whole chunk at start and its missings without waiting for
+    // them to be stored. Waits for the chunk written before, so at most one
+    // is under way; flush_chunks_() waits for the last.
+    void store_chunk_(size_t col, size_t start, Vector& in) {
+        DistributedColumn* c = dynamic_cast<DistributedColumn*>(columns[col]);
+        size_t chunk_idx = start / INTERNAL_CHUNK_SIZE;
+        Key* keys[2] = {c->chunk_keys[chunk_idx], c->missings_keys[chunk_idx]};
+        Value* values[2];
+        Serializer* serializer = store->serializer;
+
+        if (in.type == INT_TYPE) {
+            values[0] = serializer->serialize_chunk(in.data<int>(), INTERNAL_CHUNK_SIZE);
+        } else if (in.type == FLOAT_TYPE) {
+            values[0] = serializer->serialize_chunk(in.data<float>(), INTERNAL_CHUNK_SIZE);
+        } else {
+            values[0] = serializer->serialize_chunk(in.data<bool>(), INTERNAL_CHUNK_SIZE);
+        }
+
+        bool missings[INTERNAL_CHUNK_SIZE];
+        for (size_t i = 0; i < INTERNAL_CHUNK_SIZE; i++) {
+            missings[i] = i < in.size && !in.valid[i];
+        }
+        values[1] = serializer->serialize_chunk(missings, INTERNAL_CHUNK_SIZE);
+
+        flush_chunks_();
+        stored_values = store->put_async(keys[0], values[0]);
+        stored_missings = store->put_async(keys[1], values[1]);
+
+        // Force the column's caches to be reloaded
+        c->cached_chunk_idx = c->num_chunks;
+        c->cached_missings_idx = c->num_chunks;
+    }
+
+    // Waits until the chunk store_chunk_() wrote last is stored
+    void flush_chunks_() {
+        if (stored_values.valid()) {
+            stored_values.get();
+        }
+        if (stored_missings.valid()) {
+            stored_missings.get();
+        }
+    }
+
+    /** Fills the row with the values at idx. Gets the missings chunk of every
+    * column, and the values chunk of every column that has not cached it,
+    * with one batched get, rather than one get per chunk. **/
+    void fill_row(size_t idx, Row& row) {
+        size_t width = schema->width();
+        size_t chunk_idx = idx / INTERNAL_CHUNK_SIZE;
+        size_t local_idx = idx % INTERNAL_CHUNK_SIZE;
+
+        Key** keys = new Key*[2 * width];
+        size_t n = 0;
+        for (size_t col_idx = 0; col_idx < width; col_idx++) {
+            DistributedColumn* c = dynamic_cast<DistributedColumn*>(columns[col_idx]);
+            keys[n++] = c->missings_keys[chunk_idx];
+            if (c->cached_chunk_idx != chunk_idx) {
+                keys[n++] = c->chunk_keys[chunk_idx];
+            }
+        }
+        Value** values = DistributedColumn::get_chunks_dist(store, keys, n);
+
+        n = 0;
+        for (size_t col_idx = 0; col_idx < width; col_idx++) {
+            Column* col = columns[col_idx];
+            DistributedColumn* c = dynamic_cast<DistributedColumn*>(col);
+            bool missings[INTERNAL_CHUNK_SIZE];
+            store->serializer->deserialize_chunk_into(values[n], missings, INTERNAL_CHUNK_SIZE);
+            bool missing = missings[local_idx];
+            values[n++]->release();
+
+            if (c->cached_chunk_idx != chunk_idx) {
+                c->cache_chunk_dist(chunk_idx, values[n]);
+                values[n++]->release();
+            }
+
+            if (missing) {
+                row.set_missing(col_idx);
+                continue;
+            }
+
+            // The column has the chunk cached now, so these do not ask the store
+            char col_type = col->get_type();
+            if (col_type == INT_TYPE) {
+                row.set(col_idx, col->as_int()->get(idx));
+            } else if (col_type == BOOL_TYPE) {
+                row.set(col_idx, col->as_bool()->get(idx));
+            } else if (col_type == FLOAT_TYPE) {
+                row.set(col_idx, col->as_float()->get(idx));
+            } else {
+                row.set(col_idx, col->as_string()->get(idx));
+            }
+        }
+
+        delete[] values;
+        delete[] keys;
+    }
+
     // Indicates whether the cell at col,row is a missing value
     virtual bool is_missing(size_t col, size_t row) {
         //return false;
@@ -578,6 +958,7 @@ class DistributedDataFrame : public DataFrame {
             }
 
             fill_row(row_idx, row);
+            row.set_idx(row_idx);
 
             r.accept(row);
         
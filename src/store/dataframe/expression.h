@@ -0,0 +1,535 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../utils/object.h"
+#include "column.h"
+#include "schema.h"
+
+/** EXPRESSIONS
+*   ~ col(0) + col(1) * 2 > lit(5) builds a tree of Expr nodes
+*   ~ Before evaluation the tree is bound to a schema, which fixes the type
+*       of every node and allocates one result Vector per node
+*   ~ The tree is then evaluated once per chunk of INTERNAL_CHUNK_SIZE rows,
+*       each node running a typed kernel over the whole chunk at once
+*   Chunks line up with the chunks of a DistributedColumn, so every value
+*   used by an expression is fetched from the store once per chunk. */
+
+/*************************************************************************
+ * Vector::
+ * The values of one expression or column for one chunk of rows, stored
+ * contiguously, with a validity mask. valid[i] is false where value i is
+ * missing. Holds ints, floats or bools; strings are not supported.
+ */
+class Vector : public Object {
+   public:
+    char type;      // INT_TYPE, FLOAT_TYPE or BOOL_TYPE
+    size_t size;    // Number of values in use
+    void* values_;  // owned; INTERNAL_CHUNK_SIZE values of the vector's type
+    bool* valid;    // owned; INTERNAL_CHUNK_SIZE flags
+
+    Vector(char type) {
+        this->type = type;
+        size = 0;
+        valid = new bool[INTERNAL_CHUNK_SIZE];
+
+        if (type == INT_TYPE) {
+            values_ = new int[INTERNAL_CHUNK_SIZE]();
+        } else if (type == FLOAT_TYPE) {
+            values_ = new float[INTERNAL_CHUNK_SIZE]();
+        } else if (type == BOOL_TYPE) {
+            values_ = new bool[INTERNAL_CHUNK_SIZE]();
+        } else {
+            printf("ERROR expressions do not support columns of type %c\n", type);
+            exit(1);
+        }
+    }
+
+    ~Vector() {
+        delete_values_();
+        delete[] valid;
+    }
+
+    void delete_values_() {
+        if (type == INT_TYPE) {
+            delete[] data<int>();
+        } else if (type == FLOAT_TYPE) {
+            delete[] data<float>();
+        } else {
+            delete[] data<bool>();
+        }
+    }
+
+    // Returns the values as an array of T. T must match the vector's type.
+    template <class T>
+    T* data() {
+        return static_cast<T*>(values_);
+    }
+
+    // Marks every value valid
+    void set_all_valid() {
+        for (size_t i = 0; i < INTERNAL_CHUNK_SIZE; i++) {
+            valid[i] = true;
+        }
+    }
+};
+
+/*************************************************************************
+ * Batch::
+ * The column values an expression reads for one chunk of rows. Only the
+ * columns the expression uses are loaded; the rest stay nullptr. Filled
+ * in by the DataFrame the expression runs over.
+ */
+class Batch : public Object {
+   public:
+    size_t start;   // First row in the batch
+    size_t size;    // Number of rows in the batch
+    size_t width;   // Number of columns in the frame
+    Vector** cols;  // owned; cols[i] holds column i's values, or nullptr if unused
+
+    // Creates a batch for a frame of the given schema, with vectors for the
+    // columns marked in used
+    Batch(Schema& scm, bool* used) {
+        start = 0;
+        size = 0;
+        width = scm.width();
+        cols = new Vector*[width];
+        for (size_t i = 0; i < width; i++) {
+            cols[i] = used[i] ? new Vector(scm.col_type(i)) : nullptr;
+        }
+    }
+
+    ~Batch() {
+        for (size_t i = 0; i < width; i++) {
+            delete cols[i];
+        }
+        delete[] cols;
+    }
+};
+
+/** KERNELS
+*   One struct per operator, instantiated for each operand type. The loops
+*   below run over plain contiguous arrays with no calls or branches per
+*   value, so the compiler can unroll and vectorize them. */
+template <class T> struct AddOp { typedef T Result; static T apply(T a, T b) { return a + b; } };
+template <class T> struct SubOp { typedef T Result; static T apply(T a, T b) { return a - b; } };
+template <class T> struct MulOp { typedef T Result; static T apply(T a, T b) { return a * b; } };
+template <class T> struct LtOp { typedef bool Result; static bool apply(T a, T b) { return a < b; } };
+template <class T> struct GtOp { typedef bool Result; static bool apply(T a, T b) { return a > b; } };
+template <class T> struct LeOp { typedef bool Result; static bool apply(T a, T b) { return a <= b; } };
+template <class T> struct GeOp { typedef bool Result; static bool apply(T a, T b) { return a >= b; } };
+template <class T> struct EqOp { typedef bool Result; static bool apply(T a, T b) { return a == b; } };
+template <class T> struct NeOp { typedef bool Result; static bool apply(T a, T b) { return a != b; } };
+template <class T> struct AndOp { typedef bool Result; static bool apply(T a, T b) { return a && b; } };
+template <class T> struct OrOp { typedef bool Result; static bool apply(T a, T b) { return a || b; } };
+
+template <class Op, class T>
+void binary_kernel(T* a, T* b, typename Op::Result* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = Op::apply(a[i], b[i]);
+    }
+}
+
+// Division needs its own kernel, since integer division by zero is
+// undefined. Float division follows IEEE (x / 0 is inf or nan).
+template <class T>
+void div_kernel(T* a, T* b, T* out, bool* valid, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = a[i] / b[i];
+    }
+}
+
+// Integer division by zero gives a missing value
+template <>
+inline void div_kernel<int>(int* a, int* b, int* out, bool* valid, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        bool nonzero = b[i] != 0;
+        out[i] = a[i] / (nonzero ? b[i] : 1);
+        valid[i] = valid[i] && nonzero;
+    }
+}
+
+template <class From, class To>
+void cast_kernel(From* in, To* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (To) in[i];
+    }
+}
+
+// A value is valid only if both of its inputs are
+inline void and_valid_kernel(bool* a, bool* b, bool* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = a[i] && b[i];
+    }
+}
+
+/*************************************************************************
+ * Expr::
+ * A node of an expression tree. Nodes are reference counted, since the
+ * Expression handles that build them can share subtrees.
+ */
+class Expr : public Object {
+   public:
+    size_t refs = 0;           // Number of handles and parents holding this node
+    Vector* result_ = nullptr;  // owned; this node's values for the current batch
+
+    virtual ~Expr() {
+        delete result_;
+    }
+
+    void ref() { refs++; }
+
+    void deref() {
+        refs--;
+        if (refs == 0) {
+            delete this;
+        }
+    }
+
+    // Fixes the types of this subtree for the given schema and allocates its
+    // result vectors. Returns the type of the values this node produces.
+    // Exits on a type error, such as adding bools.
+    virtual char bind(Schema& scm) = 0;
+
+    // Marks the columns this subtree reads in used
+    virtual void columns_used(bool* used) {}
+
+    // Evaluates this subtree over the batch. Returns a vector of batch.size
+    // values that stays valid until the next call to eval.
+    virtual Vector* eval(Batch& batch) = 0;
+
+    // Allocates a result vector of the given type, replacing any from a
+    // previous bind
+    void bind_result_(char type) {
+        if (result_ == nullptr || result_->type != type) {
+            delete result_;
+            result_ = new Vector(type);
+        }
+    }
+};
+
+/*************************************************************************
+ * ColumnExpr::
+ * The values of a column of the frame.
+ */
+class ColumnExpr : public Expr {
+   public:
+    size_t col;
+
+    ColumnExpr(size_t col) { this->col = col; }
+
+    char bind(Schema& scm) {
+        if (col >= scm.width()) {
+            printf("ERROR expression refers to column %zu of a %zu column frame\n", col, scm.width());
+            exit(1);
+        }
+        char type = scm.col_type(col);
+        if (type == STRING_TYPE) {
+            printf("ERROR expressions do not support string column %zu\n", col);
+            exit(1);
+        }
+        return type;
+    }
+
+    void columns_used(bool* used) { used[col] = true; }
+
+    // Column values are read straight from the batch, without a copy
+    Vector* eval(Batch& batch) { return batch.cols[col]; }
+};
+
+/*************************************************************************
+ * LiteralExpr::
+ * A constant int, float or bool.
+ */
+class LiteralExpr : public Expr {
+   public:
+    char type;
+    int int_val = 0;
+    float float_val = 0;
+    bool bool_val = false;
+
+    LiteralExpr(int val) : type(INT_TYPE), int_val(val) {}
+    LiteralExpr(float val) : type(FLOAT_TYPE), float_val(val) {}
+    LiteralExpr(bool val) : type(BOOL_TYPE), bool_val(val) {}
+
+    // The constant is written out once here, not once per batch
+    char bind(Schema& scm) {
+        bind_result_(type);
+        for (size_t i = 0; i < INTERNAL_CHUNK_SIZE; i++) {
+            if (type == INT_TYPE) {
+                result_->data<int>()[i] = int_val;
+            } else if (type == FLOAT_TYPE) {
+                result_->data<float>()[i] = float_val;
+            } else {
+                result_->data<bool>()[i] = bool_val;
+            }
+        }
+        result_->set_all_valid();
+        return type;
+    }
+
+    Vector* eval(Batch& batch) {
+        result_->size = batch.size;
+        return result_;
+    }
+};
+
+enum ExprOp { OP_ADD,
+              OP_SUB,
+              OP_MUL,
+              OP_DIV,
+              OP_LT,
+              OP_GT,
+              OP_LE,
+              OP_GE,
+              OP_EQ,
+              OP_NE,
+              OP_AND,
+              OP_OR };
+
+/*************************************************************************
+ * BinaryExpr::
+ * Applies an arithmetic, comparison or logical operator to two subtrees.
+ * Arithmetic takes ints or floats; an int operand is widened to float if
+ * the other is a float. Comparisons take two numbers or two bools and give
+ * bools. Logical operators take and give bools. A result is missing where
+ * either operand is.
+ */
+class BinaryExpr : public Expr {
+   public:
+    ExprOp op;
+    Expr* left;           // shared
+    Expr* right;          // shared
+    char operand_type_;   // Type both operands are converted to
+    Vector* left_cast_;   // owned; left widened to operand_type_, or nullptr
+    Vector* right_cast_;  // owned; right widened to operand_type_, or nullptr
+
+    BinaryExpr(ExprOp op, Expr* left, Expr* right) {
+        this->op = op;
+        this->left = left;
+        this->right = right;
+        left->ref();
+        right->ref();
+        operand_type_ = INT_TYPE;
+        left_cast_ = nullptr;
+        right_cast_ = nullptr;
+    }
+
+    ~BinaryExpr() {
+        left->deref();
+        right->deref();
+        delete left_cast_;
+        delete right_cast_;
+    }
+
+    bool is_arithmetic_() { return op == OP_ADD || op == OP_SUB || op == OP_MUL || op == OP_DIV; }
+    bool is_logical_() { return op == OP_AND || op == OP_OR; }
+
+    char bind(Schema& scm) {
+        char left_type = left->bind(scm);
+        char right_type = right->bind(scm);
+
+        if (is_logical_()) {
+            if (left_type != BOOL_TYPE || right_type != BOOL_TYPE) {
+                printf("ERROR logical operator applied to non-bool values\n");
+                exit(1);
+            }
+            operand_type_ = BOOL_TYPE;
+        } else if (left_type == BOOL_TYPE || right_type == BOOL_TYPE) {
+            if (left_type != right_type || is_arithmetic_()) {
+                printf("ERROR arithmetic or mixed comparison applied to bool values\n");
+                exit(1);
+            }
+            operand_type_ = BOOL_TYPE;
+        } else if (left_type == FLOAT_TYPE || right_type == FLOAT_TYPE) {
+            operand_type_ = FLOAT_TYPE;
+        } else {
+            operand_type_ = INT_TYPE;
+        }
+
+        bind_cast_(left_cast_, left_type);
+        bind_cast_(right_cast_, right_type);
+
+        char type = is_arithmetic_() ? operand_type_ : BOOL_TYPE;
+        bind_result_(type);
+        return type;
+    }
+
+    // Allocates a vector to widen an operand of the given type, if needed
+    void bind_cast_(Vector*& cast, char type) {
+        delete cast;
+        cast = type == operand_type_ ? nullptr : new Vector(operand_type_);
+    }
+
+    void columns_used(bool* used) {
+        left->columns_used(used);
+        right->columns_used(used);
+    }
+
+    // Widens an int operand to float when the other operand is a float
+    Vector* cast_(Vector* in, Vector* cast) {
+        if (cast == nullptr) {
+            return in;
+        }
+        cast_kernel<int, float>(in->data<int>(), cast->data<float>(), in->size);
+        memcpy(cast->valid, in->valid, in->size * sizeof(bool));
+        cast->size = in->size;
+        return cast;
+    }
+
+    Vector* eval(Batch& batch) {
+        Vector* a = cast_(left->eval(batch), left_cast_);
+        Vector* b = cast_(right->eval(batch), right_cast_);
+        size_t n = batch.size;
+        result_->size = n;
+
+        and_valid_kernel(a->valid, b->valid, result_->valid, n);
+
+        switch (op) {
+            case OP_ADD: apply_numeric_<AddOp>(a, b); break;
+            case OP_SUB: apply_numeric_<SubOp>(a, b); break;
+            case OP_MUL: apply_numeric_<MulOp>(a, b); break;
+            case OP_DIV: divide_(a, b); break;
+            case OP_LT: apply_<LtOp>(a, b); break;
+            case OP_GT: apply_<GtOp>(a, b); break;
+            case OP_LE: apply_<LeOp>(a, b); break;
+            case OP_GE: apply_<GeOp>(a, b); break;
+            case OP_EQ: apply_<EqOp>(a, b); break;
+            case OP_NE: apply_<NeOp>(a, b); break;
+            case OP_AND: apply_<AndOp>(a, b); break;
+            case OP_OR: apply_<OrOp>(a, b); break;
+        }
+
+        return result_;
+    }
+
+    // Runs the operator's kernel for the bound operand type
+    template <template <class> class Op>
+    void apply_(Vector* a, Vector* b) {
+        if (operand_type_ == BOOL_TYPE) {
+            binary_kernel<Op<bool> >(a->data<bool>(), b->data<bool>(),
+                                     result_->data<typename Op<bool>::Result>(), result_->size);
+        } else {
+            apply_numeric_<Op>(a, b);
+        }
+    }
+
+    // As apply_, for operators that only take ints and floats
+    template <template <class> class Op>
+    void apply_numeric_(Vector* a, Vector* b) {
+        size_t n = result_->size;
+        if (operand_type_ == INT_TYPE) {
+            binary_kernel<Op<int> >(a->data<int>(), b->data<int>(),
+                                    result_->data<typename Op<int>::Result>(), n);
+        } else {
+            binary_kernel<Op<float> >(a->data<float>(), b->data<float>(),
+                                      result_->data<typename Op<float>::Result>(), n);
+        }
+    }
+
+    void divide_(Vector* a, Vector* b) {
+        size_t n = result_->size;
+        if (operand_type_ == INT_TYPE) {
+            div_kernel<int>(a->data<int>(), b->data<int>(), result_->data<int>(), result_->valid, n);
+        } else {
+            div_kernel<float>(a->data<float>(), b->data<float>(), result_->data<float>(), result_->valid, n);
+        }
+    }
+};
+
+/*************************************************************************
+ * NotExpr::
+ * Logical negation of a bool subtree.
+ */
+class NotExpr : public Expr {
+   public:
+    Expr* operand;  // shared
+
+    NotExpr(Expr* operand) {
+        this->operand = operand;
+        operand->ref();
+    }
+
+    ~NotExpr() { operand->deref(); }
+
+    char bind(Schema& scm) {
+        if (operand->bind(scm) != BOOL_TYPE) {
+            printf("ERROR logical operator applied to non-bool values\n");
+            exit(1);
+        }
+        bind_result_(BOOL_TYPE);
+        return BOOL_TYPE;
+    }
+
+    void columns_used(bool* used) { operand->columns_used(used); }
+
+    Vector* eval(Batch& batch) {
+        Vector* in = operand->eval(batch);
+        bool* vals = in->data<bool>();
+        bool* out = result_->data<bool>();
+        for (size_t i = 0; i < in->size; i++) {
+            out[i] = !vals[i];
+        }
+        memcpy(result_->valid, in->valid, in->size * sizeof(bool));
+        result_->size = in->size;
+        return result_;
+    }
+};
+
+/*************************************************************************
+ * Expression::
+ * A handle to an expression tree, used to build trees with operators:
+ *     col(0) + col(1) * 2 > lit(5)
+ * Ints, floats (and doubles) and bools convert to literals. Handles may be
+ * copied freely; the tree is deleted with the last handle referring to it.
+ */
+class Expression {
+   public:
+    Expr* expr;  // shared
+
+    explicit Expression(Expr* expr) : expr(expr) { expr->ref(); }
+    Expression(int val) : Expression(new LiteralExpr(val)) {}
+    Expression(float val) : Expression(new LiteralExpr(val)) {}
+    Expression(double val) : Expression(new LiteralExpr((float) val)) {}
+    Expression(bool val) : Expression(new LiteralExpr(val)) {}
+    Expression(const Expression& other) : Expression(other.expr) {}
+
+    ~Expression() { expr->deref(); }
+
+    Expression& operator=(const Expression& other) {
+        other.expr->ref();
+        expr->deref();
+        expr = other.expr;
+        return *this;
+    }
+};
+
+// The values of column idx
+inline Expression col(size_t idx) { return Expression(new ColumnExpr(idx)); }
+
+// A constant
+inline Expression lit(int val) { return Expression(val); }
+inline Expression lit(float val) { return Expression(val); }
+inline Expression lit(double val) { return Expression(val); }
+inline Expression lit(bool val) { return Expression(val); }
+
+inline Expression binary_(ExprOp op, const Expression& a, const Expression& b) {
+    return Expression(new BinaryExpr(op, a.expr, b.expr));
+}
+
+inline Expression operator+(const Expression& a, const Expression& b) { return binary_(OP_ADD, a, b); }
+inline Expression operator-(const Expression& a, const Expression& b) { return binary_(OP_SUB, a, b); }
+inline Expression operator*(const Expression& a, const Expression& b) { return binary_(OP_MUL, a, b); }
+inline Expression operator/(const Expression& a, const Expression& b) { return binary_(OP_DIV, a, b); }
+inline Expression operator<(const Expression& a, const Expression& b) { return binary_(OP_LT, a, b); }
+inline Expression operator>(const Expression& a, const Expression& b) { return binary_(OP_GT, a, b); }
+inline Expression operator<=(const Expression& a, const Expression& b) { return binary_(OP_LE, a, b); }
+inline Expression operator>=(const Expression& a, const Expression& b) { return binary_(OP_GE, a, b); }
+inline Expression operator==(const Expression& a, const Expression& b) { return binary_(OP_EQ, a, b); }
+inline Expression operator!=(const Expression& a, const Expression& b) { return binary_(OP_NE, a, b); }
+inline Expression operator&&(const Expression& a, const Expression& b) { return binary_(OP_AND, a, b); }
+inline Expression operator||(const Expression& a, const Expression& b) { return binary_(OP_OR, a, b); }
+inline Expression operator!(const Expression& a) { return Expression(new NotExpr(a.expr)); }
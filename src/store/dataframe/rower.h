@@ -2,6 +2,7 @@
 *           David Tandetnik (tandetnik.da@husky.neu.edu) */
 #pragma once
 #include "../../utils/object.h"
+#include "../../utils/sketch.h"
 #include "row.h"
 
 #define INT_TYPE 'I'
@@ -149,3 +150,58 @@ class MaxRower : public Rower {
         return m;
     }
 };
+
+// Rower that adds the non-missing values of one column to a Sketch.
+// Clones get empty sketches of the same shape that are merged back on
+// join, so it can be used with pmap as well as map and local_map.
+class SketchRower : public Rower {
+   public:
+    Sketch* sketch;     // external, unless this rower is a clone
+    size_t col;
+    bool owns_sketch_;
+
+    SketchRower(Sketch* sketch, size_t col) {
+        this->sketch = sketch;
+        this->col = col;
+        owns_sketch_ = false;
+    }
+
+    ~SketchRower() {
+        if (owns_sketch_) {
+            delete sketch;
+        }
+    }
+
+    virtual bool accept(Row& r) {
+        if (r.is_missing(col)) {
+            return false;
+        }
+
+        char type = r.col_type(col);
+        if (type == INT_TYPE) {
+            sketch->add(r.get_int(col));
+        } else if (type == FLOAT_TYPE) {
+            sketch->add(r.get_float(col));
+        } else if (type == BOOL_TYPE) {
+            sketch->add(r.get_bool(col));
+        } else {
+            sketch->add(r.get_string(col));
+        }
+
+        return false;
+    }
+
+    // Merge the other rower's sketch into this one and delete given rower
+    virtual void join_delete(Rower* other) {
+        SketchRower* s = dynamic_cast<SketchRower*>(other);
+        sketch->merge(s->sketch);
+        delete other;
+    }
+
+    // Returns a new rower over the same column with an empty sketch
+    virtual SketchRower* clone() {
+        SketchRower* s = new SketchRower(sketch->clone_empty(), col);
+        s->owns_sketch_ = true;
+        return s;
+    }
+};
@@ -1,26 +1,68 @@
 /* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
 *           David Tandetnik (tandetnik.da@husky.neu.edu) */
 #pragma once
+#include <stdint.h>
 #include <stdlib.h>
+#include "../utils/hash.h"
 #include "../utils/helper.h"
 #include "../utils/object.h"
+#include "../utils/slab.h"
+
+// Hex digits needed to print any key id
+#define KEY_ID_CHARS 16
 
 // Represents a Key in a KeyValue Store
 // Does not own or copy any of its data
+// Every key is interned to a 64-bit id, a strong hash of its name and
+// home_node computed once at construction. Every node derives the same id
+// for the same key, so the id is what hash tables compare first and what
+// travels with the key in GET and PUT messages.
+// A key may also be replicated: its value is then kept on the replicas
+// nodes starting from its home node, so reads can be spread across them.
+// Replicas do not change which key it is.
+// Keys and their names come from the global SlabAllocator, since a Store
+// makes and frees one for every entry.
 class Key : public Object {
    public:
     char* name;
     size_t home_node;
+    uint64_t id;
+    size_t replicas;  // Number of nodes holding the value; 1 for just the home node
 
     // Constructs a key from the given name and home_node. Uses a copy of the given name.
     Key(char* name, size_t home_node) {
-        Sys s;
-        this->name = s.duplicate(name);
+        size_t len = strlen(name);
+        this->name = SlabAllocator::global()->duplicate(name, len);
         this->home_node = home_node;
+        replicas = 1;
+        set_id_(hash_bytes(name, len, home_node));
+    }
+
+    // Constructs a key whose id is already known, e.g. received with it
+    // over the network, without hashing the name again
+    Key(char* name, size_t home_node, uint64_t id) {
+        this->name = SlabAllocator::global()->duplicate(name, strlen(name));
+        this->home_node = home_node;
+        replicas = 1;
+        set_id_(id);
+    }
+
+    void set_id_(uint64_t id) {
+        this->id = id;
+        // Object::hash() treats 0 as not yet computed
+        hash_ = id != 0 ? (size_t)id : 1;
     }
 
     ~Key() {
-        delete[] name;
+        SlabAllocator::global()->free(name, strlen(name) + 1);
+    }
+
+    static void* operator new(size_t size) {
+        return SlabAllocator::global()->alloc(size);
+    }
+
+    static void operator delete(void* ptr, size_t size) {
+        SlabAllocator::global()->free(ptr, size);
     }
 
     char* get_name() {
@@ -31,13 +73,37 @@ class Key : public Object {
         return home_node;
     }
 
+    uint64_t get_id() {
+        return id;
+    }
+
+    // Sets how many nodes hold this key's value, and returns this key
+    Key* set_replicas(size_t replicas) {
+        this->replicas = replicas == 0 ? 1 : replicas;
+        return this;
+    }
+
+    // Number of distinct nodes holding this key's value among num_nodes
+    size_t num_replicas(size_t num_nodes) {
+        return replicas < num_nodes ? replicas : num_nodes;
+    }
+
+    // The node holding replica i of this key's value; replica 0 is the home node
+    size_t replica_node(size_t i, size_t num_nodes) {
+        return (home_node + i) % num_nodes;
+    }
+
+    // Whether the given node holds a replica of this key's value
+    bool is_replica_on(size_t node, size_t num_nodes) {
+        return (node + num_nodes - home_node) % num_nodes < num_replicas(num_nodes);
+    }
+
     size_t hash_me() {
-        size_t name_length = strlen(name);
-        return name_length * (home_node + 1 + name_length);
+        return hash_;
     }
 
     Key* clone() {
-        return new Key(name, home_node);
+        return (new Key(name, home_node, id))->set_replicas(replicas);
     }
 
     bool equals(Object* other) {
@@ -48,7 +114,7 @@ class Key : public Object {
 
         if (other_key == nullptr) return false;
 
-        if (equal_strings(other_key->name, name) && other_key->home_node == home_node) return true;
+        if (other_key->id == id && other_key->home_node == home_node && equal_strings(other_key->name, name)) return true;
 
         return false;
     }
@@ -0,0 +1,671 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "../utils/object.h"
+#include "../utils/rwlock.h"
+#include "key.h"
+#include "spill.h"
+#include "value.h"
+
+#define KEY_TABLE_MIN_CAPACITY (size_t)64
+// Rehash once this fraction of slots is in use
+#define KEY_TABLE_MAX_LOAD 0.8
+// Slots moved from the old table to the new one per operation while rehashing
+#define KEY_TABLE_REHASH_STEP (size_t)32
+// A StripedKeyTable has 2^KEY_TABLE_STRIPE_BITS stripes
+#define KEY_TABLE_STRIPE_BITS 4
+#define KEY_TABLE_STRIPES ((size_t)1 << KEY_TABLE_STRIPE_BITS)
+// Once over its memory budget, a StripedKeyTable spills values until it
+// is down to this fraction of the budget, so it does not spill on every put
+#define KEY_TABLE_SPILL_LOW_WATER 0.9
+// Set in an entry's version once its value is sealed: promised never to
+// change, so other nodes may cache it
+#define KEY_SEALED ((uint64_t)1 << 63)
+
+/*************************************************************************
+ * KeySlot::
+ * One slot of a KeyTable. Slots are stored inline in one array, so a
+ * lookup touches consecutive memory and entries need no allocation of
+ * their own. An empty slot has a nullptr key.
+ */
+class KeySlot {
+   public:
+    uint64_t hash;  // Interned id of key, which is its hash
+    Key* key;       // owned; nullptr if the slot is empty. Its replicas are
+                    // the nodes the value is kept on, the most any put asked for
+    Value* value;   // one reference owned; nullptr while spilled to disk
+    size_t dist;    // Distance from the slot the hash maps to
+    uint64_t last_used;       // Tick of the last access, for spilling in LRU order
+    SpillLocation* spilled;   // owned; where a copy of value is on disk, or nullptr
+    uint64_t version;         // 1 when put, bumped by every replacement; may hold KEY_SEALED
+};
+
+/*************************************************************************
+ * KeyTable::
+ * Maps Keys to values for a Store. Open addressing with Robin Hood
+ * probing: an entry being inserted takes the slot of any entry that is
+ * closer to its own home slot, which keeps every probe sequence short.
+ * Key ids are cached in the slots and compared before the key names.
+ * Replacing a value is done in place, in O(1).
+ * Growing is incremental: a new table twice the size is allocated and
+ * each later operation moves a few slots of the old one across, so no
+ * single put pays to rehash millions of entries.
+ * Owns its keys and a reference to each value. Not thread safe; the
+ * Store locks around it. An entry may be spilled, with its value only on
+ * disk; the StripedKeyTable that spilled it is the one to read it back.
+ */
+class KeyTable : public Object {
+   public:
+    KeySlot* slots;      // owned
+    size_t capacity;     // Number of slots, a power of two
+    size_t count;        // Number of entries in slots
+    size_t max_dist;     // Longest distance of any entry in slots
+
+    // The table being emptied into slots during an incremental rehash
+    KeySlot* old_slots;  // owned; nullptr when not rehashing
+    size_t old_capacity;
+    size_t old_count;
+    size_t old_max_dist;
+    size_t migrate_pos;  // Slots of old_slots below this have been moved
+
+    KeyTable() {
+        capacity = KEY_TABLE_MIN_CAPACITY;
+        slots = new KeySlot[capacity]();
+        count = 0;
+        max_dist = 0;
+
+        old_slots = nullptr;
+        old_capacity = 0;
+        old_count = 0;
+        old_max_dist = 0;
+        migrate_pos = 0;
+    }
+
+    ~KeyTable() {
+        delete_slots_(slots, capacity);
+        if (old_slots != nullptr) {
+            delete_slots_(old_slots, old_capacity);
+        }
+    }
+
+    void delete_slots_(KeySlot* table, size_t table_capacity) {
+        for (size_t i = 0; i < table_capacity; i++) {
+            if (table[i].key != nullptr) {
+                delete table[i].key;
+                if (table[i].value != nullptr) {
+                    table[i].value->release();
+                }
+                delete table[i].spilled;
+            }
+        }
+        delete[] table;
+    }
+
+    // Number of entries in the table
+    size_t size() { return count + old_count; }
+
+    // Key ids are strong hashes, so their low bits pick the slot directly
+    size_t home_(uint64_t hash, size_t table_capacity) {
+        return (size_t)hash & (table_capacity - 1);
+    }
+
+    // Compares keys directly, avoiding a virtual equals and dynamic_cast
+    bool matches_(KeySlot& slot, uint64_t hash, Key* key) {
+        return slot.key != nullptr && slot.hash == hash &&
+               slot.key->home_node == key->home_node && strcmp(slot.key->name, key->name) == 0;
+    }
+
+    // Returns the slot holding key in the current table, or nullptr.
+    // Stops as soon as it passes entries closer to home than key would be.
+    KeySlot* find_(uint64_t hash, Key* key) {
+        size_t idx = home_(hash, capacity);
+        for (size_t dist = 0; dist <= max_dist; dist++) {
+            KeySlot& slot = slots[idx];
+            if (slot.key == nullptr || slot.dist < dist) {
+                return nullptr;
+            }
+            if (matches_(slot, hash, key)) {
+                return &slot;
+            }
+            idx = (idx + 1) & (capacity - 1);
+        }
+        return nullptr;
+    }
+
+    // Returns the slot holding key in the old table, or nullptr. Slots
+    // already moved are empty, so every slot up to the longest distance
+    // is checked rather than stopping at the first empty one.
+    KeySlot* find_old_(uint64_t hash, Key* key) {
+        if (old_slots == nullptr) {
+            return nullptr;
+        }
+
+        size_t idx = home_(hash, old_capacity);
+        for (size_t dist = 0; dist <= old_max_dist; dist++) {
+            if (matches_(old_slots[idx], hash, key)) {
+                return &old_slots[idx];
+            }
+            idx = (idx + 1) & (old_capacity - 1);
+        }
+        return nullptr;
+    }
+
+    // Returns the slot holding key, or nullptr. Only reads the table, so
+    // any number of lookups may run at once.
+    KeySlot* lookup_(Key* key) {
+        uint64_t hash = key->get_id();
+        KeySlot* slot = find_(hash, key);
+        return slot != nullptr ? slot : find_old_(hash, key);
+    }
+
+    // Returns the value mapped to key, or nullptr if there is none or it
+    // is spilled. The table keeps its reference; retain() the value to
+    // hold it after unlocking.
+    Value* get(Key* key) {
+        migrate_();
+        KeySlot* slot = lookup_(key);
+        return slot == nullptr ? nullptr : slot->value;
+    }
+
+    bool contains(Key* key) {
+        migrate_();
+        return lookup_(key) != nullptr;
+    }
+
+    // Maps key to value, taking over the caller's reference to value, and
+    // stamps the entry as used at the given tick. The key is copied only
+    // when it is new. Returns the value replaced, whose reference the
+    // caller now holds, or nullptr (also when the old value was spilled).
+    // Sets old_version, if given, to the replaced entry's version, or 0.
+    // The entry keeps the most replicas any of its keys asked for, so a
+    // put through a key with fewer cannot lower them; sets replicas, if
+    // given, to that count.
+    Value* put(Key* key, Value* value, uint64_t tick = 0, uint64_t* old_version = nullptr,
+               size_t* replicas = nullptr) {
+        migrate_();
+
+        KeySlot* slot = lookup_(key);
+        if (slot != nullptr) {
+            Value* replaced = slot->value;
+            if (old_version != nullptr) *old_version = slot->version;
+            if (key->replicas > slot->key->replicas) {
+                slot->key->set_replicas(key->replicas);
+            }
+            if (replicas != nullptr) *replicas = slot->key->replicas;
+            slot->value = value;
+            slot->last_used = tick;
+            // A new value starts out unsealed
+            slot->version = (slot->version & ~KEY_SEALED) + 1;
+            // The copy on disk is stale now
+            delete slot->spilled;
+            slot->spilled = nullptr;
+            return replaced;
+        }
+
+        if (old_slots == nullptr && count + 1 > capacity * KEY_TABLE_MAX_LOAD) {
+            start_rehash_();
+        }
+
+        KeySlot entry;
+        entry.hash = key->get_id();
+        entry.key = key->clone();
+        entry.value = value;
+        entry.last_used = tick;
+        entry.spilled = nullptr;
+        entry.version = 1;
+        insert_(entry);
+        if (old_version != nullptr) *old_version = 0;
+        if (replicas != nullptr) *replicas = key->replicas;
+        return nullptr;
+    }
+
+    // Removes key's mapping. Returns the value, whose reference the caller
+    // now holds, or nullptr if there was none or it was spilled. Sets
+    // old_version, if given, to the removed entry's version, or 0, and
+    // replicas, if given, to the most replicas the entry or key had.
+    Value* remove(Key* key, uint64_t* old_version = nullptr, size_t* replicas = nullptr) {
+        // Removing shifts entries back, which could move an entry of the
+        // old table behind migrate_pos, so finish any rehash first
+        finish_rehash_();
+
+        KeySlot* slot = find_(key->get_id(), key);
+        if (old_version != nullptr) *old_version = slot == nullptr ? 0 : slot->version;
+        if (replicas != nullptr) {
+            *replicas = slot != nullptr && slot->key->replicas > key->replicas ? slot->key->replicas : key->replicas;
+        }
+        if (slot == nullptr) {
+            return nullptr;
+        }
+
+        Value* value = slot->value;
+        delete slot->key;
+        delete slot->spilled;
+
+        // Backward shift: pull following entries one slot closer to home
+        size_t idx = slot - slots;
+        size_t next = (idx + 1) & (capacity - 1);
+        while (slots[next].key != nullptr && slots[next].dist > 0) {
+            slots[idx] = slots[next];
+            slots[idx].dist--;
+            idx = next;
+            next = (next + 1) & (capacity - 1);
+        }
+        slots[idx].key = nullptr;
+        slots[idx].value = nullptr;
+        slots[idx].spilled = nullptr;
+        count--;
+
+        return value;
+    }
+
+    // Places an entry known not to be in the table. Robin Hood: the entry
+    // moving in swaps with any resident that is closer to its home.
+    void insert_(KeySlot entry) {
+        entry.dist = 0;
+
+        size_t idx = home_(entry.hash, capacity);
+        while (slots[idx].key != nullptr) {
+            if (slots[idx].dist < entry.dist) {
+                KeySlot resident = slots[idx];
+                slots[idx] = entry;
+                if (entry.dist > max_dist) max_dist = entry.dist;
+                entry = resident;
+            }
+            idx = (idx + 1) & (capacity - 1);
+            entry.dist++;
+        }
+
+        slots[idx] = entry;
+        if (entry.dist > max_dist) max_dist = entry.dist;
+        count++;
+    }
+
+    // Replaces the table with an empty one twice the size. Entries are
+    // moved across a few at a time by migrate_().
+    void start_rehash_() {
+        old_slots = slots;
+        old_capacity = capacity;
+        old_count = count;
+        old_max_dist = max_dist;
+        migrate_pos = 0;
+
+        capacity *= 2;
+        slots = new KeySlot[capacity]();
+        count = 0;
+        max_dist = 0;
+    }
+
+    // Moves up to KEY_TABLE_REHASH_STEP slots of the old table, if any
+    void migrate_() {
+        if (old_slots == nullptr) {
+            return;
+        }
+
+        size_t end = migrate_pos + KEY_TABLE_REHASH_STEP;
+        if (end > old_capacity) {
+            end = old_capacity;
+        }
+
+        for (; migrate_pos < end; migrate_pos++) {
+            KeySlot& slot = old_slots[migrate_pos];
+            if (slot.key != nullptr) {
+                insert_(slot);
+                slot.key = nullptr;
+                old_count--;
+            }
+        }
+
+        if (migrate_pos == old_capacity) {
+            delete[] old_slots;
+            old_slots = nullptr;
+            old_capacity = 0;
+            old_max_dist = 0;
+        }
+    }
+
+    void finish_rehash_() {
+        while (old_slots != nullptr) {
+            migrate_();
+        }
+    }
+
+    // Calls visit on every entry's slot, in no particular order. visit may
+    // change the slot's value but must not add or remove entries.
+    template <class F>
+    void for_each_slot_(F visit) {
+        for (size_t i = 0; i < capacity; i++) {
+            if (slots[i].key != nullptr) {
+                visit(slots[i]);
+            }
+        }
+        for (size_t i = 0; old_slots != nullptr && i < old_capacity; i++) {
+            if (old_slots[i].key != nullptr) {
+                visit(old_slots[i]);
+            }
+        }
+    }
+
+    // Returns a new array of the table's keys, in no particular order. The
+    // keys are still owned by the table. Sets num_keys to its length.
+    Key** keys(size_t* num_keys) {
+        finish_rehash_();
+
+        Key** result = new Key*[count];
+        size_t pos = 0;
+        for (size_t i = 0; i < capacity; i++) {
+            if (slots[i].key != nullptr) {
+                result[pos++] = slots[i].key;
+            }
+        }
+
+        *num_keys = count;
+        return result;
+    }
+};
+
+/*************************************************************************
+ * StripedKeyTable::
+ * A KeyTable split into KEY_TABLE_STRIPES independent stripes, each with
+ * its own reader/writer lock, so that the application thread, the
+ * listener serving other nodes and any worker threads can use the table
+ * at once. A key's stripe is picked by the high bits of its id (the
+ * stripe's table uses the low bits). Gets only take a stripe's lock for
+ * reading, so reads of the same stripe run in parallel, and a write only
+ * blocks the keys of one stripe.
+ * Given a memory budget, the table keeps at most that many bytes of
+ * values in memory. Past it, the least recently used values are spilled
+ * to append-only segment files, and read back when next asked for, so
+ * callers never see the difference. A value read back keeps its copy on
+ * disk and is simply dropped if spilled again.
+ * Owns its keys and a reference to each value. Thread safe.
+ */
+class StripedKeyTable : public Object {
+   public:
+    KeyTable tables[KEY_TABLE_STRIPES];
+    RWLock locks[KEY_TABLE_STRIPES];
+
+    std::atomic<size_t> memory_budget;   // Bytes of values to keep in memory; 0 for no limit
+    SpillSegments* segments;             // owned; nullptr until a budget is set
+    std::atomic<size_t> resident_bytes;  // Bytes of values in memory
+    std::atomic<uint64_t> clock;         // Ticks on every access while there is a budget
+    std::mutex evict_lock;               // Held by the one thread spilling at a time
+
+    StripedKeyTable() : memory_budget(0), resident_bytes(0), clock(0) {
+        segments = nullptr;
+    }
+
+    ~StripedKeyTable() {
+        delete segments;
+    }
+
+    // Limits the bytes of values kept in memory, spilling the rest to
+    // segment files in dir named for node_id. May be called again to
+    // change the budget; the directory is fixed by the first call.
+    void set_memory_budget(size_t bytes, const char* dir, size_t node_id) {
+        {
+            std::lock_guard<std::mutex> lck(evict_lock);
+            if (segments == nullptr) {
+                segments = new SpillSegments(dir, node_id);
+            }
+            memory_budget = bytes;
+        }
+        evict_();
+    }
+
+    size_t stripe_(Key* key) {
+        return (size_t)(key->get_id() >> (64 - KEY_TABLE_STRIPE_BITS));
+    }
+
+    // Returns the next tick, or 0 if nothing is ever spilled, to spare the
+    // shared counter
+    uint64_t tick_() {
+        return memory_budget == 0 ? 0 : clock.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    // Stamps slot as just used. Readers share the stripe's lock, so the
+    // store is atomic.
+    void touch_(KeySlot* slot) {
+        uint64_t tick = tick_();
+        if (tick != 0) {
+            __atomic_store_n(&slot->last_used, tick, __ATOMIC_RELAXED);
+        }
+    }
+
+    // Returns the value mapped to key with a reference added for the
+    // caller, who must release() it, or nullptr. Sets version, if given,
+    // to the entry's version.
+    Value* get(Key* key, uint64_t* version = nullptr) {
+        size_t i = stripe_(key);
+        SpillLocation where;
+        {
+            ReadGuard guard(locks[i]);
+            KeySlot* slot = tables[i].lookup_(key);
+            if (slot == nullptr) {
+                return nullptr;
+            }
+            touch_(slot);
+            if (version != nullptr) *version = slot->version;
+            if (slot->value != nullptr) {
+                return slot->value->retain();
+            }
+            where = *slot->spilled;
+        }
+
+        // Read the value back without holding the lock, then put it in
+        // the table unless another thread beat us to it
+        Value* value = segments->load(where);
+        {
+            WriteGuard guard(locks[i]);
+            KeySlot* slot = tables[i].lookup_(key);
+            if (slot != nullptr && slot->value != nullptr) {
+                value->release();
+                return slot->value->retain();
+            }
+            if (slot != nullptr && slot->spilled->segment == where.segment && slot->spilled->offset == where.offset) {
+                slot->value = value->retain();
+                resident_bytes += value->size();
+            }
+            // Otherwise the key was removed meanwhile; the caller still
+            // gets the value it asked for
+        }
+        evict_();
+        return value;
+    }
+
+    // Maps key to value, taking over the caller's reference to value.
+    // Returns the value replaced, whose reference the caller now holds, or
+    // nullptr. Sets old_version, if given, to the replaced entry's version,
+    // or 0 if the key is new, and replicas, if given, to the number of
+    // nodes the entry's value is kept on; see KeyTable::put().
+    Value* put(Key* key, Value* value, uint64_t* old_version = nullptr, size_t* replicas = nullptr) {
+        size_t i = stripe_(key);
+        size_t added = value->size();
+        Value* replaced;
+        {
+            WriteGuard guard(locks[i]);
+            replaced = tables[i].put(key, value, tick_(), old_version, replicas);
+            resident_bytes += added;
+            if (replaced != nullptr) {
+                resident_bytes -= replaced->size();
+            }
+        }
+        evict_();
+        return replaced;
+    }
+
+    // Removes key's mapping. Returns the value, whose reference the caller
+    // now holds, or nullptr if there was none. Sets old_version, if given,
+    // to the removed entry's version, or 0, and replicas, if given, to the
+    // most replicas the entry or key had.
+    Value* remove(Key* key, uint64_t* old_version = nullptr, size_t* replicas = nullptr) {
+        size_t i = stripe_(key);
+        WriteGuard guard(locks[i]);
+        KeySlot* slot = tables[i].lookup_(key);
+        if (slot == nullptr) {
+            if (old_version != nullptr) *old_version = 0;
+            if (replicas != nullptr) *replicas = key->replicas;
+            return nullptr;
+        }
+        if (slot->value == nullptr) {
+            slot->value = segments->load(*slot->spilled);
+        } else {
+            resident_bytes -= slot->value->size();
+        }
+        return tables[i].remove(key, old_version, replicas);
+    }
+
+    // Maps key to value as a replica of the given version of the value on
+    // the key's home node, unless the table already holds that version or
+    // a newer one. Replicas of a key can then be written in any order and
+    // still end up with its latest value. Takes over the caller's reference
+    // to value either way. Returns whether value was kept.
+    bool put_replica(Key* key, Value* value, uint64_t version) {
+        size_t i = stripe_(key);
+        size_t added = value->size();
+        Value* replaced;
+        {
+            WriteGuard guard(locks[i]);
+            KeySlot* slot = tables[i].lookup_(key);
+            if (slot != nullptr && (slot->version & ~KEY_SEALED) >= (version & ~KEY_SEALED)) {
+                if (slot->version == (version & ~KEY_SEALED)) {
+                    // Same value, which may have been sealed since
+                    slot->version |= version & KEY_SEALED;
+                }
+                value->release();
+                return false;
+            }
+            replaced = tables[i].put(key, value, tick_());
+            tables[i].lookup_(key)->version = version;
+            resident_bytes += added;
+            if (replaced != nullptr) {
+                resident_bytes -= replaced->size();
+            }
+        }
+        if (replaced != nullptr) {
+            replaced->release();
+        }
+        evict_();
+        return true;
+    }
+
+    // Seals key's current value. Returns false if there is none.
+    bool seal(Key* key) {
+        size_t i = stripe_(key);
+        WriteGuard guard(locks[i]);
+        KeySlot* slot = tables[i].lookup_(key);
+        if (slot == nullptr) {
+            return false;
+        }
+        slot->version |= KEY_SEALED;
+        return true;
+    }
+
+    // Number of entries in the table. Other threads may change it at once.
+    size_t size() {
+        size_t total = 0;
+        for (size_t i = 0; i < KEY_TABLE_STRIPES; i++) {
+            ReadGuard guard(locks[i]);
+            total += tables[i].size();
+        }
+        return total;
+    }
+
+    // Calls visit(key, value) on every entry, one stripe at a time under
+    // its read lock, so visit must not use the table. Spilled values are
+    // read back for the call without being kept in memory. visit must
+    // retain() a value to keep it.
+    template <class F>
+    void for_each(F visit) {
+        for (size_t i = 0; i < KEY_TABLE_STRIPES; i++) {
+            ReadGuard guard(locks[i]);
+            tables[i].for_each_slot_([&](KeySlot& slot) {
+                if (slot.value != nullptr) {
+                    visit(slot.key, slot.value);
+                } else {
+                    Value* value = segments->load(*slot.spilled);
+                    visit(slot.key, value);
+                    value->release();
+                }
+            });
+        }
+    }
+
+    // If over the memory budget, spills the least recently used values
+    // until down to KEY_TABLE_SPILL_LOW_WATER of it. Finds the cutoff tick
+    // from a snapshot of every entry's last use, then spills each stripe
+    // in turn. Entries used since the snapshot, or held by a reader right
+    // now (spilling those would not free their memory), are skipped.
+    void evict_() {
+        size_t budget = memory_budget.load();
+        if (budget == 0 || resident_bytes.load() <= budget) {
+            return;
+        }
+        std::unique_lock<std::mutex> evicting(evict_lock, std::try_to_lock);
+        if (!evicting.owns_lock()) {
+            return;  // Another thread is already spilling
+        }
+
+        size_t target = (size_t)(budget * KEY_TABLE_SPILL_LOW_WATER);
+        size_t resident = resident_bytes.load();
+        if (resident <= target) {
+            return;
+        }
+
+        // (last use, bytes) of every value in memory
+        size_t num_uses = 0;
+        size_t uses_capacity = 1024;
+        std::pair<uint64_t, size_t>* uses = new std::pair<uint64_t, size_t>[uses_capacity];
+        for (size_t i = 0; i < KEY_TABLE_STRIPES; i++) {
+            ReadGuard guard(locks[i]);
+            tables[i].for_each_slot_([&](KeySlot& slot) {
+                if (slot.value == nullptr) {
+                    return;
+                }
+                if (num_uses == uses_capacity) {
+                    uses_capacity *= 2;
+                    std::pair<uint64_t, size_t>* grown = new std::pair<uint64_t, size_t>[uses_capacity];
+                    std::copy(uses, uses + num_uses, grown);
+                    delete[] uses;
+                    uses = grown;
+                }
+                uses[num_uses++] = std::make_pair(__atomic_load_n(&slot.last_used, __ATOMIC_RELAXED), slot.value->size());
+            });
+        }
+        std::sort(uses, uses + num_uses);
+
+        uint64_t cutoff = 0;
+        size_t freed = 0;
+        for (size_t u = 0; u < num_uses && freed < resident - target; u++) {
+            cutoff = uses[u].first;
+            freed += uses[u].second;
+        }
+        delete[] uses;
+
+        for (size_t i = 0; i < KEY_TABLE_STRIPES; i++) {
+            WriteGuard guard(locks[i]);
+            tables[i].for_each_slot_([&](KeySlot& slot) {
+                if (slot.value != nullptr && slot.last_used <= cutoff && slot.value->refs.load() == 1) {
+                    spill_(slot);
+                }
+            });
+        }
+    }
+
+    // Moves slot's value out of memory, writing it to disk unless an
+    // up-to-date copy is already there. Caller holds the stripe's write lock.
+    void spill_(KeySlot& slot) {
+        if (slot.spilled == nullptr) {
+            slot.spilled = new SpillLocation(segments->append(slot.value));
+        }
+        resident_bytes -= slot.value->size();
+        slot.value->release();
+        slot.value = nullptr;
+    }
+};
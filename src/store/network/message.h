@@ -4,7 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "../../utils/buffer.h"
 #include "../../utils/helper.h"
+#include "../../utils/stream.h"
 
 enum MessageType {
     ACK,
@@ -13,24 +15,44 @@ enum MessageType {
     DIRECTORY,
     SHUTDOWN,
     PUT,
-    GET
+    GET,
+    WATCH,
+    NOTIFY,
+    SEAL,
+    INVALIDATE,
+    SEALED,
+    GET_MANY,
+    PUT_MANY,
+    REMOVE,
+    STATS,
+    REPLICATE
 };
 
 // Represents a Message sent between nodes/servers in a network
+// The body may hold any bytes, including NULs; msg_len gives its length and
+// a NUL always follows it.
 class Message {
    public:
     char* sender_ip_address;
     int sender_port;
     MessageType msg_type;
     char* msg;
+    size_t msg_len;
 
     // Constructs a Message with the given fields
-    Message(char* sender_ip_address, int sender_port, MessageType msg_type, char* msg) {
+    Message(char* sender_ip_address, int sender_port, MessageType msg_type, char* msg)
+        : Message(sender_ip_address, sender_port, msg_type, msg, strlen(msg)) {}
+
+    // Constructs a Message whose body is the given msg_len bytes of msg
+    Message(char* sender_ip_address, int sender_port, MessageType msg_type, const char* msg, size_t msg_len) {
         Sys s;
         this->sender_ip_address = s.duplicate(sender_ip_address);
         this->sender_port = sender_port;
         this->msg_type = msg_type;
-        this->msg = s.duplicate(msg);
+        this->msg = new char[msg_len + 1];
+        memcpy(this->msg, msg, msg_len);
+        this->msg[msg_len] = '\0';
+        this->msg_len = msg_len;
     }
 
     ~Message() {
@@ -41,44 +63,120 @@ class Message {
     // Constructs a Message from the given stringified Message
     // Expects given string to have format 
     // [SENDER IP ADDRESS]:[SENDER PORT];[MESSAGE TYPE];[MESSAGE]
-    Message(char* message_string) {
-        Sys s;
+    Message(char* message_string) : Message(message_string, strlen(message_string)) {}
+
+    // Same as above, but the string is length bytes long and the message
+    // body may hold any bytes
+    Message(char* message_string, size_t length) {
+        // Only the header is tokenized; the body is copied as it is
+        char* type_end = (char*)memchr(message_string, ';', length);
+        assert(type_end != nullptr);
+        type_end = (char*)memchr(type_end + 1, ';', length - (type_end + 1 - message_string));
+        assert(type_end != nullptr);
 
         // Use duplicate because strtok mutates its string
-        char* msg_duplicate = s.duplicate(message_string);
+        char* header = new char[type_end - message_string + 1];
+        memcpy(header, message_string, type_end - message_string);
+        header[type_end - message_string] = '\0';
+        parse_header_(header);
+        delete[] header;
+
+        // The body may be empty
+        msg_len = length - (type_end + 1 - message_string);
+        msg = new char[msg_len + 1];
+        memcpy(msg, type_end + 1, msg_len);
+        msg[msg_len] = '\0';
+    }
+
+    // Constructs a Message from its header, [SENDER IP ADDRESS]:[SENDER
+    // PORT];[MESSAGE TYPE], which is tokenized, and its body of msg_len
+    // bytes, which it takes over. The body must be followed by a NUL.
+    Message(char* header, char* msg, size_t msg_len) {
+        parse_header_(header);
+        this->msg = msg;
+        this->msg_len = msg_len;
+    }
 
+    void parse_header_(char* header) {
+        Sys s;
         char* entry; // Used for strtok_r thread safety
         
-        sender_ip_address = s.duplicate(strtok_r(msg_duplicate, ":", &entry));
+        sender_ip_address = s.duplicate(strtok_r(header, ":", &entry));
         sender_port = atoi(strtok_r(nullptr, ";", &entry));
         
         char* msg_type_string = strtok_r(nullptr, ";", &entry);
         msg_type = static_cast<MessageType>(atoi(msg_type_string));
 
-        // May be nullptr. If so, set to empty string
-        msg = strtok_r(nullptr, "\0", &entry);
-        if (msg == nullptr) {
-            msg = new char[1];
-            msg[0] = '\0';
-        } else {
-            msg = s.duplicate(msg);
-        }
-
         assert(sender_ip_address);
         assert(sender_port);
         assert(msg_type >= 0);
-
-        delete[] msg_duplicate;
     }
 
     // Returns a string representation of this Message in the format
     // [SENDER IP ADDRESS]:[SENDER PORT];[MESSAGE TYPE];[MESSAGE]
     char* to_string() {
-        size_t buf_size = snprintf(nullptr, 0, "%s:%d;%d;%s", sender_ip_address, sender_port, msg_type, msg) + 1;
-        char* string = new char[buf_size];
-        snprintf(string, buf_size, "%s:%d;%d;%s", sender_ip_address, sender_port, msg_type, msg);
+        size_t length;
+        return to_bytes(&length);
+    }
+
+    // Same as to_string(), but sets length to the length of the result,
+    // which may contain NULs if the body does
+    char* to_bytes(size_t* length) {
+        Buffer out(64 + msg_len);
+        write_header(out);
+        out.append(msg, msg_len);
+
+        *length = out.size();
+        return out.take();
+    }
+
+    // Appends [SENDER IP ADDRESS]:[SENDER PORT];[MESSAGE TYPE]; to out
+    void write_header(Buffer& out) {
+        out.append(sender_ip_address);
+        out.append(':');
+        out.append_int(sender_port);
+        out.append(';');
+        out.append_int(msg_type);
+        out.append(';');
+    }
+};
+
+/*************************************************************************
+ * MessageBody::
+ * More of a Message's body, written to the connection after the body the
+ * Message holds as it is produced, rather than built in memory first. The
+ * receiver gets one Message with both as its body. Its size must be known
+ * before it is written.
+ */
+class MessageBody {
+   public:
+    virtual ~MessageBody() {}
+
+    // Number of bytes write_to() writes
+    virtual size_t size() = 0;
+
+    // Writes the body to sink
+    virtual void write_to(Sink* sink) = 0;
+};
+
+/*************************************************************************
+ * BytesBody::
+ * A MessageBody of bytes the caller keeps alive until it is written, so
+ * they are sent without being copied.
+ */
+class BytesBody : public MessageBody {
+   public:
+    const char* bytes;
+    size_t len;
+
+    BytesBody(const char* bytes, size_t len) {
+        this->bytes = bytes;
+        this->len = len;
+    }
+
+    size_t size() { return len; }
 
-        assert(string[buf_size-1] == '\0');
-        return string;
+    void write_to(Sink* sink) {
+        sink->append(bytes, len);
     }
 };
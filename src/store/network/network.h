@@ -7,14 +7,19 @@
 #include <poll.h>
 //#include <stropts.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "../../utils/helper.h"
+#include "../../utils/metrics.h"
 #include "../../utils/string.h"
 #include "message.h"
 
 #define MAX_MESSAGE_CHUNK_SIZE 512
 #define LISTEN_TIMEOUT 200
 #define MAX_INCOMING_CONNECTIONS 20
+// Bytes read at a time for the size and header of a message, which are
+// rarely more than 40
+#define MESSAGE_HEADER_PIECE_SIZE (size_t)64
 
 /*
     Network wraps important network functionality into helpful methods.
@@ -26,12 +31,14 @@ class Network {
     size_t listen_timeout;
     size_t max_incoming_connections;
     Sys* sys;  // helper
+    Metrics* metrics;  // external; counts bytes sent and received, if set
 
     Network() {
         max_message_chunk_size = MAX_MESSAGE_CHUNK_SIZE;
         listen_timeout = LISTEN_TIMEOUT;
         max_incoming_connections = MAX_INCOMING_CONNECTIONS;
         sys = new Sys();
+        metrics = nullptr;
     }
 
     ~Network() {
@@ -113,12 +120,13 @@ class Network {
     }
 
     // Sends the given message to the given ip_address/port and returns the response
-    Message* send_and_receive_msg(Message* msg, char* target_ip_address, int target_port) {
+    // The message's body is followed by the given body, if any
+    Message* send_and_receive_msg(Message* msg, char* target_ip_address, int target_port, MessageBody* body = nullptr) {
         // Connect to target
         int sock = connect_to_(target_ip_address, target_port);
 
         // Write and read
-        write_msg(sock, msg);
+        write_msg(sock, msg, body);
         Message* response = read_msg(sock);
 
         close(sock);
@@ -129,21 +137,14 @@ class Network {
     // Reads a Message from the given socket
     // Socket should be open and read-ready, else this call hangs.
     Message* read_msg(int socket) {
-        char* msg_string = read_from_socket_(socket);
-        Message* msg = new Message(msg_string);
-        delete[] msg_string;
-
-        return msg;
+        return read_from_socket_(socket);
     }
 
-    // Writes the given Message to the given socket
+    // Writes the given Message to the given socket, followed by the given
+    // body, if any, as the rest of the message's body
     // Socket should be open and write-ready, else this call hangs
-    void write_msg(int socket, Message* msg) {
-        char* msg_string = msg->to_string();
-
-        write_to_socket_(socket, msg_string);
-
-        delete[] msg_string;
+    void write_msg(int socket, Message* msg, MessageBody* body = nullptr) {
+        write_to_socket_(socket, msg, body);
     }
 
     // Checks for incoming connections on the given socket that are ready to be read from.
@@ -172,53 +173,110 @@ class Network {
         return -1;
     }
 
-    // Reads a size_t from the socket, and then reads that many bytes more from the socket.
-    char* read_from_socket_(int socket) {
+    // Reads a size_t from the socket, and then a Message of that many bytes.
+    // The size and header are read through a small piece, and the body
+    // straight into the Message, but for the few bytes of it that arrive
+    // in the same pieces as the header. The body is NUL-terminated but may
+    // also contain NULs.
+    Message* read_from_socket_(int socket) {
         size_t msg_size = 0;
-
-        if (read(socket, &msg_size, sizeof(size_t)) < (long) sizeof(size_t)) {
-            perror("ERROR reading msg size from socket\n");
+        FdSource source(socket, sizeof(size_t), MESSAGE_HEADER_PIECE_SIZE);
+        if (source.read(&msg_size, sizeof(size_t)) < sizeof(size_t)) {
+            printf("ERROR reading msg size from socket\n");
             exit(1);
         }
-
-        char* msg = new char[msg_size + 1];
-        msg[msg_size] = '\0';
-        
-        size_t bytes_read = 0;
-        while (bytes_read < msg_size) {
-            size_t new_bytes_read = read(socket, msg + bytes_read, msg_size - bytes_read);
-
-            if (new_bytes_read < 0) {
-                printf("ERROR reading from socket");
-                exit(1);
-            } else if (new_bytes_read == 0) {
-                printf("ERROR: read_from_socket got EOF before receiving all expected data. Expected %zu bytes. Got %zu with contents %s\n",
-                            msg_size, bytes_read, msg);
+        source.remaining += msg_size;
+
+        // The header is [SENDER IP ADDRESS]:[SENDER PORT];[MESSAGE TYPE];
+        Buffer header;
+        Buffer token;
+        for (size_t i = 0; i < 2; i++) {
+            if (source.read_token(token, ";") < 0) {
+                printf("ERROR: read_from_socket got a message without a header\n");
                 exit(1);
             }
-
-            bytes_read += new_bytes_read;
+            header.append(token.buf, token.size());
+            header.append(';');
         }
 
-        assert(strlen(msg) == msg_size);
-        assert(msg[msg_size] == '\0');
-        return msg;
+        size_t body_len = msg_size - header.size();
+        char* body = new char[body_len + 1];
+        source.read(body, body_len);
+        body[body_len] = '\0';
+
+        if (metrics != nullptr) {
+            metrics->bytes_received.add(sizeof(size_t) + msg_size);
+        }
+        return new Message(header.buf, body, body_len);
     }
 
-    // Writes given message to the given socket.
-    // First writes a size_t with the length of the message, then writes the message
-    void write_to_socket_(int socket, char* msg_to_send) {
-        size_t length = strlen(msg_to_send);
+    // Writes the given message to the given socket, followed by the given
+    // body, if any. First writes a size_t with the length of the message,
+    // then the message. A message wholly in memory is written as it lies,
+    // in one call. One with a body is written a piece at a time, so the
+    // body is sent as it is produced and nothing is copied whole.
+    void write_to_socket_(int socket, Message* msg, MessageBody* body) {
+        Buffer header;
+        msg->write_header(header);
+        size_t body_len = body == nullptr ? 0 : body->size();
+        size_t length = header.size() + msg->msg_len + body_len;
+
+        if (body == nullptr) {
+            struct iovec parts[3];
+            parts[0].iov_base = &length;
+            parts[0].iov_len = sizeof(size_t);
+            parts[1].iov_base = header.buf;
+            parts[1].iov_len = header.size();
+            parts[2].iov_base = msg->msg;
+            parts[2].iov_len = msg->msg_len;
+            write_all_(socket, parts, 3);
+        } else {
+            FdSink sink(socket, piece_size_(sizeof(size_t) + length));
+            sink.append((char*)&length, sizeof(size_t));
+            sink.append(header.buf, header.size());
+            sink.append(msg->msg, msg->msg_len);
+            body->write_to(&sink);
+            sink.flush();
+
+            if (sink.written != sizeof(size_t) + length) {
+                printf("ERROR: A message body of %zu bytes wrote %zu\n", body_len,
+                       sink.written - sizeof(size_t) - header.size() - msg->msg_len);
+                exit(1);
+            }
+        }
+        if (metrics != nullptr) {
+            metrics->bytes_sent.add(sizeof(size_t) + length);
+        }
+    }
 
-        if (write(socket, &length, sizeof(size_t)) < (long) sizeof(size_t)) {
-            printf("ERROR writing msg size to socket. Full message was %s\n", msg_to_send);
-            exit(1);
-        };
+    // Bytes to write a message of length bytes at a time: all of it, up to
+    // STREAM_PIECE_SIZE
+    size_t piece_size_(size_t length) {
+        return length < STREAM_PIECE_SIZE ? length + 1 : STREAM_PIECE_SIZE;
+    }
 
-        if (write(socket, msg_to_send, strlen(msg_to_send)) < (long) strlen(msg_to_send)) {
-            printf("ERROR writing msg to socket. Full message was %s\n", msg_to_send);
-            exit(1);
-        };
+    // Writes all the bytes of the given parts to the given socket, carrying
+    // on where the kernel takes only some of them
+    void write_all_(int socket, struct iovec* parts, int num_parts) {
+        while (num_parts > 0) {
+            ssize_t sent = writev(socket, parts, num_parts);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                printf("ERROR writing to socket %d\n", socket);
+                exit(1);
+            }
+            while (num_parts > 0 && (size_t)sent >= parts[0].iov_len) {
+                sent -= parts[0].iov_len;
+                parts++;
+                num_parts--;
+            }
+            if (num_parts > 0) {
+                parts[0].iov_base = (char*)parts[0].iov_base + sent;
+                parts[0].iov_len -= sent;
+            }
+        }
     }
 
     // Returns a socket connected to the given IP address and port
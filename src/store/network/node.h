@@ -43,6 +43,7 @@ class Node {
     std::atomic<bool> done;              
     Serializer *serializer;
     std::mutex known_nodes_lock;
+    Metrics *metrics;  // What this node has been doing
 
     Node(char *my_ip_address, int my_port, char *server_ip_address, int server_port) {
         this->my_ip_address = my_ip_address;
@@ -56,9 +57,11 @@ class Node {
         shutting_down = false;
         done = false;
         serializer = new Serializer();
+        metrics = new Metrics();
+        network->metrics = metrics;
     }
 
-    ~Node() {
+    virtual ~Node() {
         if (listener && listener->joinable()) {
             // object is being destroyed before a shutdown signal from the server
             // Making sure to cleanup listener thread
@@ -81,6 +84,7 @@ class Node {
         delete listener;
         delete network;
         delete serializer;
+        delete metrics;
     }
 
     // Sends the given message to the given target
@@ -88,14 +92,24 @@ class Node {
     // Caller is responsible for deleting returned Message object.
     // Returns nullptr if this method is called before node is registered.
     Message *send_msg(char *target_ip_address, int target_port, MessageType msg_type, char *msg_contents) {
+        return send_msg(target_ip_address, target_port, msg_type, msg_contents, strlen(msg_contents));
+    }
+
+    // Same as above, but the contents are the given number of bytes and may
+    // contain NULs. They are followed by the given body, if any, written as
+    // it is produced.
+    Message *send_msg(char *target_ip_address, int target_port, MessageType msg_type, const char *msg_contents, size_t msg_len,
+                      MessageBody *body = nullptr) {
         if (!registered) {
             printf("ERROR: cannot send message as node is unregistered.\n");
             exit(0);
         }
 
-        Message msg(my_ip_address, my_port, msg_type, msg_contents);
+        Message msg(my_ip_address, my_port, msg_type, msg_contents, msg_len);
 
-        Message *response = network->send_and_receive_msg(&msg, target_ip_address, target_port);
+        metrics->messages_sent.add();
+        LatencyTimer timer(&metrics->rpc_nanos);
+        Message *response = network->send_and_receive_msg(&msg, target_ip_address, target_port, body);
 
         return response;
     }
@@ -160,6 +174,7 @@ class Node {
 
             // msg should never be null
             Message *msg = network->read_msg(connection);
+            metrics->messages_received.add();
 
             if (msg->msg_type == DIRECTORY) {
                 // Node got a directory update from the server
@@ -0,0 +1,232 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+
+#include "../utils/object.h"
+#include "../utils/slab.h"
+#include "key.h"
+#include "value.h"
+
+// Default number of bytes of values a Store caches from other nodes
+#define REMOTE_CACHE_DEFAULT_BYTES ((size_t)64 << 20)
+#define REMOTE_CACHE_MIN_BUCKETS (size_t)64
+
+/*************************************************************************
+ * CacheEntry::
+ * A value cached by a RemoteCache, linked into its bucket's chain and into
+ * the cache's list of entries from most to least recently used. Entries
+ * come from the global SlabAllocator, like the keys and values they hold.
+ */
+class CacheEntry : public Object {
+   public:
+    Key* key;            // owned
+    Value* value;        // one reference owned
+    uint64_t version;    // Version of value on its home node
+    CacheEntry* chain;   // Next entry in the same bucket
+    CacheEntry* newer;   // Neighbours in the LRU list
+    CacheEntry* older;
+
+    CacheEntry(Key* key, Value* value, uint64_t version) {
+        this->key = key->clone();
+        this->value = value->retain();
+        this->version = version;
+        chain = nullptr;
+        newer = nullptr;
+        older = nullptr;
+    }
+
+    ~CacheEntry() {
+        delete key;
+        value->release();
+    }
+
+    static void* operator new(size_t size) {
+        return SlabAllocator::global()->alloc(size);
+    }
+
+    static void operator delete(void* ptr, size_t size) {
+        SlabAllocator::global()->free(ptr, size);
+    }
+};
+
+/*************************************************************************
+ * RemoteCache::
+ * Values this node got from other nodes that their home nodes sealed, so
+ * later gets of them need not go over the network again. Holds at most
+ * capacity bytes of values, dropping the least recently used first.
+ * A sealed key that is put again gets a new version, and its home node
+ * sends every node an invalidation, which drops cached versions older than
+ * the new one. Since a reply may cross an invalidation on the way, callers
+ * read epoch() before asking the home node and pass it to put(), which
+ * skips caching if any invalidation arrived in between. Thread safe.
+ */
+class RemoteCache : public Object {
+   public:
+    std::mutex lock;
+    CacheEntry** buckets;  // owned
+    size_t num_buckets;    // A power of two
+    size_t count;
+    size_t bytes;          // Bytes of values cached
+    size_t capacity;       // Most bytes of values to cache; 0 caches nothing
+    CacheEntry* newest;    // Ends of the LRU list
+    CacheEntry* oldest;
+    uint64_t epoch_;       // Number of invalidations received
+
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+
+    RemoteCache(size_t capacity) {
+        num_buckets = REMOTE_CACHE_MIN_BUCKETS;
+        buckets = new CacheEntry*[num_buckets]();
+        count = 0;
+        bytes = 0;
+        this->capacity = capacity;
+        newest = nullptr;
+        oldest = nullptr;
+        epoch_ = 0;
+        hits = 0;
+        misses = 0;
+        evictions = 0;
+    }
+
+    ~RemoteCache() {
+        while (oldest != nullptr) {
+            remove_(oldest);
+        }
+        delete[] buckets;
+    }
+
+    CacheEntry** bucket_(Key* key) {
+        return &buckets[(size_t)key->get_id() & (num_buckets - 1)];
+    }
+
+    CacheEntry* find_(Key* key) {
+        for (CacheEntry* e = *bucket_(key); e != nullptr; e = e->chain) {
+            if (e->key->get_id() == key->get_id() && e->key->equals(key)) {
+                return e;
+            }
+        }
+        return nullptr;
+    }
+
+    void unlink_lru_(CacheEntry* e) {
+        if (e->newer != nullptr) e->newer->older = e->older; else newest = e->older;
+        if (e->older != nullptr) e->older->newer = e->newer; else oldest = e->newer;
+        e->newer = nullptr;
+        e->older = nullptr;
+    }
+
+    void push_newest_(CacheEntry* e) {
+        e->older = newest;
+        if (newest != nullptr) newest->newer = e; else oldest = e;
+        newest = e;
+    }
+
+    // Unlinks and deletes the given entry
+    void remove_(CacheEntry* e) {
+        CacheEntry** link = bucket_(e->key);
+        while (*link != e) {
+            link = &(*link)->chain;
+        }
+        *link = e->chain;
+        unlink_lru_(e);
+        bytes -= e->value->size();
+        count--;
+        delete e;
+    }
+
+    // Doubles the number of buckets once there are more entries than buckets
+    void grow_() {
+        CacheEntry** old_buckets = buckets;
+        size_t old_num_buckets = num_buckets;
+        num_buckets *= 2;
+        buckets = new CacheEntry*[num_buckets]();
+        for (size_t i = 0; i < old_num_buckets; i++) {
+            CacheEntry* e = old_buckets[i];
+            while (e != nullptr) {
+                CacheEntry* next = e->chain;
+                CacheEntry** b = bucket_(e->key);
+                e->chain = *b;
+                *b = e;
+                e = next;
+            }
+        }
+        delete[] old_buckets;
+    }
+
+    // Returns the cached value of key with a reference added for the
+    // caller, or nullptr
+    Value* get(Key* key) {
+        std::lock_guard<std::mutex> lck(lock);
+        CacheEntry* e = find_(key);
+        if (e == nullptr) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        unlink_lru_(e);
+        push_newest_(e);
+        return e->value->retain();
+    }
+
+    // Number of invalidations so far. Read before asking for a value.
+    uint64_t epoch() {
+        std::lock_guard<std::mutex> lck(lock);
+        return epoch_;
+    }
+
+    // Caches the given version of key's value, adding a reference of its
+    // own, unless an invalidation arrived since epoch was read or the value
+    // could never fit
+    void put(Key* key, Value* value, uint64_t version, uint64_t epoch) {
+        std::lock_guard<std::mutex> lck(lock);
+        if (epoch != epoch_ || value->size() > capacity) {
+            return;
+        }
+
+        CacheEntry* e = find_(key);
+        if (e != nullptr) {
+            remove_(e);
+        }
+        while (bytes + value->size() > capacity) {
+            remove_(oldest);
+            evictions++;
+        }
+
+        e = new CacheEntry(key, value, version);
+        CacheEntry** b = bucket_(key);
+        e->chain = *b;
+        *b = e;
+        push_newest_(e);
+        bytes += value->size();
+        count++;
+        if (count > num_buckets) {
+            grow_();
+        }
+    }
+
+    // Drops key's value if it is older than the given version
+    void invalidate(Key* key, uint64_t version) {
+        std::lock_guard<std::mutex> lck(lock);
+        epoch_++;
+        CacheEntry* e = find_(key);
+        if (e != nullptr && e->version < version) {
+            remove_(e);
+        }
+    }
+
+    // Changes the most bytes to cache, dropping values to fit
+    void set_capacity(size_t capacity) {
+        std::lock_guard<std::mutex> lck(lock);
+        this->capacity = capacity;
+        while (bytes > capacity) {
+            remove_(oldest);
+            evictions++;
+        }
+    }
+};
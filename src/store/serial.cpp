@@ -7,194 +7,188 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "../utils/arena.h"
 #include "../utils/array.h"
+#include "../utils/buffer.h"
+#include "../utils/bitmap.h"
 #include "../utils/helper.h"
+#include "../utils/sketch.h"
+#include "../utils/stream.h"
 #include "dataframe/dataframe.h"
 #include "store.cpp"
+#include "chunk.h"
+#include "chunk_view.h"
+#include "codec.h"
 #include "dataframe/schema.h"
 #include "network/message.h"
 
 // Serialize a DistributedDataFrame into char*
 // Creates char* with format: 
 // "[Serialized Schema]~[Serialized Column 0]~ ... ~[Serialized Column n-1]"
+// Works out the exact length first and writes every column straight into
+// one buffer, so the time taken is linear in the number of chunk keys.
 char* Serializer::serialize_distributed_dataframe(DistributedDataFrame* df) { 
-    // Track total buffer size we need
-    size_t total_str_size = 0;
+    size_t total_len = distributed_dataframe_len(df);
+    if (total_len == 0) {
+        // DF has no columns and no schema
+        return nullptr;
+    }
+
+    Buffer out(total_len);
+    write_distributed_dataframe_(df, out);
+    return out.take();
+}
 
-    // Serialize schema
+// Length of df serialized by serialize_distributed_dataframe(), not
+// counting the NUL, or 0 if it has no columns
+size_t Serializer::distributed_dataframe_len(DistributedDataFrame* df) {
     char* schema_str = serialize_schema(&df->get_schema());
     if (schema_str == nullptr) {
-        // DF has no columns and no schema
-        return nullptr;
+        return 0;
     }
-    total_str_size += strlen(schema_str);
 
-    // Serialize all columns
     size_t cols = df->ncols();
-    char** col_strs = new char*[cols];
+    size_t total_len = strlen(schema_str) + cols;  // a tilda before each column
+    delete[] schema_str;
     for (size_t i = 0; i < cols; i++) {
-        col_strs[i] = serialize_dist_col(dynamic_cast<DistributedColumn*>(df->columns[i]));
-        total_str_size += strlen(col_strs[i]) + 1;  // +1 for tilda below
+        total_len += dist_col_len_(dynamic_cast<DistributedColumn*>(df->columns[i]));
     }
+    return total_len;
+}
 
-    // Combine all serialized pieces into one char*
-    total_str_size += 1; // for null terminator
-    char* serial_buffer = new char[total_str_size];
-
-    // Copy schema and column strings into buffer
-    strcpy(serial_buffer, schema_str);  
-    strcat(serial_buffer, "~");
+// Writes df serialized by serialize_distributed_dataframe() to the sink,
+// a piece at a time, and flushes it. Writes nothing if df has no columns.
+void Serializer::serialize_distributed_dataframe(DistributedDataFrame* df, Sink* sink) {
+    write_distributed_dataframe_(df, *sink);
+    sink->flush();
+}
 
-    // Add serialized column messages to buffer, delimeted by "~"
-    for (size_t j = 0; j < cols; j++) {
-        strcat(serial_buffer, col_strs[j]);
-        // Do not append "~" after last column string
-        if (j != cols - 1) {
-            strcat(serial_buffer, "~");
-        }
-        delete[] col_strs[j];
+// Appends df serialized by serialize_distributed_dataframe() to out, a
+// Buffer or a Sink
+template <class Out>
+void Serializer::write_distributed_dataframe_(DistributedDataFrame* df, Out& out) {
+    char* schema_str = serialize_schema(&df->get_schema());
+    if (schema_str == nullptr) {
+        return;
     }
-
-    delete[] col_strs;
+    out.append(schema_str);
     delete[] schema_str;
 
-    return serial_buffer;
+    // Add serialized columns, delimeted by "~"
+    for (size_t i = 0; i < df->ncols(); i++) {
+        out.append('~');
+        write_dist_col_(dynamic_cast<DistributedColumn*>(df->columns[i]), out);
+    }
 }
 
 // Deserialize a char* buffer into a DistributedDataFrame object
 // Expects given msg to have the form:
 // "[Serialized Schema]~[Serialized Dist_Column 0]~[...]~[Serialized Dist_Column n-1]"
+// Does not modify msg.
 DistributedDataFrame* Serializer::deserialize_distributed_dataframe(char* msg, Store* store) { 
-    if (msg == nullptr) {
-        // empty DDF
-        Schema empty_schema;
-        return new DistributedDataFrame(store, empty_schema);
-    }
-    
-    char* entry;
-    char* schema_token = strtok_r(msg, "~", &entry);
-    char* columns_token = strtok_r(nullptr, "\0", &entry);
-    Schema* schema = deserialize_schema(schema_token);
-
-    // Create array of serialized cols (distinct strings for each col)
-    char* serialized_cols[schema->width()];
-    if (!(schema->width() > 0)) {
-        return new DistributedDataFrame(store, *schema);
-    }
-   
-    serialized_cols[0] = strtok_r(columns_token, "~", &entry);
-    for (size_t i = 1; i < schema->width(); i++) {
-        serialized_cols[i] = strtok_r(nullptr, "~", &entry);
-    }
+    ArraySource source(msg, msg == nullptr ? 0 : strlen(msg));
+    return deserialize_distributed_dataframe(&source, store);
+}
 
+// Same as above, but reads the frame from source, to its end
+DistributedDataFrame* Serializer::deserialize_distributed_dataframe(Source* source, Store* store) {
     Schema empty_schema;
     // Initialize empty dataframe
     DistributedDataFrame* df = new DistributedDataFrame(store, empty_schema);
 
-    // Deserialize all serialized cols into real columns
-    for (size_t i = 0; i < schema->width(); i++) {
-        char type = schema->col_type(i);
-        if (type == INT_TYPE) {
-            DistributedIntColumn* d_i = deserialize_dist_int_col(serialized_cols[i], store);
-            df->add_column(d_i);
-            delete d_i;
-        } else if (type == BOOL_TYPE) {
-            DistributedBoolColumn* d_b = deserialize_dist_bool_col(serialized_cols[i], store);
-            df->add_column(d_b);
-            delete d_b;
-        } else if (type == FLOAT_TYPE) {
-            DistributedFloatColumn* d_f = deserialize_dist_float_col(serialized_cols[i], store);
-            df->add_column(d_f);
-            delete d_f;
-        } else {
-            DistributedStringColumn* d_s = deserialize_dist_string_col(serialized_cols[i], store);
-            df->add_column(d_s);
-            delete d_s;
-        }
+    // Copy each column into the new frame, so it has chunks of its own
+    size_t num_cols;
+    DistributedColumn** cols = deserialize_dist_columns(source, store, &num_cols);
+    for (size_t i = 0; i < num_cols; i++) {
+        df->add_column(cols[i]);
+        delete cols[i];
     }
-    delete schema;
+    delete[] cols;
     return df;
 }
 
+// Deserializes the columns of a serialized DistributedDataFrame, without
+// copying them: the columns refer to the same chunk keys as the frame.
+// Returns a new array of num_cols new columns, which may be empty.
+// Expects the same msg as deserialize_distributed_dataframe(), or nullptr.
+DistributedColumn** Serializer::deserialize_dist_columns(char* msg, Store* store, size_t* num_cols) {
+    ArraySource source(msg, msg == nullptr ? 0 : strlen(msg));
+    return deserialize_dist_columns(&source, store, num_cols);
+}
+
+// Same as above, but reads the frame from source, to its end. Only one
+// key is held at a time besides the columns built.
+DistributedColumn** Serializer::deserialize_dist_columns(Source* source, Store* store, size_t* num_cols) {
+    *num_cols = 0;
+    Buffer token;
+    if (source->read_token(token, "~") < 0 && token.size() == 0) {
+        // empty DDF
+        return new DistributedColumn*[0];
+    }
+    Schema* schema = deserialize_schema(token.buf);
+
+    // Deserialize all serialized cols into real columns; each reads up to
+    // the '~' before the next
+    size_t width = schema->width();
+    DistributedColumn** cols = new DistributedColumn*[width];
+    for (size_t i = 0; i < width; i++) {
+        cols[i] = read_dist_col_(source, store, schema->col_type(i), token);
+    }
+    *num_cols = width;
+    delete schema;
+    return cols;
+}
+
 // Serializes a Distributed Column
 // Treats a DistColumn as a set of chunk Keys and a set of Missing keys
 // As such, creates msg with format:
 // "[Serialized length];[Serialized num_chunks];[Serialized chunk Key 1];[Serialized missing Key 1];...;[Serialized chunk key (num_chunks - 1)];[Serialized missing key (num_chunks - 1)]
 char* Serializer::serialize_dist_col(DistributedColumn* col) {
-    size_t num_keys = col->num_chunks;
-
-    // Will have a char* for each value. Track them separately
-    //  because we do not know their size
-    char** chunk_key_strings = new char*[num_keys];
-    char** missing_key_strings = new char*[num_keys];
-
-    size_t i;
-    size_t total_size = 0;
-
-    char* ser_length = serialize_size_t(col->size());
-    char* ser_num_chunks = serialize_size_t(col->num_chunks);
-
-    total_size += strlen(ser_length);
-    total_size += strlen(ser_num_chunks);
-
-    // For all key-values, serialize and add to key string tracker arrays
-    for (i = 0; i < num_keys; i++) {
-        chunk_key_strings[i] = serialize_key(col->chunk_keys[i]);
-        missing_key_strings[i] = serialize_key(col->missings_keys[i]);
+    Buffer out(dist_col_len_(col));
+    write_dist_col_(col, out);
+    return out.take();
+}
 
-        // Track (a slight over-estimate due to null terminators) total
-        // size required for message
-        total_size += strlen(chunk_key_strings[i]);
-        total_size += strlen(missing_key_strings[i]);
+// Length of col serialized by serialize_dist_col(), not counting the NUL
+size_t Serializer::dist_col_len_(DistributedColumn* col) {
+    size_t len = Buffer::digits(col->size()) + 1 + Buffer::digits(col->num_chunks);
+    for (size_t i = 0; i < col->num_chunks; i++) {
+        len += 1 + key_len_(col->chunk_keys[i]) + 1 + key_len_(col->missings_keys[i]);
     }
+    return len;
+}
 
-    // need space for null terminator and all semicolons
-    total_size += 2*num_keys + 3;
-    char* serial_buffer = new char[total_size];
-    if (total_size == 1) {  // Empty case
-        strcpy(serial_buffer, "\0");
-    } else {
-        strcpy(serial_buffer, ser_length);
-        strcat(serial_buffer, ";");
-        strcat(serial_buffer, ser_num_chunks);
-        strcat(serial_buffer, ";");
-
-        // Copy all key-strings in to one buffer
-        strcat(serial_buffer, chunk_key_strings[0]);
-        strcat(serial_buffer, ";"); 
-        strcat(serial_buffer, missing_key_strings[0]);
-
-        delete[] chunk_key_strings[0];
-        delete[] missing_key_strings[0];
-        for (i = 1; i < num_keys; i++) {
-            strcat(serial_buffer, ";"); 
-            strcat(serial_buffer, chunk_key_strings[i]);
-            strcat(serial_buffer, ";");  
-            strcat(serial_buffer, missing_key_strings[i]);
-            delete[] chunk_key_strings[i];
-            delete[] missing_key_strings[i];
-
-        }
+// Appends col serialized by serialize_dist_col() to out, a Buffer or a Sink
+template <class Out>
+void Serializer::write_dist_col_(DistributedColumn* col, Out& out) {
+    out.append_size_t(col->size());
+    out.append(';');
+    out.append_size_t(col->num_chunks);
+    for (size_t i = 0; i < col->num_chunks; i++) {
+        out.append(';');
+        write_key_(col->chunk_keys[i], out);
+        out.append(';');
+        write_key_(col->missings_keys[i], out);
     }
-
-    delete[] ser_length;
-    delete[] ser_num_chunks;
-    delete[] missing_key_strings;
-    delete[] chunk_key_strings;
-    return serial_buffer;
 }
 
 // Deserialize a char* msg into a DistributedColumn 
 // Expects msg with format: 
 // "[Serialized length];[Serialized num_chunks];[Serialized chunk Key 1];[Serialized missing Key 1];...;[Serialized chunk key (num_chunks - 1)];[Serialized missing key (num_chunks - 1)]
 DistributedColumn* Serializer::deserialize_dist_col(char* msg, Store* store, char col_type) { 
-    char* entry;
-    char* ser_length = strtok_r(msg, ";", &entry);
-    char* ser_num_chunks = strtok_r(nullptr, ";", &entry);
-    char* ser_keys = strtok_r(nullptr, "\0", &entry);
+    ArraySource source(msg, strlen(msg));
+    Buffer token;
+    return read_dist_col_(&source, store, col_type, token);
+}
 
-    size_t length = deserialize_size_t(ser_length);
-    size_t num_chunks = deserialize_size_t(ser_num_chunks);
+// Reads a column serialized by serialize_dist_col() from source, up to the
+// '~' after it or the end of the source. Each field is read into token in
+// turn, so a column of any number of chunks is read with one key's room.
+DistributedColumn* Serializer::read_dist_col_(Source* source, Store* store, char col_type, Buffer& token) {
+    source->read_token(token, ";~");
+    size_t length = deserialize_size_t(token.buf);
+    source->read_token(token, ";~");
+    size_t num_chunks = deserialize_size_t(token.buf);
 
     // Key arrays that column will take ownership of, dont delete here!
     Key** chunk_keys = new Key*[num_chunks];
@@ -202,20 +196,13 @@ DistributedColumn* Serializer::deserialize_dist_col(char* msg, Store* store, cha
 
     // num_chunks should never be 0... so we dont need to handle empty case
 
-    char* chunk_tokens[num_chunks];
-    char* missings_tokens[num_chunks];
-    // Get all tokens first, because calling deserialize does weird things to token
-    chunk_tokens[0] = strtok_r(ser_keys, ";", &entry);
-    missings_tokens[0] = strtok_r(nullptr, ";", &entry);
-    for (size_t i = 1; i < num_chunks; i++) {
-        chunk_tokens[i] = strtok_r(nullptr, ";", &entry);
-        missings_tokens[i] = strtok_r(nullptr, ";", &entry);
-    }
-    
-    // Deserialize into chunk and missing keys
+    // deserialize_key only splits up the token it is given, so keys are
+    // read as they come
     for (size_t i = 0; i < num_chunks; i++) {
-        chunk_keys[i] = deserialize_key(chunk_tokens[i]);
-        missings_keys[i] = deserialize_key(missings_tokens[i]);
+        source->read_token(token, ";~");
+        chunk_keys[i] = deserialize_key(token.buf);
+        source->read_token(token, ";~");
+        missings_keys[i] = deserialize_key(token.buf);
     }
 
     DistributedColumn* dc;
@@ -338,35 +325,56 @@ String* Serializer::deserialize_string(char* msg) {
 }
 
 // Serialize pointer to Key* object
-// Creates form "[serialized Key name],[serialized Key home_node]"
+// Creates form "[serialized Key name],[serialized Key home_node]", followed by
+// ",[serialized Key replicas]" if the key is replicated
 char* Serializer::serialize_key(Key* value) {
-    char* data;
-    // Handle nullptr case --> return "\0"
+    Buffer out(key_len_(value));
+    write_key_(value, out);
+    return out.take();
+}
+
+// Length of value serialized by serialize_key(), not counting the NUL
+size_t Serializer::key_len_(Key* value) {
+    // Handle nullptr case --> ""
     if (nullptr == value) {
-        data = new char[1];
-        data[0] = '\0';
-        return data;
+        return 0;
+    }
+    size_t len = strlen(value->get_name()) + 1 + Buffer::digits(value->get_home_node());
+    if (value->replicas > 1) {
+        len += 1 + Buffer::digits(value->replicas);
+    }
+    return len;
+}
+
+// Appends value serialized by serialize_key() to out, a Buffer or a Sink
+template <class Out>
+void Serializer::write_key_(Key* value, Out& out) {
+    if (nullptr == value) {
+        return;
+    }
+    out.append(value->get_name());
+    out.append(',');
+    out.append_size_t(value->get_home_node());
+    if (value->replicas > 1) {
+        out.append(',');
+        out.append_size_t(value->replicas);
     }
-    // Do a fake write to check how much space we need
-    size_t name_buf_size = snprintf(nullptr, 0, "%s", value->get_name()) + 1;
-    char* serialized_home_node = serialize_size_t(value->get_home_node());
-    size_t node_buf_size = snprintf(nullptr, 0, "%s", serialized_home_node) + 1;
-    data = new char[name_buf_size + node_buf_size + 1];  // + 1 for comma
-    strcpy(data, value->get_name());
-    strcat(data, ",");
-    strcat(data, serialized_home_node);
-    delete[] serialized_home_node;
-    return data;
 }
 
 // Deserialize a char* into a Key object
-// Expects char* form of "[serialized Key name],[serialized Key home_node]"
+// Expects char* form of "[serialized Key name],[serialized Key home_node]",
+// optionally followed by ",[serialized Key replicas]"
 Key* Serializer::deserialize_key(char* msg) {
     char* entry;
     char* name_token = strtok_r(msg, ",", &entry);  // Get first val before ,
     char* node_token = strtok_r(nullptr, ",", &entry);
+    char* replicas_token = strtok_r(nullptr, ",", &entry);
     size_t node_id = deserialize_size_t(node_token);
-    return new Key(name_token, node_id);
+    Key* key = new Key(name_token, node_id);
+    if (replicas_token != nullptr) {
+        key->set_replicas(deserialize_size_t(replicas_token));
+    }
+    return key;
 }
 
 // Serialize StringArray object
@@ -379,44 +387,24 @@ char* Serializer::serialize_string_array(StringArray* array) {
         return nullptr;
     }
 
-    // Will have a char* for each value. Track them separately
-    //  because we do not know their size
-    char** cell_strings = new char*[length];
-    size_t total_size = 0;
-    // For all cell-values, serialize and add to cell_strings
+    // Exact size pre-pass: every cell, with a comma between each two
+    size_t total_len = length - 1;
     for (size_t i = 0; i < length; i++) {
-        cell_strings[i] = serialize_string(array->get(i));
-
-        // Track (a slight over-estimate due to null terminators) total
-        // size required for message
-        if (cell_strings[i]) {
-            total_size += strlen(cell_strings[i]);
+        if (array->get(i) != nullptr) {
+            total_len += array->get(i)->size();
         }
     }
 
-    // size of cell char*s + (length - 1) commas + 1 for null terminator
-    total_size += length;
-    char* serial_buffer = new char[total_size];
-    serial_buffer[0] = '\0';
-
-    // Loop through serialized values and concat, adding
-    // commas between values and accounting for nullptrs
-    // No need for first call to be strcpy instead of strcat as we 
-    // set index 0 to be \0 explictly above.
+    Buffer out(total_len);
     for (size_t i = 0; i < length; i++) {
         if (i != 0) {
-            strcat(serial_buffer, ",");  // CSV
+            out.append(',');  // CSV
         }
-
-        if (cell_strings[i]) {
-            strcat(serial_buffer, cell_strings[i]);
+        if (array->get(i) != nullptr) {
+            out.append(array->get(i)->c_str(), array->get(i)->size());
         }
-
-        delete[] cell_strings[i];
     }
-
-    delete[] cell_strings;
-    return serial_buffer;
+    return out.take();
 }
 
 // Deserialize serialized message to a StringArray
@@ -507,202 +495,797 @@ bool Serializer::deserialize_bool(char* msg) {
     return false;
 }
 
-/* The following serialize methods serialize an array of primitives or Strings
- * into a c-style array of characters. Produces a message with form:
- * '[VALUE],[VALUE],...,[VALUE] */
-char* Serializer::serialize_bools(bool* bools, size_t num_values) {
-    char* data;
-    if (nullptr == bools) {
-        data = new char[1];
-        data[0] = '\0';
-        return data;
+// Appends the low bytes bytes of v to buf, little-endian
+static void append_le(Buffer* buf, uint64_t v, size_t bytes) {
+    char le[8];
+    for (size_t i = 0; i < bytes; i++) {
+        le[i] = (char)(v >> (8 * i));
     }
+    buf->append(le, bytes);
+}
 
-    size_t length = num_values;
+// Reads a little-endian integer of the given number of bytes
+static uint64_t load_le(const char* src, size_t bytes) {
+    const unsigned char* s = (const unsigned char*)src;
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        v |= (uint64_t)s[i] << (8 * i);
+    }
+    return v;
+}
 
-    // 1 char per bool, 1 per comma, 1 for null-terminator
-    size_t buf_size = (length * 2) + 1;
+// Serialize a Bitmap into a binary Value of the form
+//   4 bytes:   number of containers
+// then for each container:
+//   2 bytes:   its key
+//   1 byte:    'A' for an array container, 'B' for a bitset
+//   4 bytes:   number of bytes of its values
+//   values:    an array's 16-bit values or a bitset's 64-bit words
+// Every integer is little-endian, as in chunk.h, so bitmaps mean the same
+// on every node.
+Value* Serializer::serialize_bitmap(Bitmap* bitmap) {
+    size_t num_containers = bitmap->num_containers;
+
+    size_t len = 4;
+    for (size_t i = 0; i < num_containers; i++) {
+        BitmapContainer* c = bitmap->containers[i];
+        len += 7 + (c->is_bitset() ? BITMAP_BITSET_WORDS * 8 : c->cardinality * 2);
+    }
 
-    data = new char[buf_size];
-    char* bool_tokens[length];
-    for (size_t i = 0; i < length; i++) {
-        bool_tokens[i] = serialize_bool(bools[i]);
+    Buffer buf(len + 1);
+    append_le(&buf, num_containers, 4);
+    for (size_t i = 0; i < num_containers; i++) {
+        BitmapContainer* c = bitmap->containers[i];
+        append_le(&buf, c->key, 2);
+
+        if (c->is_bitset()) {
+            buf.append('B');
+            append_le(&buf, BITMAP_BITSET_WORDS * 8, 4);
+            for (size_t w = 0; w < BITMAP_BITSET_WORDS; w++) {
+                append_le(&buf, c->words[w], 8);
+            }
+        } else {
+            buf.append('A');
+            append_le(&buf, c->cardinality * 2, 4);
+            for (size_t j = 0; j < c->cardinality; j++) {
+                append_le(&buf, c->array[j], 2);
+            }
+        }
     }
 
-    strcpy(data, bool_tokens[0]);
-    
-    // Still need to delete initialized strings for each value
-    delete[] bool_tokens[0];
+    return Value::adopt(buf.take(), len);
+}
+
+// Deserialize a Value produced by serialize_bitmap into a Bitmap
+Bitmap* Serializer::deserialize_bitmap(Value* msg) {
+    Bitmap* bitmap = new Bitmap();
+    const char* pos = msg->data();
+
+    size_t num_containers = load_le(pos, 4);
+    pos += 4;
+    for (size_t i = 0; i < num_containers; i++) {
+        BitmapContainer* c = new BitmapContainer((uint16_t)load_le(pos, 2));
+        char kind = pos[2];
+        size_t payload_len = load_le(pos + 3, 4);
+        pos += 7;
+
+        if (kind == 'B') {
+            c->to_bitset_();
+            for (size_t w = 0; w < BITMAP_BITSET_WORDS; w++) {
+                c->words[w] = load_le(pos + w * 8, 8);
+            }
+            c->recount_();
+        } else {
+            size_t count = payload_len / 2;
+            c->grow_array_(count > 4 ? count : 4);
+            for (size_t j = 0; j < count; j++) {
+                c->array[j] = (uint16_t)load_le(pos + j * 2, 2);
+            }
+            c->cardinality = count;
+        }
+        pos += payload_len;
 
-    for (size_t i = 1; i < length; i++) {
-        strcat(data, ",");  // CSV
-        strcat(data, bool_tokens[i]);
-        delete[] bool_tokens[i];
+        bitmap->insert_container_(bitmap->num_containers, c);
     }
-    return data;
+
+    return bitmap;
 }
 
-char* Serializer::serialize_ints(int* ints, size_t num_values) {
-    char* data;
-    if (nullptr == ints) {
-        data = new char[1];
-        data[0] = '\0';
-        return data;
+// Serialize a Sketch into a char* message. The first token names the type:
+// HyperLogLog: "H;[precision];[registers]", 2 hex digits per register
+// CountMinSketch: "C;[width];[depth];[total];[counters]", counters in hex
+//   separated by commas, row by row
+// KllSketch: "Q;[k];[n];[num levels];[count]:[values];...", one token per
+//   level, each float written as the 8 hex digits of its bits
+char* Serializer::serialize_sketch(Sketch* sketch) {
+    char type = sketch->sketch_type();
+    Buffer out;
+    out.append(type);
+    out.append(';');
+
+    if (type == HLL_TYPE) {
+        HyperLogLog* hll = dynamic_cast<HyperLogLog*>(sketch);
+        out.reserve(Buffer::digits(hll->precision) + 1 + hll->num_registers * 2);
+        out.append_size_t(hll->precision);
+        out.append(';');
+        for (size_t i = 0; i < hll->num_registers; i++) {
+            out.append_hex(hll->registers[i], 2);
+        }
+        return out.take();
     }
 
-    size_t length = num_values;
-    size_t buf_size = length + 1;
-    char* int_tokens[length];
-    for (size_t i = 0; i < length; i++) {
-        int_tokens[i] = serialize_int(ints[i]);
-        buf_size += strlen(int_tokens[i]);
+    if (type == COUNT_MIN_TYPE) {
+        CountMinSketch* cms = dynamic_cast<CountMinSketch*>(sketch);
+        size_t num_counters = cms->width * cms->depth;
+        out.append_size_t(cms->width);
+        out.append(';');
+        out.append_size_t(cms->depth);
+        out.append(';');
+        out.append_size_t(cms->total);
+        out.append(';');
+        for (size_t i = 0; i < num_counters; i++) {
+            if (i > 0) {
+                out.append(',');
+            }
+            out.append_hex(cms->counters[i]);
+        }
+        return out.take();
     }
 
-    data = new char[buf_size];
-    strcpy(data, int_tokens[0]);
-
-    // Still need to delete initialized strings for each int
-    delete[] int_tokens[0];
-
-    for (size_t i = 1; i < length; i++) {
-        strcat(data, ",");  // CSV
-        strcat(data, int_tokens[i]);
-        delete[] int_tokens[i];
+    KllSketch* kll = dynamic_cast<KllSketch*>(sketch);
+    out.append_size_t(kll->k);
+    out.append(';');
+    out.append_size_t(kll->n);
+    out.append(';');
+    out.append_size_t(kll->num_levels);
+    for (size_t h = 0; h < kll->num_levels; h++) {
+        out.append(';');
+        out.append_size_t(kll->sizes[h]);
+        out.append(':');
+        for (size_t i = 0; i < kll->sizes[h]; i++) {
+            uint32_t bits;
+            memcpy(&bits, &kll->levels[h][i], sizeof(bits));
+            out.append_hex(bits, 8);
+        }
     }
-    return data;
+    return out.take();
 }
 
-char* Serializer::serialize_floats(float* floats, size_t num_values) {
-    char* data;
-    if (nullptr == floats) {
-        data = new char[1];
-        data[0] = '\0';
-        return data;
+// Deserialize a char* message produced by serialize_sketch into a new
+// sketch of the type it names
+Sketch* Serializer::deserialize_sketch(char* msg) {
+    char* entry;
+    char type = strtok_r(msg, ";", &entry)[0];
+    // Hex digits are parsed a fixed width at a time
+    char digits[9];
+
+    if (type == HLL_TYPE) {
+        HyperLogLog* hll = new HyperLogLog(deserialize_size_t(strtok_r(nullptr, ";", &entry)));
+        char* registers = strtok_r(nullptr, ";", &entry);
+        for (size_t i = 0; i < hll->num_registers; i++) {
+            memcpy(digits, registers + i * 2, 2);
+            digits[2] = '\0';
+            hll->registers[i] = (uint8_t)strtoul(digits, nullptr, 16);
+        }
+        return hll;
     }
 
-    size_t length = num_values;
-    size_t buf_size = length + 1;
-    char* float_tokens[length];
-    for (size_t i = 0; i < length; i++) {
-        float_tokens[i] = serialize_float(floats[i]);
-        buf_size += strlen(float_tokens[i]);
+    if (type == COUNT_MIN_TYPE) {
+        size_t width = deserialize_size_t(strtok_r(nullptr, ";", &entry));
+        size_t depth = deserialize_size_t(strtok_r(nullptr, ";", &entry));
+        CountMinSketch* cms = new CountMinSketch(width, depth);
+        cms->total = deserialize_size_t(strtok_r(nullptr, ";", &entry));
+
+        char* counters = strtok_r(nullptr, ";", &entry);
+        for (size_t i = 0; i < width * depth; i++) {
+            cms->counters[i] = strtoull(counters, &counters, 16);
+            counters++;  // skip the comma
+        }
+        return cms;
     }
 
-    data = new char[buf_size];
-    strcpy(data, float_tokens[0]);
-    
-    // Still need to delete initialized strings for each value
-    delete[] float_tokens[0];
+    KllSketch* kll = new KllSketch(deserialize_size_t(strtok_r(nullptr, ";", &entry)));
+    kll->n = deserialize_size_t(strtok_r(nullptr, ";", &entry));
+    size_t num_levels = deserialize_size_t(strtok_r(nullptr, ";", &entry));
+    while (kll->num_levels < num_levels) {
+        kll->add_level_();
+    }
 
-    for (size_t i = 1; i < length; i++) {
-        strcat(data, ",");  // CSV
-        strcat(data, float_tokens[i]);
-        delete[] float_tokens[i];
+    for (size_t h = 0; h < num_levels; h++) {
+        char* level = strtok_r(nullptr, ";", &entry);
+        char* values;
+        size_t count = strtoull(level, &values, 10);
+        values++;  // skip the colon
+
+        for (size_t i = 0; i < count; i++) {
+            memcpy(digits, values + i * 8, 8);
+            digits[8] = '\0';
+            uint32_t bits = (uint32_t)strtoul(digits, nullptr, 16);
+            float val;
+            memcpy(&val, &bits, sizeof(val));
+            kll->push_(h, val);
+        }
     }
-    return data;
+    return kll;
 }
 
-char* Serializer::serialize_strings(String** strings, size_t num_values) {
-    char* data;
-    if (nullptr == strings) {
-        data = new char[1];
-        data[0] = '\0';
-        return data;
+/* The following serialize methods serialize an array of primitives or Strings
+ * into a c-style array of characters. Produces a message with form:
+ * '[VALUE],[VALUE],...,[VALUE]
+ * Each value is written straight into one buffer, sized up front. */
+char* Serializer::serialize_bools(bool* bools, size_t num_values) {
+    if (nullptr == bools || num_values == 0) {
+        return Buffer(0).take();
     }
 
-    size_t length = num_values;
-    size_t buf_size = length + 1;
-    char* string_tokens[length];
-    for (size_t i = 0; i < length; i++) {
-        string_tokens[i] = serialize_string(strings[i]);
-
-        if (string_tokens[i]) {
-            buf_size += strlen(string_tokens[i]);
+    // 1 char per bool, 1 per comma
+    Buffer out(2 * num_values - 1);
+    for (size_t i = 0; i < num_values; i++) {
+        if (i != 0) {
+            out.append(',');  // CSV
         }
+        out.append(bools[i] ? '1' : '0');
     }
+    return out.take();
+}
 
-    data = new char[buf_size];
-    data[0] = '\0';
+char* Serializer::serialize_ints(int* ints, size_t num_values) {
+    if (nullptr == ints || num_values == 0) {
+        return Buffer(0).take();
+    }
 
-    // Loop through serialized values and concat, adding
-    // commas between values and accounting for nullptrs
-    // No need for first call to be strcpy instead of strcat as we 
-    // set index 0 to be \0 explictly above.
-    for (size_t i = 0; i < length; i++) {
+    // At most 11 chars per int, 1 per comma
+    Buffer out(12 * num_values);
+    for (size_t i = 0; i < num_values; i++) {
         if (i != 0) {
-            strcat(data, ",");  // CSV
+            out.append(',');  // CSV
         }
+        out.append_int(ints[i]);
+    }
+    return out.take();
+}
 
-        if (string_tokens[i]) {
-            strcat(data, string_tokens[i]);
-        }
+char* Serializer::serialize_floats(float* floats, size_t num_values) {
+    if (nullptr == floats || num_values == 0) {
+        return Buffer(0).take();
+    }
 
-        delete[] string_tokens[i];
+    // Room for typical floats; larger ones grow the buffer
+    Buffer out(12 * num_values);
+    for (size_t i = 0; i < num_values; i++) {
+        out.appendf(i == 0 ? "%f" : ",%f", floats[i]);
     }
+    return out.take();
+}
 
-    return data;
+char* Serializer::serialize_strings(String** strings, size_t num_values) {
+    if (nullptr == strings || num_values == 0) {
+        return Buffer(0).take();
+    }
+
+    // Exact size pre-pass: every string, with a comma between each two.
+    // A nullptr String is written as an empty one.
+    size_t total_len = num_values - 1;
+    for (size_t i = 0; i < num_values; i++) {
+        if (strings[i] != nullptr) {
+            total_len += strings[i]->size();
+        }
+    }
+
+    Buffer out(total_len);
+    for (size_t i = 0; i < num_values; i++) {
+        if (i != 0) {
+            out.append(',');  // CSV
+        }
+        if (strings[i] != nullptr) {
+            out.append(strings[i]->c_str(), strings[i]->size());
+        }
+    }
+    return out.take();
 }
 
 /* The following deserialize methods take a char array and deserialize it into
  * an array of primitives, or Strings. The return type depends on the method
  * called, but all these methods expect the same format of the message:
- * '[VALUE],[VALUE],....,[VALUE]' */
-bool* Serializer::deserialize_bools(char* msg) {
+ * '[VALUE],[VALUE],....,[VALUE]'
+ * They read msg without modifying it, so they can parse a value shared
+ * straight out of the Store. Given an arena, they build the result in it
+ * rather than on the heap, for a caller that drops it when done. */
+bool* Serializer::deserialize_bools(const char* msg, Arena* arena) {
     Sys s;
     size_t num_bools = s.count_char(",", msg) + 1;
 
-    bool* bools = new bool[num_bools];
+    bool* bools = arena != nullptr ? arena->alloc_array<bool>(num_bools) : new bool[num_bools];
 
-    char* token = strsep(&msg, ",");
+    char* end;
     for (size_t i = 0; i < num_bools; i++) {
-        bools[i] = deserialize_bool(token);
-        token = strsep(&msg, ",");
+        // For clarity, translate 1 / 0 to true / false
+        bools[i] = strtol(msg, &end, 10) != 0;
+        msg = strchrnul(end, ',') + 1;
     }
 
     return bools;
 }
 
-int* Serializer::deserialize_ints(char* msg) {
+int* Serializer::deserialize_ints(const char* msg, Arena* arena) {
     Sys s;
     size_t num_ints = s.count_char(",", msg) + 1;
 
-    int* ints = new int[num_ints];
+    int* ints = arena != nullptr ? arena->alloc_array<int>(num_ints) : new int[num_ints];
 
-    char* token = strsep(&msg, ",");
+    char* end;
     for (size_t i = 0; i < num_ints; i++) {
-        ints[i] = deserialize_int(token);
-        token = strsep(&msg, ",");
+        ints[i] = (int)strtol(msg, &end, 10);
+        msg = strchrnul(end, ',') + 1;
     }
 
     return ints;
 }
 
-float* Serializer::deserialize_floats(char* msg) {
+float* Serializer::deserialize_floats(const char* msg, Arena* arena) {
     Sys s;
     size_t num_floats = s.count_char(",", msg) + 1;
 
-    float* floats = new float[num_floats];
+    float* floats = arena != nullptr ? arena->alloc_array<float>(num_floats) : new float[num_floats];
 
-    char* token = strsep(&msg, ",");
+    char* end;
     for (size_t i = 0; i < num_floats; i++) {
-        floats[i] = deserialize_float(token);
-        token = strsep(&msg, ",");
+        floats[i] = strtof(msg, &end);
+        msg = strchrnul(end, ',') + 1;
     }
 
     return floats;
 }
 
-String** Serializer::deserialize_strings(char* msg) {
+// In an arena, each String and its characters are made there too, and must
+// not be deleted
+String** Serializer::deserialize_strings(const char* msg, Arena* arena) {
     Sys s;
     size_t num_strings = s.count_char(",", msg) + 1;
 
-    String** strings = new String*[num_strings];
+    String** strings = arena != nullptr ? arena->alloc_array<String*>(num_strings) : new String*[num_strings];
 
-    char* token = strsep(&msg, ",");
     for (size_t i = 0; i < num_strings; i++) {
-        strings[i] = deserialize_string(token);
-        token = strsep(&msg, ",");
+        const char* end = strchrnul(msg, ',');
+        size_t len = end - msg;
+        if (arena != nullptr) {
+            strings[i] = arena->make<String>(true, arena->duplicate(msg, len), len);
+        } else {
+            strings[i] = new String(msg, len);
+        }
+        msg = end + 1;
+    }
+
+    return strings;
+}
+
+/* The following methods write and read the chunks of column values the
+ * Store holds, in the binary form described in chunk.h: a header, then the
+ * values, in whichever encoding of those ChunkCodec offers for their type
+ * takes the fewest bytes. With plain_chunks set they are always written
+ * plain, and with text_chunks set they are written in the text form above
+ * instead. Chunks of any form are read, telling them apart by the header. */
+Value* Serializer::serialize_chunk(bool* bools, size_t num_values) {
+    if (text_chunks) {
+        return Value::adopt(serialize_bools(bools, num_values));
+    }
+
+    char encoding = CHUNK_PLAIN;
+    size_t len = num_values;
+    if (!plain_chunks) {
+        size_t rle_len = ChunkCodec::rle_len(bools, num_values);
+        size_t bits_len = ChunkCodec::bits_len(num_values);
+        if (rle_len <= bits_len && rle_len < len) {
+            encoding = CHUNK_RLE;
+            len = rle_len;
+        } else if (bits_len < len) {
+            encoding = CHUNK_BITPACK;
+            len = bits_len;
+        }
+    }
+
+    Value* chunk = Value::alloc(CHUNK_HEADER_LEN + len);
+    char* values = chunk->bytes + CHUNK_HEADER_LEN;
+    if (encoding == CHUNK_RLE) {
+        ChunkCodec::write_rle(values, bools, num_values);
+    } else if (encoding == CHUNK_BITPACK) {
+        ChunkCodec::write_bits(values, bools, num_values);
+    } else {
+        for (size_t i = 0; i < num_values; i++) {
+            values[i] = bools[i] ? 1 : 0;
+        }
+    }
+    ChunkHeader(BOOL_TYPE, num_values, encoding).write(chunk->bytes, len);
+    return chunk;
+}
+
+Value* Serializer::serialize_chunk(int* ints, size_t num_values) {
+    if (text_chunks) {
+        return Value::adopt(serialize_ints(ints, num_values));
+    }
+
+    char encoding = CHUNK_PLAIN;
+    size_t len = 4 * num_values;
+    int32_t least = 0;
+    size_t width = 0;
+    if (!plain_chunks) {
+        size_t delta_len = ChunkCodec::delta_varint_len(ints, num_values);
+        size_t packed_len = ChunkCodec::bitpack_len(ints, num_values, &least, &width);
+        if (packed_len <= delta_len && packed_len < len) {
+            encoding = CHUNK_BITPACK;
+            len = packed_len;
+        } else if (delta_len < len) {
+            encoding = CHUNK_DELTA_VARINT;
+            len = delta_len;
+        }
+    }
+
+    Value* chunk = Value::alloc(CHUNK_HEADER_LEN + len);
+    char* values = chunk->bytes + CHUNK_HEADER_LEN;
+    if (encoding == CHUNK_BITPACK) {
+        ChunkCodec::write_bitpack(values, ints, num_values, least, width);
+    } else if (encoding == CHUNK_DELTA_VARINT) {
+        ChunkCodec::write_delta_varint(values, ints, num_values);
+    } else {
+        ChunkHeader::copy_le32(values, ints, num_values);
+    }
+    ChunkHeader(INT_TYPE, num_values, encoding).write(chunk->bytes, len);
+    return chunk;
+}
+
+Value* Serializer::serialize_chunk(float* floats, size_t num_values) {
+    if (text_chunks) {
+        return Value::adopt(serialize_floats(floats, num_values));
+    }
+
+    char encoding = CHUNK_PLAIN;
+    size_t len = 4 * num_values;
+    if (!plain_chunks) {
+        size_t xor_len = ChunkCodec::xor_len(floats, num_values);
+        if (xor_len < len) {
+            encoding = CHUNK_XOR;
+            len = xor_len;
+        }
+    }
+
+    Value* chunk = Value::alloc(CHUNK_HEADER_LEN + len);
+    char* values = chunk->bytes + CHUNK_HEADER_LEN;
+    if (encoding == CHUNK_XOR) {
+        ChunkCodec::write_xor(values, floats, num_values);
+    } else {
+        ChunkHeader::copy_le32(values, floats, num_values);
+    }
+    ChunkHeader(FLOAT_TYPE, num_values, encoding).write(chunk->bytes, len);
+    return chunk;
+}
+
+// A nullptr String is written as an empty one, as in the text form. The
+// plain values are laid out first, then compressed if that makes them
+// smaller: 4 bytes giving their plain length, then the LZ stream.
+Value* Serializer::serialize_chunk(String** strings, size_t num_values) {
+    if (text_chunks) {
+        return Value::adopt(serialize_strings(strings, num_values));
+    }
+
+    size_t plain_len = strings_layout_len_(strings, num_values);
+    Value* chunk = Value::alloc(CHUNK_HEADER_LEN + plain_len);
+    char* plain = chunk->bytes + CHUNK_HEADER_LEN;
+    layout_strings_(strings, num_values, plain);
+    ChunkHeader(STRING_TYPE, num_values).write(chunk->bytes, plain_len);
+    if (plain_chunks) {
+        return chunk;
+    }
+
+    char* compressed = new char[ChunkCodec::lz_bound(plain_len)];
+    size_t compressed_len = ChunkCodec::lz_compress(compressed, plain, plain_len);
+    if (4 + compressed_len >= plain_len) {
+        delete[] compressed;
+        return chunk;
+    }
+
+    Value* lz_chunk = Value::alloc(CHUNK_HEADER_LEN + 4 + compressed_len);
+    ChunkHeader::store_le32(lz_chunk->bytes + CHUNK_HEADER_LEN, (uint32_t)plain_len);
+    memcpy(lz_chunk->bytes + CHUNK_HEADER_LEN + 4, compressed, compressed_len);
+    delete[] compressed;
+    ChunkHeader(STRING_TYPE, num_values, CHUNK_LZ).write(lz_chunk->bytes, 4 + compressed_len);
+    chunk->release();
+    return lz_chunk;
+}
+
+// Bytes the plain layout of the given strings takes: the offsets, then
+// each string and its NUL
+size_t Serializer::strings_layout_len_(String** strings, size_t num_values) {
+    size_t len = 4 * (num_values + 1);
+    for (size_t i = 0; i < num_values; i++) {
+        len += (strings[i] == nullptr ? 0 : strings[i]->size()) + 1;
+    }
+    return len;
+}
+
+// Lays the given strings out plain at dst, which holds
+// strings_layout_len_() bytes
+void Serializer::layout_strings_(String** strings, size_t num_values, char* dst) {
+    char* offsets = dst;
+    char* blob = offsets + 4 * (num_values + 1);
+    size_t pos = 0;
+    for (size_t i = 0; i < num_values; i++) {
+        ChunkHeader::store_le32(offsets + 4 * i, (uint32_t)pos);
+        size_t len = strings[i] == nullptr ? 0 : strings[i]->size();
+        if (len > 0) {
+            memcpy(blob + pos, strings[i]->c_str(), len);
+        }
+        blob[pos + len] = '\0';
+        pos += len + 1;
+    }
+    ChunkHeader::store_le32(offsets + 4 * num_values, (uint32_t)pos);
+}
+
+// Reads the header of chunk into header and returns true if it is binary,
+// or returns false if it is text. A binary chunk of another type than the
+// one asked for, of an earlier unversioned or a later version, cut short,
+// in an encoding its type does not have, or with verify_chunks set, not
+// matching its checksum, is an error.
+bool Serializer::read_chunk_header_(Value* chunk, char type, ChunkHeader* header) {
+    if (!ChunkHeader::is_binary(chunk->data(), chunk->size())) {
+        return false;
+    }
+    if (!ChunkHeader::has_magic(chunk->data(), chunk->size())) {
+        printf("ERROR: Chunk of type %c has an unversioned header from an older build; ingest its data again\n",
+               type);
+        exit(1);
+    }
+
+    header->read(chunk->data());
+    if (header->version < 1 || header->version > CHUNK_VERSION) {
+        printf("ERROR: Chunk of version %d is newer than this reader's %d\n", (int)header->version, (int)CHUNK_VERSION);
+        exit(1);
+    }
+    if (header->length != chunk->size() - CHUNK_HEADER_LEN) {
+        printf("ERROR: Chunk of type %c holds %zu bytes of values but its header says %u\n", type,
+               chunk->size() - CHUNK_HEADER_LEN, header->length);
+        exit(1);
+    }
+    if (verify_chunks && ChunkHeader::checksum(chunk->data()) != header->crc) {
+        printf("ERROR: Chunk of type %c does not match its checksum\n", type);
+        exit(1);
+    }
+    if (header->type != type) {
+        printf("ERROR: Expected a chunk of type %c but got one of type %c\n", type, header->type);
+        exit(1);
+    }
+    bool known;
+    switch (header->encoding) {
+        case CHUNK_PLAIN:
+            known = true;
+            break;
+        case CHUNK_DELTA_VARINT:
+            known = type == INT_TYPE;
+            break;
+        case CHUNK_BITPACK:
+            known = type == INT_TYPE || type == BOOL_TYPE;
+            break;
+        case CHUNK_RLE:
+            known = type == BOOL_TYPE;
+            break;
+        case CHUNK_XOR:
+            known = type == FLOAT_TYPE;
+            break;
+        case CHUNK_LZ:
+            known = type == STRING_TYPE;
+            break;
+        default:
+            known = false;
+    }
+    if (!known) {
+        printf("ERROR: Unknown encoding %d for a chunk of type %c\n", (int)header->encoding, type);
+        exit(1);
+    }
+    return true;
+}
+
+// Exits if a chunk's values could not be decoded
+void Serializer::check_decoded_(bool decoded, char type) {
+    if (!decoded) {
+        printf("ERROR: Corrupt chunk of type %c\n", type);
+        exit(1);
+    }
+}
+
+// Number of values in a text chunk
+size_t Serializer::text_count_(Value* chunk) {
+    Sys s;
+    return s.count_char(",", chunk->data()) + 1;
+}
+
+/* The following read the values of a chunk into an array the caller
+ * provides, holding up to max_values of them, and return how many there
+ * were. Nothing is allocated for a binary chunk. */
+size_t Serializer::deserialize_chunk_into(Value* chunk, bool* bools, size_t max_values) {
+    ChunkHeader header;
+    if (!read_chunk_header_(chunk, BOOL_TYPE, &header)) {
+        size_t count = text_count_(chunk);
+        check_decoded_(count <= max_values, BOOL_TYPE);
+        Arena arena;
+        memcpy(bools, deserialize_bools(chunk->data(), &arena), count * sizeof(bool));
+        return count;
+    }
+
+    check_decoded_(header.count <= max_values, BOOL_TYPE);
+    const char* values = chunk->data() + CHUNK_HEADER_LEN;
+    size_t len = chunk->size() - CHUNK_HEADER_LEN;
+    if (header.encoding == CHUNK_RLE) {
+        check_decoded_(ChunkCodec::read_rle(bools, header.count, values, len), BOOL_TYPE);
+    } else if (header.encoding == CHUNK_BITPACK) {
+        check_decoded_(ChunkCodec::read_bits(bools, header.count, values, len), BOOL_TYPE);
+    } else {
+        check_decoded_(len >= header.count, BOOL_TYPE);
+        for (size_t i = 0; i < header.count; i++) {
+            bools[i] = values[i] != 0;
+        }
+    }
+    return header.count;
+}
+
+size_t Serializer::deserialize_chunk_into(Value* chunk, int* ints, size_t max_values) {
+    ChunkHeader header;
+    if (!read_chunk_header_(chunk, INT_TYPE, &header)) {
+        size_t count = text_count_(chunk);
+        check_decoded_(count <= max_values, INT_TYPE);
+        Arena arena;
+        memcpy(ints, deserialize_ints(chunk->data(), &arena), count * sizeof(int));
+        return count;
+    }
+
+    check_decoded_(header.count <= max_values, INT_TYPE);
+    const char* values = chunk->data() + CHUNK_HEADER_LEN;
+    size_t len = chunk->size() - CHUNK_HEADER_LEN;
+    if (header.encoding == CHUNK_BITPACK) {
+        check_decoded_(ChunkCodec::read_bitpack(ints, header.count, values, len), INT_TYPE);
+    } else if (header.encoding == CHUNK_DELTA_VARINT) {
+        check_decoded_(ChunkCodec::read_delta_varint(ints, header.count, values, len), INT_TYPE);
+    } else {
+        check_decoded_(len >= 4 * (size_t)header.count, INT_TYPE);
+        ChunkHeader::copy_le32(ints, values, header.count);
+    }
+    return header.count;
+}
+
+size_t Serializer::deserialize_chunk_into(Value* chunk, float* floats, size_t max_values) {
+    ChunkHeader header;
+    if (!read_chunk_header_(chunk, FLOAT_TYPE, &header)) {
+        size_t count = text_count_(chunk);
+        check_decoded_(count <= max_values, FLOAT_TYPE);
+        Arena arena;
+        memcpy(floats, deserialize_floats(chunk->data(), &arena), count * sizeof(float));
+        return count;
+    }
+
+    check_decoded_(header.count <= max_values, FLOAT_TYPE);
+    const char* values = chunk->data() + CHUNK_HEADER_LEN;
+    size_t len = chunk->size() - CHUNK_HEADER_LEN;
+    if (header.encoding == CHUNK_XOR) {
+        check_decoded_(ChunkCodec::read_xor(floats, header.count, values, len), FLOAT_TYPE);
+    } else {
+        check_decoded_(len >= 4 * (size_t)header.count, FLOAT_TYPE);
+        ChunkHeader::copy_le32(floats, values, header.count);
+    }
+    return header.count;
+}
+
+bool* Serializer::deserialize_bool_chunk(Value* chunk, Arena* arena) {
+    ChunkHeader header;
+    if (!read_chunk_header_(chunk, BOOL_TYPE, &header)) {
+        return deserialize_bools(chunk->data(), arena);
+    }
+
+    bool* bools = arena != nullptr ? arena->alloc_array<bool>(header.count) : new bool[header.count];
+    deserialize_chunk_into(chunk, bools, header.count);
+    return bools;
+}
+
+int* Serializer::deserialize_int_chunk(Value* chunk, Arena* arena) {
+    ChunkHeader header;
+    if (!read_chunk_header_(chunk, INT_TYPE, &header)) {
+        return deserialize_ints(chunk->data(), arena);
+    }
+
+    int* ints = arena != nullptr ? arena->alloc_array<int>(header.count) : new int[header.count];
+    deserialize_chunk_into(chunk, ints, header.count);
+    return ints;
+}
+
+float* Serializer::deserialize_float_chunk(Value* chunk, Arena* arena) {
+    ChunkHeader header;
+    if (!read_chunk_header_(chunk, FLOAT_TYPE, &header)) {
+        return deserialize_floats(chunk->data(), arena);
+    }
+
+    float* floats = arena != nullptr ? arena->alloc_array<float>(header.count) : new float[header.count];
+    deserialize_chunk_into(chunk, floats, header.count);
+    return floats;
+}
+
+// In an arena, each String and its characters are made there too, and must
+// not be deleted
+String** Serializer::deserialize_string_chunk(Value* chunk, Arena* arena) {
+    if (!ChunkHeader::is_binary(chunk->data(), chunk->size())) {
+        return deserialize_strings(chunk->data(), arena);
     }
 
+    StringChunkView view;
+    view_chunk(chunk, &view);
+    size_t num_strings = view.size();
+    String** strings = arena != nullptr ? arena->alloc_array<String*>(num_strings) : new String*[num_strings];
+    for (size_t i = 0; i < num_strings; i++) {
+        size_t len = view.length(i);
+        if (arena != nullptr) {
+            strings[i] = arena->make<String>(true, arena->duplicate(view.c_str(i), len), len);
+        } else {
+            strings[i] = new String(view.c_str(i), len);
+        }
+    }
     return strings;
 }
+
+// The type of the chunks arrays like values are read from
+char Serializer::chunk_type_(const bool* values) { return BOOL_TYPE; }
+char Serializer::chunk_type_(const int* values) { return INT_TYPE; }
+char Serializer::chunk_type_(const float* values) { return FLOAT_TYPE; }
+
+// A plain binary chunk is viewed in place if the view can read its values
+// as they lie, and any other is decoded into the view
+template <class T>
+void Serializer::view_chunk(Value* chunk, ChunkView<T>* view) {
+    ChunkHeader header;
+    char type = chunk_type_(view->data());
+    bool binary = read_chunk_header_(chunk, type, &header);
+    const char* values = chunk->data() + CHUNK_HEADER_LEN;
+    if (binary && header.encoding == CHUNK_PLAIN && ChunkView<T>::can_view_in_place(values)) {
+        check_decoded_(chunk->size() - CHUNK_HEADER_LEN >= sizeof(T) * (size_t)header.count, type);
+        view->view_in_place(chunk, (const T*)values, header.count);
+        return;
+    }
+    size_t count = binary ? header.count : text_count_(chunk);
+    deserialize_chunk_into(chunk, view->decode_into(count), count);
+}
+
+// The offsets of a plain chunk are checked once here, so the view can
+// index them without checks of its own
+void Serializer::view_chunk(Value* chunk, StringChunkView* view) {
+    ChunkHeader header;
+    if (!read_chunk_header_(chunk, STRING_TYPE, &header)) {
+        Arena arena;
+        size_t count = text_count_(chunk);
+        String** strings = deserialize_strings(chunk->data(), &arena);
+        layout_strings_(strings, count, view->decode_into(strings_layout_len_(strings, count), count));
+        return;
+    }
+
+    size_t count = header.count;
+    const char* values = chunk->data() + CHUNK_HEADER_LEN;
+    size_t values_len = chunk->size() - CHUNK_HEADER_LEN;
+    const char* plain = values;
+    if (header.encoding == CHUNK_LZ) {
+        check_decoded_(values_len >= 4, STRING_TYPE);
+        size_t plain_len = ChunkHeader::load_le32(values);
+        char* decompressed = view->decode_into(plain_len, count);
+        check_decoded_(ChunkCodec::lz_decompress(decompressed, plain_len, values + 4, values_len - 4), STRING_TYPE);
+        plain = decompressed;
+        values_len = plain_len;
+    }
+
+    size_t offsets_len = 4 * (count + 1);
+    check_decoded_(values_len >= offsets_len, STRING_TYPE);
+    size_t blob_len = values_len - offsets_len;
+    size_t prev = 0;
+    for (size_t i = 0; i <= count; i++) {
+        size_t offset = ChunkHeader::load_le32(plain + 4 * i);
+        // Each string ends in a NUL, so is at least a byte past the last
+        check_decoded_(offset <= blob_len && (i == 0 ? offset == 0 : offset > prev), STRING_TYPE);
+        check_decoded_(i == 0 || plain[offsets_len + offset - 1] == '\0', STRING_TYPE);
+        prev = offset;
+    }
+    if (header.encoding == CHUNK_PLAIN) {
+        view->view_in_place(chunk, plain, count);
+    }
+}
@@ -19,11 +19,22 @@ class BoolColumn;
 class FloatColumn;
 class StringColumn;
 class StringArray;
+class Bitmap;
+class Sketch;
 class Key;
 class Message;
+class Arena;
+class Buffer;
+class Sink;
+class Source;
+class ChunkHeader;
+class StringChunkView;
+template <class T>
+class ChunkView;
 class Schema;
 class String;
 class Store;
+class Value;
 
 // Utility to transform Classes and data structures used in the DataFrame API 
 // to and from a serialized character array format.
@@ -35,18 +46,36 @@ class Store;
 //   a character array describing a String, the result is undefined.
 // - This class does not manage any memory that is given to or returned by
 //   its methods. Users are expected to delete any pointers given to or
-//   returned by this class.
+//   returned by this class, except those built in an Arena they passed in,
+//   which live as long as the arena does.
 // This class is intended to be sub-classed and methods are intended to be
 // re-implemented for users who may have different ideas/requirements for
 // serialization of these same types. Sub-classes can also maintain the
 // design philosophy found here for any additional types not supported here.
 class Serializer {
    public:
-    Serializer() {}
+    bool text_chunks;    // Whether to write chunks as text, for debugging
+    bool plain_chunks;   // Whether to write binary chunks without encoding them
+    bool verify_chunks;  // Whether to check each binary chunk's checksum as it is read
+
+    Serializer() {
+        text_chunks = false;
+        plain_chunks = false;
+        verify_chunks = false;
+    }
     virtual ~Serializer() {}
 
     virtual char* serialize_distributed_dataframe(DistributedDataFrame* df);
     virtual DistributedDataFrame* deserialize_distributed_dataframe(char* msg, Store* store);
+    virtual DistributedColumn** deserialize_dist_columns(char* msg, Store* store, size_t* num_cols);
+
+    // The same frames written to a Sink and read from a Source a piece at a
+    // time, so no more than a piece of the text is held at once; see
+    // stream.h. The length is known before anything is written.
+    virtual size_t distributed_dataframe_len(DistributedDataFrame* df);
+    virtual void serialize_distributed_dataframe(DistributedDataFrame* df, Sink* sink);
+    virtual DistributedDataFrame* deserialize_distributed_dataframe(Source* source, Store* store);
+    virtual DistributedColumn** deserialize_dist_columns(Source* source, Store* store, size_t* num_cols);
 
     virtual char* serialize_message(Message* msg);
     virtual Message* deserialize_message(char* msg);
@@ -74,14 +103,61 @@ class Serializer {
     virtual Schema* deserialize_schema(char* msg);
     virtual char* serialize_bool(bool value);
     virtual bool deserialize_bool(char* msg);
+    virtual Value* serialize_bitmap(Bitmap* bitmap);
+    virtual Bitmap* deserialize_bitmap(Value* msg);
+    virtual char* serialize_sketch(Sketch* sketch);
+    virtual Sketch* deserialize_sketch(char* msg);
 
     virtual char* serialize_bools(bool* bools, size_t num_values);
     virtual char* serialize_ints(int* ints, size_t num_values);
     virtual char* serialize_floats(float* floats, size_t num_values);
     virtual char* serialize_strings(String** strings, size_t num_values);
 
-    virtual bool* deserialize_bools(char* msg);
-    virtual int* deserialize_ints(char* msg);
-    virtual float* deserialize_floats(char* msg);
-    virtual String** deserialize_strings(char* msg);
+    virtual bool* deserialize_bools(const char* msg, Arena* arena = nullptr);
+    virtual int* deserialize_ints(const char* msg, Arena* arena = nullptr);
+    virtual float* deserialize_floats(const char* msg, Arena* arena = nullptr);
+    virtual String** deserialize_strings(const char* msg, Arena* arena = nullptr);
+
+    // Chunks of column values as the Store holds them: binary, as laid out
+    // in chunk.h, unless text_chunks is set. Chunks of any form are read.
+    virtual Value* serialize_chunk(bool* bools, size_t num_values);
+    virtual Value* serialize_chunk(int* ints, size_t num_values);
+    virtual Value* serialize_chunk(float* floats, size_t num_values);
+    virtual Value* serialize_chunk(String** strings, size_t num_values);
+
+    virtual bool* deserialize_bool_chunk(Value* chunk, Arena* arena = nullptr);
+    virtual int* deserialize_int_chunk(Value* chunk, Arena* arena = nullptr);
+    virtual float* deserialize_float_chunk(Value* chunk, Arena* arena = nullptr);
+    virtual String** deserialize_string_chunk(Value* chunk, Arena* arena = nullptr);
+
+    // Reads the values of a chunk into an array of max_values, allocating
+    // nothing for a binary chunk, and returns how many there were
+    virtual size_t deserialize_chunk_into(Value* chunk, bool* bools, size_t max_values);
+    virtual size_t deserialize_chunk_into(Value* chunk, int* ints, size_t max_values);
+    virtual size_t deserialize_chunk_into(Value* chunk, float* floats, size_t max_values);
+
+    // Points a view at the values of a chunk, reading a plain binary chunk
+    // in place where the view can; see chunk_view.h
+    template <class T>
+    void view_chunk(Value* chunk, ChunkView<T>* view);
+    virtual void view_chunk(Value* chunk, StringChunkView* view);
+
+    static char chunk_type_(const bool* values);
+    static char chunk_type_(const int* values);
+    static char chunk_type_(const float* values);
+    bool read_chunk_header_(Value* chunk, char type, ChunkHeader* header);
+    void check_decoded_(bool decoded, char type);
+    size_t text_count_(Value* chunk);
+    size_t strings_layout_len_(String** strings, size_t num_values);
+    void layout_strings_(String** strings, size_t num_values, char* dst);
+
+    size_t key_len_(Key* value);
+    template <class Out>
+    void write_key_(Key* value, Out& out);
+    size_t dist_col_len_(DistributedColumn* col);
+    template <class Out>
+    void write_dist_col_(DistributedColumn* col, Out& out);
+    template <class Out>
+    void write_distributed_dataframe_(DistributedDataFrame* df, Out& out);
+    DistributedColumn* read_dist_col_(Source* source, Store* store, char type, Buffer& token);
 };
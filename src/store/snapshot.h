@@ -0,0 +1,213 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../utils/object.h"
+#include "key.h"
+#include "key_table.h"
+#include "value.h"
+
+// First bytes of every snapshot file; the last one is the format version.
+// Version 2 holds chunks with versioned, checksummed headers, and version
+// 3 each key's number of replicas.
+#define SNAPSHOT_MAGIC "EAUSNAP\x03"
+#define SNAPSHOT_MAGIC_LEN 8
+// Magic, node id, number of entries, offset of the index
+#define SNAPSHOT_HEADER_LEN (SNAPSHOT_MAGIC_LEN + 3 * sizeof(uint64_t))
+// Key id, home node, value offset, value length, name length, replicas
+#define SNAPSHOT_INDEX_ENTRY_LEN (6 * sizeof(uint64_t))
+
+/*************************************************************************
+ * Snapshot::
+ * A file holding every key and value of one node's store, so a restarted
+ * node can pick up where it left off instead of having its data ingested
+ * and sent to it again. Laid out as:
+ *   header: magic, node id, number of entries, offset of the index
+ *   data:   each value's bytes followed by a NUL
+ *   index:  for each entry its key id, home node, value offset and
+ *           length, name length and number of replicas, then the key's
+ *           name with its NUL
+ * Integers are 64 bits in host byte order: a snapshot is only read back
+ * by the machine that wrote it. The index comes last so values can be
+ * streamed out before it is complete; loading maps the whole file and
+ * copies each value out of it, with no parsing of the values themselves.
+ */
+class Snapshot : public Object {
+   public:
+    char* path;  // owned
+
+    Snapshot(const char* path) {
+        this->path = duplicate((char*)path);
+    }
+
+    ~Snapshot() {
+        delete[] path;
+    }
+
+    static void write_u64_(char* dst, uint64_t v) { memcpy(dst, &v, sizeof(v)); }
+
+    static uint64_t read_u64_(const char* src) {
+        uint64_t v;
+        memcpy(&v, src, sizeof(v));
+        return v;
+    }
+
+    // Writes the table's entries to the snapshot file, replacing it. The
+    // file only takes the place of the old one once fully written and
+    // synced, so a crash mid-save leaves the last snapshot intact. Keys
+    // whose names start with skip_prefix, if given, are left out. Returns
+    // the number of entries saved.
+    size_t save(StripedKeyTable* table, size_t node_id, const char* skip_prefix = nullptr) {
+        size_t tmp_size = strlen(path) + 5;
+        char* tmp_path = new char[tmp_size];
+        snprintf(tmp_path, tmp_size, "%s.tmp", path);
+        FILE* file = fopen(tmp_path, "wb");
+        if (file == nullptr) {
+            printf("ERROR: could not create snapshot %s\n", tmp_path);
+            exit(1);
+        }
+
+        // Header is filled in once the entries are counted
+        char header[SNAPSHOT_HEADER_LEN] = {0};
+        write_or_die_(file, header, SNAPSHOT_HEADER_LEN);
+
+        size_t offset = SNAPSHOT_HEADER_LEN;
+        size_t num_entries = 0;
+        size_t index_len = 0;
+        size_t index_capacity = 4096;
+        char* index = new char[index_capacity];
+
+        size_t skip_len = skip_prefix == nullptr ? 0 : strlen(skip_prefix);
+        table->for_each([&](Key* key, Value* value) {
+            if (skip_len > 0 && strncmp(key->name, skip_prefix, skip_len) == 0) {
+                return;
+            }
+            write_or_die_(file, value->data(), value->size() + 1);
+
+            size_t name_len = strlen(key->name) + 1;
+            size_t entry_len = SNAPSHOT_INDEX_ENTRY_LEN + name_len;
+            while (index_len + entry_len > index_capacity) {
+                index_capacity *= 2;
+                char* grown = new char[index_capacity];
+                memcpy(grown, index, index_len);
+                delete[] index;
+                index = grown;
+            }
+            char* entry = index + index_len;
+            write_u64_(entry, key->get_id());
+            write_u64_(entry + 8, key->home_node);
+            write_u64_(entry + 16, offset);
+            write_u64_(entry + 24, value->size());
+            write_u64_(entry + 32, name_len);
+            write_u64_(entry + 40, key->replicas);
+            memcpy(entry + SNAPSHOT_INDEX_ENTRY_LEN, key->name, name_len);
+
+            index_len += entry_len;
+            offset += value->size() + 1;
+            num_entries++;
+        });
+
+        write_or_die_(file, index, index_len);
+        delete[] index;
+
+        memcpy(header, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN);
+        write_u64_(header + SNAPSHOT_MAGIC_LEN, node_id);
+        write_u64_(header + SNAPSHOT_MAGIC_LEN + 8, num_entries);
+        write_u64_(header + SNAPSHOT_MAGIC_LEN + 16, offset);
+        fseek(file, 0, SEEK_SET);
+        write_or_die_(file, header, SNAPSHOT_HEADER_LEN);
+
+        if (fflush(file) != 0 || fsync(fileno(file)) != 0 || fclose(file) != 0 || rename(tmp_path, path) != 0) {
+            printf("ERROR: could not save snapshot %s\n", path);
+            exit(1);
+        }
+        delete[] tmp_path;
+        return num_entries;
+    }
+
+    void write_or_die_(FILE* file, const char* bytes, size_t len) {
+        if (fwrite(bytes, 1, len, file) != len) {
+            printf("ERROR: could not write snapshot %s\n", path);
+            exit(1);
+        }
+    }
+
+    // Puts every entry of the snapshot file into table. Returns false,
+    // leaving the table alone, if there is no snapshot file. The snapshot
+    // must have been saved by the same node.
+    bool load(StripedKeyTable* table, size_t node_id) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < SNAPSHOT_HEADER_LEN) {
+            corrupt_();
+        }
+        size_t file_len = st.st_size;
+        char* file = (char*)mmap(nullptr, file_len, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (file == MAP_FAILED) {
+            printf("ERROR: could not map snapshot %s\n", path);
+            exit(1);
+        }
+        // Values and index are each read front to back once
+        madvise(file, file_len, MADV_SEQUENTIAL);
+
+        if (memcmp(file, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN - 1) != 0) {
+            corrupt_();
+        }
+        if (file[SNAPSHOT_MAGIC_LEN - 1] != SNAPSHOT_MAGIC[SNAPSHOT_MAGIC_LEN - 1]) {
+            printf("ERROR: snapshot %s is of format version %d, but this build reads version %d\n", path,
+                   (int)file[SNAPSHOT_MAGIC_LEN - 1], (int)SNAPSHOT_MAGIC[SNAPSHOT_MAGIC_LEN - 1]);
+            exit(1);
+        }
+        if (read_u64_(file + SNAPSHOT_MAGIC_LEN) != node_id) {
+            printf("ERROR: snapshot %s belongs to another node\n", path);
+            exit(1);
+        }
+        size_t num_entries = read_u64_(file + SNAPSHOT_MAGIC_LEN + 8);
+        size_t pos = read_u64_(file + SNAPSHOT_MAGIC_LEN + 16);
+
+        for (size_t i = 0; i < num_entries; i++) {
+            if (pos + SNAPSHOT_INDEX_ENTRY_LEN > file_len) {
+                corrupt_();
+            }
+            const char* entry = file + pos;
+            uint64_t id = read_u64_(entry);
+            size_t home_node = read_u64_(entry + 8);
+            size_t offset = read_u64_(entry + 16);
+            size_t length = read_u64_(entry + 24);
+            size_t name_len = read_u64_(entry + 32);
+            char* name = (char*)entry + SNAPSHOT_INDEX_ENTRY_LEN;
+            if (pos + SNAPSHOT_INDEX_ENTRY_LEN + name_len > file_len || name_len == 0 || name[name_len - 1] != '\0' ||
+                offset + length >= file_len) {
+                corrupt_();
+            }
+
+            Key key(name, home_node, id);
+            key.set_replicas(read_u64_(entry + 40));
+            Value* replaced = table->put(&key, Value::copy(file + offset, length));
+            if (replaced != nullptr) {
+                replaced->release();
+            }
+            pos += SNAPSHOT_INDEX_ENTRY_LEN + name_len;
+        }
+
+        munmap(file, file_len);
+        return true;
+    }
+
+    void corrupt_() {
+        printf("ERROR: snapshot %s is corrupt\n", path);
+        exit(1);
+    }
+};
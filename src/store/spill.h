@@ -0,0 +1,181 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+
+#include "../utils/object.h"
+#include "value.h"
+
+// By default, a new segment file is started once the last one holds this
+// many bytes
+#define SPILL_SEGMENT_SIZE ((size_t)64 << 20)
+// Values at least this long are reloaded by mapping their pages; shorter
+// ones are cheaper to read into a fresh buffer
+#define SPILL_MMAP_MIN ((size_t)16 << 10)
+
+// Where a spilled value's bytes are
+class SpillLocation {
+   public:
+    size_t segment;  // Index of the segment file
+    size_t offset;   // Byte offset in the segment
+    size_t length;   // Length of the value, not counting the NUL after it
+};
+
+/*************************************************************************
+ * SpillSegments::
+ * Append-only files that a Store's values are spilled to when the node
+ * runs over its memory budget. Each value is written once, followed by a
+ * NUL, at the end of the last segment, and read back on demand. Space of
+ * values that are later replaced or reloaded is not reclaimed until the
+ * segments are deleted along with this object.
+ * Counts how many values and bytes were spilled and reloaded.
+ */
+class SpillSegments : public Object {
+   public:
+    char* dir;           // owned
+    size_t node_id;
+    int* fds;            // owned; open file of each segment
+    size_t num_segments;
+    size_t segments_capacity;
+    size_t segment_size;  // Bytes after which a new segment is started
+    size_t tail_size;    // Bytes written to the last segment
+    std::mutex lock;     // Guards appends and fds, which appends may grow
+
+    std::atomic<size_t> spills;
+    std::atomic<size_t> spill_bytes;
+    std::atomic<size_t> reloads;
+    std::atomic<size_t> reload_bytes;
+
+    // Segments are created in the given directory, named for node_id
+    SpillSegments(const char* dir, size_t node_id) : spills(0), spill_bytes(0), reloads(0), reload_bytes(0) {
+        this->dir = duplicate((char*)dir);
+        this->node_id = node_id;
+        segments_capacity = 4;
+        fds = new int[segments_capacity];
+        num_segments = 0;
+        segment_size = SPILL_SEGMENT_SIZE;
+        tail_size = 0;
+    }
+
+    // Closes and deletes every segment
+    ~SpillSegments() {
+        for (size_t i = 0; i < num_segments; i++) {
+            close(fds[i]);
+            char* path = segment_path_(i);
+            unlink(path);
+            delete[] path;
+        }
+        delete[] fds;
+        delete[] dir;
+    }
+
+    // Name of the given segment. The process id keeps nodes run as
+    // separate processes, or separate runs, from sharing files.
+    char* segment_path_(size_t segment) {
+        const char* fmt = "%s/spill-%d-node%zu-%zu.seg";
+        size_t size = snprintf(nullptr, 0, fmt, dir, (int)getpid(), node_id, segment) + 1;
+        char* path = new char[size];
+        snprintf(path, size, fmt, dir, (int)getpid(), node_id, segment);
+        return path;
+    }
+
+    // Opens a new, empty last segment
+    void start_segment_() {
+        if (num_segments == segments_capacity) {
+            segments_capacity *= 2;
+            int* grown = new int[segments_capacity];
+            memcpy(grown, fds, num_segments * sizeof(int));
+            delete[] fds;
+            fds = grown;
+        }
+
+        char* path = segment_path_(num_segments);
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) {
+            printf("ERROR: could not create spill segment %s\n", path);
+            exit(1);
+        }
+        delete[] path;
+
+        fds[num_segments++] = fd;
+        tail_size = 0;
+    }
+
+    // Writes value to the end of the last segment. Returns where it went.
+    SpillLocation append(Value* value) {
+        std::lock_guard<std::mutex> lck(lock);
+        if (num_segments == 0 || tail_size >= segment_size) {
+            start_segment_();
+        }
+
+        SpillLocation where;
+        where.segment = num_segments - 1;
+        where.offset = tail_size;
+        where.length = value->size();
+
+        // Write the NUL too, so the bytes can be mapped as a Value as they are
+        size_t to_write = value->size() + 1;
+        size_t written = 0;
+        while (written < to_write) {
+            ssize_t n = pwrite(fds[where.segment], value->data() + written, to_write - written, where.offset + written);
+            if (n <= 0) {
+                printf("ERROR: could not write to spill segment %zu\n", where.segment);
+                exit(1);
+            }
+            written += n;
+        }
+        tail_size += to_write;
+
+        spills++;
+        spill_bytes += where.length;
+        return where;
+    }
+
+    // Returns a new Value holding the bytes spilled at the given location.
+    // Long values are mapped rather than read, so only the pages used are
+    // brought in, and the kernel may drop them again under pressure.
+    // May run alongside appends, which may replace fds as it grows, so the
+    // segment's file is looked up under the lock.
+    Value* load(SpillLocation where) {
+        int fd;
+        {
+            std::lock_guard<std::mutex> lck(lock);
+            fd = fds[where.segment];
+        }
+        reloads++;
+        reload_bytes += where.length;
+
+        if (where.length >= SPILL_MMAP_MIN) {
+            size_t page = sysconf(_SC_PAGESIZE);
+            size_t start = where.offset & ~(page - 1);
+            size_t mapping_len = where.offset - start + where.length + 1;
+            void* mapping = mmap(nullptr, mapping_len, PROT_READ, MAP_PRIVATE, fd, start);
+            if (mapping == MAP_FAILED) {
+                printf("ERROR: could not map spill segment %zu\n", where.segment);
+                exit(1);
+            }
+            return Value::mapped(mapping, mapping_len, (char*)mapping + (where.offset - start), where.length);
+        }
+
+        Value* value = Value::alloc(where.length);
+        char* buf = value->bytes;
+        size_t got = 0;
+        while (got < where.length + 1) {
+            ssize_t n = pread(fd, buf + got, where.length + 1 - got, where.offset + got);
+            if (n <= 0) {
+                printf("ERROR: could not read from spill segment %zu\n", where.segment);
+                exit(1);
+            }
+            got += n;
+        }
+        return value;
+    }
+};
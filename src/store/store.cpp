@@ -2,43 +2,193 @@
 *           David Tandetnik (tandetnik.da@husky.neu.edu) */
 #pragma once
 #include "store.h"
+#include <inttypes.h>
+#include <chrono>
 #include <mutex>
+#include <thread>
 #include <condition_variable>
 #include "../client/sorer.h"
-#include "../utils/map.h"
+#include "../utils/arena.h"
+#include "../utils/bitmap.h"
+#include "../utils/sketch.h"
+#include "../utils/slab.h"
 #include "dataframe/dataframe.h"
 #include "key.h"
+#include "key_table.h"
 #include "network/message.h"
 #include "network/node.h"
+#include "remote_cache.h"
 #include "serial.cpp"
+#include "snapshot.h"
+#include "value.h"
+#include "watch.h"
+
+/*************************************************************************
+ * Notification::
+ * A message this node owes another node about one of its keys: the value
+ * of a key the other node sent a WATCH for (NOTIFY), or word that a sealed
+ * key the other node may have cached was put again (INVALIDATE).
+ * Queued by put() and sent by the Store's notifier thread.
+ */
+class Notification : public Object {
+   public:
+    MessageType type;    // NOTIFY or INVALIDATE
+    Key* key;            // owned
+    Value* value;        // one reference owned; nullptr for an INVALIDATE
+    uint64_t version;    // Version of key put, for an INVALIDATE
+    size_t to_node;
+    Notification* next;  // Next notification in the queue
+
+    Notification(Key* key, Value* value, size_t to_node) {
+        type = NOTIFY;
+        this->key = key->clone();
+        this->value = value;
+        version = 0;
+        this->to_node = to_node;
+        next = nullptr;
+    }
+
+    Notification(Key* key, uint64_t version, size_t to_node) {
+        type = INVALIDATE;
+        this->key = key->clone();
+        value = nullptr;
+        this->version = version;
+        this->to_node = to_node;
+        next = nullptr;
+    }
+
+    ~Notification() {
+        delete key;
+        if (value != nullptr) {
+            value->release();
+        }
+    }
+};
+
+/*************************************************************************
+ * Expiry::
+ * A key this node removes once its deadline passes, along with every chunk
+ * of the frame stored under it if frame is set. Kept by the Store in a list
+ * ordered by deadline, and removed by its notifier thread.
+ */
+class Expiry : public Object {
+   public:
+    Key* key;  // owned
+    bool frame;
+    std::chrono::steady_clock::time_point deadline;
+    Expiry* next;  // Next expiry in the list
+
+    Expiry(Key* key, bool frame, std::chrono::steady_clock::time_point deadline) {
+        this->key = key->clone();
+        this->frame = frame;
+        this->deadline = deadline;
+        next = nullptr;
+    }
 
-#define GETANDWAIT_SLEEP 100
+    ~Expiry() {
+        delete key;
+    }
+};
+
+/*************************************************************************
+ * ScopedFrame::
+ * A temporary DistributedDataFrame whose chunks are removed from the store,
+ * wherever they live, once the ScopedFrame goes out of scope. Frames gotten
+ * from the store copy the chunks of the frame put, so wrapping one in a
+ * ScopedFrame frees that copy when it is no longer needed. Given the key a
+ * temporary frame was put under, also drops that frame when done with it.
+ */
+class ScopedFrame : public Object {
+   public:
+    Store* store;              // external
+    DistributedDataFrame* df;  // owned
+    Key* key;                  // owned; nullptr if the frame was not put
+
+    ScopedFrame(Store* store, DistributedDataFrame* df, Key* key = nullptr) {
+        this->store = store;
+        this->df = df;
+        this->key = key == nullptr ? nullptr : key->clone();
+    }
+
+    ~ScopedFrame() {
+        store->drop_chunks(df);
+        delete df;
+        if (key != nullptr) {
+            store->drop_frame(key);
+            delete key;
+        }
+    }
+};
+
+// Runs send(node) for each of the num given nodes at once, one of them on
+// the calling thread, and returns once all are done
+template <typename F>
+static void run_per_node_(size_t *nodes, size_t num, F send) {
+    if (num == 0) {
+        return;
+    }
+    std::thread **threads = new std::thread *[num - 1];
+    for (size_t i = 0; i + 1 < num; i++) {
+        threads[i] = new std::thread(send, nodes[i]);
+    }
+    send(nodes[num - 1]);
+    for (size_t i = 0; i + 1 < num; i++) {
+        threads[i]->join();
+        delete threads[i];
+    }
+    delete[] threads;
+}
 
 // Construct a store from all networking info required
 Store::Store(size_t node_id, char *my_ip_address, int my_port, char *server_ip_address, int server_port) 
         : Node(my_ip_address, my_port, server_ip_address, server_port) {
     this->node_id = node_id;
-    map = new Map();
+    collective_seq = 0;
+    in_flight = nullptr;
+    in_flight_len = 0;
+    max_in_flight = STORE_MAX_IN_FLIGHT;
+    requests = nullptr;
+    requests_len = 0;
+    map = new StripedKeyTable();
+    cache = new RemoteCache(REMOTE_CACHE_DEFAULT_BYTES);
+    watches = new WatchTable();
+    notify_head = nullptr;
+    notify_tail = nullptr;
+    notifier_stopping = false;
+    expiries = nullptr;
+    stats_path = nullptr;
+    notifier = new std::thread(&Store::notify_loop_, this);
     register_and_listen();
 }
 
 Store::~Store() {
-    // Delete both keys and values from our map
-    map_lock.lock();
-    List *keys = map->keys();
-    List *vals = map->values();
-
-    for (size_t i = 0; i < keys->size(); i++) {
-        Object *key = keys->get(i);
-        Object *val = vals->get(i);
-        delete key;
-        delete val;
+    if (stats_path != nullptr) {
+        write_stats_(stats_path);
+        delete[] stats_path;
+    }
+
+    // Let the notifier send what it still owes, then stop it
+    {
+        std::lock_guard<std::mutex> lck(notify_lock);
+        notifier_stopping = true;
+    }
+    notify_cond.notify_one();
+    notifier->join();
+    delete notifier;
+
+    // Keys not yet expired stay; other nodes may have shut down already
+    while (expiries != nullptr) {
+        Expiry *e = expiries;
+        expiries = e->next;
+        delete e;
     }
 
-    delete keys;
-    delete vals;
+    delete watches;
+    delete cache;
+    delete[] in_flight;
+    delete[] requests;
+    // The table owns and deletes both keys and values
     delete map;
-    map_lock.unlock();
 }
 
 // Returns the ID of this node
@@ -55,43 +205,370 @@ size_t Store::num_nodes() {
     return num_nodes;
 }
 
+// Keeps at most the given number of bytes of this node's values in memory,
+// spilling the least recently used ones to files in spill_dir. 0 removes the limit.
+void Store::set_memory_budget(size_t bytes, const char* spill_dir) {
+    map->set_memory_budget(bytes, spill_dir, node_id);
+}
+
+// Caches at most the given number of bytes of sealed values from other
+// nodes. 0 turns the cache off.
+void Store::set_cache_capacity(size_t bytes) {
+    cache->set_capacity(bytes);
+}
+
+// Returns a new string describing this node's memory use: bytes of values in
+// memory, how many values and bytes were spilled to and reloaded from disk,
+// and how often gets of other nodes' values were answered from the cache
+char *Store::memory_stats() {
+    size_t spills = 0, spill_bytes = 0, reloads = 0, reload_bytes = 0;
+    if (map->segments != nullptr) {
+        spills = map->segments->spills;
+        spill_bytes = map->segments->spill_bytes;
+        reloads = map->segments->reloads;
+        reload_bytes = map->segments->reload_bytes;
+    }
+
+    size_t hits, misses, cached_bytes;
+    {
+        std::lock_guard<std::mutex> lck(cache->lock);
+        hits = cache->hits;
+        misses = cache->misses;
+        cached_bytes = cache->bytes;
+    }
+
+    const char *fmt = "resident %zu bytes, spilled %zu values (%zu bytes), reloaded %zu values (%zu bytes), "
+                      "cache hits %zu, misses %zu (%zu bytes cached), slabs %zu bytes (%zu in use)";
+    size_t resident = map->resident_bytes;
+    SlabAllocator *slab = SlabAllocator::global();
+    size_t slab_reserved = slab->reserved, slab_in_use = slab->in_use;
+    size_t size = snprintf(nullptr, 0, fmt, resident, spills, spill_bytes, reloads, reload_bytes, hits, misses,
+                           cached_bytes, slab_reserved, slab_in_use) + 1;
+    char *stats = new char[size];
+    snprintf(stats, size, fmt, resident, spills, spill_bytes, reloads, reload_bytes, hits, misses, cached_bytes,
+             slab_reserved, slab_in_use);
+    return stats;
+}
+
+// Returns a new JSON object of this node's metrics: counts of gets, puts and
+// messages, latency percentiles and the busiest key prefixes, along with the
+// size of its table and cache.
+char *Store::stats_json() {
+    size_t hits, misses, cached_bytes;
+    {
+        std::lock_guard<std::mutex> lck(cache->lock);
+        hits = cache->hits;
+        misses = cache->misses;
+        cached_bytes = cache->bytes;
+    }
+
+    char fields[384];
+    snprintf(fields, sizeof(fields),
+             "\"node\": %zu, \"keys\": %zu, \"resident_bytes\": %zu, \"cache_hits\": %zu, "
+             "\"cache_misses\": %zu, \"cache_bytes\": %zu, \"slab_reserved_bytes\": %zu, \"slab_in_use_bytes\": %zu",
+             node_id, map->size(), (size_t)map->resident_bytes, hits, misses, cached_bytes,
+             (size_t)SlabAllocator::global()->reserved, (size_t)SlabAllocator::global()->in_use);
+    return metrics->to_json(fields);
+}
+
+// Returns a new JSON object of the metrics of the given node, as made by
+// stats_json(), asking it with a STATS message if it is not this node
+char *Store::get_stats(size_t node) {
+    if (node == node_id) {
+        return stats_json();
+    }
+
+    Message *response = send_to_node_(node, STATS, "", 0);
+    if (response->msg_type != ACK) {
+        printf("ERROR: Node %zu did not get an ACK for its STATS to node %zu\n", node_id, node);
+        exit(1);
+    }
+    char *stats = duplicate(response->msg);
+    delete response;
+    return stats;
+}
+
+// Has this node write its metrics as JSON to the file at path when it shuts down
+void Store::set_stats_path(const char *path) {
+    delete[] stats_path;
+    stats_path = path == nullptr ? nullptr : duplicate((char *)path);
+}
+
+// Writes this node's metrics as JSON to the file at path, replacing it
+void Store::write_stats_(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) {
+        printf("WARN: Node %zu could not write its stats to %s\n", node_id, path);
+        return;
+    }
+    char *stats = stats_json();
+    fprintf(file, "%s\n", stats);
+    fclose(file);
+    delete[] stats;
+}
+
+// Saves every key and value this node holds to a snapshot file at path, for
+// load_snapshot() to restore after a restart. Values left by collective
+// operations are not saved. Returns the number saved.
+size_t Store::save_snapshot(const char *path) {
+    Snapshot snapshot(path);
+    return snapshot.save(map, node_id, COLLECTIVE_KEY_PREFIX);
+}
+
+// Puts every key and value of the snapshot this node saved at path back in
+// its store. Frames saved by every node can then be gotten by their Keys again
+// without being rebuilt. Returns false if there is no snapshot at path.
+// Meant for startup: threads already waiting for the keys are not woken.
+bool Store::load_snapshot(const char *path) {
+    Snapshot snapshot(path);
+    return snapshot.load(map, node_id);
+}
+
+/*******************************************************************************
+ *  FrameBody::
+ *  The body of a message that puts a DistributedDataFrame, serialized as it
+ *  is written to the connection, so the frame's text is never held whole.
+ */
+class FrameBody : public MessageBody {
+   public:
+    Serializer* serializer;
+    DistributedDataFrame* df;  // external
+    size_t len;
+    Histogram* serialize_nanos;  // external; times writing, waits on the connection included
+
+    FrameBody(Serializer* serializer, DistributedDataFrame* df, Histogram* serialize_nanos) {
+        this->serializer = serializer;
+        this->df = df;
+        this->serialize_nanos = serialize_nanos;
+        len = serializer->distributed_dataframe_len(df);
+    }
+
+    size_t size() { return len; }
+
+    void write_to(Sink* sink) {
+        serialize_nanos->timed([&] { serializer->serialize_distributed_dataframe(df, sink); });
+    }
+};
+
 // Stores the given DistributedDataFrame in the store, possibly on another node.
-// Does not modify or delete given vales
+// Does not delete given values. If k is replicated, the frame's chunk keys are
+// made replicated the same way, so the frame is read from its replicas too.
+// A frame with no columns has nothing to store, and is an error.
 void Store::put(Key *k, DistributedDataFrame *df) {
-    char *value = serializer->serialize_distributed_dataframe(df);
+    if (df->ncols() == 0) {
+        printf("ERROR: Tried to put a DistributedDataFrame with no columns under key %s\n", k->get_name());
+        exit(1);
+    }
+    if (k->replicas > 1) {
+        replicate_frame_(df, k->replicas);
+    }
+
+    // A frame another node keeps the only copy of is streamed to it as it is
+    // serialized; one this node or replicas keep is built once and shared
+    if (k->get_home_node() != node_id && k->num_replicas(num_nodes()) <= 1) {
+        LatencyTimer timer(&metrics->put_nanos);
+        metrics->puts_remote.add();
+        FrameBody body(serializer, df, &metrics->serialize_nanos);
+        size_t replicas;
+        uint64_t version = send_put_request_(k, &body, &replicas);
+        if (replicas > 1) {
+            // The home node keeps the frame on more nodes than k says
+            Value *value = Value::adopt(
+                metrics->serialize_nanos.timed([&] { return serializer->serialize_distributed_dataframe(df); }));
+            put_replicas_(&k, &value, &version, &replicas, 1);
+            value->release();
+        }
+        return;
+    }
+    char *serialized = metrics->serialize_nanos.timed([&] { return serializer->serialize_distributed_dataframe(df); });
+    put(k, Value::adopt(serialized));
+}
 
-    put_char_(k, value);
+// Stores the given Bitmap in the store, possibly on another node.
+// Does not modify or delete given values
+void Store::put(Key *k, Bitmap *bitmap) {
+    put(k, serializer->serialize_bitmap(bitmap));
+}
 
-    delete[] value;
+// Stores the given Sketch in the store, possibly on another node.
+// Does not modify or delete given values
+void Store::put(Key *k, Sketch *sketch) {
+    put(k, Value::adopt(serializer->serialize_sketch(sketch)));
 }
 
-// Saves the given char* to the given key. For internal use only.
-// Uses copies of given key/value (does not modify or delete them)
-void Store::put_char_(Key *key, char *value) {
+// Stores the given Value in the store, possibly on another node.
+// Takes over the caller's reference to value rather than copying it, so the
+// caller must not release it afterwards. Uses a copy of the given key.
+void Store::put(Key *key, Value *value) {
     if (value == nullptr) {
         printf("ERROR: Tried to put a nullptr value into the store under key %s\n", key->get_name());
         exit(1);
     }
 
+    LatencyTimer timer(&metrics->put_nanos);
     size_t key_home = key->get_home_node();
-
+    // Replicas get the value once its home node has given it a version and
+    // said how many nodes keep it
+    uint64_t version;
+    size_t replicas;
     if (key_home == node_id) {
-        // Value belongs on this node
-        String *val = new String(value);  // deleted in destructor
-
-        // Put value in map under mutex
-        // In case active thread is getAndWaiting for a new value, notify it that there's a new value in the map
-        {
-            std::lock_guard<std::mutex> lck(map_lock);
-            // Calling delete here in case put returns a replaced value
-            delete map->put(key->clone(), val);
-            put_has_occured = true;
-        }
-        cond_var.notify_one();
+        metrics->puts_local.add();
+        version = put_local_(key, value->retain(), &replicas);
     } else {
         // Value belongs on another node
-        send_put_request_(key, value);
+        metrics->puts_remote.add();
+        version = send_put_request_(key, value->data(), value->size(), &replicas);
+    }
+
+    if (replicas > 1) {
+        put_replicas_(&key, &value, &version, &replicas, 1);
+    }
+    value->release();
+}
+
+// Puts the given Value under the given key of this node, and hands it to
+// anyone waiting for the key. Takes over the caller's reference to value.
+// Returns the version the value got. Sets replicas, if given, to the number
+// of nodes the entry keeps its value on: the most any put of the key asked
+// for, not just this one.
+uint64_t Store::put_local_(Key *key, Value *value, size_t *replicas) {
+    metrics->record_put(key->get_name(), value->size());
+
+    // The table keeps our reference. Hold another until waiters have it,
+    // since a racing put could replace it in the table.
+    value->retain();
+
+    // The table locks only the stripe holding key.
+    // The table copies the key only if it is new.
+    uint64_t old_version;
+    Value *replaced = map->put(key, value, &old_version, replicas);
+
+    // Other nodes may have cached the sealed value just replaced
+    if (old_version & KEY_SEALED) {
+        invalidate_caches_(key, (old_version & ~KEY_SEALED) + 1);
+    }
+
+    // In case other threads or nodes are waiting for this key, hand them the new value
+    notify_watchers_(key, value);
+    value->release();
+
+    // Readers may still hold the replaced value, so only drop our reference
+    if (replaced != nullptr) {
+        replaced->release();
+    }
+    return (old_version & ~KEY_SEALED) + 1;
+}
+
+// Puts copies of values[i] under keys[i] on every node holding a replica of
+// the key other than its home node, all sent at once, for each of the n keys
+// that are replicated. Versions[i] and replicas[i] are the version keys[i]
+// got on its home node and the number of nodes the home node keeps it on,
+// which may be more than the key says. A replica keeps only values newer
+// than the one it has, so replicas agree on the latest value even when puts
+// of a key race each other. Does not take over the caller's references to
+// the values.
+void Store::put_replicas_(Key **keys, Value **values, uint64_t *versions, size_t *replicas, size_t n) {
+    size_t nodes = num_nodes();
+    size_t *starts = new size_t[nodes + 1];
+    size_t *order = group_by_replica_(keys, replicas, n, nodes, starts);
+
+    size_t *asked = new size_t[nodes];
+    size_t num_asked = 0;
+    for (size_t node = 0; node < nodes; node++) {
+        if (node == node_id) {
+            for (size_t i = starts[node]; i < starts[node + 1]; i++) {
+                size_t idx = order[i];
+                map->put_replica(keys[idx], values[idx]->retain(), versions[idx]);
+            }
+        } else if (starts[node + 1] > starts[node]) {
+            asked[num_asked++] = node;
+        }
+    }
+
+    run_per_node_(asked, num_asked, [&](size_t node) {
+        send_replicate_(node, keys, values, versions, order + starts[node], starts[node + 1] - starts[node]);
+    });
+
+    delete[] asked;
+    delete[] order;
+    delete[] starts;
+}
+
+// Orders the indices of the n keys by the nodes holding their replicas,
+// other than their home nodes, like group_by_home_(). A key replicated on r
+// nodes, replicas[i] for keys[i] if replicas are given, appears r - 1 times.
+// Returns a new array of the indices, where those of the keys node j holds a
+// replica of run from starts[j] up to starts[j + 1]. Starts must have room
+// for nodes + 1 entries.
+size_t *Store::group_by_replica_(Key **keys, size_t *replicas, size_t n, size_t nodes, size_t *starts) {
+    size_t *counts = new size_t[n];
+    for (size_t i = 0; i < n; i++) {
+        size_t r = replicas != nullptr ? replicas[i] : keys[i]->replicas;
+        counts[i] = r < nodes ? r : nodes;
+    }
+    for (size_t node = 0; node <= nodes; node++) {
+        starts[node] = 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        for (size_t r = 1; r < counts[i]; r++) {
+            starts[keys[i]->replica_node(r, nodes) + 1]++;
+        }
+    }
+    for (size_t node = 0; node < nodes; node++) {
+        starts[node + 1] += starts[node];
+    }
+
+    size_t *order = new size_t[starts[nodes]];
+    size_t *next = new size_t[nodes];
+    memcpy(next, starts, nodes * sizeof(size_t));
+    for (size_t i = 0; i < n; i++) {
+        for (size_t r = 1; r < counts[i]; r++) {
+            order[next[keys[i]->replica_node(r, nodes)]++] = i;
+        }
+    }
+    delete[] next;
+    delete[] counts;
+    return order;
+}
+
+// Makes every chunk and missings of the given frame's columns replicated on
+// the given number of nodes, copying the chunks it already has to the new
+// replicas. Chunks are read and put again COPY_BATCH_CHUNKS at a time with
+// batched gets and puts. Does not delete the given frame
+void Store::replicate_frame_(DistributedDataFrame *df, size_t replicas) {
+    // Chunks still being put would be missed
+    df->flush_chunks_();
+
+    Key *batch[2 * COPY_BATCH_CHUNKS];
+    for (size_t col_idx = 0; col_idx < df->ncols(); col_idx++) {
+        DistributedColumn *col = dynamic_cast<DistributedColumn *>(df->columns[col_idx]);
+        for (size_t start = 0; start < col->num_chunks; start += COPY_BATCH_CHUNKS) {
+            size_t n = 0;
+            for (size_t i = start; i < col->num_chunks && i < start + COPY_BATCH_CHUNKS; i++) {
+                batch[n++] = col->chunk_keys[i];
+                batch[n++] = col->missings_keys[i];
+            }
+
+            // Read from the home nodes before the keys say there are replicas
+            Value **values = DistributedColumn::get_chunks_dist(this, batch, n);
+            for (size_t i = 0; i < n; i++) {
+                batch[i]->set_replicas(replicas);
+            }
+            put_many(batch, values, n);
+            delete[] values;
+        }
+    }
+}
+
+// Saves the given char* to the given key. For internal use only.
+// Uses copies of given key/value (does not modify or delete them)
+void Store::put_char_(Key *key, char *value) {
+    if (value == nullptr) {
+        printf("ERROR: Tried to put a nullptr value into the store under key %s\n", key->get_name());
+        exit(1);
     }
+
+    put(key, Value::copy(value, strlen(value)));
 }
 
 /*
@@ -100,95 +577,213 @@ void Store::put_char_(Key *key, char *value) {
     Uses copies of given key/array (does not modify or delete them)
 */
 void Store::put_(Key *k, bool *bools, size_t num) {
-    char *value = serializer->serialize_bools(bools, num);
-
-    put_char_(k, value);
-
-    // Delete memory allocated by serializer
-    delete[] value;
+    // The store takes over the chunk made by the serializer
+    Value *chunk = metrics->serialize_nanos.timed([&] { return serializer->serialize_chunk(bools, num); });
+    put(k, chunk);
 }
 
 void Store::put_(Key *k, int *ints, size_t num) {
-    char *value = serializer->serialize_ints(ints, num);
+    Value *chunk = metrics->serialize_nanos.timed([&] { return serializer->serialize_chunk(ints, num); });
+    put(k, chunk);
+}
 
-    put_char_(k, value);
+void Store::put_(Key *k, float *floats, size_t num) {
+    Value *chunk = metrics->serialize_nanos.timed([&] { return serializer->serialize_chunk(floats, num); });
+    put(k, chunk);
+}
 
-    delete[] value;
+void Store::put_(Key *k, String **strings, size_t num) {
+    Value *chunk = metrics->serialize_nanos.timed([&] { return serializer->serialize_chunk(strings, num); });
+    put(k, chunk);
 }
 
-void Store::put_(Key *k, float *floats, size_t num) {
-    char *value = serializer->serialize_floats(floats, num);
+/*
+    The following put_ methods save the same array under each of num_keys keys,
+    serializing it once and sending one batch per node. They are helper methods
+    for DistributedColumns filling new chunks with defaults.
+*/
+void Store::put_(Key **keys, size_t num_keys, bool *bools, size_t num) {
+    Value *chunk = metrics->serialize_nanos.timed([&] { return serializer->serialize_chunk(bools, num); });
+    put_same_(keys, num_keys, chunk);
+}
 
-    put_char_(k, value);
+void Store::put_(Key **keys, size_t num_keys, int *ints, size_t num) {
+    Value *chunk = metrics->serialize_nanos.timed([&] { return serializer->serialize_chunk(ints, num); });
+    put_same_(keys, num_keys, chunk);
+}
 
-    delete[] value;
+void Store::put_(Key **keys, size_t num_keys, float *floats, size_t num) {
+    Value *chunk = metrics->serialize_nanos.timed([&] { return serializer->serialize_chunk(floats, num); });
+    put_same_(keys, num_keys, chunk);
 }
 
-void Store::put_(Key *k, String **strings, size_t num) {
-    char *value = serializer->serialize_strings(strings, num);
+void Store::put_(Key **keys, size_t num_keys, String **strings, size_t num) {
+    Value *chunk = metrics->serialize_nanos.timed([&] { return serializer->serialize_chunk(strings, num); });
+    put_same_(keys, num_keys, chunk);
+}
 
-    put_char_(k, value);
-    
-    delete[] value;
+// Puts value under every one of the given keys with put_many(). Values never
+// change once made, so every local key shares the one value. Takes over the
+// caller's reference to value.
+void Store::put_same_(Key **keys, size_t num_keys, Value *value) {
+    Value **values = new Value *[num_keys];
+    for (size_t i = 0; i < num_keys; i++) {
+        values[i] = value->retain();
+    }
+    value->release();
+
+    put_many(keys, values, num_keys);
+    delete[] values;
 }
 
-// Asks another node to PUT the given key/value
-void Store::send_put_request_(Key *key, char *value) {
+// Sends a message about the given key to the given node, and returns its
+// response. The message has the form [KEY_ID]~[KEY_STRING], where the id is
+// in hex, followed by ~[REST] if rest is not nullptr. Rest is sent as len
+// bytes, so it may hold anything. If the key lives on another node than
+// to_node, the id is followed by @[HOME_NODE].
+Message *Store::send_key_msg_(size_t to_node, MessageType type, Key *key, const char *rest, size_t len) {
+    BytesBody body(rest, len);
+    return send_key_msg_(to_node, type, key, rest == nullptr ? nullptr : &body);
+}
+
+// Same as above, but the rest is written after the key as it is produced,
+// without being copied into the message
+Message *Store::send_key_msg_(size_t to_node, MessageType type, Key *key, MessageBody *rest) {
     char *key_str = key->get_name();
-    size_t key_home = key->get_home_node();
 
+    size_t header_size = KEY_ID_MSG_CHARS + strlen(key_str) + 1 + 1 + 1;
+    char *msg = new char[header_size];
+    size_t msg_len = write_key_id_(msg, key, to_node);
+    msg_len += snprintf(msg + msg_len, header_size - msg_len, "~%s", key_str);
+    if (rest != nullptr) {
+        msg[msg_len++] = '~';
+    }
+
+    Message *response = send_to_node_(to_node, type, msg, msg_len, rest);
+
+    delete[] msg;
+    return response;
+}
+
+// Writes the id of the given key in hex to buf, followed by @[HOME_NODE] if
+// the key lives on another node than to_node, and by #[REPLICAS] if it is
+// replicated, and returns the number of chars written. Buf needs room for
+// KEY_ID_MSG_CHARS chars.
+size_t Store::write_key_id_(char *buf, Key *key, size_t to_node) {
+    size_t len;
+    if (key->get_home_node() == to_node) {
+        len = sprintf(buf, "%" PRIx64, key->get_id());
+    } else {
+        len = sprintf(buf, "%" PRIx64 "@%zu", key->get_id(), key->get_home_node());
+    }
+    if (key->replicas > 1) {
+        len += sprintf(buf + len, "#%zu", key->replicas);
+    }
+    return len;
+}
+
+// Returns the home node of a key whose id, as written by write_key_id_(),
+// starts at id_str: the node named after the id, or else this node
+size_t Store::parse_key_home_(char *id_str) {
+    char *end;
+    strtoull(id_str, &end, 16);
+    return *end == '@' ? strtoul(end + 1, nullptr, 10) : node_id;
+}
+
+// Returns the number of replicas of a key whose id, as written by
+// write_key_id_(), starts at id_str: the number after the id, or else 1
+size_t Store::parse_key_replicas_(char *id_str) {
+    char *end;
+    strtoull(id_str, &end, 16);
+    if (*end == '@') {
+        strtoul(end + 1, &end, 10);
+    }
+    return *end == '#' ? strtoul(end + 1, nullptr, 10) : 1;
+}
+
+// Sends a message with the len bytes of msg as its body to the given node,
+// followed by the given body if any, and returns its response
+Message *Store::send_to_node_(size_t to_node, MessageType type, const char *msg, size_t len, MessageBody *body) {
     known_nodes_lock.lock();
-    String *other_node_address = known_nodes->get(key_home);
+    String *other_node_address = known_nodes->get(to_node);
     known_nodes_lock.unlock();
 
     char *other_node_host = network->get_host_from_address(other_node_address);
     int other_node_port = network->get_port_from_address(other_node_address);
 
-    // Create PUT message to send to the other node, consisting of the format
-    // [KEY_STRING]~[VALUE]
-    char msg[strlen(key_str) + 1 + strlen(value)];
-    sprintf(msg, "%s~%s", key_str, value);
+    count_request_(to_node, true);
+    Message *response = send_msg(other_node_host, other_node_port, type, msg, len, body);
+    count_request_(to_node, false);
+    assert(response != nullptr);
+
+    delete[] other_node_host;
+    return response;
+}
+
+// Parses the key at the start of a message sent by send_key_msg_(), and
+// returns it as a new Key homed on this node, unless the message names its
+// home. Sets rest to the start of the rest of the message, or nullptr if
+// there is none.
+Key *Store::parse_key_msg_(Message *msg, char **rest) {
+    char *id_str = msg->msg;
+    char *key_str = strchr(id_str, '~') + 1;
+
+    // Key names never hold '~', but the rest may
+    char *key_end = strchr(key_str, '~');
+    *rest = nullptr;
+    if (key_end != nullptr) {
+        *key_end = '\0';
+        *rest = key_end + 1;
+    }
+
+    // The sender already computed the key's id
+    Key *key = new Key(key_str, parse_key_home_(id_str), strtoull(id_str, nullptr, 16));
+    return key->set_replicas(parse_key_replicas_(id_str));
+}
+
+// Asks another node to PUT the given key and the len bytes of value.
+// Returns the version the value got there, and sets replicas to the number
+// of nodes that node keeps the key's value on.
+uint64_t Store::send_put_request_(Key *key, const char *value, size_t len, size_t *replicas) {
+    BytesBody body(value, len);
+    return send_put_request_(key, &body, replicas);
+}
+
+// Same as above, but the value is written as it is produced
+uint64_t Store::send_put_request_(Key *key, MessageBody *value, size_t *replicas) {
+    size_t key_home = key->get_home_node();
 
-    Message *response = send_msg(other_node_host, other_node_port, PUT, msg);
+    Message *response = send_key_msg_(key_home, PUT, key, value);
 
     if (response->msg_type != ACK) {
         printf("Node %zu did not get successful ACK for its PUT request to node %zu\n", node_id, key_home);
         exit(1);
     }
-    
+
+    // Response consists of [VERSION]~[REPLICAS], the version in hex
+    char *pos;
+    uint64_t version = strtoull(response->msg, &pos, 16);
+    *replicas = strtoul(pos + 1, nullptr, 10);
     delete response;
-    delete[] other_node_host;
+    return version;
 }
 
 // Gets the given key for a DistributedDataFrame from the store, possibly from another node.
 // If key doesn't exist, returns nullptr.
 // Does not modify or delete given key
 DistributedDataFrame *Store::get(Key *k) {
-    char *serialized_df = get_char_(k, true);
+    Value *serialized_df = get_value_(k);
 
     if (serialized_df == nullptr) {
         return nullptr;
     }
 
-    DistributedDataFrame *df = serializer->deserialize_distributed_dataframe(serialized_df, this);
+    // Parses the shared value in place, without copying it
+    ArraySource source(serialized_df->data(), serialized_df->size());
+    DistributedDataFrame *df = metrics->deserialize_nanos.timed(
+        [&] { return serializer->deserialize_distributed_dataframe(&source, this); });
 
-    delete[] serialized_df;
-
-    return df;
-}
-
-// Same as get() but does not use mutex when accessing store.
-// Useful if caller has acquired the lock already.
-DistributedDataFrame *Store::get_unsafe_(Key* k) {
-    char *serialized_df = get_char_(k, false);
-
-    if (serialized_df == nullptr) {
-        return nullptr;
-    }
-
-    DistributedDataFrame *df = serializer->deserialize_distributed_dataframe(serialized_df, this);
-
-    delete[] serialized_df;
+    serialized_df->release();
 
     return df;
 }
@@ -196,212 +791,1808 @@ DistributedDataFrame *Store::get_unsafe_(Key* k) {
 /*
     The following get_ methods save the given arrays under the given key, possibly on another node.
     They are helper method for DistributedColumns. Not meant to be used by end users.
-    Uses copies of given key (does not modify or delete it)
+    Uses copies of given key (does not modify or delete it). Given an arena, the array is
+    built in it, for a caller that only needs it for the one operation, and must not be deleted.
 */
-bool *Store::get_bool_array_(Key *k) {
-    char *serialized_array = get_char_(k, true);
+bool *Store::get_bool_array_(Key *k, Arena *arena) {
+    Value *serialized_array = get_value_(k);
 
     if (serialized_array == nullptr) {
         printf("WARN: get_bool_array_ return nullptr for key %s,%zu\n", k->get_name(), k->get_home_node());
         return nullptr;
     }
 
-    bool *bools = serializer->deserialize_bools(serialized_array);
+    // Parses the shared value in place, without copying it
+    bool *bools = metrics->deserialize_nanos.timed(
+        [&] { return serializer->deserialize_bool_chunk(serialized_array, arena); });
 
-    delete[] serialized_array;
+    serialized_array->release();
     return bools;
 }
 
-int *Store::get_int_array_(Key *k) {
-    char *serialized_array = get_char_(k, true);
+int *Store::get_int_array_(Key *k, Arena *arena) {
+    Value *serialized_array = get_value_(k);
 
     if (serialized_array == nullptr) {
         printf("WARN: get_int_array_ return nullptr for key %s,%zu\n", k->get_name(), k->get_home_node());
         return nullptr;
     }
 
-    int *ints = serializer->deserialize_ints(serialized_array);
+    int *ints = metrics->deserialize_nanos.timed(
+        [&] { return serializer->deserialize_int_chunk(serialized_array, arena); });
 
-    delete[] serialized_array;
+    serialized_array->release();
     return ints;
 }
 
-float *Store::get_float_array_(Key *k) {
-    char *serialized_array = get_char_(k, true);
+float *Store::get_float_array_(Key *k, Arena *arena) {
+    Value *serialized_array = get_value_(k);
 
     if (serialized_array == nullptr) {
         printf("WARN: get_float_array_ return nullptr for key %s,%zu\n", k->get_name(), k->get_home_node());
         return nullptr;
     }
 
-    float *floats = serializer->deserialize_floats(serialized_array);
-    
-    delete[] serialized_array;
+    float *floats = metrics->deserialize_nanos.timed(
+        [&] { return serializer->deserialize_float_chunk(serialized_array, arena); });
+
+    serialized_array->release();
     return floats;
 }
 
-String **Store::get_string_array_(Key *k) {
-    char *serialized_array = get_char_(k, true);
+String **Store::get_string_array_(Key *k, Arena *arena) {
+    Value *serialized_array = get_value_(k);
 
     if (serialized_array == nullptr) {
         printf("WARN: get_string_array_ return nullptr for key %s,%zu\n", k->get_name(), k->get_home_node());
         return nullptr;
     }
 
-    String **strings = serializer->deserialize_strings(serialized_array);
+    String **strings = metrics->deserialize_nanos.timed(
+        [&] { return serializer->deserialize_string_chunk(serialized_array, arena); });
 
-    delete[] serialized_array;
+    serialized_array->release();
     return strings;
 }
 
-// Gets a copy of the value associated with the given key, possibly from another node,
-// and returns as a char*. If key doesn't exist, returns nullptr.
-// If safe is true, uses a lock while accessing the store.
-// For internal use only.
-char *Store::get_char_(Key *key, bool safe) {
+/*
+    Points the given view, a ChunkView or StringChunkView, at the chunk under the given key,
+    possibly on another node, reading it in place when it is plain binary. Returns false,
+    leaving the view empty, if there is no such key. The view holds the chunk while it
+    looks at it, so a local chunk is neither copied nor parsed.
+*/
+template <class View>
+bool Store::get_view_(Key *k, View *view) {
+    Value *chunk = get_value_(k);
+    if (chunk == nullptr) {
+        printf("WARN: get_view_ found nothing for key %s,%zu\n", k->get_name(), k->get_home_node());
+        view->clear();
+        return false;
+    }
+
+    metrics->deserialize_nanos.timed([&] { serializer->view_chunk(chunk, view); });
+    chunk->release();
+    return true;
+}
+
+// Gets the value associated with the given key, possibly from another node.
+// If key doesn't exist, returns nullptr. A local value, or a sealed one
+// cached from another node, is shared rather than copied; the caller must
+// release() the result. For internal use only.
+Value *Store::get_value_(Key *key) {
+    LatencyTimer timer(&metrics->get_nanos);
     size_t key_home = key->get_home_node();
 
     if (key_home == node_id) {
-        if (safe) map_lock.lock();
-        Object *value_obj = map->get(key);
-        if (safe) map_lock.unlock();
+        metrics->gets_local.add();
+        return get_local_(key);
+    }
 
-        if (value_obj == nullptr) {
-            // Key does not exist
-            return nullptr;
-        }
+    Value *replica = get_local_replica_(key);
+    if (replica != nullptr) {
+        return replica;
+    }
+    Value *cached = cache->get(key);
+    if (cached != nullptr) {
+        return cached;
+    }
+    // Value maybe lives on another node
+    return send_get_request_(key, read_node_(key));
+}
+
+// Returns this node's replica of the value of the given key of another node,
+// or nullptr if it holds none
+Value *Store::get_local_replica_(Key *key) {
+    if (key->replicas <= 1 || !key->is_replica_on(node_id, num_nodes())) {
+        return nullptr;
+    }
+    Value *value = get_local_(key);
+    if (value != nullptr) {
+        metrics->gets_local.add();
+    }
+    return value;
+}
+
+// Picks the node to ask for the value of the given key of another node: of
+// the nodes holding a replica other than this one, the one this node has the
+// fewest requests under way to. Readers start looking from different
+// replicas, so ties spread them over all of them.
+size_t Store::read_node_(Key *key) {
+    size_t nodes = num_nodes();
+    size_t replicas = key->num_replicas(nodes);
+    if (replicas <= 1) {
+        return key->get_home_node();
+    }
 
-        // All objects in the map should be string*
-        String *val_string = dynamic_cast<String *>(value_obj);
-        char *value = val_string->c_str();
+    std::lock_guard<std::mutex> lck(in_flight_lock);
+    size_t start = (size_t)((key->get_id() + node_id) % replicas);
+    size_t best = key->get_home_node();
+    size_t best_load = SIZE_MAX;
+    for (size_t i = 0; i < replicas; i++) {
+        size_t node = key->replica_node((start + i) % replicas, nodes);
+        size_t load = node < requests_len ? requests[node] : 0;
+        if (node != node_id && load < best_load) {
+            best = node;
+            best_load = load;
+        }
+    }
+    return best;
+}
 
-        return duplicate(value);
+// Counts a request from this node to the given node as started, or finished
+void Store::count_request_(size_t to_node, bool started) {
+    std::lock_guard<std::mutex> lck(in_flight_lock);
+    if (to_node >= requests_len) {
+        size_t len = to_node + 1;
+        size_t *grown = new size_t[len]();
+        if (requests != nullptr) {
+            memcpy(grown, requests, requests_len * sizeof(size_t));
+        }
+        delete[] requests;
+        requests = grown;
+        requests_len = len;
+    }
+    if (started) {
+        requests[to_node]++;
     } else {
-        // Value maybe lives on another node
-        char *value = send_get_request_(key);
-        return value;
+        requests[to_node]--;
     }
 }
 
-// Asks another node to GET the value associated with the given key
-// Returns a heap-allocated value, or nullptr
-char *Store::send_get_request_(Key *key) {
-    char *key_str = key->get_name();
-    size_t key_home = key->get_home_node();
+// Gets the value of the given key of this node, or nullptr, and sets version
+// to its version if given. The table takes our reference under its stripe's
+// read lock, so a concurrent put replacing the value cannot free it first.
+Value *Store::get_local_(Key *key, uint64_t *version) {
+    Value *value = map->get(key, version);
+    if (value != nullptr) {
+        metrics->record_get(key->get_name(), value->size());
+    }
+    return value;
+}
 
-    known_nodes_lock.lock();
-    String *other_node_address = known_nodes->get(key_home);
-    known_nodes_lock.unlock();
+// Gets a copy of the value associated with the given key, possibly from another node,
+// and returns as a char*. If key doesn't exist, returns nullptr.
+// For internal use only.
+char *Store::get_char_(Key *key) {
+    Value *value = get_value_(key);
+    if (value == nullptr) {
+        return nullptr;
+    }
 
-    char *other_node_host = network->get_host_from_address(other_node_address);
-    int other_node_port = network->get_port_from_address(other_node_address);
+    char *copy = value->duplicate_bytes();
+    value->release();
+    return copy;
+}
+
+// Asks the given node, which holds the home or a replica of the given key,
+// to GET the value associated with the key. A replica that does not have the
+// value (yet) leaves the answer to the home node.
+// Returns a new Value, or nullptr
+Value *Store::send_get_request_(Key *key, size_t to_node) {
+    if (to_node != key->get_home_node()) {
+        Value *value = send_key_request_(key, GET, nullptr, to_node);
+        if (value != nullptr) {
+            return value;
+        }
+    }
+    return send_key_request_(key, GET, nullptr, key->get_home_node());
+}
 
-    // Send GET request to another node with key we're asking for
-    Message *response = send_msg(other_node_host, other_node_port, GET, key_str);
+// Asks the given node, the home node of the given key or one holding a
+// replica, for its value with a GET, or with a WATCH naming this node as
+// watcher. Returns a new Value, or nullptr if the key does not exist (yet).
+// Caches the value if its home node sealed it.
+Value *Store::send_key_request_(Key *key, MessageType type, char *watcher, size_t to_node) {
+    // An invalidation may overtake the reply, so note how many came before
+    uint64_t epoch = cache->epoch();
 
-    assert(response != nullptr);
+    metrics->gets_remote.add();
+    size_t watcher_len = watcher == nullptr ? 0 : strlen(watcher);
+    Message *response = send_key_msg_(to_node, type, key, watcher, watcher_len);
 
     if (response->msg_type == NACK) {
         // key does not exist
+        delete response;
         return nullptr;
+    } else if (response->msg_type == SEALED) {
+        // Response consists of [VERSION]~[VALUE], where the version is in hex
+        char *val_str;
+        uint64_t version = strtoull(response->msg, &val_str, 16);
+        val_str++;
+        Value *value = Value::copy(val_str, response->msg_len - (val_str - response->msg));
+        cache->put(key, value, version, epoch);
+
+        delete response;
+        return value;
     } else if (response->msg_type != ACK) {
-        printf("ERROR: Node %zu did not get successful NACK or ACK for its GET request to node %zu\n", node_id, key_home);
+        printf("ERROR: Node %zu did not get successful NACK or ACK for its request to node %zu\n", node_id, to_node);
         exit(1);
     } else if (response->msg == nullptr) {
-        printf("ERROR: Node %zu got a nullptr response body to its GET request. Full response was %s\n", node_id, response->to_string());
+        printf("ERROR: Node %zu got a nullptr response body to its request. Full response was %s\n", node_id, response->to_string());
         exit(1);
     }
 
-    char *serialized_value = duplicate(response->msg);
+    // Take over the response body instead of copying it
+    Value *value = Value::adopt(response->msg, response->msg_len);
+    response->msg = nullptr;
 
     delete response;
-    delete[] other_node_host;
 
-    return serialized_value;
+    return value;
 }
 
 // Gets the given key for a DistributedDataFrame from the store, possibly from another node.
 // If key doesn't exist, blocks until it does. Never returns nullptr.
 // Does not modify or delete given key
 DistributedDataFrame *Store::waitAndGet(Key *k) {
-    size_t key_home = k->get_home_node();
+    Value *serialized_df = wait_and_get_value_(k);
 
-    // If key is in the store, return it right away
-    DistributedDataFrame *df = get(k);
-    if (df) return df;
-
-    // Key is not yet in the store, loop and wait
-    while (df == nullptr) {
-        if (key_home == node_id) {
-            // Key is local. Use a conditional_variable to wait for it to appear
-            std::unique_lock<std::mutex> lck(map_lock);
-            cond_var.wait(lck, [&] { return put_has_occured; });
-            df = get_unsafe_(k); // Use unsafe version because we've already acquired the lock
-            put_has_occured = false;
-        } else {
-            // Key is across the network. Sleep intermittently while we wait.
-            std::this_thread::sleep_for(std::chrono::milliseconds(GETANDWAIT_SLEEP));
-            df = get(k);
-        }
-    }
+    ArraySource source(serialized_df->data(), serialized_df->size());
+    DistributedDataFrame *df = metrics->deserialize_nanos.timed(
+        [&] { return serializer->deserialize_distributed_dataframe(&source, this); });
+
+    serialized_df->release();
 
     return df;
 }
 
-// OVERRIDE
-// Handler for all messages that come into this node
-// Some sort of reply is expected to be written to the given socket
-// By default, sends empty ACK back to the message sender and prints a "message-received" string
-void Store::handle_message(int connected_socket, Message *msg) {
-    if (msg->msg_type == PUT) {
-        handle_put_(connected_socket, msg);
-    } else if (msg->msg_type == GET) {
-        handle_get_(connected_socket, msg);
-    } else {
-        printf("WARN: Store got a message from another node with unexpected message type %d\n", msg->msg_type);
+// Gets the Bitmap stored under the given key, possibly from another node.
+// If key doesn't exist, returns nullptr.
+// Does not modify or delete given key
+Bitmap *Store::get_bitmap(Key *k) {
+    Value *serialized_bitmap = get_value_(k);
+
+    if (serialized_bitmap == nullptr) {
+        return nullptr;
     }
-}
 
-// Called when this store gets a PUT request from another node
-void Store::handle_put_(int connected_socket, Message *msg) {
-    char *msg_contents = msg->msg;
-    
-    // For re-entrant, thread safety of strtok_r
-    char* entry; 
-    
-    // put together Key
-    char *key_str = strtok_r(msg_contents, "~", &entry);
-    // put together value_str
-    char *val_str = strtok_r(nullptr, "\0", &entry);
-
-    Key key(key_str, node_id);  // This node got a PUT request, so the key must live on this node.
-    // save to map
-    put_char_(&key, val_str);
+    Bitmap *bitmap = serializer->deserialize_bitmap(serialized_bitmap);
 
-    // Send ACK
-    Message ack(my_ip_address, my_port, ACK, (char *)"");
-    network->write_msg(connected_socket, &ack);
+    serialized_bitmap->release();
+
+    return bitmap;
 }
 
-// Called when this store gets a GET request from another node
-void Store::handle_get_(int connected_socket, Message *msg) {
-    // Message consists of just the key
-    char *key_str = msg->msg;
+// Same as get_bitmap() but blocks until the key exists. Never returns nullptr.
+Bitmap *Store::waitAndGet_bitmap(Key *k) {
+    Value *serialized_bitmap = wait_and_get_value_(k);
 
-    Key key(key_str, node_id);  // This node got a GET request, so the key must live on this node.
+    Bitmap *bitmap = serializer->deserialize_bitmap(serialized_bitmap);
 
-    char *serialized_value = get_char_(&key, true);
+    serialized_bitmap->release();
 
-    if (serialized_value == nullptr) {
-        // Value doesn't exist, so send NACK
-        Message nack(my_ip_address, my_port, NACK, (char *)"");
-        network->write_msg(connected_socket, &nack);
-    } else {
+    return bitmap;
+}
+
+// Combiner that unions two serialized Bitmaps. Used by merge_bitmap.
+class BitmapUnionCombiner : public Combiner {
+   public:
+    Serializer* serializer;
+
+    BitmapUnionCombiner(Serializer* serializer) {
+        this->serializer = serializer;
+    }
+
+    // Serialized bitmaps are binary, so they are only combined as Values
+    char* combine(char* left, char* right) {
+        printf("ERROR: Tried to combine serialized bitmaps as C strings\n");
+        exit(1);
+    }
+
+    Value* combine_values(Value* left, Value* right) {
+        Bitmap* merged = serializer->deserialize_bitmap(left);
+        Bitmap* other = serializer->deserialize_bitmap(right);
+
+        merged->union_with(other);
+        Value* value = serializer->serialize_bitmap(merged);
+
+        delete merged;
+        delete other;
+        return value;
+    }
+};
+
+// Cluster-wide OR-merge of one Bitmap per node. Must be called by every node.
+// Returns a new Bitmap, identical on every node, holding the union of all
+// nodes' bitmaps. Does not modify or delete the given bitmap.
+Bitmap *Store::merge_bitmap(Bitmap *local) {
+    BitmapUnionCombiner combiner(serializer);
+
+    Value *value = serializer->serialize_bitmap(local);
+    Value *merged_value = allreduce_value_(value, &combiner);
+
+    Bitmap *merged = serializer->deserialize_bitmap(merged_value);
+
+    value->release();
+    merged_value->release();
+    return merged;
+}
+
+// Gets the Sketch stored under the given key, possibly from another node.
+// If key doesn't exist, returns nullptr.
+// Does not modify or delete given key
+Sketch *Store::get_sketch(Key *k) {
+    char *serialized_sketch = get_char_(k);
+
+    if (serialized_sketch == nullptr) {
+        return nullptr;
+    }
+
+    Sketch *sketch = serializer->deserialize_sketch(serialized_sketch);
+
+    delete[] serialized_sketch;
+
+    return sketch;
+}
+
+// Same as get_sketch() but blocks until the key exists. Never returns nullptr.
+Sketch *Store::waitAndGet_sketch(Key *k) {
+    char *serialized_sketch = wait_and_get_char_(k);
+
+    Sketch *sketch = serializer->deserialize_sketch(serialized_sketch);
+
+    delete[] serialized_sketch;
+
+    return sketch;
+}
+
+// Combiner that merges two serialized Sketches of the same type and shape.
+// Used by merge_sketch.
+class SketchMergeCombiner : public Combiner {
+   public:
+    Serializer* serializer;
+
+    SketchMergeCombiner(Serializer* serializer) {
+        this->serializer = serializer;
+    }
+
+    char* combine(char* left, char* right) {
+        // deserialize_sketch tokenizes its input, so work with copies
+        char* left_copy = duplicate(left);
+        char* right_copy = duplicate(right);
+        Sketch* merged = serializer->deserialize_sketch(left_copy);
+        Sketch* other = serializer->deserialize_sketch(right_copy);
+
+        if (!merged->merge(other)) {
+            printf("ERROR: Tried to merge sketches of different types or shapes\n");
+            exit(1);
+        }
+        char* value = serializer->serialize_sketch(merged);
+
+        delete merged;
+        delete other;
+        delete[] left_copy;
+        delete[] right_copy;
+        return value;
+    }
+};
+
+// Cluster-wide merge of one Sketch per node, all of the same type and shape.
+// Must be called by every node. Returns a new Sketch, identical on every
+// node, summarizing the values of all nodes' sketches. Does not modify or
+// delete the given sketch.
+Sketch *Store::merge_sketch(Sketch *local) {
+    SketchMergeCombiner combiner(serializer);
+
+    char *value = serializer->serialize_sketch(local);
+    char *merged_value = allreduce(value, &combiner);
+
+    Sketch *merged = serializer->deserialize_sketch(merged_value);
+
+    delete[] value;
+    delete[] merged_value;
+    return merged;
+}
+
+// Gets the Value stored under the given key, possibly from another node.
+// If key doesn't exist, returns nullptr. Local values are shared with the
+// store rather than copied and may hold any bytes. The caller must
+// release() the result. Does not modify or delete given key
+Value *Store::get_value(Key *k) {
+    return get_value_(k);
+}
+
+// Same as get_value() but blocks until the key exists. Never returns nullptr.
+Value *Store::waitAndGet_value(Key *k) {
+    return wait_and_get_value_(k);
+}
+
+// Starts getting the value of the given key, possibly from another node, and
+// returns at once with a future for it: the value, or nullptr if the key has
+// none. Like get_value(), the caller must release() the value. Local and
+// cached values are ready at once. Blocks only while the key's home node
+// already has max_in_flight requests from this node under way.
+// Does not modify or delete given key
+std::future<Value *> Store::get_async(Key *k) {
+    size_t key_home = k->get_home_node();
+    Value *ready = nullptr;
+    if (key_home == node_id) {
+        metrics->gets_local.add();
+        ready = get_local_(k);
+    } else {
+        ready = get_local_replica_(k);
+        if (ready == nullptr) {
+            ready = cache->get(k);
+        }
+    }
+    if (key_home == node_id || ready != nullptr) {
+        std::promise<Value *> promise;
+        promise.set_value(ready);
+        return promise.get_future();
+    }
+
+    size_t to_node = read_node_(k);
+    acquire_request_slot_(to_node);
+    Key *key = k->clone();
+    return std::async(std::launch::async, [this, key, to_node] {
+        Value *value = send_get_request_(key, to_node);
+        delete key;
+        release_request_slot_(to_node);
+        return value;
+    });
+}
+
+// Starts putting value under the given key, possibly on another node, and
+// returns at once with a future that is ready once the value is stored.
+// Takes over the caller's reference to value, like put(). Local puts are done
+// before returning. Blocks only while the key's home node already has
+// max_in_flight requests from this node under way. Two puts of one key under
+// way at once may land in either order. Uses a copy of the given key.
+std::future<void> Store::put_async(Key *k, Value *value) {
+    size_t key_home = k->get_home_node();
+    if (key_home == node_id) {
+        put(k, value);
+        std::promise<void> promise;
+        promise.set_value();
+        return promise.get_future();
+    }
+
+    acquire_request_slot_(key_home);
+    Key *key = k->clone();
+    return std::async(std::launch::async, [this, key, key_home, value] {
+        size_t replicas;
+        uint64_t version = send_put_request_(key, value->data(), value->size(), &replicas);
+        release_request_slot_(key_home);
+        if (replicas > 1) {
+            Key *keys[] = {key};
+            Value *values[] = {value};
+            put_replicas_(keys, values, &version, &replicas, 1);
+        }
+        value->release();
+        delete key;
+    });
+}
+
+// Lets at most max asynchronous requests wait on any one node at once
+void Store::set_max_in_flight(size_t max) {
+    std::lock_guard<std::mutex> lck(in_flight_lock);
+    max_in_flight = max == 0 ? 1 : max;
+    in_flight_cond.notify_all();
+}
+
+// Waits until fewer than max_in_flight asynchronous requests to the given
+// node are under way, and counts one more
+void Store::acquire_request_slot_(size_t to_node) {
+    std::unique_lock<std::mutex> lck(in_flight_lock);
+    if (to_node >= in_flight_len) {
+        size_t len = to_node + 1;
+        size_t *grown = new size_t[len]();
+        if (in_flight != nullptr) {
+            memcpy(grown, in_flight, in_flight_len * sizeof(size_t));
+        }
+        delete[] in_flight;
+        in_flight = grown;
+        in_flight_len = len;
+    }
+    in_flight_cond.wait(lck, [&] { return in_flight[to_node] < max_in_flight; });
+    in_flight[to_node]++;
+}
+
+// Counts one asynchronous request to the given node as finished
+void Store::release_request_slot_(size_t to_node) {
+    std::lock_guard<std::mutex> lck(in_flight_lock);
+    in_flight[to_node]--;
+    in_flight_cond.notify_all();
+}
+
+// Gets the values of n keys, possibly from several nodes, with one GET_MANY
+// per node holding some of them, all sent at once. Returns a new array with
+// the value of keys[i], or nullptr if it has none, at index i. The caller
+// must release() each value and delete[] the array. Sealed values cached
+// from other nodes, and local values, are shared rather than copied.
+// Does not modify or delete given keys
+Value **Store::get_many(Key **keys, size_t n) {
+    LatencyTimer timer(&metrics->get_nanos);
+    Value **values = new Value *[n];
+    size_t nodes = num_nodes();
+    size_t *starts = new size_t[nodes + 1];
+
+    // Replicated keys are read from this node's replica if it has one, or
+    // else from the least loaded node holding one
+    size_t *targets = new size_t[n];
+    for (size_t i = 0; i < n; i++) {
+        Key *key = keys[i];
+        if (key->get_home_node() == node_id || key->replicas <= 1) {
+            targets[i] = key->get_home_node();
+        } else {
+            targets[i] = key->is_replica_on(node_id, nodes) ? node_id : read_node_(key);
+        }
+    }
+    size_t *order = group_by_home_(keys, n, nodes, starts, targets);
+
+    // Number of keys each node is asked for
+    size_t *counts = new size_t[nodes];
+    size_t *asked = new size_t[nodes];
+    size_t num_asked = 0;
+    for (size_t node = 0; node < nodes; node++) {
+        size_t *batch = order + starts[node];
+        size_t count = starts[node + 1] - starts[node];
+        if (node == node_id) {
+            metrics->gets_local.add(count);
+            for (size_t i = 0; i < count; i++) {
+                values[batch[i]] = get_local_(keys[batch[i]]);
+            }
+            continue;
+        }
+
+        // Only ask for the keys not cached, moving them to the front
+        size_t remaining = 0;
+        for (size_t i = 0; i < count; i++) {
+            Value *cached = cache->get(keys[batch[i]]);
+            if (cached != nullptr) {
+                values[batch[i]] = cached;
+            } else {
+                batch[remaining++] = batch[i];
+            }
+        }
+        counts[node] = remaining;
+        if (remaining > 0) {
+            asked[num_asked++] = node;
+        }
+    }
+
+    run_per_node_(asked, num_asked, [&](size_t node) {
+        send_get_many_(node, keys, order + starts[node], counts[node], values);
+    });
+
+    // A replica that does not have a value (yet) leaves the answer to the
+    // key's home node
+    for (size_t i = 0; i < n; i++) {
+        if (values[i] == nullptr && targets[i] != keys[i]->get_home_node()) {
+            values[i] = send_get_request_(keys[i], keys[i]->get_home_node());
+        }
+    }
+
+    delete[] targets;
+    delete[] asked;
+    delete[] counts;
+    delete[] order;
+    delete[] starts;
+    return values;
+}
+
+// Puts values[i] under keys[i] for each of the n keys, possibly on several
+// nodes, with one PUT_MANY per node holding some of them, all sent at once.
+// Takes over the caller's reference to each value, like put(), but not the
+// array itself. Uses copies of the given keys.
+void Store::put_many(Key **keys, Value **values, size_t n) {
+    LatencyTimer timer(&metrics->put_nanos);
+    size_t nodes = num_nodes();
+    size_t *starts = new size_t[nodes + 1];
+    size_t *order = group_by_home_(keys, n, nodes, starts);
+
+    // Replicas get the values once their home nodes have given them versions
+    // and said how many nodes keep each
+    uint64_t *versions = new uint64_t[n];
+    size_t *replicas = new size_t[n];
+    for (size_t i = 0; i < n; i++) {
+        values[i]->retain();
+    }
+
+    size_t *asked = new size_t[nodes];
+    size_t num_asked = 0;
+    for (size_t node = 0; node < nodes; node++) {
+        if (node == node_id) {
+            metrics->puts_local.add(starts[node + 1] - starts[node]);
+            for (size_t i = starts[node]; i < starts[node + 1]; i++) {
+                size_t idx = order[i];
+                versions[idx] = put_local_(keys[idx], values[idx], &replicas[idx]);
+            }
+        } else if (starts[node + 1] > starts[node]) {
+            asked[num_asked++] = node;
+        }
+    }
+
+    run_per_node_(asked, num_asked, [&](size_t node) {
+        send_put_many_(node, keys, values, order + starts[node], starts[node + 1] - starts[node], versions,
+                       replicas);
+    });
+
+    put_replicas_(keys, values, versions, replicas, n);
+    for (size_t i = 0; i < n; i++) {
+        values[i]->release();
+    }
+    delete[] versions;
+    delete[] replicas;
+
+    delete[] asked;
+    delete[] order;
+    delete[] starts;
+}
+
+// Orders the indices of the n keys by home node, or by targets[i] for
+// keys[i] if targets are given, keeping their order within each node.
+// Returns a new array of the indices, where those of node j's keys run from
+// starts[j] up to starts[j + 1]. Starts must have room for nodes + 1 entries.
+size_t *Store::group_by_home_(Key **keys, size_t n, size_t nodes, size_t *starts, size_t *targets) {
+    for (size_t node = 0; node <= nodes; node++) {
+        starts[node] = 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t home = targets == nullptr ? keys[i]->get_home_node() : targets[i];
+        if (home >= nodes) {
+            printf("ERROR: Key %s lives on node %zu, but there are only %zu nodes\n", keys[i]->get_name(), home, nodes);
+            exit(1);
+        }
+        starts[home + 1]++;
+    }
+    for (size_t node = 0; node < nodes; node++) {
+        starts[node + 1] += starts[node];
+    }
+
+    size_t *order = new size_t[n];
+    size_t *next = new size_t[nodes];
+    memcpy(next, starts, nodes * sizeof(size_t));
+    for (size_t i = 0; i < n; i++) {
+        order[next[targets == nullptr ? keys[i]->get_home_node() : targets[i]]++] = i;
+    }
+    delete[] next;
+    return order;
+}
+
+// Returns a new message to to_node naming the count keys whose indices are
+// in batch, of the form [COUNT]~ followed by [KEY_ID]~[KEY_STRING]~ for each
+// key, with the ids written by write_key_id_(). Sets len to its length.
+char *Store::key_list_msg_(size_t to_node, Key **keys, size_t *batch, size_t count, size_t *len) {
+    size_t msg_size = snprintf(nullptr, 0, "%zu~", count) + 1;
+    for (size_t i = 0; i < count; i++) {
+        msg_size += KEY_ID_MSG_CHARS + strlen(keys[batch[i]]->get_name()) + 1;
+    }
+    char *msg = new char[msg_size];
+    size_t msg_len = sprintf(msg, "%zu~", count);
+    for (size_t i = 0; i < count; i++) {
+        Key *key = keys[batch[i]];
+        msg_len += write_key_id_(msg + msg_len, key, to_node);
+        msg_len += sprintf(msg + msg_len, "~%s~", key->get_name());
+    }
+    *len = msg_len;
+    return msg;
+}
+
+// Asks the given node for the values of the count keys whose indices are in
+// batch with one GET_MANY, made by key_list_msg_(), and stores each at the
+// key's index in values
+void Store::send_get_many_(size_t to_node, Key **keys, size_t *batch, size_t count, Value **values) {
+    // An invalidation may overtake the reply, so note how many came before
+    uint64_t epoch = cache->epoch();
+
+    metrics->gets_remote.add(count);
+    size_t msg_len;
+    char *msg = key_list_msg_(to_node, keys, batch, count, &msg_len);
+    Message *response = send_to_node_(to_node, GET_MANY, msg, msg_len);
+    delete[] msg;
+    if (response->msg_type != ACK) {
+        printf("ERROR: Node %zu did not get an ACK for its GET_MANY to node %zu\n", node_id, to_node);
+        exit(1);
+    }
+
+    // Response holds [LENGTH]~[VERSION]~[VALUE] for each key in order, where
+    // the version is in hex and 0 unless the value is sealed, or -~ for a
+    // key with no value
+    char *pos = response->msg;
+    for (size_t i = 0; i < count; i++) {
+        if (*pos == '-') {
+            values[batch[i]] = nullptr;
+            pos += 2;
+            continue;
+        }
+        size_t len = strtoull(pos, &pos, 10);
+        uint64_t version = strtoull(pos + 1, &pos, 16);
+        pos++;
+
+        Value *value = Value::copy(pos, len);
+        if (version != 0) {
+            cache->put(keys[batch[i]], value, version, epoch);
+        }
+        values[batch[i]] = value;
+        pos += len;
+    }
+
+    delete response;
+}
+
+// Asks the given node to put the values of the count keys whose indices are
+// in batch with one PUT_MANY, and releases those values. The message has the
+// form [COUNT]~ followed by [KEY_ID]~[KEY_STRING]~[LENGTH]~[VALUE] for each
+// key, with the ids written by write_key_id_(). Stores the version each
+// value got and the number of nodes keeping it at the key's index in
+// versions and replicas.
+void Store::send_put_many_(size_t to_node, Key **keys, Value **values, size_t *batch, size_t count,
+                           uint64_t *versions, size_t *replicas) {
+    metrics->puts_remote.add(count);
+    size_t msg_size = snprintf(nullptr, 0, "%zu~", count) + 1;
+    for (size_t i = 0; i < count; i++) {
+        Value *value = values[batch[i]];
+        msg_size += KEY_ID_MSG_CHARS + 1 + strlen(keys[batch[i]]->get_name()) + 1 + 21 + 1 + value->size();
+    }
+    char *msg = new char[msg_size];
+    size_t msg_len = sprintf(msg, "%zu~", count);
+    for (size_t i = 0; i < count; i++) {
+        Key *key = keys[batch[i]];
+        Value *value = values[batch[i]];
+        msg_len += write_key_id_(msg + msg_len, key, to_node);
+        msg_len += sprintf(msg + msg_len, "~%s~%zu~", key->get_name(), value->size());
+        memcpy(msg + msg_len, value->data(), value->size());
+        msg_len += value->size();
+        value->release();
+    }
+
+    Message *response = send_to_node_(to_node, PUT_MANY, msg, msg_len);
+    delete[] msg;
+    if (response->msg_type != ACK) {
+        printf("ERROR: Node %zu did not get an ACK for its PUT_MANY to node %zu\n", node_id, to_node);
+        exit(1);
+    }
+
+    // Response holds [VERSION]~[REPLICAS]~ for each key in order, the
+    // versions in hex
+    char *pos = response->msg;
+    for (size_t i = 0; i < count; i++) {
+        versions[batch[i]] = strtoull(pos, &pos, 16);
+        replicas[batch[i]] = strtoul(pos + 1, &pos, 10);
+        pos++;
+    }
+    delete response;
+}
+
+// Asks the given node to keep copies of the values of the count keys whose
+// indices are in batch, as replicas of the given versions, with one
+// REPLICATE. The message has the form [COUNT]~ followed by
+// [KEY_ID]@[HOME_NODE]~[KEY_STRING]~[VERSION]~[LENGTH]~[VALUE] for each key,
+// with the ids and versions in hex. Does not release the values.
+void Store::send_replicate_(size_t to_node, Key **keys, Value **values, uint64_t *versions, size_t *batch,
+                            size_t count) {
+    size_t msg_size = snprintf(nullptr, 0, "%zu~", count) + 1;
+    for (size_t i = 0; i < count; i++) {
+        Value *value = values[batch[i]];
+        msg_size += KEY_ID_MSG_CHARS + strlen(keys[batch[i]]->get_name()) + 1 + 16 + 1 + 21 + 1 + value->size();
+    }
+    char *msg = new char[msg_size];
+    size_t msg_len = sprintf(msg, "%zu~", count);
+    for (size_t i = 0; i < count; i++) {
+        Key *key = keys[batch[i]];
+        Value *value = values[batch[i]];
+        msg_len += write_key_id_(msg + msg_len, key, to_node);
+        msg_len += sprintf(msg + msg_len, "~%s~%" PRIx64 "~%zu~", key->get_name(), versions[batch[i]], value->size());
+        memcpy(msg + msg_len, value->data(), value->size());
+        msg_len += value->size();
+    }
+
+    Message *response = send_to_node_(to_node, REPLICATE, msg, msg_len);
+    delete[] msg;
+    if (response->msg_type != ACK) {
+        printf("ERROR: Node %zu did not get an ACK for its REPLICATE to node %zu\n", node_id, to_node);
+        exit(1);
+    }
+    delete response;
+}
+
+// Asks the given node to remove the count keys whose indices are in batch
+// with one REMOVE, made by key_list_msg_(). Returns how many had a value.
+// Stores the number of nodes each key's value was kept on, as far as that
+// node knows, at the key's index in replicas, if given.
+size_t Store::send_remove_many_(size_t to_node, Key **keys, size_t *batch, size_t count, size_t *replicas) {
+    size_t msg_len;
+    char *msg = key_list_msg_(to_node, keys, batch, count, &msg_len);
+    Message *response = send_to_node_(to_node, REMOVE, msg, msg_len);
+    delete[] msg;
+    if (response->msg_type != ACK) {
+        printf("ERROR: Node %zu did not get an ACK for its REMOVE to node %zu\n", node_id, to_node);
+        exit(1);
+    }
+
+    // Response consists of [COUNT]~, then [REPLICAS]~ for each key in order
+    char *pos;
+    size_t removed = strtoul(response->msg, &pos, 10);
+    for (size_t i = 0; replicas != nullptr && i < count; i++) {
+        replicas[batch[i]] = strtoul(pos + 1, &pos, 10);
+    }
+    delete response;
+    return removed;
+}
+
+// Gets the value associated with the given key, possibly from another node.
+// If key doesn't exist, blocks until it does. Never returns nullptr.
+// The caller must release() the result. For internal use only.
+Value *Store::wait_and_get_value_(Key *k) {
+    // Register as waiting before looking, so a put landing between the
+    // lookup and the wait still finds us
+    std::unique_lock<std::mutex> lck(watches->lock);
+    Watch *watch = watches->get(k);
+    watch->waiting++;
+    lck.unlock();
+
+    Value *value;
+    if (k->get_home_node() == node_id) {
+        value = get_value_(k);
+    } else {
+        // Ask the home node for the value, or to push it to us once it is
+        // put. The reply to a WATCH is the value if it already exists.
+        char watcher[24];
+        snprintf(watcher, sizeof(watcher), "%zu", node_id);
+        value = send_key_request_(k, WATCH, watcher, k->get_home_node());
+    }
+
+    lck.lock();
+    if (value == nullptr) {
+        // Key is not yet in the store. Wait on this key alone until a put
+        // (or a NOTIFY from its home node) delivers its value.
+        watch->delivered.wait(lck, [&] { return watch->value != nullptr; });
+        value = watch->value->retain();
+    }
+    watch->waiting--;
+    watches->remove_if_unused(watch);
+
+    return value;
+}
+
+// Seals the value of the given key, possibly on another node: promises it
+// will not change, so every node may cache it after getting it once. Putting
+// the key again is still allowed, but then has to invalidate those caches.
+// Returns false if the key has no value. Does not modify or delete given key
+bool Store::seal(Key *k) {
+    // Replicas are sealed too, so values read from them can be cached. Only
+    // whether the home node had a value counts.
+    size_t nodes = num_nodes();
+    bool sealed = false;
+    for (size_t r = 0; r < k->num_replicas(nodes); r++) {
+        size_t to_node = k->replica_node(r, nodes);
+        bool done;
+        if (to_node == node_id) {
+            done = map->seal(k);
+        } else {
+            Message *response = send_key_msg_(to_node, SEAL, k, nullptr, 0);
+            done = response->msg_type == ACK;
+            if (!done && response->msg_type != NACK) {
+                printf("ERROR: Node %zu did not get an ACK or NACK for its SEAL to node %zu\n", node_id, to_node);
+                exit(1);
+            }
+            delete response;
+        }
+        if (r == 0) {
+            sealed = done;
+        }
+    }
+    return sealed;
+}
+
+// Seals every chunk of the given frame, wherever it lives, so scanning the
+// frame again only goes over the network for chunks overwritten since.
+// Frames are immutable once built, so this is safe after creating or getting
+// one. Does not modify or delete given frame
+void Store::seal_frame(DistributedDataFrame *df) {
+    for (size_t col_idx = 0; col_idx < df->ncols(); col_idx++) {
+        DistributedColumn *col = dynamic_cast<DistributedColumn *>(df->columns[col_idx]);
+        size_t used_chunks = (col->size() + INTERNAL_CHUNK_SIZE - 1) / INTERNAL_CHUNK_SIZE;
+        for (size_t i = 0; i < used_chunks && i < col->num_chunks; i++) {
+            seal(col->chunk_keys[i]);
+            seal(col->missings_keys[i]);
+        }
+    }
+}
+
+// Removes the value of the given key, possibly on another node, so its memory
+// can be reused. Threads waiting for the key keep waiting for the next put.
+// Returns false if the key had no value. Does not modify or delete given key
+bool Store::remove(Key *k) {
+    return remove_many(&k, 1) == 1;
+}
+
+// Removes the values of n keys, possibly on several nodes, with one REMOVE
+// per node holding some of them, all sent at once, then their replicas, on
+// as many nodes as their home nodes kept them. Returns how many of the keys
+// had a value. Does not modify or delete given keys
+size_t Store::remove_many(Key **keys, size_t n) {
+    size_t nodes = num_nodes();
+    size_t *starts = new size_t[nodes + 1];
+    size_t *order = group_by_home_(keys, n, nodes, starts);
+    size_t *replicas = new size_t[n];
+
+    // Number of keys with a value, by node
+    size_t *removed = new size_t[nodes]();
+    size_t *asked = new size_t[nodes];
+    size_t num_asked = 0;
+    for (size_t node = 0; node < nodes; node++) {
+        for (size_t i = starts[node]; i < starts[node + 1]; i++) {
+            if (node == node_id) {
+                Value *value = remove_local_(keys[order[i]], &replicas[order[i]]);
+                if (value != nullptr) {
+                    removed[node]++;
+                    value->release();
+                }
+            } else {
+                // The home node invalidates caches too, but only later
+                cache->invalidate(keys[order[i]], UINT64_MAX);
+            }
+        }
+        if (node != node_id && starts[node + 1] > starts[node]) {
+            asked[num_asked++] = node;
+        }
+    }
+
+    run_per_node_(asked, num_asked, [&](size_t node) {
+        removed[node] = send_remove_many_(node, keys, order + starts[node], starts[node + 1] - starts[node], replicas);
+    });
+
+    size_t total = 0;
+    for (size_t node = 0; node < nodes; node++) {
+        total += removed[node];
+    }
+    remove_replicas_(keys, replicas, n);
+    delete[] replicas;
+    delete[] asked;
+    delete[] removed;
+    delete[] order;
+    delete[] starts;
+    return total;
+}
+
+// Removes the replicas of the n keys that are replicated, replicas[i] times
+// for keys[i], from every node holding one other than the key's home node,
+// all at once
+void Store::remove_replicas_(Key **keys, size_t *replicas, size_t n) {
+    size_t nodes = num_nodes();
+    size_t *starts = new size_t[nodes + 1];
+    size_t *order = group_by_replica_(keys, replicas, n, nodes, starts);
+
+    size_t *asked = new size_t[nodes];
+    size_t num_asked = 0;
+    for (size_t node = 0; node < nodes; node++) {
+        if (node == node_id) {
+            for (size_t i = starts[node]; i < starts[node + 1]; i++) {
+                Value *value = remove_local_(keys[order[i]]);
+                if (value != nullptr) {
+                    value->release();
+                }
+            }
+        } else if (starts[node + 1] > starts[node]) {
+            asked[num_asked++] = node;
+        }
+    }
+
+    run_per_node_(asked, num_asked, [&](size_t node) {
+        send_remove_many_(node, keys, order + starts[node], starts[node + 1] - starts[node]);
+    });
+
+    delete[] asked;
+    delete[] order;
+    delete[] starts;
+}
+
+// Removes the value of the given key, or of this node's replica of it, from
+// the table, and returns it with the table's reference, or nullptr. If it
+// was sealed, its home node has other nodes drop the copies they may have
+// cached. Sets replicas, if given, to the number of nodes the value was
+// kept on, as this node knows it.
+Value *Store::remove_local_(Key *k, size_t *replicas) {
+    uint64_t old_version;
+    Value *removed = map->remove(k, &old_version, replicas);
+    if (removed != nullptr) {
+        metrics->removes.add();
+    }
+    if ((old_version & KEY_SEALED) && k->get_home_node() == node_id) {
+        invalidate_caches_(k, UINT64_MAX);
+    }
+    return removed;
+}
+
+// Removes the frame stored under the given key, along with every chunk and
+// missings of its columns, on whichever nodes they live. Frames already
+// gotten from the key hold copies of the chunks, so they keep working.
+// Returns false if the key had no value. Does not modify or delete given key
+bool Store::drop_frame(Key *k) {
+    Value *serialized_df = get_value_(k);
+    if (serialized_df == nullptr) {
+        return false;
+    }
+
+    // Only the keys are needed, so do not copy the chunks like get() does
+    size_t num_cols;
+    ArraySource source(serialized_df->data(), serialized_df->size());
+    DistributedColumn **cols = serializer->deserialize_dist_columns(&source, this, &num_cols);
+    remove_chunks_(cols, num_cols);
+    for (size_t i = 0; i < num_cols; i++) {
+        delete cols[i];
+    }
+    delete[] cols;
+    serialized_df->release();
+
+    return remove(k);
+}
+
+// Removes every chunk and missings of the given frame, on whichever nodes
+// they live. Meant for frames gotten from the store, once done with them:
+// their chunks are copies no other frame uses. Does not delete given frame
+void Store::drop_chunks(DistributedDataFrame *df) {
+    // Chunks still being put would land after the removal
+    df->flush_chunks_();
+
+    size_t num_cols = df->ncols();
+    DistributedColumn **cols = new DistributedColumn *[num_cols];
+    for (size_t i = 0; i < num_cols; i++) {
+        cols[i] = dynamic_cast<DistributedColumn *>(df->columns[i]);
+    }
+    remove_chunks_(cols, num_cols);
+    delete[] cols;
+}
+
+// Removes every chunk and missings key of the given columns with one
+// remove_many()
+void Store::remove_chunks_(DistributedColumn **cols, size_t num_cols) {
+    size_t num_keys = 0;
+    for (size_t i = 0; i < num_cols; i++) {
+        num_keys += 2 * cols[i]->num_chunks;
+    }
+
+    Key **keys = new Key *[num_keys];
+    size_t k = 0;
+    for (size_t i = 0; i < num_cols; i++) {
+        for (size_t j = 0; j < cols[i]->num_chunks; j++) {
+            keys[k++] = cols[i]->chunk_keys[j];
+            keys[k++] = cols[i]->missings_keys[j];
+        }
+    }
+    remove_many(keys, num_keys);
+    delete[] keys;
+}
+
+// Removes the value of the given key, possibly on another node, once the
+// given number of milliseconds have passed. Meant for temporaries that no
+// node needs after then. Does not modify or delete given key
+void Store::expire_after(Key *k, size_t millis) {
+    schedule_expiry_(k, millis, false);
+}
+
+// Same as expire_after(), but drops the frame stored under the given key and
+// all of its chunks, as drop_frame() does
+void Store::expire_frame_after(Key *k, size_t millis) {
+    schedule_expiry_(k, millis, true);
+}
+
+// Adds an Expiry for the given key to the list, in deadline order, and wakes
+// the notifier thread in case it is sleeping until a later deadline
+void Store::schedule_expiry_(Key *k, size_t millis, bool frame) {
+    Expiry *e = new Expiry(k, frame, std::chrono::steady_clock::now() + std::chrono::milliseconds(millis));
+
+    std::lock_guard<std::mutex> lck(notify_lock);
+    Expiry **link = &expiries;
+    while (*link != nullptr && (*link)->deadline <= e->deadline) {
+        link = &(*link)->next;
+    }
+    e->next = *link;
+    *link = e;
+    notify_cond.notify_one();
+}
+
+// Removes the keys whose deadlines have passed. Called by the notifier
+// thread holding lck on notify_lock, which is released while removing.
+void Store::expire_due_(std::unique_lock<std::mutex> &lck) {
+    while (expiries != nullptr && !notifier_stopping && expiries->deadline <= std::chrono::steady_clock::now()) {
+        Expiry *e = expiries;
+        expiries = e->next;
+        lck.unlock();
+
+        if (e->frame) {
+            drop_frame(e->key);
+        } else {
+            remove(e->key);
+        }
+        delete e;
+        lck.lock();
+    }
+}
+
+// Appends n to the notifier thread's queue and wakes it. The caller must
+// hold notify_lock.
+void Store::queue_notification_(Notification *n) {
+    if (notify_tail == nullptr) {
+        notify_head = n;
+    } else {
+        notify_tail->next = n;
+    }
+    notify_tail = n;
+    notify_cond.notify_one();
+}
+
+// Queues an INVALIDATE for every other node, telling it that the given
+// local key now has the given version, so cached older ones are stale
+void Store::invalidate_caches_(Key *k, uint64_t version) {
+    size_t n = num_nodes();
+    std::lock_guard<std::mutex> notify_lck(notify_lock);
+    for (size_t i = 0; i < n; i++) {
+        if (i != node_id) {
+            queue_notification_(new Notification(k, version, i));
+        }
+    }
+}
+
+// Hands value, just put under the given local key, to this node's threads
+// waiting for the key, and queues it for every node that sent a WATCH for it
+void Store::notify_watchers_(Key *k, Value *value) {
+    std::lock_guard<std::mutex> lck(watches->lock);
+    Watch *watch = watches->find(k);
+    if (watch == nullptr) {
+        return;
+    }
+
+    if (watch->waiting > 0) {
+        watch->deliver(value->retain());
+    }
+
+    if (watch->num_watchers > 0) {
+        std::lock_guard<std::mutex> notify_lck(notify_lock);
+        for (size_t i = 0; i < watch->num_watchers; i++) {
+            queue_notification_(new Notification(k, value->retain(), watch->watchers[i]));
+        }
+        // Watches are one-shot: a node watches again if it waits again
+        watch->num_watchers = 0;
+    }
+
+    watches->remove_if_unused(watch);
+}
+
+// Body of the notifier thread. Sends each queued Notification to its node
+// as a NOTIFY of the form [KEY_ID]~[KEY_STRING]~[HOME_NODE]~[VALUE], or an
+// INVALIDATE of the form [KEY_ID]~[KEY_STRING]~[HOME_NODE]~[VERSION].
+// Sending from this thread keeps the listener from ever blocking on
+// another node, which could deadlock two listeners notifying each other.
+// Also removes expired keys, waking for the first deadline if there is
+// nothing to send. Drains the queue before stopping.
+void Store::notify_loop_() {
+    std::unique_lock<std::mutex> lck(notify_lock);
+    while (true) {
+        expire_due_(lck);
+        if (notify_head == nullptr) {
+            if (notifier_stopping) {
+                return;
+            }
+            if (expiries == nullptr) {
+                notify_cond.wait(lck);
+            } else {
+                notify_cond.wait_until(lck, expiries->deadline);
+            }
+            continue;
+        }
+
+        Notification *n = notify_head;
+        notify_head = n->next;
+        if (notify_head == nullptr) {
+            notify_tail = nullptr;
+        }
+        lck.unlock();
+
+        // The message names the key's home, since it is not the receiver
+        size_t body_len = n->value == nullptr ? 16 : n->value->size();
+        char *rest = new char[body_len + 1];
+        if (n->value == nullptr) {
+            snprintf(rest, body_len + 1, "%016" PRIx64, n->version);
+        } else {
+            memcpy(rest, n->value->data(), body_len);
+        }
+
+        Message *response = send_key_msg_(n->to_node, n->type, n->key, rest, body_len);
+        if (response->msg_type != ACK) {
+            printf("ERROR: Node %zu did not get an ACK for its notification to node %zu\n", node_id, n->to_node);
+            exit(1);
+        }
+
+        delete response;
+        delete[] rest;
+        delete n;
+        lck.lock();
+    }
+}
+
+// Same as wait_and_get_value_(), but returns a heap-allocated copy of the
+// value as a char*. For internal use only.
+char *Store::wait_and_get_char_(Key *k) {
+    Value *value = wait_and_get_value_(k);
+    char *copy = value->duplicate_bytes();
+    value->release();
+    return copy;
+}
+
+/*
+    Collective operations. Every node in the network must call the same
+    collectives in the same order. Messages travel along a binomial tree
+    rooted at the collective's root, so each takes O(log nodes) rounds. A node
+    receives by waiting on a key that lives on itself, so no node ever polls
+    another node.
+*/
+
+// By default values are combined as the C strings they hold
+Value *Combiner::combine_values(Value *left, Value *right) {
+    return Value::adopt(combine(left->c_str(), right->c_str()));
+}
+
+// Combiner that concatenates two values. Used to gather values up the tree.
+class ConcatCombiner : public Combiner {
+   public:
+    char* combine(char* left, char* right) {
+        size_t left_len = strlen(left);
+        size_t right_len = strlen(right);
+        char* value = new char[left_len + right_len + 1];
+        memcpy(value, left, left_len);
+        memcpy(value + left_len, right, right_len + 1);
+        return value;
+    }
+};
+
+// Blocks until every node in the network has called barrier()
+void Store::barrier() {
+    ConcatCombiner combiner;
+    char *value = allreduce((char *)"1", &combiner);
+    delete[] value;
+}
+
+// Sends a value from the home node of the given key to every node.
+// The home node passes the value to send, or nullptr to send the value
+// stored under the given key. Other nodes' values are ignored.
+// Returns a heap-allocated copy of the value on every node.
+char *Store::broadcast(Key *k, char *value) {
+    size_t seq = collective_seq++;
+    size_t root = k->get_home_node();
+
+    Value *data = nullptr;
+    if (node_id == root) {
+        data = value == nullptr ? wait_and_get_value_(k) : Value::copy(value, strlen(value));
+    }
+    Value *result = broadcast_(seq, root, data);
+    if (data != nullptr) {
+        data->release();
+    }
+
+    char *copy = result->duplicate_bytes();
+    result->release();
+    return copy;
+}
+
+// Collects one value from every node on the home node of the given key.
+// The home node gets a heap-allocated array, indexed by node id, with a copy
+// of each node's value. Every other node gets nullptr.
+char **Store::gather(Key *k, char *value) {
+    size_t seq = collective_seq++;
+    size_t root = k->get_home_node();
+
+    // Tag this node's value with its id and length: "[node id],[length];[value]"
+    size_t value_len = strlen(value);
+    size_t tagged_size = snprintf(nullptr, 0, "%zu,%zu;", node_id, value_len) + value_len + 1;
+    char *tagged = new char[tagged_size];
+    size_t header_len = sprintf(tagged, "%zu,%zu;", node_id, value_len);
+    memcpy(tagged + header_len, value, value_len + 1);
+    Value *tagged_value = Value::adopt(tagged, tagged_size - 1);
+
+    ConcatCombiner combiner;
+    Value *gathered = reduce_(seq, root, tagged_value, &combiner);
+    tagged_value->release();
+
+    if (gathered == nullptr) {
+        return nullptr;
+    }
+
+    size_t n = num_nodes();
+    char **values = new char *[n];
+    char *pos = gathered->c_str();
+    for (size_t i = 0; i < n; i++) {
+        char *end;
+        size_t from_node = strtoul(pos, &end, 10);
+        size_t len = strtoul(end + 1, &end, 10);
+        pos = end + 1;
+
+        char *node_value = new char[len + 1];
+        memcpy(node_value, pos, len);
+        node_value[len] = '\0';
+        values[from_node] = node_value;
+        pos += len;
+    }
+
+    gathered->release();
+    return values;
+}
+
+// Combines one value from every node with the given combiner and gives the
+// result to every node. Returns a heap-allocated copy of the result.
+char *Store::allreduce(char *value, Combiner *combiner) {
+    Value *local = Value::copy(value, strlen(value));
+    Value *result = allreduce_value_(local, combiner);
+    local->release();
+
+    char *copy = result->duplicate_bytes();
+    result->release();
+    return copy;
+}
+
+// Same as allreduce(), but on Values, which may hold any bytes, combined
+// with combine_values(). The caller must release() the result.
+Value *Store::allreduce_value_(Value *value, Combiner *combiner) {
+    size_t seq = collective_seq++;
+
+    Value *reduced = reduce_(seq, 0, value, combiner);
+    Value *result = broadcast_(seq, 0, reduced);
+
+    if (reduced != nullptr) {
+        reduced->release();
+    }
+    return result;
+}
+
+// Returns the key under which the node with the given rank (relative to the
+// collective's root) leaves a value for to_node during collective seq
+Key *Store::collective_key_(size_t seq, const char *tag, size_t from_rank, size_t to_node) {
+    size_t buf_size = snprintf(nullptr, 0, COLLECTIVE_KEY_PREFIX "%zu-%s-%zu", seq, tag, from_rank) + 1;
+    char name[buf_size];
+    snprintf(name, buf_size, COLLECTIVE_KEY_PREFIX "%zu-%s-%zu", seq, tag, from_rank);
+
+    return new Key(name, to_node);
+}
+
+// Leaves the given value for to_node
+void Store::collective_send_(size_t seq, const char *tag, size_t from_rank, size_t to_node, Value *value) {
+    Key *k = collective_key_(seq, tag, from_rank, to_node);
+    put(k, value->retain());
+    delete k;
+}
+
+// Waits for the value left for this node by the node with the given rank,
+// then removes it, since no node reads it again
+Value *Store::collective_receive_(size_t seq, const char *tag, size_t from_rank) {
+    Key *k = collective_key_(seq, tag, from_rank, node_id);
+    Value *value = wait_and_get_value_(k);
+    Value *left = remove_local_(k);
+    if (left != nullptr) {
+        left->release();
+    }
+    delete k;
+    return value;
+}
+
+// Combines every node's value up a binomial tree towards root.
+// Returns the result on root, which must release() it, and nullptr on every
+// other node.
+Value *Store::reduce_(size_t seq, size_t root, Value *value, Combiner *combiner) {
+    size_t n = num_nodes();
+    size_t rank = (node_id + n - root) % n;  // Position relative to root
+    Value *acc = value->retain();
+
+    for (size_t mask = 1; mask < n; mask <<= 1) {
+        if (rank & mask) {
+            // Done combining our subtree, hand it to our parent
+            size_t parent = (rank - mask + root) % n;
+            collective_send_(seq, "r", rank, parent, acc);
+            acc->release();
+            return nullptr;
+        }
+
+        if (rank + mask < n) {
+            Value *child = collective_receive_(seq, "r", rank + mask);
+            Value *combined = combiner->combine_values(acc, child);
+            acc->release();
+            child->release();
+            acc = combined;
+        }
+    }
+
+    return acc;
+}
+
+// Sends root's value down a binomial tree to every node.
+// Value is only read on root. Returns the value on every node, which must
+// release() it.
+Value *Store::broadcast_(size_t seq, size_t root, Value *value) {
+    size_t n = num_nodes();
+    size_t rank = (node_id + n - root) % n;  // Position relative to root
+    Value *data = nullptr;
+
+    size_t mask = 1;
+    while (mask < n) {
+        if (rank & mask) {
+            data = collective_receive_(seq, "b", rank - mask);
+            break;
+        }
+        mask <<= 1;
+    }
+
+    if (rank == 0) {
+        data = value->retain();
+    }
+
+    // Forward to our children, largest subtree first
+    for (mask >>= 1; mask > 0; mask >>= 1) {
+        if (rank + mask < n) {
+            collective_send_(seq, "b", rank, (rank + mask + root) % n, data);
+        }
+    }
+
+    return data;
+}
+
+// OVERRIDE
+// Handler for all messages that come into this node
+// Some sort of reply is expected to be written to the given socket
+// By default, sends empty ACK back to the message sender and prints a "message-received" string
+void Store::handle_message(int connected_socket, Message *msg) {
+    if (msg->msg_type == PUT) {
+        handle_put_(connected_socket, msg);
+    } else if (msg->msg_type == GET) {
+        handle_get_(connected_socket, msg);
+    } else if (msg->msg_type == WATCH) {
+        handle_watch_(connected_socket, msg);
+    } else if (msg->msg_type == NOTIFY) {
+        handle_notify_(connected_socket, msg);
+    } else if (msg->msg_type == SEAL) {
+        handle_seal_(connected_socket, msg);
+    } else if (msg->msg_type == INVALIDATE) {
+        handle_invalidate_(connected_socket, msg);
+    } else if (msg->msg_type == GET_MANY) {
+        handle_get_many_(connected_socket, msg);
+    } else if (msg->msg_type == PUT_MANY) {
+        handle_put_many_(connected_socket, msg);
+    } else if (msg->msg_type == REMOVE) {
+        handle_remove_(connected_socket, msg);
+    } else if (msg->msg_type == STATS) {
+        handle_stats_(connected_socket, msg);
+    } else if (msg->msg_type == REPLICATE) {
+        handle_replicate_(connected_socket, msg);
+    } else {
+        printf("WARN: Store got a message from another node with unexpected message type %d\n", msg->msg_type);
+    }
+}
+
+// Called when this store gets a PUT request from another node
+void Store::handle_put_(int connected_socket, Message *msg) {
+    // Message consists of [KEY_ID]~[KEY_STRING]~[VALUE]
+    // This node got a PUT request, so the key must live on this node.
+    char *val_str;
+    Key *key = parse_key_msg_(msg, &val_str);
+
+    // The value is everything after the key, may be empty, and may hold any bytes
+    size_t val_len = msg->msg_len - (val_str - msg->msg);
+
+    // save to map
+    metrics->puts_served.add();
+    size_t replicas;
+    uint64_t version = put_local_(key, Value::copy(val_str, val_len), &replicas);
+    delete key;
+
+    // Send ACK with the value's version and the number of nodes keeping it,
+    // for the sender to give its replicas
+    char reply[KEY_ID_CHARS + 1 + 21];
+    snprintf(reply, sizeof(reply), "%" PRIx64 "~%zu", version, replicas);
+    Message ack(my_ip_address, my_port, ACK, reply);
+    network->write_msg(connected_socket, &ack);
+}
+
+// Called when this store gets a GET request from another node
+void Store::handle_get_(int connected_socket, Message *msg) {
+    // Message consists of [KEY_ID]~[KEY_STRING], where the id is in hex
+    // This node got a GET request, so the key lives on this node, or the
+    // message names its home and this node holds a replica
+    char *rest;
+    Key *key = parse_key_msg_(msg, &rest);
+
+    uint64_t version = 0;
+    metrics->gets_served.add();
+    Value *value = get_local_(key, &version);
+    reply_value_(connected_socket, value, replied_version_(key, version));
+    delete key;
+}
+
+// Called when this store gets a WATCH request from another node
+// Replies with the value like a GET if the key exists. If not, remembers
+// to push the value to the watcher once the key is put here.
+void Store::handle_watch_(int connected_socket, Message *msg) {
+    // Message consists of [KEY_ID]~[KEY_STRING]~[WATCHER_NODE]
+    // This node got a WATCH request, so the key must live on this node.
+    char *watcher;
+    Key *key = parse_key_msg_(msg, &watcher);
+
+    Value *value;
+    {
+        // Look under the watch lock, so a put either lands before the
+        // lookup or finds the watcher recorded below
+        std::lock_guard<std::mutex> lck(watches->lock);
+        metrics->gets_served.add();
+        value = get_local_(key);
+        if (value == nullptr) {
+            watches->get(key)->add_watcher(strtoul(watcher, nullptr, 10));
+        }
+    }
+
+    reply_value_(connected_socket, value);
+    delete key;
+}
+
+// Called when a node this store sent a WATCH to pushes the value it watched
+void Store::handle_notify_(int connected_socket, Message *msg) {
+    // Message consists of [KEY_ID]@[HOME_NODE]~[KEY_STRING]~[VALUE]
+    char *val_str;
+    Key *key = parse_key_msg_(msg, &val_str);
+    size_t val_len = msg->msg_len - (val_str - msg->msg);
+
+    {
+        // Nobody may be waiting any more, e.g. if the value also came back
+        // in the reply to another WATCH
+        std::lock_guard<std::mutex> lck(watches->lock);
+        Watch *watch = watches->find(key);
+        if (watch != nullptr && watch->waiting > 0) {
+            watch->deliver(Value::copy(val_str, val_len));
+        }
+    }
+    delete key;
+
+    // Send ACK
+    Message ack(my_ip_address, my_port, ACK, (char *)"");
+    network->write_msg(connected_socket, &ack);
+}
+
+// Called when another node asks this store to seal one of its keys
+void Store::handle_seal_(int connected_socket, Message *msg) {
+    // Message consists of [KEY_ID]~[KEY_STRING]
+    // This node got a SEAL request, so the key lives on this node, or the
+    // message names its home and this node holds a replica
+    char *rest;
+    Key *key = parse_key_msg_(msg, &rest);
+
+    // NACK if there is nothing to seal
+    Message reply(my_ip_address, my_port, map->seal(key) ? ACK : NACK, (char *)"");
+    network->write_msg(connected_socket, &reply);
+    delete key;
+}
+
+// Called when the home node of a sealed key this store may have cached puts
+// the key again
+void Store::handle_invalidate_(int connected_socket, Message *msg) {
+    // Message consists of [KEY_ID]@[HOME_NODE]~[KEY_STRING]~[VERSION]
+    char *version_str;
+    Key *key = parse_key_msg_(msg, &version_str);
+    cache->invalidate(key, strtoull(version_str, nullptr, 16));
+    delete key;
+
+    // Send ACK
+    Message ack(my_ip_address, my_port, ACK, (char *)"");
+    network->write_msg(connected_socket, &ack);
+}
+
+// Called when this store gets a GET_MANY request from another node, as sent
+// by send_get_many_(). Replies with the values of all its keys at once.
+void Store::handle_get_many_(int connected_socket, Message *msg) {
+    // This node got a GET_MANY request, so the keys live on this node, or the
+    // message names their homes and this node holds replicas
+    char *pos;
+    size_t count = strtoul(msg->msg, &pos, 10);
+    pos++;
+
+    metrics->gets_served.add(count);
+    Value **values = new Value *[count];
+    uint64_t *versions = new uint64_t[count];
+    size_t reply_size = 1;
+    for (size_t i = 0; i < count; i++) {
+        // Key names never hold '~'
+        char *name = strchr(pos, '~') + 1;
+        char *name_end = strchr(name, '~');
+        *name_end = '\0';
+        Key key(name, parse_key_home_(pos), strtoull(pos, nullptr, 16));
+        pos = name_end + 1;
+
+        versions[i] = 0;
+        values[i] = get_local_(&key, &versions[i]);
+        versions[i] = replied_version_(&key, versions[i]);
+        reply_size += values[i] == nullptr ? 2 : 21 + 1 + 16 + 1 + values[i]->size();
+    }
+
+    // Reply holds [LENGTH]~[VERSION]~[VALUE] for each key, or -~ if it has
+    // no value. Only sealed values have a version, so only they are cached.
+    char *reply = new char[reply_size];
+    size_t reply_len = 0;
+    for (size_t i = 0; i < count; i++) {
+        Value *value = values[i];
+        if (value == nullptr) {
+            memcpy(reply + reply_len, "-~", 2);
+            reply_len += 2;
+            continue;
+        }
+        uint64_t version = versions[i] & KEY_SEALED ? versions[i] & ~KEY_SEALED : 0;
+        reply_len += sprintf(reply + reply_len, "%zu~%" PRIx64 "~", value->size(), version);
+        memcpy(reply + reply_len, value->data(), value->size());
+        reply_len += value->size();
+        value->release();
+    }
+
+    Message ack(my_ip_address, my_port, ACK, reply, reply_len);
+    network->write_msg(connected_socket, &ack);
+
+    delete[] reply;
+    delete[] versions;
+    delete[] values;
+}
+
+// Called when this store gets a PUT_MANY request from another node, as sent
+// by send_put_many_()
+void Store::handle_put_many_(int connected_socket, Message *msg) {
+    // This node got a PUT_MANY request, so the keys must live on this node
+    char *pos;
+    size_t count = strtoul(msg->msg, &pos, 10);
+    pos++;
+
+    // Reply holds the version each value got and the number of nodes
+    // keeping it, for the sender to give its replicas, as
+    // [VERSION]~[REPLICAS]~ for each key, the versions in hex
+    char *reply = new char[count * (KEY_ID_CHARS + 1 + 21) + 1];
+    size_t reply_len = 0;
+    reply[0] = '\0';
+    for (size_t i = 0; i < count; i++) {
+        char *name = strchr(pos, '~') + 1;
+        char *name_end = strchr(name, '~');
+        *name_end = '\0';
+        Key key(name, node_id, strtoull(pos, nullptr, 16));
+        key.set_replicas(parse_key_replicas_(pos));
+
+        // Values may hold any bytes, including '~'
+        size_t len = strtoull(name_end + 1, &pos, 10);
+        pos++;
+        metrics->puts_served.add();
+        size_t replicas;
+        uint64_t version = put_local_(&key, Value::copy(pos, len), &replicas);
+        reply_len += sprintf(reply + reply_len, "%" PRIx64 "~%zu~", version, replicas);
+        pos += len;
+    }
+
+    Message ack(my_ip_address, my_port, ACK, reply, reply_len);
+    network->write_msg(connected_socket, &ack);
+    delete[] reply;
+}
+
+// Called when this store gets a REPLICATE request from another node, as sent
+// by send_replicate_(). Keeps each value as a replica, unless it already has
+// that version of the key's value or a newer one.
+void Store::handle_replicate_(int connected_socket, Message *msg) {
+    char *pos;
+    size_t count = strtoul(msg->msg, &pos, 10);
+    pos++;
+
+    for (size_t i = 0; i < count; i++) {
+        char *name = strchr(pos, '~') + 1;
+        char *name_end = strchr(name, '~');
+        *name_end = '\0';
+        Key key(name, parse_key_home_(pos), strtoull(pos, nullptr, 16));
+
+        // Values may hold any bytes, including '~'
+        uint64_t version = strtoull(name_end + 1, &pos, 16);
+        size_t len = strtoull(pos + 1, &pos, 10);
+        pos++;
+        metrics->puts_served.add();
+        map->put_replica(&key, Value::copy(pos, len), version);
+        pos += len;
+    }
+
+    // Send ACK
+    Message ack(my_ip_address, my_port, ACK, (char *)"");
+    network->write_msg(connected_socket, &ack);
+}
+
+// Called when this store gets a REMOVE request from another node, as sent by
+// send_remove_many_(). Replies with how many of the keys had a value.
+void Store::handle_remove_(int connected_socket, Message *msg) {
+    // This node got a REMOVE request, so the keys live on this node, or the
+    // message names their homes and this node holds replicas
+    char *pos;
+    size_t count = strtoul(msg->msg, &pos, 10);
+    pos++;
+
+    size_t removed = 0;
+    size_t *replicas = new size_t[count];
+    for (size_t i = 0; i < count; i++) {
+        char *name = strchr(pos, '~') + 1;
+        char *name_end = strchr(name, '~');
+        *name_end = '\0';
+        Key key(name, parse_key_home_(pos), strtoull(pos, nullptr, 16));
+        key.set_replicas(parse_key_replicas_(pos));
+        pos = name_end + 1;
+
+        Value *value = remove_local_(&key, &replicas[i]);
+        if (value != nullptr) {
+            removed++;
+            value->release();
+        }
+    }
+
+    // Reply holds how many keys had a value, and the number of nodes each
+    // key was kept on, for the sender to remove its replicas, as
+    // [COUNT]~ and then [REPLICAS]~ for each key
+    char *reply = new char[(count + 1) * 22 + 1];
+    size_t reply_len = sprintf(reply, "%zu~", removed);
+    for (size_t i = 0; i < count; i++) {
+        reply_len += sprintf(reply + reply_len, "%zu~", replicas[i]);
+    }
+    delete[] replicas;
+    Message ack(my_ip_address, my_port, ACK, reply, reply_len);
+    network->write_msg(connected_socket, &ack);
+    delete[] reply;
+}
+
+// Called when this store gets a STATS request from another node. Replies
+// with this node's metrics as JSON.
+void Store::handle_stats_(int connected_socket, Message *msg) {
+    char *stats = stats_json();
+    Message ack(my_ip_address, my_port, ACK, stats);
+    network->write_msg(connected_socket, &ack);
+    delete[] stats;
+}
+
+// Returns the version to reply to a GET of the given key with, given the
+// version this node holds. Only the home node says a value is sealed: a
+// replica may still hold a sealed version the home has already overwritten
+// and invalidated, which an asker must not cache, so a replica's reply is
+// never cached.
+uint64_t Store::replied_version_(Key *key, uint64_t version) {
+    return key->get_home_node() == node_id ? version : 0;
+}
+
+// Replies to a GET or WATCH with an ACK holding the given value, or a NACK
+// if it is nullptr. A value whose version is sealed is sent as SEALED, with
+// the version first, so the asker may cache it. Releases the value.
+void Store::reply_value_(int connected_socket, Value *serialized_value, uint64_t version) {
+    if (serialized_value == nullptr) {
+        // Value doesn't exist, so send NACK
+        Message nack(my_ip_address, my_port, NACK, (char *)"");
+        network->write_msg(connected_socket, &nack);
+    } else if (version & KEY_SEALED) {
+        // Send SEALED with [VERSION]~[VALUE]. The value is written straight
+        // from the store, without being copied into the message.
+        char version_str[18];
+        snprintf(version_str, sizeof(version_str), "%016" PRIx64 "~", version & ~KEY_SEALED);
+        Message sealed(my_ip_address, my_port, SEALED, version_str, 17);
+        BytesBody body(serialized_value->data(), serialized_value->size());
+        network->write_msg(connected_socket, &sealed, &body);
+
+        serialized_value->release();
+    } else {
         // Send ACK with serialized value
-        Message ack(my_ip_address, my_port, ACK, serialized_value);
-        network->write_msg(connected_socket, &ack);
+        Message ack(my_ip_address, my_port, ACK, "", 0);
+        BytesBody body(serialized_value->data(), serialized_value->size());
+        network->write_msg(connected_socket, &ack, &body);
 
-        delete[] serialized_value;
+        serialized_value->release();
     }
 }
 
@@ -415,7 +2606,7 @@ DistributedDataFrame *DataFrame::fromArray(Key *key, Store *store, size_t count,
         col.push_back(vals[i]);
     }
 
-    return fromDistributedColumn(key, store, &col);
+    return fromTemporaryColumn_(key, store, &col);
 }
 
 DistributedDataFrame *DataFrame::fromArray(Key *key, Store *store, size_t count, bool *vals) {
@@ -425,7 +2616,7 @@ DistributedDataFrame *DataFrame::fromArray(Key *key, Store *store, size_t count,
         col.push_back(vals[i]);
     }
 
-    return fromDistributedColumn(key, store, &col);
+    return fromTemporaryColumn_(key, store, &col);
 }
 
 DistributedDataFrame *DataFrame::fromArray(Key *key, Store *store, size_t count, int *vals) {
@@ -435,7 +2626,7 @@ DistributedDataFrame *DataFrame::fromArray(Key *key, Store *store, size_t count,
         col.push_back(vals[i]);
     }
 
-    return fromDistributedColumn(key, store, &col);
+    return fromTemporaryColumn_(key, store, &col);
 }
 
 DistributedDataFrame *DataFrame::fromArray(Key *key, Store *store, size_t count, String **vals) {
@@ -445,7 +2636,15 @@ DistributedDataFrame *DataFrame::fromArray(Key *key, Store *store, size_t count,
         col.push_back(vals[i]);
     }
 
-    return fromDistributedColumn(key, store, &col);
+    return fromTemporaryColumn_(key, store, &col);
+}
+
+// Stores copy of col in store under key, then removes the chunks of col,
+// which was only built to be copied
+DistributedDataFrame *DataFrame::fromTemporaryColumn_(Key *key, Store *store, DistributedColumn *col) {
+    DistributedDataFrame *df = fromDistributedColumn(key, store, col);
+    store->remove_chunks_(&col, 1);
+    return df;
 }
 
 // Stores copy of col in store under key
@@ -482,28 +2681,28 @@ DistributedDataFrame *DataFrame::fromScalar(Key *key, Store *store, float val) {
     DistributedFloatColumn col(store);
     col.push_back(val);
 
-    return fromDistributedColumn(key, store, &col);
+    return fromTemporaryColumn_(key, store, &col);
 }
 
 DistributedDataFrame *DataFrame::fromScalar(Key *key, Store *store, bool val) {
     DistributedBoolColumn col(store);
     col.push_back(val);
 
-    return fromDistributedColumn(key, store, &col);
+    return fromTemporaryColumn_(key, store, &col);
 }
 
 DistributedDataFrame *DataFrame::fromScalar(Key *key, Store *store, int val) {
     DistributedIntColumn col(store);
     col.push_back(val);
 
-    return fromDistributedColumn(key, store, &col);
+    return fromTemporaryColumn_(key, store, &col);
 }
 
 DistributedDataFrame *DataFrame::fromScalar(Key *key, Store *store, String *val) {
     DistributedStringColumn col(store);
     col.push_back(val);
 
-    return fromDistributedColumn(key, store, &col);
+    return fromTemporaryColumn_(key, store, &col);
 }
 
 
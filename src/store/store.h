@@ -4,12 +4,52 @@
 #include <stdlib.h>
 #include <mutex>
 #include <condition_variable>
+#include <future>
 #include "network/node.h"
 
+// Names of the keys collective operations pass values under start with this.
+// They only mean something within one run, so snapshots leave them out.
+#define COLLECTIVE_KEY_PREFIX "coll-"
+// Default number of asynchronous requests a Store lets wait on one node at once
+#define STORE_MAX_IN_FLIGHT (size_t)8
+// Room a key id needs in a message, as written by write_key_id_()
+#define KEY_ID_MSG_CHARS (KEY_ID_CHARS + 43)
+
+class Arena;
+class StringChunkView;
+template <class T>
+class ChunkView;
 class String;
 class Key;
-class Map;
+class StripedKeyTable;
+class RemoteCache;
+class WatchTable;
+class Notification;
+class Expiry;
+class Value;
 class DistributedDataFrame;
+class DistributedColumn;
+class Bitmap;
+class Sketch;
+
+/*******************************************************************************
+ *  Combiner::
+ *  An interface for combining two serialized values into one during an
+ *  allreduce. Should be subclassed and combine() given a meaningful
+ *  implementation. The combination must be associative and commutative,
+ *  since nodes combine values in tree order.
+ */
+class Combiner : public Object {
+   public:
+    /** Returns a new heap-allocated value combining left and right.
+      Does not modify or delete the given values. */
+    virtual char* combine(char* left, char* right) = 0;
+
+    /** Returns a new Value combining left and right, which may hold any
+      bytes. By default combines them as C strings with combine().
+      Does not modify or release the given values. */
+    virtual Value* combine_values(Value* left, Value* right);
+};
 
 // Represents a KeyValue with local data as well as the capability to fetch data from other KeyValue stores.
 // USAGE:
@@ -17,11 +57,36 @@ class DistributedDataFrame;
 //   - Distributed DataFrame calls private Store.get_() and Store.put_() that work on normal Dataframes only
 class Store : public Node {
    public:
-    Map* map;
-    std::mutex map_lock;
+    StripedKeyTable* map;  // Values stored on this node; locks itself
+    RemoteCache* cache;    // Sealed values this node got from other nodes; locks itself
     size_t node_id;
-    std::condition_variable cond_var; // Used to coordinate active thread and listener
-    bool put_has_occured; // Used in tandem with cond_var above
+    WatchTable* watches;  // Threads and nodes waiting for keys, by key
+    // Values owed to nodes that watched for them. Sent in order by the
+    // notifier thread, so the listener never blocks on another node.
+    Notification* notify_head;
+    Notification* notify_tail;
+    std::mutex notify_lock;  // Guards the queue, expiries and notifier_stopping
+    std::condition_variable notify_cond;
+    bool notifier_stopping;
+    // Keys to remove once their time is up, soonest first. Also removed by
+    // the notifier thread, which wakes for the first one.
+    Expiry* expiries;
+    char* stats_path;  // owned; where to write metrics at shutdown, or nullptr
+    std::thread* notifier;
+    // Number of collective operations started by this node. Every node
+    // starts collectives in the same order, so this names each one uniquely.
+    size_t collective_seq;
+    // Asynchronous requests under way, by node they went to. A node gets at
+    // most max_in_flight at once; more wait for one to finish.
+    size_t* in_flight;
+    size_t in_flight_len;
+    size_t max_in_flight;
+    // Requests under way from this node, asynchronous or not, by node they
+    // went to, for reading replicated keys from the least loaded node
+    size_t* requests;
+    size_t requests_len;
+    std::mutex in_flight_lock;  // Guards the five above
+    std::condition_variable in_flight_cond;
 
     Store(size_t node_id, char* my_ip_address, int my_port, char* server_ip_address, int server_port);
 
@@ -29,28 +94,129 @@ class Store : public Node {
 
     size_t this_node();
     size_t num_nodes();
+    void set_memory_budget(size_t bytes, const char* spill_dir);
+    char* memory_stats();
+    char* stats_json();
+    char* get_stats(size_t node);
+    void set_stats_path(const char* path);
+    void write_stats_(const char* path);
+    void set_cache_capacity(size_t bytes);
+    size_t save_snapshot(const char* path);
+    bool load_snapshot(const char* path);
 
     void put(Key* k, DistributedDataFrame* df);
+    void put(Key* k, Bitmap* bitmap);
+    void put(Key* k, Sketch* sketch);
+    void put(Key* k, Value* value);
+    uint64_t put_local_(Key* k, Value* value, size_t* replicas = nullptr);
+    void put_replicas_(Key** keys, Value** values, uint64_t* versions, size_t* replicas, size_t n);
+    size_t* group_by_replica_(Key** keys, size_t* replicas, size_t n, size_t nodes, size_t* starts);
+    void replicate_frame_(DistributedDataFrame* df, size_t replicas);
 
     void put_(Key* k, bool* bools, size_t num);
     void put_(Key* k, int* ints, size_t num);
     void put_(Key* k, float* floats, size_t num);
     void put_(Key* k, String** strings, size_t num);
+    void put_(Key** keys, size_t num_keys, bool* bools, size_t num);
+    void put_(Key** keys, size_t num_keys, int* ints, size_t num);
+    void put_(Key** keys, size_t num_keys, float* floats, size_t num);
+    void put_(Key** keys, size_t num_keys, String** strings, size_t num);
+    void put_same_(Key** keys, size_t num_keys, Value* value);
     void put_char_(Key* k, char* value);
-    void send_put_request_(Key* k, char* value);
+    uint64_t send_put_request_(Key* k, const char* value, size_t len, size_t* replicas);
+    uint64_t send_put_request_(Key* k, MessageBody* value, size_t* replicas);
+    Message* send_to_node_(size_t to_node, MessageType type, const char* msg, size_t len, MessageBody* body = nullptr);
+    Message* send_key_msg_(size_t to_node, MessageType type, Key* k, const char* rest, size_t len);
+    Message* send_key_msg_(size_t to_node, MessageType type, Key* k, MessageBody* rest);
+    size_t write_key_id_(char* buf, Key* k, size_t to_node);
+    size_t parse_key_home_(char* id_str);
+    size_t parse_key_replicas_(char* id_str);
+    Key* parse_key_msg_(Message* msg, char** rest);
 
     DistributedDataFrame* get(Key* k);
-    DistributedDataFrame* get_unsafe_(Key* k);
     DistributedDataFrame* waitAndGet(Key* k);
+    Bitmap* get_bitmap(Key* k);
+    Bitmap* waitAndGet_bitmap(Key* k);
+    Bitmap* merge_bitmap(Bitmap* local);
+    Sketch* get_sketch(Key* k);
+    Sketch* waitAndGet_sketch(Key* k);
+    Sketch* merge_sketch(Sketch* local);
+    Value* get_value(Key* k);
+    Value* waitAndGet_value(Key* k);
+    Value** get_many(Key** keys, size_t n);
+    void put_many(Key** keys, Value** values, size_t n);
+    std::future<Value*> get_async(Key* k);
+    std::future<void> put_async(Key* k, Value* value);
+    void set_max_in_flight(size_t max);
+    void acquire_request_slot_(size_t to_node);
+    void release_request_slot_(size_t to_node);
+    size_t* group_by_home_(Key** keys, size_t n, size_t nodes, size_t* starts, size_t* targets = nullptr);
+    char* key_list_msg_(size_t to_node, Key** keys, size_t* batch, size_t count, size_t* len);
+    void send_get_many_(size_t to_node, Key** keys, size_t* batch, size_t count, Value** values);
+    void send_put_many_(size_t to_node, Key** keys, Value** values, size_t* batch, size_t count,
+                        uint64_t* versions, size_t* replicas);
+    void send_replicate_(size_t to_node, Key** keys, Value** values, uint64_t* versions, size_t* batch,
+                         size_t count);
+    bool seal(Key* k);
+    void seal_frame(DistributedDataFrame* df);
+    bool remove(Key* k);
+    size_t remove_many(Key** keys, size_t n);
+    bool drop_frame(Key* k);
+    void drop_chunks(DistributedDataFrame* df);
+    void expire_after(Key* k, size_t millis);
+    void expire_frame_after(Key* k, size_t millis);
+    Value* remove_local_(Key* k, size_t* replicas = nullptr);
+    void remove_replicas_(Key** keys, size_t* replicas, size_t n);
+    void remove_chunks_(DistributedColumn** cols, size_t num_cols);
+    size_t send_remove_many_(size_t to_node, Key** keys, size_t* batch, size_t count, size_t* replicas = nullptr);
+    void schedule_expiry_(Key* k, size_t millis, bool frame);
+    void expire_due_(std::unique_lock<std::mutex>& lck);
+
+    bool* get_bool_array_(Key* k, Arena* arena = nullptr);
+    int* get_int_array_(Key* k, Arena* arena = nullptr);
+    float* get_float_array_(Key* k, Arena* arena = nullptr);
+    String** get_string_array_(Key* k, Arena* arena = nullptr);
+    template <class View>
+    bool get_view_(Key* k, View* view);
+    Value* get_value_(Key* k);
+    Value* get_local_(Key* k, uint64_t* version = nullptr);
+    Value* get_local_replica_(Key* k);
+    size_t read_node_(Key* k);
+    void count_request_(size_t to_node, bool started);
+    char* get_char_(Key* k);
+    Value* send_get_request_(Key* k, size_t to_node);
+    Value* send_key_request_(Key* k, MessageType type, char* watcher, size_t to_node);
+    Value* wait_and_get_value_(Key* k);
+    char* wait_and_get_char_(Key* k);
+    void notify_watchers_(Key* k, Value* value);
+    void queue_notification_(Notification* n);
+    void invalidate_caches_(Key* k, uint64_t version);
+    void notify_loop_();
+
+    void barrier();
+    char* broadcast(Key* k, char* value);
+    char** gather(Key* k, char* value);
+    char* allreduce(char* value, Combiner* combiner);
+    Value* allreduce_value_(Value* value, Combiner* combiner);
 
-    bool* get_bool_array_(Key* k);
-    int* get_int_array_(Key* k);
-    float* get_float_array_(Key* k);
-    String** get_string_array_(Key* k);
-    char* get_char_(Key* k, bool safe);
-    char* send_get_request_(Key* k);
+    Key* collective_key_(size_t seq, const char* tag, size_t from_rank, size_t to_node);
+    void collective_send_(size_t seq, const char* tag, size_t from_rank, size_t to_node, Value* value);
+    Value* collective_receive_(size_t seq, const char* tag, size_t from_rank);
+    Value* reduce_(size_t seq, size_t root, Value* value, Combiner* combiner);
+    Value* broadcast_(size_t seq, size_t root, Value* value);
 
     void handle_message(int connected_socket, Message* msg);
     void handle_put_(int connected_socket, Message* msg);
     void handle_get_(int connected_socket, Message* msg);
+    void handle_watch_(int connected_socket, Message* msg);
+    void handle_notify_(int connected_socket, Message* msg);
+    void handle_seal_(int connected_socket, Message* msg);
+    void handle_invalidate_(int connected_socket, Message* msg);
+    void handle_get_many_(int connected_socket, Message* msg);
+    void handle_put_many_(int connected_socket, Message* msg);
+    void handle_remove_(int connected_socket, Message* msg);
+    void handle_stats_(int connected_socket, Message* msg);
+    void handle_replicate_(int connected_socket, Message* msg);
+    void reply_value_(int connected_socket, Value* value, uint64_t version = 0);
+    uint64_t replied_version_(Key* k, uint64_t version);
 };
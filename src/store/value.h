@@ -0,0 +1,136 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <atomic>
+
+#include "../utils/hash.h"
+#include "../utils/object.h"
+#include "../utils/slab.h"
+
+/*************************************************************************
+ * Value::
+ * An immutable byte buffer holding one value of a Store. The length is
+ * kept alongside the bytes rather than found with strlen, so a value may
+ * hold any bytes, including NULs. A NUL always follows the last byte, so
+ * text values can still be read as C strings.
+ * Values are reference counted. The Store and every local reader share
+ * one buffer: a get hands out another reference instead of a copy, and
+ * the last release() frees it. Never modify a Value once it is shared.
+ * A value read back from disk may point into a read-only file mapping,
+ * which is unmapped instead of deleted. Values, and the bytes of those
+ * the Store copies in itself, come from the global SlabAllocator.
+ */
+class Value : public Object {
+   public:
+    char* bytes;   // owned; length bytes followed by a NUL
+    size_t length;
+    std::atomic<size_t> refs;
+    void* mapping;       // File mapping bytes lie in, or nullptr if bytes came from new[]
+    size_t mapping_len;
+    bool pooled;         // Whether bytes came from the SlabAllocator instead of new[]
+
+    // Takes ownership of bytes, which must come from new[] and have a NUL
+    // at bytes[length]. The caller holds the only reference.
+    Value(char* bytes, size_t length) : refs(1) {
+        assert(bytes[length] == '\0');
+        this->bytes = bytes;
+        this->length = length;
+        mapping = nullptr;
+        mapping_len = 0;
+        pooled = false;
+    }
+
+    ~Value() {
+        if (mapping != nullptr) {
+            munmap(mapping, mapping_len);
+        } else if (pooled) {
+            SlabAllocator::global()->free(bytes, length + 1);
+        } else {
+            delete[] bytes;
+        }
+    }
+
+    static void* operator new(size_t size) {
+        return SlabAllocator::global()->alloc(size);
+    }
+
+    static void operator delete(void* ptr, size_t size) {
+        SlabAllocator::global()->free(ptr, size);
+    }
+
+    // Returns a new Value of length bytes from the SlabAllocator, for the
+    // caller to fill in before sharing it
+    static Value* alloc(size_t length) {
+        char* buf = (char*)SlabAllocator::global()->alloc(length + 1);
+        buf[length] = '\0';
+        Value* v = new Value(buf, length);
+        v->pooled = true;
+        return v;
+    }
+
+    // Returns a new Value holding a copy of the given bytes
+    static Value* copy(const char* bytes, size_t length) {
+        Value* v = alloc(length);
+        memcpy(v->bytes, bytes, length);
+        return v;
+    }
+
+    // Returns a new Value that takes over the given buffer without copying.
+    // See the constructor for what the buffer must look like.
+    static Value* adopt(char* bytes, size_t length) {
+        return new Value(bytes, length);
+    }
+
+    // Returns a new Value that takes over the given NUL-terminated string
+    static Value* adopt(char* str) {
+        return new Value(str, strlen(str));
+    }
+
+    // Returns a new Value whose bytes lie in the given mmap'd region, which
+    // it takes over and unmaps when freed
+    static Value* mapped(void* mapping, size_t mapping_len, char* bytes, size_t length) {
+        Value* v = new Value(bytes, length);
+        v->mapping = mapping;
+        v->mapping_len = mapping_len;
+        return v;
+    }
+
+    const char* data() { return bytes; }
+    size_t size() { return length; }
+    char* c_str() { return bytes; }
+
+    // Adds a reference and returns this value, for the new holder
+    Value* retain() {
+        refs.fetch_add(1);
+        return this;
+    }
+
+    // Drops a reference, freeing the value if it was the last one
+    void release() {
+        if (refs.fetch_sub(1) == 1) {
+            delete this;
+        }
+    }
+
+    // Returns a heap-allocated, NUL-terminated copy of the bytes
+    char* duplicate_bytes() {
+        char* buf = new char[length + 1];
+        memcpy(buf, bytes, length + 1);
+        return buf;
+    }
+
+    size_t hash_me() {
+        return hash_bytes(bytes, length);
+    }
+
+    bool equals(Object* other) {
+        if (other == this) return true;
+        Value* other_value = dynamic_cast<Value*>(other);
+        if (other_value == nullptr) return false;
+        return other_value->length == length && memcmp(other_value->bytes, bytes, length) == 0;
+    }
+};
@@ -0,0 +1,148 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+
+#include "../utils/object.h"
+#include "key.h"
+#include "value.h"
+
+// Number of buckets in a WatchTable. Watches only live while someone is
+// waiting, so there are rarely more than a few of them.
+#define WATCH_TABLE_BUCKETS (size_t)64
+
+/*************************************************************************
+ * Watch::
+ * Everyone waiting for one key on a node: the node's own threads blocked
+ * in waitAndGet, and, on the key's home node, the other nodes that sent a
+ * WATCH for it and must be sent its value once it is put.
+ */
+class Watch : public Object {
+   public:
+    Key* key;            // owned
+    size_t waiting;      // Threads of this node waiting for the key
+    Value* value;        // Latest value delivered, or nullptr; one reference owned
+    std::condition_variable delivered;  // Signalled whenever value is set
+    size_t* watchers;    // owned; ids of nodes to send the value to
+    size_t num_watchers;
+    size_t watchers_capacity;
+    Watch* next;         // Next watch in the same bucket
+
+    Watch(Key* key) {
+        this->key = key->clone();
+        waiting = 0;
+        value = nullptr;
+        watchers_capacity = 2;
+        watchers = new size_t[watchers_capacity];
+        num_watchers = 0;
+        next = nullptr;
+    }
+
+    ~Watch() {
+        delete key;
+        delete[] watchers;
+        if (value != nullptr) {
+            value->release();
+        }
+    }
+
+    // Records that the given node wants the key's value. Each node is
+    // recorded once, however many WATCHes it sends.
+    void add_watcher(size_t node) {
+        for (size_t i = 0; i < num_watchers; i++) {
+            if (watchers[i] == node) {
+                return;
+            }
+        }
+
+        if (num_watchers == watchers_capacity) {
+            watchers_capacity *= 2;
+            size_t* grown = new size_t[watchers_capacity];
+            memcpy(grown, watchers, num_watchers * sizeof(size_t));
+            delete[] watchers;
+            watchers = grown;
+        }
+        watchers[num_watchers++] = node;
+    }
+
+    // Hands value to the threads waiting here, taking over the caller's
+    // reference to it
+    void deliver(Value* value) {
+        if (this->value != nullptr) {
+            this->value->release();
+        }
+        this->value = value;
+        delivered.notify_all();
+    }
+};
+
+/*************************************************************************
+ * WatchTable::
+ * The Watches of one Store, by key. Waiting threads each block on their
+ * key's own condition variable, so a put only wakes the threads waiting
+ * for that key. Callers must hold lock around every method.
+ */
+class WatchTable : public Object {
+   public:
+    std::mutex lock;
+    Watch* buckets[WATCH_TABLE_BUCKETS];
+
+    WatchTable() {
+        for (size_t i = 0; i < WATCH_TABLE_BUCKETS; i++) {
+            buckets[i] = nullptr;
+        }
+    }
+
+    ~WatchTable() {
+        for (size_t i = 0; i < WATCH_TABLE_BUCKETS; i++) {
+            while (buckets[i] != nullptr) {
+                Watch* next = buckets[i]->next;
+                delete buckets[i];
+                buckets[i] = next;
+            }
+        }
+    }
+
+    size_t bucket_(Key* key) {
+        return (size_t)key->get_id() & (WATCH_TABLE_BUCKETS - 1);
+    }
+
+    // Returns the watch for key, or nullptr
+    Watch* find(Key* key) {
+        for (Watch* w = buckets[bucket_(key)]; w != nullptr; w = w->next) {
+            if (w->key->get_id() == key->get_id() && w->key->equals(key)) {
+                return w;
+            }
+        }
+        return nullptr;
+    }
+
+    // Returns the watch for key, adding an empty one if there is none
+    Watch* get(Key* key) {
+        Watch* w = find(key);
+        if (w == nullptr) {
+            w = new Watch(key);
+            size_t b = bucket_(key);
+            w->next = buckets[b];
+            buckets[b] = w;
+        }
+        return w;
+    }
+
+    // Deletes the given watch if nobody is waiting on it any more
+    void remove_if_unused(Watch* watch) {
+        if (watch->waiting > 0 || watch->num_watchers > 0) {
+            return;
+        }
+
+        Watch** link = &buckets[bucket_(watch->key)];
+        while (*link != watch) {
+            link = &(*link)->next;
+        }
+        *link = watch->next;
+        delete watch;
+    }
+};
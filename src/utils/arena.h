@@ -0,0 +1,120 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "object.h"
+
+// Bytes an Arena holds within itself before it takes any from the heap;
+// enough for one deserialized chunk of a column
+#define ARENA_INLINE_BYTES (size_t)8192
+// Least bytes an Arena takes from the heap at once once its own run out
+#define ARENA_BLOCK_BYTES ((size_t)32 << 10)
+#define ARENA_ALIGN (size_t)16
+
+/*************************************************************************
+ * ArenaBlock::
+ * Heap memory an Arena took once its own ran out. The bytes follow it,
+ * aligned like the block.
+ */
+class alignas(ARENA_ALIGN) ArenaBlock {
+   public:
+    ArenaBlock* next;
+    size_t size;
+};
+
+/*************************************************************************
+ * Arena::
+ * Memory for the short-lived results of one operation, such as the array
+ * a chunk is deserialized into to change one cell of it. Each alloc()
+ * just moves a pointer forward, and everything is freed at once when the
+ * arena is deleted or reset, so an operation that builds and drops
+ * hundreds of small objects does no heap allocation at all if they fit in
+ * the arena's own bytes. Declare one on the stack for the operation.
+ * Objects made in an arena are never destroyed, so they must own nothing
+ * outside it. Not thread safe.
+ */
+class Arena : public Object {
+   public:
+    alignas(ARENA_ALIGN) char inline_[ARENA_INLINE_BYTES];
+    char* pos;             // Next free byte
+    char* end;             // End of the memory pos is in
+    ArenaBlock* blocks;    // owned; heap blocks taken, newest first
+
+    Arena() {
+        pos = inline_;
+        end = inline_ + ARENA_INLINE_BYTES;
+        blocks = nullptr;
+    }
+
+    ~Arena() {
+        free_blocks_();
+    }
+
+    // Returns size bytes aligned to align, a power of two no more than
+    // ARENA_ALIGN, that live until the arena is reset or deleted
+    void* alloc(size_t size, size_t align = ARENA_ALIGN) {
+        char* start = (char*)(((uintptr_t)pos + align - 1) & ~(uintptr_t)(align - 1));
+        if (start + size > end) {
+            start = grow_(size);
+        }
+        pos = start + size;
+        return start;
+    }
+
+    // Returns an uninitialized array of n values of the given plain type
+    template <class T>
+    T* alloc_array(size_t n) {
+        return (T*)alloc(n * sizeof(T), alignof(T));
+    }
+
+    // Returns a new T built in the arena from the given arguments. It is
+    // never destroyed, so must own nothing outside the arena.
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        return new (alloc(sizeof(T), alignof(T))) T(static_cast<Args&&>(args)...);
+    }
+
+    // Returns a copy of the first len bytes of s followed by a NUL
+    char* duplicate(const char* s, size_t len) {
+        char* copy = (char*)alloc(len + 1, 1);
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+        return copy;
+    }
+
+    // Frees everything allocated so far, keeping the arena for reuse
+    void reset() {
+        free_blocks_();
+        pos = inline_;
+        end = inline_ + ARENA_INLINE_BYTES;
+    }
+
+    // Takes a heap block big enough for size more bytes and returns where
+    // they start
+    char* grow_(size_t size) {
+        size_t block_size = size > ARENA_BLOCK_BYTES ? size : ARENA_BLOCK_BYTES;
+        ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + block_size);
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+        block->next = blocks;
+        block->size = block_size;
+        blocks = block;
+        char* start = (char*)(block + 1);
+        end = start + block_size;
+        return start;
+    }
+
+    void free_blocks_() {
+        while (blocks != nullptr) {
+            ArenaBlock* next = blocks->next;
+            ::free(blocks);
+            blocks = next;
+        }
+    }
+};
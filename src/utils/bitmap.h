@@ -0,0 +1,596 @@
+// lang::Cpp
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "object.h"
+
+// A container holding more than this many values switches from a sorted
+// array of 16-bit values to a fixed size bitset (and back when it shrinks).
+#define BITMAP_ARRAY_MAX 4096
+// Number of 64-bit words in a bitset container (2^16 bits)
+#define BITMAP_BITSET_WORDS 1024
+
+/**************************************************************************
+ * BitmapContainer ::
+ * Holds all values of a Bitmap that share the same upper 16 bits (the
+ * container's key). Sparse containers store the lower 16 bits of each value
+ * in a sorted array, dense containers store them in a 2^16 bit bitset.
+ * Owned and managed by a Bitmap, not intended for direct use.
+ */
+class BitmapContainer {
+   public:
+    uint16_t key;          // Upper 16 bits shared by all values here
+    size_t cardinality;    // Number of values in this container
+    uint16_t* array;       // owned; sorted values, nullptr when a bitset
+    size_t capacity;       // Number of slots in array
+    uint64_t* words;       // owned; bitset, nullptr when an array
+
+    // Create an empty array container for the given key
+    BitmapContainer(uint16_t key) {
+        this->key = key;
+        cardinality = 0;
+        capacity = 4;
+        array = new uint16_t[capacity];
+        words = nullptr;
+    }
+
+    // Deep copy of the given container
+    BitmapContainer(BitmapContainer* other) {
+        key = other->key;
+        cardinality = other->cardinality;
+        capacity = other->capacity;
+        array = nullptr;
+        words = nullptr;
+
+        if (other->is_bitset()) {
+            words = new uint64_t[BITMAP_BITSET_WORDS];
+            memcpy(words, other->words, BITMAP_BITSET_WORDS * sizeof(uint64_t));
+        } else {
+            array = new uint16_t[capacity];
+            memcpy(array, other->array, cardinality * sizeof(uint16_t));
+        }
+    }
+
+    ~BitmapContainer() {
+        delete[] array;
+        delete[] words;
+    }
+
+    bool is_bitset() {
+        return words != nullptr;
+    }
+
+    // Index of the first array slot holding a value >= low
+    size_t lower_bound_(uint16_t low) {
+        size_t lo = 0;
+        size_t hi = cardinality;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (array[mid] < low) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    bool contains(uint16_t low) {
+        if (is_bitset()) {
+            return (words[low >> 6] >> (low & 63)) & 1;
+        }
+
+        size_t idx = lower_bound_(low);
+        return idx < cardinality && array[idx] == low;
+    }
+
+    // Adds the given value. Returns whether it was not already present.
+    bool add(uint16_t low) {
+        if (is_bitset()) {
+            uint64_t mask = (uint64_t)1 << (low & 63);
+            if (words[low >> 6] & mask) return false;
+            words[low >> 6] |= mask;
+            cardinality++;
+            return true;
+        }
+
+        size_t idx = lower_bound_(low);
+        if (idx < cardinality && array[idx] == low) return false;
+
+        if (cardinality == BITMAP_ARRAY_MAX) {
+            // Too dense for an array, switch representation and retry
+            to_bitset_();
+            return add(low);
+        }
+
+        if (cardinality == capacity) {
+            grow_array_(capacity * 2);
+        }
+
+        memmove(array + idx + 1, array + idx, (cardinality - idx) * sizeof(uint16_t));
+        array[idx] = low;
+        cardinality++;
+        return true;
+    }
+
+    // Removes the given value. Returns whether it was present.
+    bool remove(uint16_t low) {
+        if (is_bitset()) {
+            uint64_t mask = (uint64_t)1 << (low & 63);
+            if (!(words[low >> 6] & mask)) return false;
+            words[low >> 6] &= ~mask;
+            cardinality--;
+            if (cardinality <= BITMAP_ARRAY_MAX) to_array_();
+            return true;
+        }
+
+        size_t idx = lower_bound_(low);
+        if (idx >= cardinality || array[idx] != low) return false;
+
+        memmove(array + idx, array + idx + 1, (cardinality - idx - 1) * sizeof(uint16_t));
+        cardinality--;
+        return true;
+    }
+
+    // In place union with the given container (which must share this key)
+    void union_with(BitmapContainer* other) {
+        if (!is_bitset() && !other->is_bitset() &&
+            cardinality + other->cardinality <= BITMAP_ARRAY_MAX) {
+            // Sorted merge of both arrays
+            uint16_t* merged = new uint16_t[cardinality + other->cardinality];
+            size_t i = 0, j = 0, n = 0;
+            while (i < cardinality && j < other->cardinality) {
+                if (array[i] < other->array[j]) {
+                    merged[n++] = array[i++];
+                } else if (array[i] > other->array[j]) {
+                    merged[n++] = other->array[j++];
+                } else {
+                    merged[n++] = array[i++];
+                    j++;
+                }
+            }
+            while (i < cardinality) merged[n++] = array[i++];
+            while (j < other->cardinality) merged[n++] = other->array[j++];
+
+            delete[] array;
+            array = merged;
+            capacity = cardinality + other->cardinality;
+            cardinality = n;
+            return;
+        }
+
+        to_bitset_();
+        if (other->is_bitset()) {
+            for (size_t w = 0; w < BITMAP_BITSET_WORDS; w++) {
+                words[w] |= other->words[w];
+            }
+        } else {
+            for (size_t i = 0; i < other->cardinality; i++) {
+                uint16_t low = other->array[i];
+                words[low >> 6] |= (uint64_t)1 << (low & 63);
+            }
+        }
+        recount_();
+    }
+
+    // In place intersection with the given container (which must share this key)
+    void intersect_with(BitmapContainer* other) {
+        if (is_bitset() && other->is_bitset()) {
+            for (size_t w = 0; w < BITMAP_BITSET_WORDS; w++) {
+                words[w] &= other->words[w];
+            }
+            recount_();
+            return;
+        }
+
+        keep_if_(other, true);
+    }
+
+    // In place difference: removes all values found in other (which must share this key)
+    void subtract(BitmapContainer* other) {
+        if (is_bitset() && other->is_bitset()) {
+            for (size_t w = 0; w < BITMAP_BITSET_WORDS; w++) {
+                words[w] &= ~other->words[w];
+            }
+            recount_();
+            return;
+        }
+
+        keep_if_(other, false);
+    }
+
+    // Keeps only values whose membership in other equals keep_members
+    void keep_if_(BitmapContainer* other, bool keep_members) {
+        if (is_bitset()) {
+            // other is an array here, so walk its values
+            if (keep_members) {
+                uint64_t* kept = new uint64_t[BITMAP_BITSET_WORDS]();
+                for (size_t i = 0; i < other->cardinality; i++) {
+                    uint16_t low = other->array[i];
+                    kept[low >> 6] |= words[low >> 6] & ((uint64_t)1 << (low & 63));
+                }
+                delete[] words;
+                words = kept;
+            } else {
+                for (size_t i = 0; i < other->cardinality; i++) {
+                    uint16_t low = other->array[i];
+                    words[low >> 6] &= ~((uint64_t)1 << (low & 63));
+                }
+            }
+            recount_();
+            return;
+        }
+
+        size_t n = 0;
+        for (size_t i = 0; i < cardinality; i++) {
+            if (other->contains(array[i]) == keep_members) {
+                array[n++] = array[i];
+            }
+        }
+        cardinality = n;
+    }
+
+    // Writes all values of this container, as full 32-bit values, to out.
+    // Returns the number of values written.
+    size_t to_uint32s(uint32_t* out) {
+        uint32_t high = (uint32_t)key << 16;
+        if (!is_bitset()) {
+            for (size_t i = 0; i < cardinality; i++) {
+                out[i] = high | array[i];
+            }
+            return cardinality;
+        }
+
+        size_t n = 0;
+        for (size_t w = 0; w < BITMAP_BITSET_WORDS; w++) {
+            uint64_t word = words[w];
+            while (word) {
+                size_t bit = __builtin_ctzll(word);
+                out[n++] = high | (uint32_t)(w * 64 + bit);
+                word &= word - 1;
+            }
+        }
+        return n;
+    }
+
+    void grow_array_(size_t new_capacity) {
+        uint16_t* grown = new uint16_t[new_capacity];
+        memcpy(grown, array, cardinality * sizeof(uint16_t));
+        delete[] array;
+        array = grown;
+        capacity = new_capacity;
+    }
+
+    // Converts this container into a bitset, if it is not one already
+    void to_bitset_() {
+        if (is_bitset()) return;
+
+        words = new uint64_t[BITMAP_BITSET_WORDS]();
+        for (size_t i = 0; i < cardinality; i++) {
+            words[array[i] >> 6] |= (uint64_t)1 << (array[i] & 63);
+        }
+        delete[] array;
+        array = nullptr;
+        capacity = 0;
+    }
+
+    // Converts this container back into a sorted array, if it is a bitset
+    void to_array_() {
+        if (!is_bitset()) return;
+
+        capacity = cardinality > 4 ? cardinality : 4;
+        uint16_t* values = new uint16_t[capacity];
+        size_t n = 0;
+        for (size_t w = 0; w < BITMAP_BITSET_WORDS; w++) {
+            uint64_t word = words[w];
+            while (word) {
+                values[n++] = (uint16_t)(w * 64 + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+        delete[] words;
+        words = nullptr;
+        array = values;
+    }
+
+    // Recomputes cardinality of a bitset container, shrinking to an array if sparse
+    void recount_() {
+        if (!is_bitset()) return;
+
+        size_t count = 0;
+        for (size_t w = 0; w < BITMAP_BITSET_WORDS; w++) {
+            count += __builtin_popcountll(words[w]);
+        }
+        cardinality = count;
+
+        if (cardinality <= BITMAP_ARRAY_MAX) to_array_();
+    }
+};
+
+/**************************************************************************
+ * Bitmap ::
+ * A compressed set of unsigned 32-bit integers, in the style of Roaring
+ * bitmaps. Values are split on their upper 16 bits into containers which are
+ * kept sorted by key. Each container picks a sorted array or a bitset
+ * representation depending on how dense it is, so both sparse and dense
+ * sets stay small. Supports fast union, intersection, difference and
+ * cardinality. Bitmaps are mutable, equality compares contents.
+ */
+class Bitmap : public Object {
+   public:
+    BitmapContainer** containers;  // owned; sorted by container key
+    size_t num_containers;
+    size_t capacity;
+
+    // Create an empty bitmap
+    Bitmap() {
+        num_containers = 0;
+        capacity = 4;
+        containers = new BitmapContainer*[capacity];
+    }
+
+    // Deep copy of the given bitmap
+    Bitmap(Bitmap* other) {
+        num_containers = other->num_containers;
+        capacity = other->num_containers > 4 ? other->num_containers : 4;
+        containers = new BitmapContainer*[capacity];
+        for (size_t i = 0; i < num_containers; i++) {
+            containers[i] = new BitmapContainer(other->containers[i]);
+        }
+    }
+
+    ~Bitmap() {
+        clear();
+        delete[] containers;
+    }
+
+    // Removes all values from this bitmap
+    void clear() {
+        for (size_t i = 0; i < num_containers; i++) {
+            delete containers[i];
+        }
+        num_containers = 0;
+    }
+
+    // Index of the first container with a key >= the given key
+    size_t container_index_(uint16_t key) {
+        size_t lo = 0;
+        size_t hi = num_containers;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (containers[mid]->key < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // Inserts the given container at the given index, taking ownership of it
+    void insert_container_(size_t idx, BitmapContainer* c) {
+        if (num_containers == capacity) {
+            capacity *= 2;
+            BitmapContainer** grown = new BitmapContainer*[capacity];
+            memcpy(grown, containers, num_containers * sizeof(BitmapContainer*));
+            delete[] containers;
+            containers = grown;
+        }
+
+        memmove(containers + idx + 1, containers + idx, (num_containers - idx) * sizeof(BitmapContainer*));
+        containers[idx] = c;
+        num_containers++;
+    }
+
+    // Deletes the container at the given index
+    void remove_container_(size_t idx) {
+        delete containers[idx];
+        memmove(containers + idx, containers + idx + 1, (num_containers - idx - 1) * sizeof(BitmapContainer*));
+        num_containers--;
+    }
+
+    // Drops all containers that became empty after an in-place operation
+    void compact_() {
+        size_t n = 0;
+        for (size_t i = 0; i < num_containers; i++) {
+            if (containers[i]->cardinality == 0) {
+                delete containers[i];
+            } else {
+                containers[n++] = containers[i];
+            }
+        }
+        num_containers = n;
+    }
+
+    // Adds the given value. Returns whether it was not already present.
+    bool add(uint32_t value) {
+        uint16_t key = value >> 16;
+        size_t idx = container_index_(key);
+
+        if (idx == num_containers || containers[idx]->key != key) {
+            insert_container_(idx, new BitmapContainer(key));
+        }
+
+        return containers[idx]->add(value & 0xFFFF);
+    }
+
+    // Removes the given value. Returns whether it was present.
+    bool remove(uint32_t value) {
+        uint16_t key = value >> 16;
+        size_t idx = container_index_(key);
+
+        if (idx == num_containers || containers[idx]->key != key) return false;
+
+        bool removed = containers[idx]->remove(value & 0xFFFF);
+        if (containers[idx]->cardinality == 0) remove_container_(idx);
+        return removed;
+    }
+
+    bool contains(uint32_t value) {
+        uint16_t key = value >> 16;
+        size_t idx = container_index_(key);
+
+        if (idx == num_containers || containers[idx]->key != key) return false;
+
+        return containers[idx]->contains(value & 0xFFFF);
+    }
+
+    // Number of values in this bitmap
+    size_t cardinality() {
+        size_t count = 0;
+        for (size_t i = 0; i < num_containers; i++) {
+            count += containers[i]->cardinality;
+        }
+        return count;
+    }
+
+    bool is_empty() {
+        return num_containers == 0;
+    }
+
+    // In place union: afterwards this bitmap holds every value of either bitmap
+    void union_with(Bitmap* other) {
+        size_t i = 0;
+        for (size_t j = 0; j < other->num_containers; j++) {
+            BitmapContainer* theirs = other->containers[j];
+
+            while (i < num_containers && containers[i]->key < theirs->key) i++;
+
+            if (i < num_containers && containers[i]->key == theirs->key) {
+                containers[i]->union_with(theirs);
+            } else {
+                insert_container_(i, new BitmapContainer(theirs));
+            }
+            i++;
+        }
+    }
+
+    // In place intersection: afterwards this bitmap holds values found in both bitmaps
+    void intersect_with(Bitmap* other) {
+        size_t j = 0;
+        for (size_t i = 0; i < num_containers; i++) {
+            BitmapContainer* mine = containers[i];
+
+            while (j < other->num_containers && other->containers[j]->key < mine->key) j++;
+
+            if (j < other->num_containers && other->containers[j]->key == mine->key) {
+                mine->intersect_with(other->containers[j]);
+            } else {
+                mine->cardinality = 0;  // dropped by compact_
+            }
+        }
+        compact_();
+    }
+
+    // In place difference: afterwards this bitmap holds no value found in other
+    void subtract(Bitmap* other) {
+        size_t j = 0;
+        for (size_t i = 0; i < num_containers; i++) {
+            BitmapContainer* mine = containers[i];
+
+            while (j < other->num_containers && other->containers[j]->key < mine->key) j++;
+
+            if (j < other->num_containers && other->containers[j]->key == mine->key) {
+                mine->subtract(other->containers[j]);
+            }
+        }
+        compact_();
+    }
+
+    // Returns a heap-allocated array with all values of this bitmap in
+    // ascending order. Its length is cardinality(). Caller owns the array.
+    uint32_t* to_array() {
+        uint32_t* values = new uint32_t[cardinality()];
+        size_t n = 0;
+        for (size_t i = 0; i < num_containers; i++) {
+            n += containers[i]->to_uint32s(values + n);
+        }
+        return values;
+    }
+
+    /** Compare two bitmaps by their contents */
+    bool equals(Object* other) {
+        if (other == this) return true;
+        Bitmap* b = dynamic_cast<Bitmap*>(other);
+        if (b == nullptr) return false;
+        if (b->num_containers != num_containers) return false;
+
+        for (size_t i = 0; i < num_containers; i++) {
+            BitmapContainer* mine = containers[i];
+            BitmapContainer* theirs = b->containers[i];
+            if (mine->key != theirs->key || mine->cardinality != theirs->cardinality) return false;
+
+            // Containers with equal cardinality share a representation
+            if (mine->is_bitset()) {
+                if (memcmp(mine->words, theirs->words, BITMAP_BITSET_WORDS * sizeof(uint64_t)) != 0) return false;
+            } else if (memcmp(mine->array, theirs->array, mine->cardinality * sizeof(uint16_t)) != 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    Bitmap* clone() {
+        return new Bitmap(this);
+    }
+};
+
+/**************************************************************************
+ * BitmapIterator ::
+ * Visits the values of a Bitmap in ascending order. The bitmap must not be
+ * modified while it is being iterated.
+ */
+class BitmapIterator {
+   public:
+    Bitmap* bitmap;
+    size_t container_idx;  // Container currently being visited
+    size_t pos;            // Array slot, or bit index for bitset containers
+
+    BitmapIterator(Bitmap* bitmap) {
+        this->bitmap = bitmap;
+        container_idx = 0;
+        pos = 0;
+        skip_to_value_();
+    }
+
+    bool has_next() {
+        return container_idx < bitmap->num_containers;
+    }
+
+    // Returns the current value and advances. Only valid if has_next().
+    uint32_t next() {
+        BitmapContainer* c = bitmap->containers[container_idx];
+        uint32_t high = (uint32_t)c->key << 16;
+        uint32_t value = c->is_bitset() ? high | (uint32_t)pos : high | c->array[pos];
+        pos++;
+        skip_to_value_();
+        return value;
+    }
+
+    // Moves pos forward to the next present value, crossing containers if needed
+    void skip_to_value_() {
+        while (container_idx < bitmap->num_containers) {
+            BitmapContainer* c = bitmap->containers[container_idx];
+
+            if (!c->is_bitset()) {
+                if (pos < c->cardinality) return;
+            } else {
+                while (pos < BITMAP_BITSET_WORDS * 64) {
+                    uint64_t word = c->words[pos >> 6] >> (pos & 63);
+                    if (word) {
+                        pos += __builtin_ctzll(word);
+                        return;
+                    }
+                    pos = (pos | 63) + 1;  // jump to the start of the next word
+                }
+            }
+
+            container_idx++;
+            pos = 0;
+        }
+    }
+};
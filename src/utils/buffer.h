@@ -0,0 +1,159 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "object.h"
+
+/*************************************************************************
+ * Buffer::
+ * A growable buffer that serialized text is built in, always followed by
+ * a NUL. Each append copies its bytes straight to the end, growing the
+ * buffer at least twofold when it is full, so building any output takes
+ * time linear in its length. Callers that can work out the exact length
+ * first pass it to the constructor or reserve(), and the buffer never
+ * grows. take() hands the text to the caller.
+ */
+class Buffer : public Object {
+   public:
+    char* buf;  // owned until taken
+    size_t len;
+    size_t capacity;  // Bytes in buf, counting room for the NUL
+
+    // A buffer with room for capacity characters before it grows
+    Buffer(size_t capacity = 64) {
+        this->capacity = capacity + 1;
+        buf = new char[this->capacity];
+        buf[0] = '\0';
+        len = 0;
+    }
+
+    ~Buffer() {
+        delete[] buf;
+    }
+
+    size_t size() { return len; }
+
+    // Makes room for n more characters and a NUL
+    void reserve(size_t n) {
+        if (len + n + 1 <= capacity) {
+            return;
+        }
+        size_t grown_capacity = 2 * capacity;
+        if (grown_capacity < len + n + 1) {
+            grown_capacity = len + n + 1;
+        }
+        char* grown = new char[grown_capacity];
+        memcpy(grown, buf, len + 1);
+        delete[] buf;
+        buf = grown;
+        capacity = grown_capacity;
+    }
+
+    // Appends the first n bytes of s
+    void append(const char* s, size_t n) {
+        reserve(n);
+        memcpy(buf + len, s, n);
+        len += n;
+        buf[len] = '\0';
+    }
+
+    void append(const char* s) {
+        append(s, strlen(s));
+    }
+
+    void append(char c) {
+        reserve(1);
+        buf[len++] = c;
+        buf[len] = '\0';
+    }
+
+    // Appends v in decimal
+    void append_size_t(size_t v) {
+        char digits[20];
+        size_t n = 0;
+        do {
+            digits[n++] = (char)('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+
+        reserve(n);
+        while (n > 0) {
+            buf[len++] = digits[--n];
+        }
+        buf[len] = '\0';
+    }
+
+    void append_int(int v) {
+        if (v < 0) {
+            append('-');
+            // Negate as unsigned, so INT_MIN does not overflow
+            append_size_t((size_t)(-(long long)v));
+        } else {
+            append_size_t((size_t)v);
+        }
+    }
+
+    // Appends v in lowercase hex, zero-padded to at least width digits
+    void append_hex(uint64_t v, size_t width = 0) {
+        char digits[16];
+        size_t n = 0;
+        do {
+            digits[n++] = "0123456789abcdef"[v & 0xf];
+            v >>= 4;
+        } while (v != 0);
+        while (n < width) {
+            digits[n++] = '0';
+        }
+
+        reserve(n);
+        while (n > 0) {
+            buf[len++] = digits[--n];
+        }
+        buf[len] = '\0';
+    }
+
+    // Appends printf-style formatted text
+    void appendf(const char* fmt, ...) {
+        va_list args;
+        va_start(args, fmt);
+        size_t needed = vsnprintf(nullptr, 0, fmt, args);
+        va_end(args);
+
+        reserve(needed);
+        va_start(args, fmt);
+        vsnprintf(buf + len, capacity - len, fmt, args);
+        va_end(args);
+        len += needed;
+    }
+
+    // Empties the buffer, keeping its room
+    void clear() {
+        len = 0;
+        buf[0] = '\0';
+    }
+
+    // Returns the text, which the caller must delete[], and empties the buffer
+    char* take() {
+        char* text = buf;
+        capacity = 64;
+        buf = new char[capacity];
+        buf[0] = '\0';
+        len = 0;
+        return text;
+    }
+
+    // Number of decimal digits in v
+    static size_t digits(size_t v) {
+        size_t n = 1;
+        while (v >= 10) {
+            v /= 10;
+            n++;
+        }
+        return n;
+    }
+};
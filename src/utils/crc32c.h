@@ -0,0 +1,97 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#endif
+
+#include "object.h"
+
+// The CRC-32C (Castagnoli) polynomial, bit-reversed
+#define CRC32C_POLY 0x82F63B78u
+
+/*************************************************************************
+ * Crc32c::
+ * The CRC-32C checksum of a run of bytes, as used by iSCSI and ext4. On
+ * x86 processors with SSE4.2 it is computed 8 bytes per instruction with
+ * crc32; elsewhere it falls back to a table, a byte at a time. Both give
+ * the same result, so checksums written on one node are checked on any.
+ */
+class Crc32c : public Object {
+   public:
+    // Returns the checksum of the len bytes at data
+    static uint32_t compute(const void* data, size_t len) {
+        return extend(0, data, len);
+    }
+
+    // Returns the checksum of the bytes crc was computed over followed by
+    // the len bytes at data
+    static uint32_t extend(uint32_t crc, const void* data, size_t len) {
+#ifdef CRC32C_X86
+        if (has_hardware()) {
+            return ~extend_hardware_(~crc, (const unsigned char*)data, len);
+        }
+#endif
+        return ~extend_table_(~crc, (const unsigned char*)data, len);
+    }
+
+    // Whether the processor has the crc32 instruction
+    static bool has_hardware() {
+#ifdef CRC32C_X86
+        static const bool sse42 = __builtin_cpu_supports("sse4.2");
+        return sse42;
+#else
+        return false;
+#endif
+    }
+
+    static uint32_t extend_table_(uint32_t crc, const unsigned char* p, size_t len) {
+        const uint32_t* table = table_();
+        for (size_t i = 0; i < len; i++) {
+            crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+    // The remainder of each byte, built once
+    static const uint32_t* table_() {
+        static uint32_t* table = build_table_();
+        return table;
+    }
+
+    static uint32_t* build_table_() {
+        static uint32_t table[256];
+        for (uint32_t b = 0; b < 256; b++) {
+            uint32_t crc = b;
+            for (size_t bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+            }
+            table[b] = crc;
+        }
+        return table;
+    }
+
+#ifdef CRC32C_X86
+    __attribute__((target("sse4.2")))
+    static uint32_t extend_hardware_(uint32_t crc, const unsigned char* p, size_t len) {
+#if defined(__x86_64__)
+        uint64_t crc64 = crc;
+        for (; len >= 8; p += 8, len -= 8) {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = (uint32_t)crc64;
+#endif
+        for (; len > 0; p++, len--) {
+            crc = _mm_crc32_u8(crc, *p);
+        }
+        return crc;
+    }
+#endif
+};
@@ -0,0 +1,107 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// Primes of the xxHash64 algorithm
+#define HASH_PRIME_1 0x9e3779b185ebca87ULL
+#define HASH_PRIME_2 0xc2b2ae3d27d4eb4fULL
+#define HASH_PRIME_3 0x165667b19e3779f9ULL
+#define HASH_PRIME_4 0x85ebca77c2b2ae63ULL
+#define HASH_PRIME_5 0x27d4eb2f165667c5ULL
+
+// Scrambles the bits of x (the splitmix64 finalizer). Nearby inputs give
+// unrelated outputs.
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+inline uint64_t rotl64_(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// Unaligned little-endian reads
+inline uint64_t read64_(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32_(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t hash_round_(uint64_t acc, uint64_t input) {
+    acc += input * HASH_PRIME_2;
+    acc = rotl64_(acc, 31);
+    return acc * HASH_PRIME_1;
+}
+
+inline uint64_t hash_merge_round_(uint64_t acc, uint64_t val) {
+    acc ^= hash_round_(0, val);
+    return acc * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+// 64-bit hash of the given bytes (xxHash64). Reads eight bytes at a time,
+// and every input bit affects every output bit, so it is fast on long
+// names and strong on short, similar ones. Different seeds give
+// independent hashes of the same bytes.
+inline uint64_t hash_bytes(const char* bytes, size_t len, uint64_t seed = 0) {
+    const unsigned char* p = (const unsigned char*)bytes;
+    const unsigned char* end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        // Four independent lanes of 8 bytes each
+        uint64_t v1 = seed + HASH_PRIME_1 + HASH_PRIME_2;
+        uint64_t v2 = seed + HASH_PRIME_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - HASH_PRIME_1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = hash_round_(v1, read64_(p));
+            v2 = hash_round_(v2, read64_(p + 8));
+            v3 = hash_round_(v3, read64_(p + 16));
+            v4 = hash_round_(v4, read64_(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl64_(v1, 1) + rotl64_(v2, 7) + rotl64_(v3, 12) + rotl64_(v4, 18);
+        h = hash_merge_round_(h, v1);
+        h = hash_merge_round_(h, v2);
+        h = hash_merge_round_(h, v3);
+        h = hash_merge_round_(h, v4);
+    } else {
+        h = seed + HASH_PRIME_5;
+    }
+
+    h += (uint64_t)len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= hash_round_(0, read64_(p));
+        h = rotl64_(h, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32_(p) * HASH_PRIME_1;
+        h = rotl64_(h, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= (*p) * HASH_PRIME_5;
+        h = rotl64_(h, 11) * HASH_PRIME_1;
+    }
+
+    // Avalanche
+    h ^= h >> 33;
+    h *= HASH_PRIME_2;
+    h ^= h >> 29;
+    h *= HASH_PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
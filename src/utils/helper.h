@@ -89,7 +89,7 @@ class Sys {
     }
 
     // Counts frequency of given char in the given string
-    size_t count_char(const char* c, char* string) {
+    size_t count_char(const char* c, const char* string) {
         size_t count = 0;
         size_t length = strlen(string);
 
@@ -0,0 +1,360 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+
+#include "buffer.h"
+#include "hash.h"
+#include "helper.h"
+#include "object.h"
+
+// Sub-buckets per power of two in a Histogram, as a power of two. 3 bits
+// keeps every recorded value within 12.5% of the bucket reported for it.
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB_BUCKETS ((size_t)1 << HISTOGRAM_SUB_BITS)
+// Values below HISTOGRAM_SUB_BUCKETS get a bucket each, then every power of
+// two up to 2^63 gets HISTOGRAM_SUB_BUCKETS
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+// Most distinct key prefixes a PrefixTable tracks; others are lumped together
+#define METRICS_MAX_PREFIXES (size_t)64
+#define METRICS_MAX_PREFIX_LEN (size_t)32
+
+/*************************************************************************
+ * JsonBuffer::
+ * A Buffer that JSON text is printed into, which can also quote strings.
+ */
+class JsonBuffer : public Buffer {
+   public:
+    JsonBuffer() : Buffer(1024) {}
+
+    // Appends the given string as a quoted JSON string
+    void quote(const char* str) {
+        reserve(2 * strlen(str) + 2);
+        buf[len++] = '"';
+        for (const char* c = str; *c != '\0'; c++) {
+            if (*c == '"' || *c == '\\') {
+                buf[len++] = '\\';
+                buf[len++] = *c;
+            } else if ((unsigned char)*c < 0x20) {
+                buf[len++] = '?';
+            } else {
+                buf[len++] = *c;
+            }
+        }
+        buf[len++] = '"';
+        buf[len] = '\0';
+    }
+};
+
+/*************************************************************************
+ * Counter::
+ * A count any number of threads may add to at once without locking.
+ */
+class Counter : public Object {
+   public:
+    std::atomic<uint64_t> value;
+
+    Counter() : value(0) {}
+
+    void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+
+    uint64_t get() { return value.load(std::memory_order_relaxed); }
+};
+
+/*************************************************************************
+ * Histogram::
+ * Counts of recorded values, such as latencies in nanoseconds, in buckets
+ * whose width grows with the values (as in HdrHistogram): every power of
+ * two is split into HISTOGRAM_SUB_BUCKETS equal buckets, so percentiles are
+ * reported within a fixed relative error from a few KB of counters, however
+ * large the values. Recording is lock-free; reading while others record
+ * gives a consistent enough picture for monitoring.
+ */
+class Histogram : public Object {
+   public:
+    std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+    Histogram() : count(0), sum(0), max(0) {
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Index of the bucket holding value
+    static size_t bucket_of(uint64_t value) {
+        if (value < HISTOGRAM_SUB_BUCKETS) {
+            return value;
+        }
+        size_t exponent = 63 - __builtin_clzll(value);
+        size_t sub = (value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+        return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+    }
+
+    // Smallest value the bucket at idx holds
+    static uint64_t bucket_low(size_t idx) {
+        if (idx < HISTOGRAM_SUB_BUCKETS) {
+            return idx;
+        }
+        size_t exponent = idx / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+        uint64_t sub = idx % HISTOGRAM_SUB_BUCKETS;
+        return (HISTOGRAM_SUB_BUCKETS + sub) << (exponent - HISTOGRAM_SUB_BITS);
+    }
+
+    void record(uint64_t value) {
+        buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t seen = max.load(std::memory_order_relaxed);
+        while (value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Returns the largest value the bucket holding the q-th quantile (0 to 1)
+    // of recorded values can hold, but no more than the largest recorded.
+    // 0 if nothing was recorded.
+    uint64_t percentile(double q) {
+        uint64_t total = count.load(std::memory_order_relaxed);
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(q * total);
+        if (rank >= total) rank = total - 1;
+
+        uint64_t seen = 0;
+        uint64_t largest = max.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen > rank) {
+                uint64_t high = i + 1 < HISTOGRAM_BUCKETS ? bucket_low(i + 1) - 1 : UINT64_MAX;
+                return high < largest ? high : largest;
+            }
+        }
+        return largest;
+    }
+
+    uint64_t mean() {
+        uint64_t total = count.load(std::memory_order_relaxed);
+        return total == 0 ? 0 : sum.load(std::memory_order_relaxed) / total;
+    }
+
+    // Calls f, records how long it took, and returns what it returned
+    template <typename F>
+    auto timed(F f) -> decltype(f());
+
+    // Prints the count, mean, median, 90th and 99th percentiles and maximum
+    // as a JSON object
+    void to_json(JsonBuffer& out) {
+        out.appendf("{\"count\": %" PRIu64 ", \"mean\": %" PRIu64 ", \"p50\": %" PRIu64 ", \"p90\": %" PRIu64
+                    ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 "}",
+                    count.load(std::memory_order_relaxed), mean(), percentile(0.5), percentile(0.9), percentile(0.99),
+                    max.load(std::memory_order_relaxed));
+    }
+};
+
+/*************************************************************************
+ * LatencyTimer::
+ * Records the nanoseconds between its construction and destruction in a
+ * Histogram, so timing a scope takes one line.
+ */
+class LatencyTimer {
+   public:
+    Histogram* histogram;  // external
+    std::chrono::steady_clock::time_point start;
+
+    LatencyTimer(Histogram* histogram) {
+        this->histogram = histogram;
+        start = std::chrono::steady_clock::now();
+    }
+
+    ~LatencyTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+};
+
+template <typename F>
+auto Histogram::timed(F f) -> decltype(f()) {
+    LatencyTimer timer(this);
+    return f();
+}
+
+/*************************************************************************
+ * PrefixStats::
+ * How often keys sharing one prefix were read and written, and how many
+ * bytes of values that moved.
+ */
+class PrefixStats : public Object {
+   public:
+    std::atomic<char*> prefix;  // owned; nullptr while the slot is free
+    Counter gets;
+    Counter puts;
+    Counter bytes;
+
+    PrefixStats() : prefix(nullptr) {}
+
+    ~PrefixStats() {
+        delete[] prefix.load();
+    }
+};
+
+/*************************************************************************
+ * PrefixTable::
+ * PrefixStats by key prefix: the part of a key's name before its first
+ * '-'. Chunk keys, whose names start with the id of the node that made
+ * them, all count under "chunk". Slots are claimed with a compare-and-swap
+ * and never given back, so lookups and counting never lock. Past
+ * METRICS_MAX_PREFIXES prefixes, the rest count under "other".
+ */
+class PrefixTable : public Object {
+   public:
+    PrefixStats slots[METRICS_MAX_PREFIXES];
+    PrefixStats other;
+
+    PrefixTable() {
+        other.prefix = duplicate((char*)"other");
+    }
+
+    // Returns the stats for the prefix of the given key name
+    PrefixStats* find(const char* name) {
+        size_t len = strcspn(name, "-");
+        if (len > 0 && strspn(name, "0123456789") >= len) {
+            name = "chunk";
+            len = strlen(name);
+        }
+        if (len > METRICS_MAX_PREFIX_LEN) {
+            len = METRICS_MAX_PREFIX_LEN;
+        }
+
+        size_t start = hash_bytes(name, len) % METRICS_MAX_PREFIXES;
+        char* mine = nullptr;
+        for (size_t probe = 0; probe < METRICS_MAX_PREFIXES; probe++) {
+            PrefixStats* slot = &slots[(start + probe) % METRICS_MAX_PREFIXES];
+            char* prefix = slot->prefix.load(std::memory_order_acquire);
+            if (prefix == nullptr) {
+                if (mine == nullptr) {
+                    mine = new char[len + 1];
+                    memcpy(mine, name, len);
+                    mine[len] = '\0';
+                }
+                if (slot->prefix.compare_exchange_strong(prefix, mine, std::memory_order_acq_rel)) {
+                    return slot;
+                }
+                // Another thread claimed the slot first; prefix is now theirs
+            }
+            if (strncmp(prefix, name, len) == 0 && prefix[len] == '\0') {
+                delete[] mine;
+                return slot;
+            }
+        }
+        delete[] mine;
+        return &other;
+    }
+
+    // Prints every prefix seen, with its stats, as a JSON array
+    void to_json(JsonBuffer& out) {
+        out.appendf("[");
+        bool first = true;
+        for (size_t i = 0; i <= METRICS_MAX_PREFIXES; i++) {
+            PrefixStats* slot = i < METRICS_MAX_PREFIXES ? &slots[i] : &other;
+            char* prefix = slot->prefix.load(std::memory_order_acquire);
+            if (prefix == nullptr || (slot == &other && slot->gets.get() + slot->puts.get() == 0)) {
+                continue;
+            }
+            out.appendf(first ? "{\"prefix\": " : ", {\"prefix\": ");
+            out.quote(prefix);
+            out.appendf(", \"gets\": %" PRIu64 ", \"puts\": %" PRIu64 ", \"bytes\": %" PRIu64 "}", slot->gets.get(),
+                        slot->puts.get(), slot->bytes.get());
+            first = false;
+        }
+        out.appendf("]");
+    }
+};
+
+/*************************************************************************
+ * Metrics::
+ * What one node has been doing, for finding hot spots from data. Gets and
+ * puts are counted by where they went: to this node's own table (local),
+ * to another node (remote), or from another node to this one (served).
+ * Network traffic is counted as it crosses sockets. Latencies are in
+ * nanoseconds. Every counter and histogram may be updated by any thread
+ * without locking.
+ */
+class Metrics : public Object {
+   public:
+    Counter gets_local;
+    Counter gets_remote;
+    Counter gets_served;
+    Counter puts_local;
+    Counter puts_remote;
+    Counter puts_served;
+    Counter removes;
+    Counter messages_sent;
+    Counter messages_received;
+    Counter bytes_sent;
+    Counter bytes_received;
+
+    Histogram get_nanos;          // Store gets, including any round trip
+    Histogram put_nanos;          // Store puts, including any round trip
+    Histogram rpc_nanos;          // Round trips of messages to other nodes
+    Histogram serialize_nanos;    // Turning frames and chunks into bytes
+    Histogram deserialize_nanos;  // And back
+
+    PrefixTable prefixes;  // Keys of this node's table by prefix
+
+    // Counts a get of the value of a key held by this node
+    void record_get(const char* name, size_t bytes) {
+        PrefixStats* stats = prefixes.find(name);
+        stats->gets.add();
+        stats->bytes.add(bytes);
+    }
+
+    // Counts a put of a value under a key held by this node
+    void record_put(const char* name, size_t bytes) {
+        PrefixStats* stats = prefixes.find(name);
+        stats->puts.add();
+        stats->bytes.add(bytes);
+    }
+
+    // Returns a new JSON object of every metric, starting with the given
+    // fields (a comma-separated list of "name": value pairs, or nullptr)
+    char* to_json(const char* fields) {
+        JsonBuffer out;
+        out.appendf("{");
+        if (fields != nullptr) {
+            out.appendf("%s, ", fields);
+        }
+
+        out.appendf("\"counters\": {");
+        const char* counter_names[] = {"gets_local", "gets_remote", "gets_served", "puts_local",
+                                       "puts_remote", "puts_served", "removes", "messages_sent",
+                                       "messages_received", "bytes_sent", "bytes_received"};
+        Counter* counters[] = {&gets_local, &gets_remote, &gets_served, &puts_local,
+                               &puts_remote, &puts_served, &removes, &messages_sent,
+                               &messages_received, &bytes_sent, &bytes_received};
+        for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+            out.appendf("%s\"%s\": %" PRIu64, i == 0 ? "" : ", ", counter_names[i], counters[i]->get());
+        }
+
+        out.appendf("}, \"latency_nanos\": {");
+        const char* histogram_names[] = {"get", "put", "rpc", "serialize", "deserialize"};
+        Histogram* histograms[] = {&get_nanos, &put_nanos, &rpc_nanos, &serialize_nanos, &deserialize_nanos};
+        for (size_t i = 0; i < sizeof(histograms) / sizeof(histograms[0]); i++) {
+            out.appendf("%s\"%s\": ", i == 0 ? "" : ", ", histogram_names[i]);
+            histograms[i]->to_json(out);
+        }
+
+        out.appendf("}, \"prefixes\": ");
+        prefixes.to_json(out);
+        out.appendf("}");
+        return out.take();
+    }
+};
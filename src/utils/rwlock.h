@@ -0,0 +1,50 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*************************************************************************
+ * RWLock::
+ * A reader/writer lock. Any number of readers may hold it at once; a
+ * writer holds it alone. Wraps pthread_rwlock_t, since C++11 has no
+ * std::shared_mutex.
+ */
+class RWLock {
+   public:
+    pthread_rwlock_t lock_;
+
+    RWLock() {
+        if (pthread_rwlock_init(&lock_, nullptr) != 0) {
+            printf("ERROR: could not create reader/writer lock\n");
+            exit(1);
+        }
+    }
+
+    ~RWLock() {
+        pthread_rwlock_destroy(&lock_);
+    }
+
+    void read_lock() { pthread_rwlock_rdlock(&lock_); }
+    void write_lock() { pthread_rwlock_wrlock(&lock_); }
+    void unlock() { pthread_rwlock_unlock(&lock_); }
+};
+
+// Holds an RWLock for reading for as long as it is in scope
+class ReadGuard {
+   public:
+    RWLock& lock;
+
+    ReadGuard(RWLock& lock) : lock(lock) { lock.read_lock(); }
+    ~ReadGuard() { lock.unlock(); }
+};
+
+// Holds an RWLock for writing for as long as it is in scope
+class WriteGuard {
+   public:
+    RWLock& lock;
+
+    WriteGuard(RWLock& lock) : lock(lock) { lock.write_lock(); }
+    ~WriteGuard() { lock.unlock(); }
+};
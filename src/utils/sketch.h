@@ -0,0 +1,480 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "hash.h"
+#include "object.h"
+#include "string.h"
+
+#define HLL_DEFAULT_PRECISION (size_t)12
+#define COUNT_MIN_DEFAULT_WIDTH (size_t)1024
+#define COUNT_MIN_DEFAULT_DEPTH (size_t)4
+#define KLL_DEFAULT_K (size_t)200
+
+#define HLL_TYPE 'H'
+#define COUNT_MIN_TYPE 'C'
+#define KLL_TYPE 'Q'
+
+// 64-bit hash of the given bytes
+inline uint64_t hash64(const char* bytes, size_t len) { return hash_bytes(bytes, len); }
+
+inline uint64_t hash64(int val) { return mix64((uint64_t)(int64_t)val); }
+inline uint64_t hash64(bool val) { return mix64(val ? 1 : 0); }
+inline uint64_t hash64(String* val) { return hash64(val->c_str(), val->size()); }
+
+inline uint64_t hash64(float val) {
+    uint32_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return mix64(bits);
+}
+
+/*******************************************************************************
+ *  Sketch::
+ *  A fixed-size summary of a stream of values that answers one kind of
+ *  question approximately. Sketches built on different nodes (or threads)
+ *  from different values can be merged into the sketch of all the values,
+ *  so they are built with local_map or pmap and combined with
+ *  Store::merge_sketch() instead of shipping the values to one node.
+ */
+class Sketch : public Object {
+   public:
+    // One of HLL_TYPE, COUNT_MIN_TYPE or KLL_TYPE
+    virtual char sketch_type() = 0;
+
+    // Value adders, one per column type. Sketches ignore types they cannot
+    // summarize (quantile sketches ignore strings).
+    virtual void add(int val) = 0;
+    virtual void add(float val) = 0;
+    virtual void add(bool val) = 0;
+    virtual void add(String* val) = 0;
+
+    // Folds other into this sketch. Returns false, leaving this sketch
+    // unchanged, if other is of a different type or shape.
+    virtual bool merge(Sketch* other) = 0;
+
+    // Returns a new empty sketch of the same type and shape
+    virtual Sketch* clone_empty() = 0;
+};
+
+/*******************************************************************************
+ *  HyperLogLog::
+ *  Estimates the number of distinct values added, to within about
+ *  1.04 / sqrt(2^precision) (1.6% at the default precision), using one
+ *  byte per register. Merging takes the register-wise maximum.
+ */
+class HyperLogLog : public Sketch {
+   public:
+    size_t precision;    // Number of hash bits used to pick a register
+    size_t num_registers;
+    uint8_t* registers;  // owned; longest run of leading zeros seen per register
+
+    HyperLogLog(size_t precision = HLL_DEFAULT_PRECISION) {
+        this->precision = precision;
+        num_registers = (size_t)1 << precision;
+        registers = new uint8_t[num_registers]();
+    }
+
+    ~HyperLogLog() {
+        delete[] registers;
+    }
+
+    char sketch_type() { return HLL_TYPE; }
+
+    void add(int val) { add_hash(hash64(val)); }
+    void add(float val) { add_hash(hash64(val)); }
+    void add(bool val) { add_hash(hash64(val)); }
+    void add(String* val) { add_hash(hash64(val)); }
+
+    // The top bits of the hash pick a register, which records the position
+    // of the first set bit among the rest
+    void add_hash(uint64_t hash) {
+        size_t idx = hash >> (64 - precision);
+        // The guard bit bounds the rank when the remaining bits are all zero
+        uint64_t rest = (hash << precision) | ((uint64_t)1 << (precision - 1));
+        uint8_t rank = __builtin_clzll(rest) + 1;
+
+        if (rank > registers[idx]) {
+            registers[idx] = rank;
+        }
+    }
+
+    // Returns the estimated number of distinct values added
+    double estimate() {
+        double m = (double)num_registers;
+        double sum = 0;
+        size_t zeros = 0;
+        for (size_t i = 0; i < num_registers; i++) {
+            sum += ldexp(1.0, -registers[i]);
+            if (registers[i] == 0) {
+                zeros++;
+            }
+        }
+
+        double alpha = 0.7213 / (1 + 1.079 / m);
+        double estimate = alpha * m * m / sum;
+
+        // Few distinct values leave many empty registers, which linear
+        // counting estimates better
+        if (estimate <= 2.5 * m && zeros > 0) {
+            estimate = m * log(m / zeros);
+        }
+
+        return estimate;
+    }
+
+    bool merge(Sketch* other) {
+        HyperLogLog* o = dynamic_cast<HyperLogLog*>(other);
+        if (o == nullptr || o->precision != precision) {
+            return false;
+        }
+
+        for (size_t i = 0; i < num_registers; i++) {
+            if (o->registers[i] > registers[i]) {
+                registers[i] = o->registers[i];
+            }
+        }
+        return true;
+    }
+
+    HyperLogLog* clone_empty() { return new HyperLogLog(precision); }
+
+    bool equals(Object* other) {
+        HyperLogLog* o = dynamic_cast<HyperLogLog*>(other);
+        return o != nullptr && o->precision == precision &&
+               memcmp(o->registers, registers, num_registers) == 0;
+    }
+};
+
+/*******************************************************************************
+ *  CountMinSketch::
+ *  Estimates how many times each value was added. Estimates never fall
+ *  below the true count, and exceed it by at most e / width of the total
+ *  count with probability 1 - e^-depth. Finds heavy hitters, such as the
+ *  most frequent words, without keeping a counter per distinct value.
+ *  Merging adds the counters.
+ */
+class CountMinSketch : public Sketch {
+   public:
+    size_t width;      // Counters per row
+    size_t depth;      // Number of rows, each with its own hash
+    size_t total;      // Sum of all counts added
+    size_t* counters;  // owned; depth rows of width counters
+
+    CountMinSketch(size_t width = COUNT_MIN_DEFAULT_WIDTH, size_t depth = COUNT_MIN_DEFAULT_DEPTH) {
+        this->width = width;
+        this->depth = depth;
+        total = 0;
+        counters = new size_t[width * depth]();
+    }
+
+    ~CountMinSketch() {
+        delete[] counters;
+    }
+
+    char sketch_type() { return COUNT_MIN_TYPE; }
+
+    void add(int val) { add_hash(hash64(val), 1); }
+    void add(float val) { add_hash(hash64(val), 1); }
+    void add(bool val) { add_hash(hash64(val), 1); }
+    void add(String* val) { add_hash(hash64(val), 1); }
+
+    // Row i's counter is picked by h1 + i * h2, both halves of one hash
+    size_t cell_(uint64_t hash, size_t row) {
+        uint32_t h1 = (uint32_t)hash;
+        uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+        return row * width + (size_t)(h1 + row * h2) % width;
+    }
+
+    void add_hash(uint64_t hash, size_t count) {
+        for (size_t row = 0; row < depth; row++) {
+            counters[cell_(hash, row)] += count;
+        }
+        total += count;
+    }
+
+    size_t estimate_hash(uint64_t hash) {
+        size_t min = counters[cell_(hash, 0)];
+        for (size_t row = 1; row < depth; row++) {
+            size_t count = counters[cell_(hash, row)];
+            if (count < min) {
+                min = count;
+            }
+        }
+        return min;
+    }
+
+    // Returns the estimated number of times the value was added
+    size_t estimate(int val) { return estimate_hash(hash64(val)); }
+    size_t estimate(float val) { return estimate_hash(hash64(val)); }
+    size_t estimate(bool val) { return estimate_hash(hash64(val)); }
+    size_t estimate(String* val) { return estimate_hash(hash64(val)); }
+
+    // Whether the value's estimated share of the total is at least fraction
+    bool is_heavy_hitter(String* val, double fraction) {
+        return estimate(val) >= fraction * total;
+    }
+
+    bool merge(Sketch* other) {
+        CountMinSketch* o = dynamic_cast<CountMinSketch*>(other);
+        if (o == nullptr || o->width != width || o->depth != depth) {
+            return false;
+        }
+
+        for (size_t i = 0; i < width * depth; i++) {
+            counters[i] += o->counters[i];
+        }
+        total += o->total;
+        return true;
+    }
+
+    CountMinSketch* clone_empty() { return new CountMinSketch(width, depth); }
+
+    bool equals(Object* other) {
+        CountMinSketch* o = dynamic_cast<CountMinSketch*>(other);
+        return o != nullptr && o->width == width && o->depth == depth && o->total == total &&
+               memcmp(o->counters, counters, width * depth * sizeof(size_t)) == 0;
+    }
+};
+
+/*******************************************************************************
+ *  KllSketch::
+ *  Estimates quantiles (medians, percentiles) of the numbers added, with
+ *  rank error around 1.7 / k, in O(k) space. Values are kept in levels
+ *  of compactors; a value at level h stands for 2^h of the values added.
+ *  When the sketch is full, the lowest over-full level is sorted and every
+ *  other value promoted to the next level. Merging concatenates the levels
+ *  and compacts again.
+ */
+class KllSketch : public Sketch {
+   public:
+    size_t k;           // Capacity of the top level; larger is more accurate
+    size_t n;           // Number of values added
+    size_t num_levels;
+    float** levels;     // owned; levels[h] holds values of weight 2^h
+    size_t* sizes;      // Number of values in each level
+    size_t* capacities_;  // Allocated size of each level
+    uint64_t rng_;      // State for picking which half of a level to promote
+
+    KllSketch(size_t k = KLL_DEFAULT_K) {
+        this->k = k;
+        n = 0;
+        num_levels = 0;
+        levels = nullptr;
+        sizes = nullptr;
+        capacities_ = nullptr;
+        rng_ = 0x2545f4914f6cdd1dULL;
+        add_level_();
+    }
+
+    ~KllSketch() {
+        for (size_t h = 0; h < num_levels; h++) {
+            delete[] levels[h];
+        }
+        delete[] levels;
+        delete[] sizes;
+        delete[] capacities_;
+    }
+
+    char sketch_type() { return KLL_TYPE; }
+
+    void add(int val) { add((float)val); }
+    void add(bool val) { add((float)val); }
+    void add(String* val) {}
+
+    void add(float val) {
+        push_(0, val);
+        n++;
+        if (num_values() >= total_capacity_()) {
+            compact_();
+        }
+    }
+
+    // Number of values retained across all levels
+    size_t num_values() {
+        size_t count = 0;
+        for (size_t h = 0; h < num_levels; h++) {
+            count += sizes[h];
+        }
+        return count;
+    }
+
+    // Levels shrink geometrically (by 2/3) below the top level
+    size_t level_capacity_(size_t h) {
+        size_t depth = num_levels - 1 - h;
+        size_t cap = (size_t)ceil(k * pow(2.0 / 3.0, (double)depth));
+        return cap < 2 ? 2 : cap;
+    }
+
+    size_t total_capacity_() {
+        size_t total = 0;
+        for (size_t h = 0; h < num_levels; h++) {
+            total += level_capacity_(h);
+        }
+        return total;
+    }
+
+    void add_level_() {
+        float** new_levels = new float*[num_levels + 1];
+        size_t* new_sizes = new size_t[num_levels + 1];
+        size_t* new_capacities = new size_t[num_levels + 1];
+        for (size_t h = 0; h < num_levels; h++) {
+            new_levels[h] = levels[h];
+            new_sizes[h] = sizes[h];
+            new_capacities[h] = capacities_[h];
+        }
+        new_levels[num_levels] = new float[8];
+        new_sizes[num_levels] = 0;
+        new_capacities[num_levels] = 8;
+
+        delete[] levels;
+        delete[] sizes;
+        delete[] capacities_;
+        levels = new_levels;
+        sizes = new_sizes;
+        capacities_ = new_capacities;
+        num_levels++;
+    }
+
+    void push_(size_t h, float val) {
+        while (h >= num_levels) {
+            add_level_();
+        }
+        if (sizes[h] == capacities_[h]) {
+            float* grown = new float[capacities_[h] * 2];
+            memcpy(grown, levels[h], sizes[h] * sizeof(float));
+            delete[] levels[h];
+            levels[h] = grown;
+            capacities_[h] *= 2;
+        }
+        levels[h][sizes[h]++] = val;
+    }
+
+    // Compacts levels until the retained values fit the sketch's capacity
+    void compact_() {
+        while (num_values() >= total_capacity_()) {
+            for (size_t h = 0; h < num_levels; h++) {
+                if (sizes[h] >= level_capacity_(h)) {
+                    compact_level_(h);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Promotes every other value of level h, after sorting, to level h + 1.
+    // An odd value out stays behind, so no weight is lost.
+    void compact_level_(size_t h) {
+        float* vals = levels[h];
+        size_t count = sizes[h];
+        size_t leftover = count % 2;
+        std::sort(vals, vals + count - leftover);
+
+        rng_ = mix64(rng_);
+        size_t offset = rng_ & 1;
+        for (size_t i = offset; i < count - leftover; i += 2) {
+            push_(h + 1, vals[i]);
+        }
+
+        // push_ may have added a level, replacing the arrays
+        levels[h][0] = levels[h][count - 1];
+        sizes[h] = leftover;
+    }
+
+    // Returns the sorted retained values and their weights. Caller owns both.
+    size_t weighted_values_(float** values, size_t** weights) {
+        size_t count = num_values();
+        size_t* order = new size_t[count];
+        float* vals = new float[count];
+        size_t* wts = new size_t[count];
+
+        size_t pos = 0;
+        for (size_t h = 0; h < num_levels; h++) {
+            for (size_t i = 0; i < sizes[h]; i++) {
+                vals[pos] = levels[h][i];
+                wts[pos] = (size_t)1 << h;
+                order[pos] = pos;
+                pos++;
+            }
+        }
+        std::sort(order, order + count, [vals](size_t a, size_t b) { return vals[a] < vals[b]; });
+
+        *values = new float[count];
+        *weights = new size_t[count];
+        for (size_t i = 0; i < count; i++) {
+            (*values)[i] = vals[order[i]];
+            (*weights)[i] = wts[order[i]];
+        }
+
+        delete[] order;
+        delete[] vals;
+        delete[] wts;
+        return count;
+    }
+
+    // Returns an estimate of the value at the given quantile, from 0 (the
+    // minimum) to 1 (the maximum). Returns 0 if the sketch is empty.
+    float quantile(double q) {
+        float* values;
+        size_t* weights;
+        size_t count = weighted_values_(&values, &weights);
+        if (count == 0) {
+            delete[] values;
+            delete[] weights;
+            return 0;
+        }
+
+        double target = q * n;
+        size_t seen = 0;
+        float result = values[count - 1];
+        for (size_t i = 0; i < count; i++) {
+            seen += weights[i];
+            if (seen > target) {
+                result = values[i];
+                break;
+            }
+        }
+
+        delete[] values;
+        delete[] weights;
+        return result;
+    }
+
+    // Returns the estimated fraction of values added that are <= val
+    double rank(float val) {
+        if (n == 0) {
+            return 0;
+        }
+
+        size_t below = 0;
+        for (size_t h = 0; h < num_levels; h++) {
+            for (size_t i = 0; i < sizes[h]; i++) {
+                if (levels[h][i] <= val) {
+                    below += (size_t)1 << h;
+                }
+            }
+        }
+        return (double)below / n;
+    }
+
+    bool merge(Sketch* other) {
+        KllSketch* o = dynamic_cast<KllSketch*>(other);
+        if (o == nullptr || o->k != k) {
+            return false;
+        }
+
+        for (size_t h = 0; h < o->num_levels; h++) {
+            for (size_t i = 0; i < o->sizes[h]; i++) {
+                push_(h, o->levels[h][i]);
+            }
+        }
+        n += o->n;
+        compact_();
+        return true;
+    }
+
+    KllSketch* clone_empty() { return new KllSketch(k); }
+};
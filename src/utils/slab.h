@@ -0,0 +1,176 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <new>
+
+#include "object.h"
+
+// Blocks up to this many bytes come in 16 byte steps
+#define SLAB_FINE_MAX (size_t)256
+#define SLAB_FINE_CLASSES (SLAB_FINE_MAX / 16)
+// Larger blocks come in powers of two up to this many bytes; bigger ones
+// go straight to the system allocator
+#define SLAB_MAX_BLOCK (size_t)8192
+#define SLAB_CLASSES (SLAB_FINE_CLASSES + 5)
+// Bytes taken from the system allocator at once and cut into blocks
+#define SLAB_BYTES ((size_t)64 << 10)
+// Room at the start of each slab for the link to the next one, which also
+// keeps every block 16 byte aligned
+#define SLAB_HEADER (size_t)16
+
+/*************************************************************************
+ * SlabBlock::
+ * A free block of a SlabClass, linked through its own first bytes.
+ */
+class SlabBlock {
+   public:
+    SlabBlock* next;
+};
+
+/*************************************************************************
+ * SlabClass::
+ * The blocks of one size: a list of freed blocks to hand out again, and
+ * the rest of the newest slab, not yet handed out at all.
+ */
+class SlabClass {
+   public:
+    std::mutex lock;
+    size_t block_size;
+    SlabBlock* free;  // Freed blocks
+    char* fresh;      // Next never used block of the newest slab
+    char* fresh_end;
+    char* slabs;      // owned; every slab taken, linked through their headers
+};
+
+/*************************************************************************
+ * SlabAllocator::
+ * Hands out small blocks of memory by size class, so the keys, values and
+ * chunk buffers a Store makes and frees by the million come from a few
+ * large slabs instead of one system allocation each. A freed block goes
+ * back on its class's free list and is handed out for the next block of
+ * that size, which keeps the heap from fragmenting under churn.
+ * Blocks are freed with the size they were asked for. Slabs are never
+ * given back until the allocator is deleted. Thread safe: each class has
+ * its own lock. global() is the one all Keys and Values share.
+ */
+class SlabAllocator : public Object {
+   public:
+    SlabClass classes[SLAB_CLASSES];
+    std::atomic<size_t> reserved;  // Bytes of slabs taken from the system
+    std::atomic<size_t> in_use;    // Bytes of blocks handed out and not freed
+
+    SlabAllocator() : reserved(0), in_use(0) {
+        for (size_t c = 0; c < SLAB_CLASSES; c++) {
+            classes[c].block_size = class_size(c);
+            classes[c].free = nullptr;
+            classes[c].fresh = nullptr;
+            classes[c].fresh_end = nullptr;
+            classes[c].slabs = nullptr;
+        }
+    }
+
+    ~SlabAllocator() {
+        for (size_t c = 0; c < SLAB_CLASSES; c++) {
+            char* slab = classes[c].slabs;
+            while (slab != nullptr) {
+                char* next = *(char**)slab;
+                ::free(slab);
+                slab = next;
+            }
+        }
+    }
+
+    // The allocator Keys and Values come from. Never deleted, so blocks
+    // may be freed while static objects are torn down at exit.
+    static SlabAllocator* global() {
+        static SlabAllocator* slab = new SlabAllocator();
+        return slab;
+    }
+
+    // The class of blocks holding size bytes; size is at most SLAB_MAX_BLOCK
+    static size_t class_of(size_t size) {
+        if (size <= SLAB_FINE_MAX) {
+            return size == 0 ? 0 : (size - 1) / 16;
+        }
+        size_t c = SLAB_FINE_CLASSES;
+        for (size_t block = 2 * SLAB_FINE_MAX; block < size; block *= 2) {
+            c++;
+        }
+        return c;
+    }
+
+    // Bytes in each block of the given class
+    static size_t class_size(size_t c) {
+        if (c < SLAB_FINE_CLASSES) {
+            return (c + 1) * 16;
+        }
+        return (2 * SLAB_FINE_MAX) << (c - SLAB_FINE_CLASSES);
+    }
+
+    // Returns a 16 byte aligned block of at least size bytes
+    void* alloc(size_t size) {
+        if (size > SLAB_MAX_BLOCK) {
+            return ::operator new(size);
+        }
+
+        SlabClass& cls = classes[class_of(size)];
+        in_use.fetch_add(cls.block_size, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lck(cls.lock);
+        if (cls.free != nullptr) {
+            SlabBlock* block = cls.free;
+            cls.free = block->next;
+            return block;
+        }
+        if (cls.fresh == cls.fresh_end) {
+            new_slab_(cls);
+        }
+        void* block = cls.fresh;
+        cls.fresh += cls.block_size;
+        return block;
+    }
+
+    // Takes back a block from alloc() of the same size
+    void free(void* ptr, size_t size) {
+        if (ptr == nullptr) {
+            return;
+        }
+        if (size > SLAB_MAX_BLOCK) {
+            ::operator delete(ptr);
+            return;
+        }
+
+        SlabClass& cls = classes[class_of(size)];
+        in_use.fetch_sub(cls.block_size, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lck(cls.lock);
+        SlabBlock* block = (SlabBlock*)ptr;
+        block->next = cls.free;
+        cls.free = block;
+    }
+
+    // Returns a copy of the first len bytes of s followed by a NUL, to be
+    // freed with free(copy, len + 1)
+    char* duplicate(const char* s, size_t len) {
+        char* copy = (char*)alloc(len + 1);
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+        return copy;
+    }
+
+    // Takes a new slab for cls. Called with its lock held.
+    void new_slab_(SlabClass& cls) {
+        char* slab = (char*)malloc(SLAB_BYTES);
+        if (slab == nullptr) {
+            throw std::bad_alloc();
+        }
+        *(char**)slab = cls.slabs;
+        cls.slabs = slab;
+        cls.fresh = slab + SLAB_HEADER;
+        cls.fresh_end = cls.fresh + (SLAB_BYTES - SLAB_HEADER) / cls.block_size * cls.block_size;
+        reserved.fetch_add(SLAB_BYTES, std::memory_order_relaxed);
+    }
+};
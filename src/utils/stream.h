@@ -0,0 +1,266 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#pragma once
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "object.h"
+
+// Default bytes a Sink or Source holds at once
+#define STREAM_PIECE_SIZE (size_t)65536
+
+/*************************************************************************
+ * Sink::
+ * Somewhere serialized bytes are written a piece at a time. Appends are
+ * gathered into a piece of fixed size, which is drained when it fills,
+ * so whatever is written, a sink never holds more than one piece. A write
+ * bigger than a piece is drained straight from the caller's bytes. The
+ * appends match Buffer's, so the same code can write to either. Callers
+ * must flush() once done. Subclasses say where pieces go with drain_().
+ */
+class Sink : public Object {
+   public:
+    char* piece;  // owned
+    size_t capacity;
+    size_t len;      // Bytes in piece, not yet drained
+    size_t written;  // Bytes appended in all
+
+    Sink(size_t capacity = STREAM_PIECE_SIZE) {
+        this->capacity = capacity;
+        piece = new char[capacity];
+        len = 0;
+        written = 0;
+    }
+
+    virtual ~Sink() {
+        delete[] piece;
+    }
+
+    // Appends the first n bytes of s
+    void append(const char* s, size_t n) {
+        written += n;
+        if (n > capacity - len) {
+            flush();
+            if (n >= capacity) {
+                drain_(s, n);
+                return;
+            }
+        }
+        memcpy(piece + len, s, n);
+        len += n;
+    }
+
+    void append(const char* s) {
+        append(s, strlen(s));
+    }
+
+    void append(char c) {
+        if (len == capacity) {
+            flush();
+        }
+        piece[len++] = c;
+        written++;
+    }
+
+    // Appends v in decimal
+    void append_size_t(size_t v) {
+        char digits[20];
+        size_t start = sizeof(digits);
+        do {
+            digits[--start] = (char)('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+        append(digits + start, sizeof(digits) - start);
+    }
+
+    // Drains the bytes appended so far
+    void flush() {
+        if (len > 0) {
+            drain_(piece, len);
+            len = 0;
+        }
+    }
+
+    // Sends the n bytes at bytes on to wherever this sink writes
+    virtual void drain_(const char* bytes, size_t n) = 0;
+};
+
+/*************************************************************************
+ * FdSink::
+ * A Sink writing to a file descriptor, such as a socket. A write the
+ * kernel only takes part of is carried on until every byte is written.
+ */
+class FdSink : public Sink {
+   public:
+    int fd;
+
+    FdSink(int fd, size_t capacity = STREAM_PIECE_SIZE) : Sink(capacity) {
+        this->fd = fd;
+    }
+
+    void drain_(const char* bytes, size_t n) {
+        while (n > 0) {
+            ssize_t sent = write(fd, bytes, n);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                printf("ERROR writing to fd %d with %zu bytes left to write\n", fd, n);
+                exit(1);
+            }
+            bytes += sent;
+            n -= sent;
+        }
+    }
+};
+
+/*************************************************************************
+ * Source::
+ * Somewhere serialized bytes are read from a piece at a time. Bytes are
+ * read from the current piece until it runs out, and then the next is
+ * filled, so a source never holds more than one piece. A read bigger than
+ * a piece is filled straight into the caller's bytes. Subclasses say where
+ * bytes come from with fill_().
+ */
+class Source : public Object {
+   public:
+    char* piece;      // owned, or nullptr if bytes are read in place
+    size_t capacity;
+    const char* pos;  // Next byte to read
+    const char* end;  // End of the bytes read into piece
+
+    Source(size_t capacity = STREAM_PIECE_SIZE) {
+        this->capacity = capacity;
+        piece = capacity == 0 ? nullptr : new char[capacity];
+        pos = piece;
+        end = piece;
+    }
+
+    virtual ~Source() {
+        delete[] piece;
+    }
+
+    // Returns the next byte, or -1 if there are no more
+    int get() {
+        if (pos == end && !refill_()) {
+            return -1;
+        }
+        return (unsigned char)*pos++;
+    }
+
+    // Reads up to n bytes into dst, and returns how many there were
+    size_t read(void* dst, size_t n) {
+        char* out = (char*)dst;
+        size_t total = 0;
+        while (total < n) {
+            if (pos == end) {
+                if (n - total >= capacity) {
+                    size_t got = fill_(out + total, n - total);
+                    if (got == 0) {
+                        break;
+                    }
+                    total += got;
+                    continue;
+                }
+                if (!refill_()) {
+                    break;
+                }
+            }
+            size_t take = (size_t)(end - pos) < n - total ? (size_t)(end - pos) : n - total;
+            memcpy(out + total, pos, take);
+            pos += take;
+            total += take;
+        }
+        return total;
+    }
+
+    // Reads the bytes up to the next of the given delimiters into token,
+    // replacing what it held, and skips the delimiter. Returns the
+    // delimiter, or -1 if the bytes ran out first.
+    int read_token(Buffer& token, const char* delims) {
+        token.clear();
+        while (pos != end || refill_()) {
+            const char* start = pos;
+            while (pos != end && strchr(delims, *pos) == nullptr) {
+                pos++;
+            }
+            token.append(start, pos - start);
+            if (pos != end) {
+                return (unsigned char)*pos++;
+            }
+        }
+        return -1;
+    }
+
+    // Reads the next piece into piece. Returns false if there are no more.
+    bool refill_() {
+        if (piece == nullptr) {
+            return false;
+        }
+        pos = piece;
+        end = piece + fill_(piece, capacity);
+        return end != pos;
+    }
+
+    // Reads up to max bytes into dst, and returns how many there were, or
+    // 0 if there are no more
+    virtual size_t fill_(char* dst, size_t max) = 0;
+};
+
+/*************************************************************************
+ * ArraySource::
+ * A Source reading bytes already in memory, in place, without copying
+ * them. The bytes must outlive the source.
+ */
+class ArraySource : public Source {
+   public:
+    ArraySource(const char* bytes, size_t len) : Source(0) {
+        pos = bytes;
+        end = bytes + len;
+    }
+
+    size_t fill_(char* dst, size_t max) {
+        return 0;
+    }
+};
+
+/*************************************************************************
+ * FdSource::
+ * A Source reading from a file descriptor, such as a socket. Reads no
+ * more than remaining bytes from it, so it never takes the bytes of what
+ * follows; callers that learn how much more to read add to remaining.
+ * Reaching the end of the descriptor first is an error.
+ */
+class FdSource : public Source {
+   public:
+    int fd;
+    size_t remaining;  // Bytes yet to be read from fd
+
+    FdSource(int fd, size_t remaining, size_t capacity = STREAM_PIECE_SIZE) : Source(capacity) {
+        this->fd = fd;
+        this->remaining = remaining;
+    }
+
+    size_t fill_(char* dst, size_t max) {
+        if (max > remaining) {
+            max = remaining;
+        }
+        if (max == 0) {
+            return 0;
+        }
+        ssize_t got = ::read(fd, dst, max);
+        while (got < 0 && errno == EINTR) {
+            got = ::read(fd, dst, max);
+        }
+        if (got <= 0) {
+            printf("ERROR: fd %d ended with %zu bytes still expected\n", fd, remaining);
+            exit(1);
+        }
+        remaining -= got;
+        return got;
+    }
+};
@@ -80,6 +80,14 @@ class Set {
         }
     }
 
+    /** Performs set union in place with the values of a bitmap. */
+    void union_(Bitmap& from) {
+        BitmapIterator it(&from);
+        while (it.has_next()) {
+            set(it.next());
+        }
+    }
+
     void print() {
         printf("Set contains: ");
         for (size_t i=0; i<size_; i++) {
@@ -90,113 +98,52 @@ class Set {
 };
 
 
-/*******************************************************************************
- * A SetUpdater is a rower that gets the first column of the data frame and
- * sets the corresponding value in the given set.
- ******************************************************************************/
-class SetUpdater : public Rower {
-   public:
-    Set& set_; // set to update
-
-    SetUpdater(Set& set): set_(set) {}
-
-    /** Assume a row with at least one column of type I. Assumes that there
-     * are no missing. Reads the value and sets the corresponding position.
-     * The return value is irrelevant here. */
-    bool accept(Row & row) { 
-        set_.set(row.get_int(0));  
-        return false; 
-    }
-};
-
-/*****************************************************************************
- * A SetWriter copies all the values present in the set into a one-column
- * dataframe. The data contains all the values in the set. The dataframe has
- * at least one integer column.
- ****************************************************************************/
-class SetWriter: public Writer {
-   public:
-    Set& set_; // set to read from
-    size_t i_ = 0;  // position in set
-
-    SetWriter(Set& set): set_(set) { }
-
-    /** Skip over false values and stop when the entire set has been seen */
-    bool done() {
-        while (i_ < set_.size_ && set_.test(i_) == false) ++i_;
-        return i_ == set_.size_;
-    }
-
-    bool accept(Row & row) { 
-        // printf("SetWriter putting value %zu into accepted row\n", i_);
-        row.set(0, (int)i_++);
-        return true;
-    }
-};
-
 /***************************************************************************
- * The ProjectTagger is a reader that is mapped over commits, and marks all
- * of the projects to which a collaborator of Linus committed as an author.
- * The commit dataframe has the form:
+ * The ProjectTagger is a rower that is mapped over the commits authored by
+ * the users tagged in the previous round, and marks the projects of those
+ * commits. The commit dataframe has the form:
  *    pid x uid x uid
  * where the pid is the identifier of a project and the uids are the
- * identifiers of the author and committer. If the author is a collaborator
- * of Linus, then the project is added to the set. If the project was
- * already tagged then it is not added to the set of newProjects.
+ * identifiers of the author and committer. If the project was already
+ * tagged then it is not added to the set of newProjects.
  *************************************************************************/
 class ProjectsTagger : public Rower {
    public:
-    Set& uSet; // set of collaborator 
     Set& pSet; // set of projects of collaborators
-    Set newProjects;  // newly tagged collaborator projects
+    Bitmap newProjects;  // newly tagged collaborator projects
 
-    ProjectsTagger(Set& uSet, Set& pSet, DataFrame* proj):
-        uSet(uSet), pSet(pSet), newProjects(proj) {}
+    ProjectsTagger(Set& pSet): pSet(pSet) {}
 
     /** The data frame must have at least two integer columns. The newProject
      * set keeps track of projects that were newly tagged (they will have to
      * be communicated to other nodes). */
     bool accept(Row & row) override {
         int pid = row.get_int(0);
-        int uid = row.get_int(1);
-        // printf("Projects tagger processing commit for project %d from user %d\n", pid, uid);
-        if (uSet.test(uid)) {
-            // printf("... author is a collaborator\n");
-            if (!pSet.test(pid)) {
-                // printf("... marking %d as new project\n", pid);
-                pSet.set(pid);
-                newProjects.set(pid);
-            }
+        if (!pSet.test(pid)) {
+            pSet.set(pid);
+            newProjects.add(pid);
         }
         return false;
     }
 };
 
 /***************************************************************************
- * The UserTagger is a rower that is mapped over commits, and marks all of
- * the users which commmitted to a project to which a collaborator of Linus
- * also committed as an author. The commit dataframe has the form:
- *    pid x uid x uid
- * where the pid is the idefntifier of a project and the uids are the
- * identifiers of the author and committer. 
+ * The UserTagger is a rower that is mapped over the commits to newly tagged
+ * projects, and marks the authors of those commits. Users that are already
+ * tagged are dropped by the iteration driver, so only uids that do not
+ * appear in users are filtered here.
  *************************************************************************/
 class UsersTagger : public Rower {
    public:
-    Set& pSet;
-    Set& uSet;
-    Set newUsers;
+    size_t num_users;
+    Bitmap* newUsers;  // external; returned to the iteration driver
 
-    UsersTagger(Set& pSet,Set& uSet, DataFrame* users):
-        pSet(pSet), uSet(uSet), newUsers(users->nrows()) { }
+    UsersTagger(size_t num_users): num_users(num_users), newUsers(new Bitmap()) {}
 
     bool accept(Row & row) override {
-        int pid = row.get_int(0);
         int uid = row.get_int(1);
-        if (pSet.test(pid)) {
-            if(!uSet.test(uid)) {
-                uSet.set(uid);
-                newUsers.set(uid);
-            }
+        if (uid >= 0 && (size_t) uid < num_users) {
+            newUsers->add(uid);
         }
         return false;
     }
@@ -206,8 +153,10 @@ class UsersTagger : public Rower {
  * This computes the collaborators of Linus Torvalds.
  * is the linus example using the adapter.  And slightly revised
  *   algorithm that only ever trades the deltas.
+ * Runs as a delta iteration: each round only visits the commits authored
+ * by users tagged in the previous round, found through a local index.
  **************************************************************************/
-class Linus : public Application {
+class Linus : public Application, public DeltaIteration {
    public:
     size_t DEGREES = 3;  // How many degrees of separation from linus?
     int LINUS = 0; //4967;   // The OFFSET of the uid of Linus in the DF
@@ -217,8 +166,11 @@ class Linus : public Application {
     DataFrame* projects; //  pid x project name
     DataFrame* users;  // uid x user name
     DataFrame* commits;  // pid x uid x uid 
-    Set* uSet; // Linus' collaborators
     Set* pSet; // projects of collaborators
+    LocalIndex* commitsByAuthor; // local commit rows by uid
+    LocalIndex* commitsByProject; // local commit rows by pid
+    const char* SNAPSHOT = nullptr; // This node's snapshot file, or nullptr
+    size_t REPLICAS = 1; // Copies of each input dataframe's chunks
 
     Linus(Store* store): Application(store) {}
 
@@ -234,37 +186,54 @@ class Linus : public Application {
         delete projects;
         delete users;
         delete commits;
-        delete uSet;
         delete pSet;
+        delete commitsByAuthor;
+        delete commitsByProject;
     }
 
     /** Compute DEGREES of Linus.  */
     void run_() override {
         readInput();
-        for (size_t i = 0; i < DEGREES; i++) step(i);
-        store->is_done();
-    }
 
-    // Return a key for storing a node's partial results
-    Key* mk_key(char* str, size_t stage, size_t node_id) {
-        size_t needed_buf_size = snprintf(nullptr, 0, "%s-%zu-%zu", str, stage, node_id) + 1;
-        char key_name[needed_buf_size];
-        snprintf(key_name, needed_buf_size, "%s-%zu-%zu", str, stage, node_id);
+        // Initial collaborators are just Linus
+        Bitmap linus;
+        linus.add(LINUS);
+        Bitmap* collaborators = iterate(*this, &linus, DEGREES);
+        delete collaborators;
 
-        return new Key(key_name, node_id);
+        store->is_done();
     }
 
     /** Node 0 reads three files, cointainng projects, users and commits, and
      *  creates thre dataframes. All other nodes wait and load the three
-     *  dataframes. Once we know the size of users and projects, we create
-     *  sets of each (uSet and pSet). We also output a data frame with a the
-     *  'tagged' users. At this point the dataframe consists of only
-     *  Linus. **/
+     *  dataframes. Once we know the size of projects, we create a set of
+     *  them (pSet), and every node indexes the commits it stores.
+     *  With a SNAPSHOT, every node first restores its store from it, so
+     *  node 0 can fetch the dataframes instead of reading the files; if
+     *  there is none yet, every node saves one once it has its data. Every
+     *  node must have a snapshot from the same run, or none. **/
     void readInput() {
         Key* pK = new Key((char*) "projs", 0);
         Key* uK = new Key((char*) "usrs", 0);
         Key* cK = new Key((char*) "comts", 0);
-        if (this_node() == 0) {
+        pK->set_replicas(REPLICAS);
+        uK->set_replicas(REPLICAS);
+        cK->set_replicas(REPLICAS);
+        bool restored = false;
+        if (SNAPSHOT != nullptr) {
+            restored = store->load_snapshot(SNAPSHOT);
+            // Nobody reads another node's chunks before it has restored them
+            barrier();
+        }
+        if (this_node() == 0 && restored) {
+            printf("Restored input from snapshot %s\n", SNAPSHOT);
+            projects = store->get(pK);
+            printf("%zu projects\n", projects->nrows());
+            users = store->get(uK);
+            printf("%zu users\n", users->nrows());
+            commits = store->get(cK);
+            printf("%zu commits\n", commits->nrows());
+        } else if (this_node() == 0) {
             printf("Reading...\n");
 
             projects = DataFrame::fromSorFile(pK, store, (char*) PROJ);
@@ -278,11 +247,6 @@ class Linus : public Application {
             commits = DataFrame::fromSorFile(cK, store, (char*) COMM);
             printf("%zu commits\n", commits->nrows());
             // commits->print();
-
-            // Make initial collaboraters DF with just Linus.
-            Key* initial_collabs_key = mk_key((char*) "users", 0, 0);
-            delete DataFrame::fromScalar(initial_collabs_key, store, LINUS);
-            delete initial_collabs_key;
         } else {
             printf("Node %zu waiting for initial data from master node\n", store->this_node());
             projects = dynamic_cast<DataFrame*>(store->waitAndGet(pK));
@@ -293,13 +257,20 @@ class Linus : public Application {
             printf("%zu commits\n", commits->nrows());
             printf("Node %zu finished reading input from master node\n", store->this_node());
         }
-        // All users and all projects set to false initially
-        uSet = new Set(users);
+        // The frames never change from here on, so every node may cache
+        // the chunks it reads from other nodes
+        store->seal_frame(dynamic_cast<DistributedDataFrame*>(projects));
+        store->seal_frame(dynamic_cast<DistributedDataFrame*>(users));
+        store->seal_frame(dynamic_cast<DistributedDataFrame*>(commits));
+        if (SNAPSHOT != nullptr && !restored) {
+            size_t saved = store->save_snapshot(SNAPSHOT);
+            printf("Node %zu saved %zu values to snapshot %s\n", store->this_node(), saved, SNAPSHOT);
+        }
+        // All projects set to false initially
         pSet = new Set(projects);
-        // printf("user set: \n");
-        // uSet->print();
-        // printf("project set: \n");
-        // pSet->print();
+        // IMPORTANT: Will only index commits on this node
+        commitsByAuthor = new LocalIndex(commits, 1);
+        commitsByProject = new LocalIndex(commits, 0);
 
         delete pK;
         delete uK;
@@ -307,116 +278,51 @@ class Linus : public Application {
     }
 
 
-    /** Performs a step of the linus calculation. It operates over the three
-     *  datafrrames (projects, users, commits), the sets of tagged users and
-     *  projects, and the users added in the previous round. */
-    void step(size_t stage) {
-        printf("Node %zu starting step at stage %zu\n", store->this_node(), stage);
-        // Key of the shape: users-stage-0
-        Key* uK = mk_key((char*) "users", stage, 0);
-
-        // A df with all the users added on the previous round
-        DataFrame* newUsers = dynamic_cast<DataFrame*>(store->waitAndGet(uK));
-        // printf("Starting with %zu new users\n", newUsers->nrows());
-        // Create set with length = all users    
-        Set delta(users);
-    
-        // For all users in newUsers, set that user bit to True in delta 
-        SetUpdater upd(delta); 
-        newUsers->map(upd);
-
-        delete uK;
-        delete newUsers;
-
-        // printf("Delta from new users ");
-        // delta.print();
-
-        // At this point delta has bool flags set to true for the newUsers
+    /** Performs a step of the linus calculation. Tags the projects authored
+     *  by the users added in the previous round, then returns the authors
+     *  of those projects, which the iteration driver merges across nodes. */
+    Bitmap* step(Bitmap* delta, Bitmap* working) override {
+        printf("Node %zu starting step\n", store->this_node());
 
         // Mark all projects touched by the users in delta as projects related to linus
-        ProjectsTagger ptagger(delta, *pSet, projects);
-        // IMPORTANT: Will only update with projects on this node
-        commits->local_map(ptagger);
+        ProjectsTagger ptagger(*pSet);
+        Bitmap* rows = commitsByAuthor->rows_for(delta);
+        commits->map_rows(rows, ptagger);
+        delete rows;
 
         // Merge results from other nodes
-        merge(ptagger.newProjects, "projects", stage);
+        Bitmap* newProjects = merge(ptagger.newProjects, "projects");
         // Add new projects to set of projects related to linus
-        pSet->union_(ptagger.newProjects); 
-
-        // printf("Pset with projects of all new users marked: ");
-        // pSet->print();
+        pSet->union_(*newProjects);
 
         // Now mark all users who contributed to any of the new projects
-        UsersTagger utagger(*pSet, *uSet, users);
-        // IMPORTANT: Will only update with users on this node
-        commits->local_map(utagger);
-
-        // Merge results from other nodes
-        merge(utagger.newUsers, "users", stage + 1);
-        // Add new users to set of users related to linus
-        uSet->union_(utagger.newUsers); 
-   
-        // printf("Uset with all new marked users marked: ");
-        // uSet->print();
+        UsersTagger utagger(users->nrows());
+        rows = commitsByProject->rows_for(newProjects);
+        commits->map_rows(rows, utagger);
+        delete rows;
+        delete newProjects;
+
+        printf("   sending %zu new users elements to be merged\n", utagger.newUsers->cardinality());
+        return utagger.newUsers;
+    }
 
+    void iteration_done(size_t stage, Bitmap* delta, Bitmap* working) override {
+        printf("   merge gave me %zu new users elements \n", delta->cardinality());
         printf("After stage %zu : \n", stage);
         printf("   tagged projects: %zu\n", pSet->num_true());
-        printf("   tagged users: %zu\n", uSet->num_true());
+        printf("   tagged users: %zu\n", working->cardinality());
     }
 
-    /** Gather updates to the given set from all the nodes in the systems.
-     * The union of those updates is then published as dataframe.  The key
-     * used for the otuput is of the form "name-stage-0" where name is either
-     * 'users' or 'projects', stage is the degree of separation being
-     * computed.
+    /** Gather updates to the given bitmap from all the nodes in the systems.
+     * Returns the union of those updates, which every node receives. Name
+     * is either 'users' or 'projects', used for logging.
      */ 
-    void merge(Set& set, char const* name, int stage) {
-        if (this_node() == 0) {
-            for (size_t i = 1; i < num_nodes(); ++i) {
-                // STEP (2)
-                Key* nK = mk_key((char*) name, stage, i);
-                // New elements
-                printf("   waiting for node %zu to give me data under key %s\n", i, nK->get_name());
-                DataFrame* delta = dynamic_cast<DataFrame*>(store->waitAndGet(nK));
-                printf("   received %zu new %s elements from node %zu\n", delta->nrows(), name, i);
-
-                // Update the given set with new elements
-                SetUpdater upd(set);
-                delta->map(upd);
-
-                delete nK;
-                delete delta;
-            }
-            // STEP (3)
-            // printf("    After merge, master has %zu (true) %s elements \n", set.num_true(), name);
-            // Create a new DF from the updated set 
-            SetWriter writer(set);
-            Key* k = mk_key((char*) name, stage, 0);
-            // printf("Writing set using fromWriter: ");
-            // set.print();
-            delete DataFrame::fromWriter(k, store, (char*) "I", writer);
-            delete k;
-        } else {
-            // STEP (1) 
-            printf("   sending %zu new %s elements to master node \n", set.num_true(), name);
-            // Put a DF in KVS with updated elements (for master node to process)
-            SetWriter writer(set);
-            Key* k = mk_key((char*) name, stage, this_node());
-            // printf("   ...under key %s\n", k->get_name());
-            delete DataFrame::fromWriter(k, store, (char*) "I", writer);
-            delete k;
-
-            // STEP (4)
-            // Get the merged result from master node
-            Key* mK = mk_key((char*) name, stage, 0);
-            DataFrame* merged = dynamic_cast<DataFrame*>(store->waitAndGet(mK));
-            printf("   master gave me %zu new %s elements \n", merged->nrows(), name);
-
-            SetUpdater upd(set);
-            merged->map(upd);
-            delete merged;
-            delete mK;
-        }
+    Bitmap* merge(Bitmap& delta, char const* name) {
+        printf("   sending %zu new %s elements to be merged\n", delta.cardinality(), name);
+        Bitmap* merged = store->merge_bitmap(&delta);
+        printf("   merge gave me %zu new %s elements \n", merged->cardinality(), name);
+
+        return merged;
     }
 }; // Linus
 
@@ -439,6 +345,18 @@ int main(int argc, char** argv) {
     int node_port = args.node_port;
 
     Store store(node_id, node_ip, node_port, master_ip, master_port);
+    if (args.memory_budget_mb > 0) {
+        store.set_memory_budget(args.memory_budget_mb << 20, args.spill_dir);
+    }
+    store.set_cache_capacity(args.cache_mb << 20);
+    store.serializer->text_chunks = args.text_chunks;
+    store.serializer->plain_chunks = args.plain_chunks;
+    store.serializer->verify_chunks = args.verify_chunks;
+    if (args.stats_dir != nullptr) {
+        char stats_path[512];
+        snprintf(stats_path, sizeof(stats_path), "%s/linus-node%d-stats.json", args.stats_dir, node_id);
+        store.set_stats_path(stats_path);
+    }
 
     int degrees = args.degrees;
     char* proj_file = args.proj_file;
@@ -450,8 +368,18 @@ int main(int argc, char** argv) {
     }
 
     Linus linus(&store, degrees, proj_file, users_file, commits_file);
+    char snapshot[512];
+    if (args.snapshot_dir != nullptr) {
+        snprintf(snapshot, sizeof(snapshot), "%s/linus-node%d.snap", args.snapshot_dir, node_id);
+        linus.SNAPSHOT = snapshot;
+    }
+    linus.REPLICAS = args.replicas;
     linus.run();
 
+    char* stats = store.memory_stats();
+    printf("Node %zu memory: %s\n", store.this_node(), stats);
+    delete[] stats;
+
     if (start_server) {
         s->shutdown();
         delete s;
@@ -136,7 +136,9 @@ class WordCount : public Application {
     /** Compute word counts on the local node and build a data frame. */
     void local_count() {
  	    printf("Node %zu is waitAndGetting the main DF\n", this_node());
-	    DistributedDataFrame* words = store->waitAndGet(data_key);
+	    // Frees this node's copy of the data once counted
+	    ScopedFrame scope(store, store->waitAndGet(data_key));
+	    DistributedDataFrame* words = scope.df;
 
 	    printf("Node %zu found main DF to have %zu rows and %zu columns\n", this_node(), words->nrows(), words->ncols());
 
@@ -171,7 +173,6 @@ class WordCount : public Application {
         store->put(partial_results_key, &partial_results);
 
         delete partial_results_key;
-        delete words;
     }
 
     // Merge the results of Wordcounter from all other nodes onto this node
@@ -183,7 +184,9 @@ class WordCount : public Application {
         for (size_t node_idx = 0; node_idx < num_nodes(); ++node_idx) {
             Key* partial_results_key = mk_key(node_idx);
 
-            DistributedDataFrame* partial_results = store->waitAndGet(partial_results_key);
+            // Drops both the copy and the node's results once merged
+            ScopedFrame scope(store, store->waitAndGet(partial_results_key), partial_results_key);
+            DistributedDataFrame* partial_results = scope.df;
 
 	        //printf("%zu got %zu partial results from node %zu\n", this_node(), partial_results->nrows(), node_idx);
 
@@ -191,7 +194,6 @@ class WordCount : public Application {
 	
 	        //printf("Node %zu merged results from node %zu of total %zu\n", this_node(), node_idx, num_nodes());
 
-            delete partial_results;
             delete partial_results_key;
         }
 
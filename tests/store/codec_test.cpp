@@ -0,0 +1,161 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../src/store/codec.h"
+
+// Confirm ints round trip through both int encodings, including the
+// extremes, and that sorted or small-range ints shrink several-fold
+bool test_int_codecs() {
+    int sorted[1000], small[1000], wild[1000];
+    srand(7);
+    for (int i = 0; i < 1000; i++) {
+        sorted[i] = 5000000 + 3 * i;
+        small[i] = rand() % 12;
+        wild[i] = i % 2 == 0 ? INT_MIN + i : INT_MAX - rand();
+    }
+    int* cases[3] = {sorted, small, wild};
+    int decoded[1000];
+    char buf[8000];
+
+    for (size_t c = 0; c < 3; c++) {
+        size_t delta_len = ChunkCodec::delta_varint_len(cases[c], 1000);
+        assert(ChunkCodec::write_delta_varint(buf, cases[c], 1000) == delta_len);
+        assert(ChunkCodec::read_delta_varint(decoded, 1000, buf, delta_len));
+        assert(memcmp(decoded, cases[c], sizeof(decoded)) == 0);
+        assert(!ChunkCodec::read_delta_varint(decoded, 1000, buf, delta_len - 1));
+
+        int32_t least;
+        size_t width;
+        size_t packed_len = ChunkCodec::bitpack_len(cases[c], 1000, &least, &width);
+        assert(ChunkCodec::write_bitpack(buf, cases[c], 1000, least, width) == packed_len);
+        assert(ChunkCodec::read_bitpack(decoded, 1000, buf, packed_len));
+        assert(memcmp(decoded, cases[c], sizeof(decoded)) == 0);
+        assert(!ChunkCodec::read_bitpack(decoded, 1000, buf, packed_len - 1));
+    }
+
+    assert(ChunkCodec::delta_varint_len(sorted, 1000) < 4 * 1000 / 3);
+    int32_t least;
+    size_t width;
+    assert(ChunkCodec::bitpack_len(small, 1000, &least, &width) == 5 + 500);
+    assert(least == 0 && width == 4);
+    assert(ChunkCodec::bitpack_len(wild, 1000, &least, &width) > 4 * 1000);
+    assert(width == 32);
+
+    // Every value the same packs into no bits at all
+    int same[3] = {-9, -9, -9};
+    assert(ChunkCodec::bitpack_len(same, 3, &least, &width) == 5);
+    ChunkCodec::write_bitpack(buf, same, 3, least, width);
+    assert(ChunkCodec::read_bitpack(decoded, 3, buf, 5));
+    assert(decoded[0] == -9 && decoded[2] == -9);
+
+    return true;
+}
+
+// Confirm bools round trip through both bool encodings, and that long runs
+// such as a chunk with nothing missing take a couple of bytes
+bool test_bool_codecs() {
+    bool none[100], runs[100], mixed[100];
+    for (size_t i = 0; i < 100; i++) {
+        none[i] = false;
+        runs[i] = i >= 40 && i < 45;
+        mixed[i] = i % 3 == 0;
+    }
+    bool* cases[3] = {none, runs, mixed};
+    bool decoded[100];
+    char buf[200];
+
+    for (size_t c = 0; c < 3; c++) {
+        size_t rle_len = ChunkCodec::rle_len(cases[c], 100);
+        assert(ChunkCodec::write_rle(buf, cases[c], 100) == rle_len);
+        assert(ChunkCodec::read_rle(decoded, 100, buf, rle_len));
+        assert(memcmp(decoded, cases[c], sizeof(decoded)) == 0);
+        assert(!ChunkCodec::read_rle(decoded, 100, buf, rle_len - 1));
+
+        assert(ChunkCodec::write_bits(buf, cases[c], 100) == 13);
+        assert(ChunkCodec::read_bits(decoded, 100, buf, 13));
+        assert(memcmp(decoded, cases[c], sizeof(decoded)) == 0);
+    }
+    assert(ChunkCodec::rle_len(none, 100) == 2);
+    assert(ChunkCodec::rle_len(runs, 100) == 4);
+
+    return true;
+}
+
+// Confirm floats round trip bit for bit through XOR, and that repeated and
+// slowly changing values take fewer bytes than plain
+bool test_float_codec() {
+    float floats[200];
+    for (size_t i = 0; i < 200; i++) {
+        floats[i] = i < 100 ? 5.5f : 1.0f + (i / 10) * 0.25f;
+    }
+    floats[7] = -0.0f;
+    floats[8] = 1e-40f;  // subnormal
+    float decoded[200];
+    char buf[1000];
+
+    size_t xor_len = ChunkCodec::xor_len(floats, 200);
+    assert(ChunkCodec::write_xor(buf, floats, 200) == xor_len);
+    assert(ChunkCodec::read_xor(decoded, 200, buf, xor_len));
+    assert(memcmp(decoded, floats, sizeof(decoded)) == 0);
+    assert(!ChunkCodec::read_xor(decoded, 200, buf, xor_len - 1));
+    assert(xor_len < 4 * 200 / 2);
+
+    return true;
+}
+
+// Confirm bytes round trip through LZ, shrink when repetitive, and that
+// corrupt streams are caught rather than read past
+bool test_lz_codec() {
+    char text[5000];
+    size_t n = 0;
+    for (size_t i = 0; n + 20 < sizeof(text); i++) {
+        n += snprintf(text + n, sizeof(text) - n, "user-%zu%c", i % 37, '\0');
+    }
+    char* compressed = new char[ChunkCodec::lz_bound(sizeof(text))];
+    char decoded[5000];
+
+    size_t compressed_len = ChunkCodec::lz_compress(compressed, text, n);
+    assert(compressed_len < n / 4);
+    assert(ChunkCodec::lz_decompress(decoded, n, compressed, compressed_len));
+    assert(memcmp(decoded, text, n) == 0);
+    assert(!ChunkCodec::lz_decompress(decoded, n, compressed, compressed_len / 2));
+    assert(!ChunkCodec::lz_decompress(decoded, n - 1, compressed, compressed_len));
+
+    // Random bytes, long literal runs and tiny inputs stay within the bound
+    srand(11);
+    for (size_t i = 0; i < sizeof(text); i++) {
+        text[i] = (char)rand();
+    }
+    size_t sizes[5] = {0, 3, 15, 300, sizeof(text)};
+    for (size_t s = 0; s < 5; s++) {
+        compressed_len = ChunkCodec::lz_compress(compressed, text, sizes[s]);
+        assert(compressed_len <= ChunkCodec::lz_bound(sizes[s]));
+        assert(ChunkCodec::lz_decompress(decoded, sizes[s], compressed, compressed_len));
+        assert(memcmp(decoded, text, sizes[s]) == 0);
+    }
+
+    // A long run of one byte is a repeat that overlaps what it copies
+    memset(text, 'z', 1000);
+    compressed_len = ChunkCodec::lz_compress(compressed, text, 1000);
+    assert(compressed_len < 20);
+    assert(ChunkCodec::lz_decompress(decoded, 1000, compressed, compressed_len));
+    assert(memcmp(decoded, text, 1000) == 0);
+
+    delete[] compressed;
+    return true;
+}
+
+int main() {
+    assert(test_int_codecs());
+    printf("========== test_int_codecs PASSED =============\n");
+    assert(test_bool_codecs());
+    printf("========== test_bool_codecs PASSED =============\n");
+    assert(test_float_codec());
+    printf("========== test_float_codec PASSED =============\n");
+    assert(test_lz_codec());
+    printf("========== test_lz_codec PASSED =============\n");
+}
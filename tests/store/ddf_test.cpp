@@ -1,4 +1,5 @@
 #include <assert.h>
+#include "../../src/client/iteration.h"
 #include "../../src/store/dataframe/dataframe.h"
 #include "../../src/store/network/master.h"
 #include "../../src/store/store.cpp"
@@ -112,12 +113,187 @@ bool test_ddf_with_missings() {
     return true;
 }
 
+// Sums the second int column of every row visited
+class SumSecondRower : public Rower {
+   public:
+    int sum = 0;
+    size_t count = 0;
+
+    bool accept(Row& r) {
+        sum += r.get_int(1);
+        count++;
+        return false;
+    }
+};
+
+bool test_local_index() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server serv(master_ip, master_port);
+    serv.listen_for_clients();
+
+    Store store(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+
+    Schema schema("II");
+    DistributedDataFrame df(&store, schema);
+    Row r(schema);
+    for (size_t i = 0; i < 300; i++) {
+        r.set(0, (int)(i % 5));
+        r.set(1, (int)i);
+        df.add_row(r);
+    }
+
+    LocalIndex index(&df, 0);
+    Bitmap values;
+    values.add(2);
+    values.add(4);
+    values.add(99);  // never appears, so contributes no rows
+
+    Bitmap* rows = index.rows_for(&values);
+    assert(rows->cardinality() == 120);
+    assert(rows->contains(2));
+    assert(rows->contains(299));
+    assert(!rows->contains(3));
+
+    // Visits only the indexed rows, and ignores rows past the end
+    rows->add(1000);
+    SumSecondRower sum;
+    df.map_rows(rows, sum);
+    assert(sum.count == 120);
+    int expected = 0;
+    for (int i = 0; i < 300; i++) {
+        if (i % 5 == 2 || i % 5 == 4) expected += i;
+    }
+    assert(sum.sum == expected);
+    delete rows;
+
+    store.is_done();
+    serv.shutdown();
+    while (!store.is_shutdown()) {
+    }
+
+    return true;
+}
+
+bool test_sketches() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server serv(master_ip, master_port);
+    serv.listen_for_clients();
+
+    Store store(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+
+    Schema schema("IF");
+    DistributedDataFrame df(&store, schema);
+    Row r(schema);
+    for (size_t i = 0; i < 300; i++) {
+        r.set(0, (int)(i % 5));
+        r.set(1, (float)i);
+        df.add_row(r);
+    }
+
+    // Sketch rowers, including clones joined back as pmap would
+    HyperLogLog distinct;
+    SketchRower sketcher(&distinct, 0);
+    SketchRower* split = sketcher.clone();
+    df.local_map(sketcher);
+    df.local_map(*split);
+    sketcher.join_delete(split);
+    assert(fabs(distinct.estimate() - 5) < 0.5);
+
+    CountMinSketch counts;
+    SketchRower counter(&counts, 0);
+    df.local_map(counter);
+    assert(counts.estimate(2) >= 60);
+    assert(counts.total == 300);
+
+    KllSketch quantiles;
+    SketchRower ranker(&quantiles, 1);
+    df.local_map(ranker);
+    assert(quantiles.n == 300);
+    assert(quantiles.quantile(0) < 15);
+    assert(quantiles.quantile(1) > 285);
+    assert(fabs(quantiles.quantile(0.5) - 150) < 15);
+
+    store.is_done();
+    serv.shutdown();
+    while (!store.is_shutdown()) {
+    }
+
+    return true;
+}
+
+bool test_expressions() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server serv(master_ip, master_port);
+    serv.listen_for_clients();
+
+    Store store(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+
+    Schema schema("IIFB");
+    DistributedDataFrame df(&store, schema);
+    Row r(schema);
+    for (size_t i = 0; i < 250; i++) {
+        r.set(0, (int)i);
+        r.set(1, (int)(i % 7));
+        r.set(2, (float)0);
+        r.set(3, i % 2 == 0);
+        df.add_row(r);
+    }
+    df.set_missing(1, 3);
+
+    // Rows where i + (i % 7) * 2 > 5, skipping the missing row 3
+    Bitmap* rows = df.where(col(0) + col(1) * 2 > lit(5));
+    size_t expected = 0;
+    for (size_t i = 0; i < 250; i++) {
+        bool match = i != 3 && (int)(i + (i % 7) * 2) > 5;
+        assert(rows->contains(i) == match);
+        if (match) expected++;
+    }
+    assert(rows->cardinality() == expected);
+    delete rows;
+
+    // Ints widen to floats; integer division by zero is missing
+    df.map(2, col(0) * 0.5 + col(0) / col(1));
+    assert(df.get_float(2, 9) == (float)(4.5 + 9 / 2));
+    assert(df.get_float(2, 248) == (float)(124 + 248 / 3));
+    assert(df.is_missing(2, 7));
+    assert(df.is_missing(2, 3));
+    assert(!df.is_missing(2, 8));
+
+    // Logical operators over bool columns and comparisons
+    Expression even_and_small = col(3) && col(0) < 100;
+    DataFrame* small = df.filter(even_and_small || col(0) == 249);
+    assert(small->nrows() == 51);
+    assert(small->get_int(0, 1) == 2);
+    assert(small->get_int(0, 50) == 249);
+    delete small;
+
+    DataFrame* odd = df.filter(!col(3));
+    assert(odd->nrows() == 125);
+    assert(odd->get_int(0, 0) == 1);
+    delete odd;
+
+    store.is_done();
+    serv.shutdown();
+    while (!store.is_shutdown()) {
+    }
+
+    return true;
+}
 
 int main() {
     assert(test_ddf_multi_column());
     printf("=========== test_ddf_multi_column PASSED =========\n");
     assert(test_ddf_with_missings());
     printf("=========== test_ddf_with_missings PASSED =========\n");
+    assert(test_local_index());
+    printf("=========== test_local_index PASSED =========\n");
+    assert(test_sketches());
+    printf("=========== test_sketches PASSED =========\n");
+    assert(test_expressions());
+    printf("=========== test_expressions PASSED =========\n");
 
     return 0;
 }
@@ -0,0 +1,386 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#include <assert.h>
+#include <stdio.h>
+#include <thread>
+#include "../../src/store/key_table.h"
+#include "../../src/store/snapshot.h"
+
+// Makes the key "key-[i]" homed on node i % 3
+Key* make_key(size_t i) {
+    char name[32];
+    snprintf(name, sizeof(name), "key-%zu", i);
+    return new Key(name, i % 3);
+}
+
+// Confirm key ids are the xxHash64 of the name seeded with the home node,
+// survive cloning, and can be supplied instead of recomputed
+bool test_key_ids() {
+    assert(hash_bytes("", 0) == 0xef46db3751d8e999ULL);
+    assert(hash_bytes("abc", 3) == 0x44bc2cf5ad770999ULL);
+
+    Key a((char*)"chunk-17", 2);
+    Key same((char*)"chunk-17", 2);
+    Key other_node((char*)"chunk-17", 3);
+    Key other_name((char*)"chunk-71", 2);
+    assert(a.get_id() == hash_bytes("chunk-17", 8, 2));
+    assert(a.get_id() == same.get_id());
+    assert(a.hash() == same.hash());
+    assert(a.get_id() != other_node.get_id());
+    assert(a.get_id() != other_name.get_id());
+    assert(a.equals(&same));
+    assert(!a.equals(&other_node));
+
+    Key* copy = a.clone();
+    assert(copy->get_id() == a.get_id());
+    assert(copy->equals(&a));
+    delete copy;
+
+    Key received((char*)"chunk-17", 2, a.get_id());
+    assert(received.equals(&a));
+
+    return true;
+}
+
+// Confirm put, get, in-place replacement and remove
+bool test_put_get_replace_remove() {
+    KeyTable table;
+    Key k1((char*)"a", 0);
+    Key k2((char*)"a", 1);  // Same name on another node is a different key
+
+    assert(table.put(&k1, Value::copy("one", 3)) == nullptr);
+    assert(table.put(&k2, Value::copy("two", 3)) == nullptr);
+    assert(table.size() == 2);
+    assert(strcmp(table.get(&k1)->c_str(), "one") == 0);
+
+    // Replacement hands back the old value and keeps the stored key
+    Key* stored = table.lookup_(&k1)->key;
+    Value* replaced = table.put(&k1, Value::copy("uno", 3));
+    assert(strcmp(replaced->c_str(), "one") == 0);
+    replaced->release();
+    assert(table.size() == 2);
+    assert(table.lookup_(&k1)->key == stored);
+    assert(strcmp(table.get(&k1)->c_str(), "uno") == 0);
+
+    Value* removed = table.remove(&k1);
+    assert(strcmp(removed->c_str(), "uno") == 0);
+    removed->release();
+    assert(table.get(&k1) == nullptr);
+    assert(table.remove(&k1) == nullptr);
+    assert(strcmp(table.get(&k2)->c_str(), "two") == 0);
+    assert(table.size() == 1);
+
+    return true;
+}
+
+// Confirm every entry stays reachable while the table grows incrementally,
+// and after removing half of them
+bool test_growth_and_removal() {
+    KeyTable table;
+    size_t n = 20000;
+    bool saw_rehash = false;
+
+    for (size_t i = 0; i < n; i++) {
+        Key* k = make_key(i);
+        char val[32];
+        snprintf(val, sizeof(val), "%zu", i);
+        assert(table.put(k, Value::copy(val, strlen(val))) == nullptr);
+        delete k;
+
+        saw_rehash = saw_rehash || table.old_slots != nullptr;
+        // Spot check entries, which may still be in the old table
+        Key* first = make_key(i / 2);
+        assert(table.get(first) != nullptr);
+        delete first;
+    }
+
+    assert(saw_rehash);
+    assert(table.size() == n);
+
+    for (size_t i = 0; i < n; i += 2) {
+        Key* k = make_key(i);
+        table.remove(k)->release();
+        delete k;
+    }
+
+    assert(table.size() == n / 2);
+    for (size_t i = 0; i < n; i++) {
+        Key* k = make_key(i);
+        Value* val = table.get(k);
+        if (i % 2 == 0) {
+            assert(val == nullptr);
+        } else {
+            assert((size_t)atoi(val->c_str()) == i);
+        }
+        delete k;
+    }
+
+    size_t num_keys;
+    Key** keys = table.keys(&num_keys);
+    assert(num_keys == n / 2);
+    delete[] keys;
+
+    return true;
+}
+
+// Writer thread for test_striped_concurrency: keeps replacing the values of
+// keys [0, n) with their index plus a growing multiple of n
+void striped_writer(StripedKeyTable* table, size_t n, size_t rounds) {
+    for (size_t r = 1; r <= rounds; r++) {
+        for (size_t i = 0; i < n; i++) {
+            Key* k = make_key(i);
+            char val[32];
+            snprintf(val, sizeof(val), "%zu", i + r * n);
+            Value* replaced = table->put(k, Value::copy(val, strlen(val)));
+            if (replaced != nullptr) replaced->release();
+            delete k;
+        }
+    }
+}
+
+// Reader thread for test_striped_concurrency: every value it gets must be
+// intact and belong to the key it asked for
+void striped_reader(StripedKeyTable* table, size_t n, size_t rounds, bool* ok) {
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < n; i++) {
+            Key* k = make_key(i);
+            Value* val = table->get(k);
+            if (val == nullptr || (size_t)atol(val->c_str()) % n != i) {
+                *ok = false;
+            } else {
+                val->release();
+            }
+            delete k;
+        }
+    }
+}
+
+// Confirm readers and writers can share a StripedKeyTable, and that values
+// handed to readers survive being replaced
+bool test_striped_concurrency() {
+    StripedKeyTable table;
+    size_t n = 2000;
+    striped_writer(&table, n, 1);
+    assert(table.size() == n);
+
+    const size_t num_readers = 4;
+    bool ok[num_readers];
+    std::thread* readers[num_readers];
+    std::thread writer(striped_writer, &table, n, 20);
+    for (size_t i = 0; i < num_readers; i++) {
+        ok[i] = true;
+        readers[i] = new std::thread(striped_reader, &table, n, 20, &ok[i]);
+    }
+
+    writer.join();
+    for (size_t i = 0; i < num_readers; i++) {
+        readers[i]->join();
+        delete readers[i];
+        assert(ok[i]);
+    }
+
+    assert(table.size() == n);
+    Key* k = make_key(7);
+    Value* val = table.get(k);
+    assert((size_t)atol(val->c_str()) == 7 + 20 * n);
+    val->release();
+    table.remove(k)->release();
+    assert(table.get(k) == nullptr);
+    delete k;
+
+    return true;
+}
+
+// Makes a value of the given length whose bytes depend on i, with a NUL
+// in the middle to check binary values survive the trip to disk
+Value* make_spill_value(size_t i, size_t length) {
+    char* bytes = new char[length + 1];
+    for (size_t b = 0; b < length; b++) {
+        bytes[b] = (char)('a' + (i + b) % 26);
+    }
+    bytes[length / 2] = '\0';
+    bytes[length] = '\0';
+    return Value::adopt(bytes, length);
+}
+
+// Confirm a table over its memory budget spills its least recently used
+// values, that they read back intact (by read for short values, by mmap
+// for long ones), and that replacing and removing spilled keys works
+bool test_spill() {
+    StripedKeyTable table;
+    size_t budget = 256 << 10;
+    table.set_memory_budget(budget, "/tmp", 99);
+
+    size_t n = 200;
+    size_t lengths[2] = {100, SPILL_MMAP_MIN + 5000};
+    for (size_t i = 0; i < n; i++) {
+        Key* k = make_key(i);
+        assert(table.put(k, make_spill_value(i, lengths[i % 2])) == nullptr);
+        delete k;
+        assert(table.resident_bytes <= budget);
+    }
+    assert(table.size() == n);
+    assert(table.segments->spills > 0);
+    assert(table.segments->reloads == 0);
+
+    // The first keys put are the coldest, so they went first
+    Key* first = make_key(1);
+    assert(table.tables[table.stripe_(first)].get(first) == nullptr);
+    delete first;
+
+    for (size_t i = 0; i < n; i++) {
+        Key* k = make_key(i);
+        Value* expected = make_spill_value(i, lengths[i % 2]);
+        Value* val = table.get(k);
+        assert(val->equals(expected));
+        val->release();
+        expected->release();
+        delete k;
+        assert(table.resident_bytes <= budget);
+    }
+    assert(table.segments->reloads > 0);
+    assert(table.segments->reload_bytes > 0);
+
+    // Values read back are already on disk, so spilling them again is free
+    size_t spills = table.segments->spills;
+    for (size_t i = 0; i < n; i++) {
+        Key* k = make_key(i);
+        table.get(k)->release();
+        delete k;
+    }
+    assert(table.segments->spills == spills);
+
+    // Replace and remove keys whether or not they are spilled
+    for (size_t i = 0; i < n; i += 3) {
+        Key* k = make_key(i);
+        Value* replaced = table.put(k, make_spill_value(i + 1, 50));
+        if (replaced != nullptr) replaced->release();
+        Value* val = table.get(k);
+        Value* expected = make_spill_value(i + 1, 50);
+        assert(val->equals(expected));
+        val->release();
+        expected->release();
+        delete k;
+    }
+    for (size_t i = 1; i < n; i += 3) {
+        Key* k = make_key(i);
+        Value* removed = table.remove(k);
+        Value* expected = make_spill_value(i, lengths[i % 2]);
+        assert(removed->equals(expected));
+        removed->release();
+        expected->release();
+        assert(table.get(k) == nullptr);
+        delete k;
+    }
+
+    // Readers and a writer racing with spills always see intact values
+    StripedKeyTable shared;
+    shared.set_memory_budget(1 << 10, "/tmp", 98);
+    striped_writer(&shared, 500, 1);
+    bool ok[2] = {true, true};
+    std::thread writer(striped_writer, &shared, 500, 5);
+    std::thread reader1(striped_reader, &shared, 500, 5, &ok[0]);
+    std::thread reader2(striped_reader, &shared, 500, 5, &ok[1]);
+    writer.join();
+    reader1.join();
+    reader2.join();
+    assert(ok[0] && ok[1]);
+    assert(shared.segments->spills > 0);
+
+    return true;
+}
+
+// Appends values to segments, tiny so that the table of their files keeps
+// growing, noting where each went
+void spill_appender(SpillSegments* segments, SpillLocation* where, std::atomic<size_t>* appended, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        Value* value = make_spill_value(i, 100);
+        where[i] = segments->append(value);
+        value->release();
+        appended->store(i + 1);
+    }
+}
+
+// Reloads values as they are appended, checking each is intact
+void spill_loader(SpillSegments* segments, SpillLocation* where, std::atomic<size_t>* appended, size_t n, bool* ok) {
+    for (size_t i = 0; i < n; i++) {
+        while (appended->load() <= i) {
+            std::this_thread::yield();
+        }
+        Value* expected = make_spill_value(i, 100);
+        Value* value = segments->load(where[i]);
+        *ok = *ok && value->equals(expected);
+        value->release();
+        expected->release();
+    }
+}
+
+// Confirm values reload intact while appends keep starting segments, and
+// so keep replacing the table of segment files being read
+bool test_spill_reload_concurrency() {
+    SpillSegments segments("/tmp", 96);
+    segments.segment_size = 1000;
+    size_t n = 3000;
+    SpillLocation* where = new SpillLocation[n];
+    std::atomic<size_t> appended(0);
+    bool ok[2] = {true, true};
+
+    std::thread appender(spill_appender, &segments, where, &appended, n);
+    std::thread loader1(spill_loader, &segments, where, &appended, n, &ok[0]);
+    std::thread loader2(spill_loader, &segments, where, &appended, n, &ok[1]);
+    appender.join();
+    loader1.join();
+    loader2.join();
+
+    assert(ok[0] && ok[1]);
+    assert(segments.num_segments > 100);
+    assert(segments.reloads == 2 * n);
+    delete[] where;
+    return true;
+}
+
+// Confirm a snapshot holds every entry, spilled or not, and loads back
+// into an empty table, ids and all
+bool test_snapshot() {
+    const char* path = "/tmp/key_table_test.snap";
+    StripedKeyTable table;
+    table.set_memory_budget(16 << 10, "/tmp", 97);
+    size_t n = 300;
+    for (size_t i = 0; i < n; i++) {
+        Key* k = make_key(i);
+        table.put(k, make_spill_value(i, 100 + i));
+        delete k;
+    }
+    assert(table.segments->spills > 0);
+
+    Snapshot snapshot(path);
+    assert(snapshot.save(&table, 97) == n);
+
+    StripedKeyTable restored;
+    assert(snapshot.load(&restored, 97));
+    assert(restored.size() == n);
+    for (size_t i = 0; i < n; i++) {
+        Key* k = make_key(i);
+        Value* val = restored.get(k);
+        Value* expected = make_spill_value(i, 100 + i);
+        assert(val->equals(expected));
+        val->release();
+        expected->release();
+        delete k;
+    }
+
+    unlink(path);
+    assert(!snapshot.load(&restored, 97));
+    return true;
+}
+
+int main() {
+    assert(test_key_ids());
+    assert(test_put_get_replace_remove());
+    assert(test_growth_and_removal());
+    assert(test_striped_concurrency());
+    assert(test_spill());
+    assert(test_spill_reload_concurrency());
+    assert(test_snapshot());
+    printf("====== KeyTable tests PASSED ===========\n");
+}
@@ -18,11 +18,21 @@ bool test_key_serialize() {
 
     assert(k1.equals(new_k1));
     assert(k2.equals(new_k2));
+    assert(new_k1->replicas == 1);
+
+    // Replicated keys keep their replicas
+    k1.set_replicas(3);
+    char* serialized_k3 = serial.serialize_key(&k1);
+    Key* new_k3 = serial.deserialize_key(serialized_k3);
+    assert(k1.equals(new_k3));
+    assert(new_k3->replicas == 3);
 
     delete[] serialized_k1;
     delete[] serialized_k2;
+    delete[] serialized_k3;
     delete new_k1;
     delete new_k2;
+    delete new_k3;
 
     return true;
 }
@@ -112,7 +122,6 @@ bool test_string_array_serialize() {
     assert(strings[3]->equals(new_strings[3]));
     assert(strings[4]->equals(new_strings[4]));
 
-    delete[] ser_strings;
     delete new_strings[0];
     delete new_strings[1];
     delete new_strings[2];
@@ -120,6 +129,191 @@ bool test_string_array_serialize() {
     delete new_strings[4];
     delete[] new_strings;
 
+    // Strings made in an arena are freed with it
+    Arena arena;
+    String** arena_strings = serial.deserialize_strings(ser_strings, &arena);
+    for (size_t i = 0; i < num_strings; i++) {
+        assert(strings[i]->equals(arena_strings[i]));
+    }
+    int* arena_ints = serial.deserialize_ints("1,-2,3", &arena);
+    assert(arena_ints[0] == 1 && arena_ints[1] == -2 && arena_ints[2] == 3);
+
+    delete[] ser_strings;
+
+    return true;
+}
+
+// Confirm chunks round trip through the binary form exactly, in the
+// smallest encoding or plain, and that chunks written as text are still read
+bool test_chunk_serialize() {
+    Serializer serial;
+    int ints[100];
+    float floats[100];
+    bool bools[100];
+    for (int i = 0; i < 100; i++) {
+        ints[i] = i * 1000003 - 50000000;
+        floats[i] = 0.1f * i - 3.3e-7f;
+        bools[i] = i % 3 == 0;
+    }
+    String a("a,b"), empty("");
+    String* strings[4] = {&a, nullptr, &empty, &a};
+
+    ChunkHeader header;
+    Value* int_chunk = serial.serialize_chunk(ints, 100);
+    header.read(int_chunk->data());
+    assert(header.encoding == CHUNK_DELTA_VARINT && header.count == 100);
+    assert(int_chunk->size() < CHUNK_HEADER_LEN + 4 * 100);
+    assert(header.version == CHUNK_VERSION && header.length == int_chunk->size() - CHUNK_HEADER_LEN);
+    assert(header.crc == ChunkHeader::checksum(int_chunk->data()));
+    assert(ChunkHeader::verify(int_chunk->data(), int_chunk->size()));
+    int* new_ints = serial.deserialize_int_chunk(int_chunk);
+    assert(memcmp(ints, new_ints, sizeof(ints)) == 0);
+
+    Value* float_chunk = serial.serialize_chunk(floats, 100);
+    float* new_floats = serial.deserialize_float_chunk(float_chunk);
+    assert(memcmp(floats, new_floats, sizeof(floats)) == 0);
+
+    Value* bool_chunk = serial.serialize_chunk(bools, 100);
+    header.read(bool_chunk->data());
+    assert(header.encoding == CHUNK_BITPACK);
+    assert(bool_chunk->size() == CHUNK_HEADER_LEN + 13);
+    Arena arena;
+    bool* new_bools = serial.deserialize_bool_chunk(bool_chunk, &arena);
+    assert(memcmp(bools, new_bools, sizeof(bools)) == 0);
+
+    // Commas survive, and a nullptr String comes back empty
+    Value* string_chunk = serial.serialize_chunk(strings, 4);
+    String** new_strings = serial.deserialize_string_chunk(string_chunk);
+    assert(new_strings[0]->equals(&a) && new_strings[3]->equals(&a));
+    assert(new_strings[1]->equals(&empty) && new_strings[2]->equals(&empty));
+    String** arena_strings = serial.deserialize_string_chunk(string_chunk, &arena);
+    assert(arena_strings[0]->equals(&a) && arena_strings[2]->size() == 0);
+
+    serial.plain_chunks = true;
+    Value* plain_chunk = serial.serialize_chunk(ints, 100);
+    header.read(plain_chunk->data());
+    assert(header.encoding == CHUNK_PLAIN);
+    assert(plain_chunk->size() == CHUNK_HEADER_LEN + 4 * 100);
+    int* plain_ints = serial.deserialize_int_chunk(plain_chunk, &arena);
+    assert(memcmp(ints, plain_ints, sizeof(ints)) == 0);
+
+    serial.text_chunks = true;
+    Value* text_chunk = serial.serialize_chunk(ints, 100);
+    assert(!ChunkHeader::is_binary(text_chunk->data(), text_chunk->size()));
+
+    // A chunk with the unversioned header of older builds is still told
+    // apart from text, but not taken for one with a header of this layout
+    char legacy[8 + 4 * 3] = {'\0', INT_TYPE, CHUNK_PLAIN, CHUNK_FLAGS_NONE, 3, 0, 0, 0};
+    assert(ChunkHeader::is_binary(legacy, sizeof(legacy)));
+    assert(!ChunkHeader::has_magic(legacy, sizeof(legacy)));
+    assert(!ChunkHeader::verify(legacy, sizeof(legacy)));
+    assert(ChunkHeader::has_magic(int_chunk->data(), int_chunk->size()));
+    int* text_ints = serial.deserialize_int_chunk(text_chunk);
+    assert(memcmp(ints, text_ints, sizeof(ints)) == 0);
+
+    // A flipped bit or a cut short chunk no longer verifies, while the
+    // intact chunks still read with verification on
+    Value* corrupt = Value::copy(string_chunk->data(), string_chunk->size());
+    assert(ChunkHeader::verify(corrupt->data(), corrupt->size()));
+    corrupt->bytes[corrupt->size() - 1] ^= 0x10;
+    assert(!ChunkHeader::verify(corrupt->data(), corrupt->size()));
+    assert(!ChunkHeader::verify(int_chunk->data(), int_chunk->size() - 1));
+    serial.verify_chunks = true;
+    int* verified_ints = serial.deserialize_int_chunk(plain_chunk, &arena);
+    assert(memcmp(ints, verified_ints, sizeof(ints)) == 0);
+    corrupt->release();
+
+    delete[] new_ints;
+    delete[] new_floats;
+    delete[] text_ints;
+    for (size_t i = 0; i < 4; i++) {
+        delete new_strings[i];
+    }
+    delete[] new_strings;
+    int_chunk->release();
+    float_chunk->release();
+    bool_chunk->release();
+    string_chunk->release();
+    plain_chunk->release();
+    text_chunk->release();
+
+    return true;
+}
+
+// Confirm views read plain chunks in place, holding them while they do,
+// and decode any other chunk into an array they reuse
+bool test_chunk_views() {
+    Serializer serial;
+    int ints[100];
+    bool bools[100];
+    for (int i = 0; i < 100; i++) {
+        ints[i] = i * 7 - 300;
+        bools[i] = i > 90;
+    }
+
+    serial.plain_chunks = true;
+    Value* plain_chunk = serial.serialize_chunk(ints, 100);
+    ChunkView<int> view;
+    serial.view_chunk(plain_chunk, &view);
+    assert(view.in_place() && view.size() == 100);
+    assert((const char*)view.data() == plain_chunk->data() + CHUNK_HEADER_LEN);
+    assert(plain_chunk->refs == 2);
+    plain_chunk->release();
+    for (size_t i = 0; i < 100; i++) {
+        assert(view.get(i) == ints[i]);
+    }
+
+    // An encoded chunk is decoded, into the same array each time
+    serial.plain_chunks = false;
+    Value* encoded_chunk = serial.serialize_chunk(ints, 100);
+    serial.view_chunk(encoded_chunk, &view);
+    assert(!view.in_place() && view.size() == 100);
+    const int* decoded = view.data();
+    assert(memcmp(decoded, ints, sizeof(ints)) == 0);
+    serial.view_chunk(encoded_chunk, &view);
+    assert(view.data() == decoded);
+    assert(encoded_chunk->refs == 1);
+    encoded_chunk->release();
+
+    Value* bool_chunk = serial.serialize_chunk(bools, 100);
+    ChunkView<bool> bool_view;
+    serial.view_chunk(bool_chunk, &bool_view);
+    assert(!bool_view.get(90) && bool_view.get(91) && bool_view.get(99));
+    bool into[INTERNAL_CHUNK_SIZE];
+    assert(serial.deserialize_chunk_into(bool_chunk, into, INTERNAL_CHUNK_SIZE) == 100);
+    assert(memcmp(into, bools, sizeof(bools)) == 0);
+    bool_chunk->release();
+
+    // Plain bools are decoded, not viewed, so a byte other than 0 or 1
+    // still reads as true
+    serial.plain_chunks = true;
+    Value* plain_bools = serial.serialize_chunk(bools, 100);
+    plain_bools->bytes[CHUNK_HEADER_LEN + 95] = 2;
+    serial.view_chunk(plain_bools, &bool_view);
+    assert(!bool_view.in_place() && plain_bools->refs == 1);
+    assert(!bool_view.get(90) && bool_view.get(95) && bool_view.get(99));
+    plain_bools->release();
+    serial.plain_chunks = false;
+
+    // Strings, plain, compressed and as text, are found by offset
+    String a("alpha"), empty("");
+    String* strings[6] = {&a, &empty, nullptr, &a, &a, &a};
+    StringChunkView string_view;
+    for (size_t form = 0; form < 3; form++) {
+        serial.plain_chunks = form == 0;
+        serial.text_chunks = form == 2;
+        Value* string_chunk = serial.serialize_chunk(strings, 6);
+        serial.view_chunk(string_chunk, &string_view);
+        string_chunk->release();
+        assert(string_view.in_place() == (form == 0));
+        assert(string_view.size() == 6);
+        assert(strcmp(string_view.c_str(0), "alpha") == 0 && string_view.length(0) == 5);
+        assert(string_view.length(1) == 0 && string_view.length(2) == 0);
+        assert(strcmp(string_view.c_str(5), "alpha") == 0);
+    }
+    string_view.clear();
+    assert(string_view.size() == 0 && !string_view.in_place());
+
     return true;
 }
 
@@ -163,6 +357,79 @@ bool test_dist_col_serialize() {
     return true;
 }
 
+// A column with 100k chunks serializes in time linear in its keys, into
+// exactly the length it needs, and reads back key for key
+bool test_many_chunk_keys_serialize() {
+    size_t num_chunks = 100000;
+    Key** chunk_keys = new Key*[num_chunks];
+    Key** missings_keys = new Key*[num_chunks];
+    char name[32];
+    for (size_t i = 0; i < num_chunks; i++) {
+        snprintf(name, sizeof(name), "c-%zu", i);
+        chunk_keys[i] = new Key(name, i % 7);
+        snprintf(name, sizeof(name), "m-%zu", i);
+        missings_keys[i] = new Key(name, i % 5);
+    }
+    chunk_keys[3]->set_replicas(3);
+    DistributedIntColumn col(nullptr, chunk_keys, missings_keys, num_chunks * INTERNAL_CHUNK_SIZE, num_chunks);
+
+    Serializer serial;
+    char* ser_col = serial.serialize_dist_col(&col);
+    assert(strlen(ser_col) == serial.dist_col_len_(&col));
+    assert(strncmp(ser_col, "10000000;100000;c-0,0;m-0,0;c-1,1;m-1,1;", 40) == 0);
+
+    DistributedIntColumn* col2 = serial.deserialize_dist_int_col(ser_col, nullptr);
+    assert(col2->size() == col.size());
+    assert(col2->num_chunks == num_chunks);
+    for (size_t i = 0; i < num_chunks; i++) {
+        assert(col2->chunk_keys[i]->equals(chunk_keys[i]));
+        assert(col2->chunk_keys[i]->get_home_node() == i % 7);
+        assert(col2->missings_keys[i]->equals(missings_keys[i]));
+    }
+    assert(col2->chunk_keys[3]->replicas == 3);
+
+    delete[] ser_col;
+    delete col2;
+
+    return true;
+}
+
+// A Sink that gathers what it drains, counting the pieces
+class GatherSink : public Sink {
+   public:
+    Buffer out;
+    size_t pieces;
+
+    GatherSink(size_t capacity) : Sink(capacity) {
+        pieces = 0;
+    }
+
+    void drain_(const char* bytes, size_t n) {
+        out.append(bytes, n);
+        pieces++;
+    }
+};
+
+// A Source handing out bytes in memory a few at a time
+class TrickleSource : public Source {
+   public:
+    const char* bytes;
+    size_t left;
+
+    TrickleSource(const char* bytes, size_t len, size_t capacity) : Source(capacity) {
+        this->bytes = bytes;
+        left = len;
+    }
+
+    size_t fill_(char* dst, size_t max) {
+        size_t n = max < left ? max : left;
+        memcpy(dst, bytes, n);
+        bytes += n;
+        left -= n;
+        return n;
+    }
+};
+
 bool test_ddf_serialize() {
     char* master_ip = (char*) "127.0.0.1";
     int master_port = rand_port();
@@ -205,8 +472,22 @@ bool test_ddf_serialize() {
     assert(new_ddf->get_int(0, 6) == 6);
     assert(new_ddf->get_string(1, 6)->equals(&str));
 
+    // Streamed a few bytes at a time, the frame is the same text, and reads
+    // back from pieces as small
+    GatherSink sink(8);
+    serial.serialize_distributed_dataframe(&ddf, &sink);
+    assert(sink.out.size() == serial.distributed_dataframe_len(&ddf));
+    assert(strcmp(sink.out.buf, ser_ddf) == 0);
+    assert(sink.pieces > sink.out.size() / 8 / 2);
+    TrickleSource source(ser_ddf, strlen(ser_ddf), 8);
+    DistributedDataFrame* streamed_ddf = serial.deserialize_distributed_dataframe(&source, &store);
+    assert(streamed_ddf->ncols() == 3 && streamed_ddf->nrows() == ddf.nrows());
+    assert(streamed_ddf->get_int(0, 6) == 6);
+    assert(streamed_ddf->get_string(1, 6)->equals(&str));
+
     delete[] ser_ddf;
     delete new_ddf;
+    delete streamed_ddf;
 
     store.is_done();
 
@@ -220,6 +501,81 @@ bool test_ddf_serialize() {
     return true;
 }
 
+bool test_bitmap_serialize() {
+    Bitmap sparse;
+    sparse.add(7);
+    sparse.add(65535);
+    sparse.add(1 << 20);
+
+    Bitmap dense;
+    for (uint32_t i = 0; i < 20000; i++) {
+        dense.add(i);
+    }
+    dense.add(300000);
+
+    Bitmap empty;
+
+    Serializer serial;
+    Bitmap* bitmaps[3] = {&sparse, &dense, &empty};
+    for (size_t i = 0; i < 3; i++) {
+        Value* ser_bitmap = serial.serialize_bitmap(bitmaps[i]);
+        Bitmap* new_bitmap = serial.deserialize_bitmap(ser_bitmap);
+
+        assert(bitmaps[i]->equals(new_bitmap));
+
+        ser_bitmap->release();
+        delete new_bitmap;
+    }
+
+    // Two array containers, keys 0 and 16, values as raw little-endian bytes
+    Value* ser_sparse = serial.serialize_bitmap(&sparse);
+    assert(ser_sparse->size() == 4 + (7 + 4) + (7 + 2));
+    assert(memcmp(ser_sparse->data(), "\x02\0\0\0\0\0A\x04\0\0\0\x07\0\xff\xff", 15) == 0);
+    assert(memcmp(ser_sparse->data() + 15, "\x10\0A\x02\0\0\0\0\0", 9) == 0);
+    ser_sparse->release();
+
+    return true;
+}
+
+bool test_sketch_serialize() {
+    Serializer serial;
+    HyperLogLog hll;
+    CountMinSketch cms(64, 3);
+    KllSketch kll(50);
+    String word("word");
+    for (int i = 0; i < 3000; i++) {
+        hll.add(i);
+        cms.add(i % 10);
+        cms.add(&word);
+        kll.add((float)i / 3);
+    }
+
+    char* ser_hll = serial.serialize_sketch(&hll);
+    Sketch* new_hll = serial.deserialize_sketch(ser_hll);
+    assert(hll.equals(new_hll));
+
+    char* ser_cms = serial.serialize_sketch(&cms);
+    Sketch* new_cms = serial.deserialize_sketch(ser_cms);
+    assert(cms.equals(new_cms));
+
+    char* ser_kll = serial.serialize_sketch(&kll);
+    KllSketch* new_kll = dynamic_cast<KllSketch*>(serial.deserialize_sketch(ser_kll));
+    assert(new_kll->n == kll.n);
+    assert(new_kll->num_levels == kll.num_levels);
+    assert(new_kll->num_values() == kll.num_values());
+    assert(new_kll->quantile(0.5) == kll.quantile(0.5));
+    assert(new_kll->quantile(0.99) == kll.quantile(0.99));
+
+    delete[] ser_hll;
+    delete[] ser_cms;
+    delete[] ser_kll;
+    delete new_hll;
+    delete new_cms;
+    delete new_kll;
+
+    return true;
+}
+
 bool test_schema_serialize() {
     Schema scm("IFBS");
 
@@ -244,6 +600,8 @@ bool test_schema_serialize() {
 int main() {
     assert(test_dist_col_serialize());
     printf("========= serialize_dist_col PASSED =============\n");
+    assert(test_many_chunk_keys_serialize());
+    printf("========= serialize_many_chunk_keys PASSED =============\n");
     assert(test_ddf_serialize());
     printf("========= serialize_ddf PASSED =============\n");
     assert(test_schema_serialize());
@@ -254,6 +612,14 @@ int main() {
     printf("========= serialize_int_array PASSED =============\n");
     assert(test_bool_array_serialize());
     printf("========= serialize_bool_array PASSED =============\n");
+    assert(test_chunk_serialize());
+    printf("========= serialize_chunk PASSED =============\n");
+    assert(test_chunk_views());
+    printf("========= chunk_views PASSED =============\n");
+    assert(test_bitmap_serialize());
+    printf("========= serialize_bitmap PASSED =============\n");
+    assert(test_sketch_serialize());
+    printf("========= serialize_sketch PASSED =============\n");
     assert(test_key_serialize());
     printf("========= serialize_key PASSED =============\n");
     assert(test_bool_serialize());
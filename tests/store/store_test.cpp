@@ -126,6 +126,495 @@ bool test_network_put_get() {
     return true;
 }
 
+// Tests that local gets share the stored Value instead of copying it, that
+// puts adopt the caller's Value, and that values holding NUL bytes survive
+// both local and network round trips
+bool test_values() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+
+    Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+
+    const char bytes[] = {'a', '\0', '~', ';', '\0', 'z'};
+    Key local((char*)"blob", 0);
+    Key remote((char*)"blob", 1);
+
+    Value* value = Value::copy(bytes, sizeof(bytes));
+    value->retain();  // Keep a reference to check the store adopted it
+    store1.put(&local, value);
+    store1.put(&remote, Value::copy(bytes, sizeof(bytes)));
+
+    Value* got = store1.get_value(&local);
+    assert(got == value);
+    assert(got->refs == 3);
+    got->release();
+
+    // Replacing the value leaves readers' references intact
+    store1.put(&local, Value::copy("new", 3));
+    assert(value->refs == 1);
+    assert(value->size() == sizeof(bytes));
+    value->release();
+
+    Value* fetched = store1.waitAndGet_value(&remote);
+    assert(fetched->size() == sizeof(bytes));
+    assert(memcmp(fetched->data(), bytes, sizeof(bytes)) == 0);
+    fetched->release();
+
+    Key missing((char*)"missing", 1);
+    assert(store1.get_value(&missing) == nullptr);
+
+    store1.is_done();
+    store2.is_done();
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    while (!store1.is_shutdown()) {
+    }
+    while (!store2.is_shutdown()) {
+    }
+
+    return true;
+}
+
+// Tests that a node over its memory budget spills values to disk and still
+// serves them, to itself and to other nodes, and reports doing so
+bool test_memory_budget() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    store1.set_memory_budget(64 << 10, "/tmp");
+
+    Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+
+    char buf[4096];
+    for (size_t i = 0; i < 64; i++) {
+        memset(buf, 'a' + i % 26, sizeof(buf));
+        char name[32];
+        snprintf(name, sizeof(name), "spill-%zu", i);
+        Key key(name, 0);
+        store1.put(&key, Value::copy(buf, sizeof(buf)));
+    }
+
+    for (size_t i = 0; i < 64; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "spill-%zu", i);
+        Key key(name, 0);
+        Value* local = store1.get_value(&key);
+        Value* remote = store2.get_value(&key);
+        assert(local->size() == sizeof(buf));
+        assert(local->equals(remote));
+        assert(local->data()[0] == (char)('a' + i % 26));
+        local->release();
+        remote->release();
+    }
+
+    char* stats = store1.memory_stats();
+    assert(strstr(stats, "spilled 0 values") == nullptr);
+    assert(strstr(stats, "reloaded 0 values") == nullptr);
+    delete[] stats;
+
+    store1.is_done();
+    store2.is_done();
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    while (!store1.is_shutdown()) {
+    }
+    while (!store2.is_shutdown()) {
+    }
+
+    return true;
+}
+
+// Tests that a frame spread over two nodes can be gotten by its Key again
+// after both nodes restart from the snapshots they saved
+bool test_snapshot() {
+    const char* paths[2] = {"/tmp/store_test-node0.snap", "/tmp/store_test-node1.snap"};
+    Key k((char*)"frame", 0);
+    size_t n = 3000;  // Enough for chunks on both nodes
+
+    {
+        char* master_ip = (char*)"127.0.0.1";
+        int master_port = rand_port();
+        Server s(master_ip, master_port);
+        s.listen_for_clients();
+
+        Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+        Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+
+        DistributedIntColumn i_c(&store1);
+        for (size_t i = 0; i < n; i++) {
+            i_c.push_back(i * 7);
+        }
+        Schema empty_schema;
+        DistributedDataFrame df(&store1, empty_schema);
+        df.add_column(&i_c);
+        store1.put(&k, &df);
+
+        assert(store1.save_snapshot(paths[0]) > 0);
+        assert(store2.save_snapshot(paths[1]) > 0);
+
+        store1.is_done();
+        store2.is_done();
+        s.shutdown();
+        while (!store1.is_shutdown()) {
+        }
+        while (!store2.is_shutdown()) {
+        }
+    }
+
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    assert(!store1.load_snapshot("/tmp/store_test-missing.snap"));
+    assert(store1.load_snapshot(paths[0]));
+    assert(store2.load_snapshot(paths[1]));
+
+    DistributedDataFrame* df = store2.get(&k);
+    assert(df->nrows() == n);
+    for (size_t i = 0; i < n; i++) {
+        assert(df->get_int(0, i) == (int)(i * 7));
+    }
+    delete df;
+
+    unlink(paths[0]);
+    unlink(paths[1]);
+
+    store1.is_done();
+    store2.is_done();
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    while (!store1.is_shutdown()) {
+    }
+    while (!store2.is_shutdown()) {
+    }
+
+    return true;
+}
+
+// Returns whether value holds exactly the given string, and releases it
+bool value_is(Value* value, const char* expected) {
+    bool same = value != nullptr && value->size() == strlen(expected) && strcmp(value->data(), expected) == 0;
+    if (value != nullptr) {
+        value->release();
+    }
+    return same;
+}
+
+// Tests that sealed values from other nodes are cached, that putting them
+// again invalidates the caches, and that scanning a sealed frame a second
+// time gets every chunk from the cache
+bool test_remote_cache() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    RemoteCache* cache = store1.cache;
+
+    // Unsealed values are fetched every time
+    Key k((char*)"sealed", 1);
+    Key missing((char*)"missing", 1);
+    store1.put(&k, Value::copy("v1", 2));
+    assert(value_is(store1.get_value(&k), "v1"));
+    assert(value_is(store1.get_value(&k), "v1"));
+    assert(cache->count == 0 && cache->hits == 0);
+
+    // Sealed ones only once
+    assert(!store1.seal(&missing));
+    assert(store1.seal(&k));
+    assert(value_is(store1.get_value(&k), "v1"));
+    assert(cache->count == 1 && cache->hits == 0);
+    assert(value_is(store1.get_value(&k), "v1"));
+    assert(cache->hits == 1);
+
+    // Putting a sealed key again reaches the cache asynchronously
+    store2.put(&k, Value::copy("v2", 2));
+    while (value_is(store1.get_value(&k), "v1")) {
+        std::this_thread::yield();
+    }
+    assert(value_is(store1.get_value(&k), "v2"));
+    assert(cache->count == 0);
+
+    // A frame with chunks on both nodes, built and sealed on node 0
+    Key frame((char*)"frame", 0);
+    size_t n = 3000;
+    DistributedIntColumn i_c(&store1);
+    for (size_t i = 0; i < n; i++) {
+        i_c.push_back(i * 3);
+    }
+    Schema empty_schema;
+    DistributedDataFrame df(&store1, empty_schema);
+    df.add_column(&i_c);
+    store1.put(&frame, &df);
+    store1.seal_frame(&df);
+
+    // Node 1 scans it twice, only going over the network the first time
+    DistributedDataFrame* copy = store2.get(&frame);
+    store2.seal_frame(copy);
+    for (size_t scan = 0; scan < 2; scan++) {
+        size_t misses = store2.cache->misses;
+        for (size_t i = 0; i < n; i++) {
+            assert(copy->get_int(0, i) == (int)(i * 3));
+        }
+        assert(scan == 0 ? store2.cache->misses > misses : store2.cache->misses == misses);
+    }
+    delete copy;
+
+    store1.is_done();
+    store2.is_done();
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    while (!store1.is_shutdown()) {
+    }
+    while (!store2.is_shutdown()) {
+    }
+
+    return true;
+}
+
+// Tests putting and getting many keys at once, spread over every node
+bool test_batches() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store3(2, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+
+    // Values hold the message separators and NULs
+    const size_t n = 30;
+    Key* keys[n];
+    Value* values[n];
+    char names[n][16];
+    for (size_t i = 0; i < n; i++) {
+        snprintf(names[i], sizeof(names[i]), "batch-%zu", i);
+        keys[i] = new Key(names[i], (i * 7) % 3);
+        char bytes[4] = {'~', (char)('a' + i), '\0', '~'};
+        values[i] = Value::copy(bytes, 1 + i % 4);
+    }
+    store1.put_many(keys, values, n);
+
+    // Every key put is asked for, then n / 3 more that never were
+    Key* asked[n + n / 3];
+    for (size_t i = 0; i < n; i++) {
+        asked[i] = keys[i];
+    }
+    Key* missing[n / 3];
+    for (size_t i = 0; i < n / 3; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "none-%zu", i);
+        missing[i] = new Key(name, i % 3);
+        asked[n + i] = missing[i];
+    }
+
+    Value** got = store2.get_many(asked, n + n / 3);
+    for (size_t i = 0; i < n; i++) {
+        char bytes[4] = {'~', (char)('a' + i), '\0', '~'};
+        assert(got[i] != nullptr && got[i]->size() == 1 + i % 4);
+        assert(memcmp(got[i]->data(), bytes, got[i]->size()) == 0);
+        got[i]->release();
+    }
+    for (size_t i = n; i < n + n / 3; i++) {
+        assert(got[i] == nullptr);
+    }
+    delete[] got;
+
+    // Sealed values come back from the cache the second time
+    assert(store3.seal(keys[2]));
+    Value** first = store2.get_many(&keys[2], 1);
+    Value** second = store2.get_many(&keys[2], 1);
+    assert(first[0]->equals(second[0]));
+    assert(store2.cache->hits == 1);
+    first[0]->release();
+    second[0]->release();
+    delete[] first;
+    delete[] second;
+
+    for (size_t i = 0; i < n; i++) {
+        delete keys[i];
+    }
+    for (size_t i = 0; i < n / 3; i++) {
+        delete missing[i];
+    }
+
+    store1.is_done();
+    store2.is_done();
+    store3.is_done();
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    while (!store1.is_shutdown()) {
+    }
+    while (!store2.is_shutdown()) {
+    }
+    while (!store3.is_shutdown()) {
+    }
+
+    return true;
+}
+
+// Tests asynchronous gets and puts, with few requests allowed under way, and
+// expressions over a frame whose next chunk is fetched while one is evaluated
+bool test_async() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    store1.set_max_in_flight(2);
+
+    const size_t n = 20;
+    Key* keys[n];
+    std::future<void> puts[n];
+    for (size_t i = 0; i < n; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "async-%zu", i);
+        keys[i] = new Key(name, i % 2);
+        puts[i] = store1.put_async(keys[i], Value::copy(name, strlen(name)));
+    }
+    for (size_t i = 0; i < n; i++) {
+        puts[i].get();
+    }
+
+    std::future<Value*> gets[n + 1];
+    for (size_t i = 0; i < n; i++) {
+        gets[i] = store1.get_async(keys[i]);
+    }
+    Key missing((char*)"async-missing", 1);
+    gets[n] = store1.get_async(&missing);
+    for (size_t i = 0; i < n; i++) {
+        assert(value_is(gets[i].get(), keys[i]->get_name()));
+        delete keys[i];
+    }
+    assert(gets[n].get() == nullptr);
+    assert(store1.in_flight[1] == 0);
+
+    // A frame with chunks on both nodes, evaluated and written a chunk at a time
+    Schema schema("IF");
+    DistributedDataFrame df(&store1, schema);
+    Row r(schema);
+    size_t rows = 1000;
+    for (size_t i = 0; i < rows; i++) {
+        r.set(0, (int)i);
+        r.set(1, (float)0);
+        df.add_row(r);
+    }
+    df.map(1, col(0) * 2.0);
+    Bitmap* big = df.where(col(1) > lit(1000));
+    for (size_t i = 0; i < rows; i++) {
+        assert(df.get_float(1, i) == (float)(i * 2));
+        assert(big->contains(i) == (i * 2 > 1000));
+    }
+    delete big;
+
+    store1.is_done();
+    store2.is_done();
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    while (!store1.is_shutdown()) {
+    }
+    while (!store2.is_shutdown()) {
+    }
+
+    return true;
+}
+
+// Waits for the given key on the given store, and stores what it gets
+void wait_for_value(Store* store, Key* k, Value** result) {
+    *result = store->waitAndGet_value(k);
+}
+
+// Tests that waitAndGet wakes up for local puts of its own key, and for
+// remote keys once their home node pushes the value it was WATCHed for
+bool test_watch() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store3(2, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+
+    Key remote((char*)"later", 1);
+    Key local((char*)"mine", 0);
+    Key other((char*)"other", 0);
+    Value* got_remote1 = nullptr;
+    Value* got_remote3 = nullptr;
+    Value* got_local = nullptr;
+
+    std::thread remote1(wait_for_value, &store1, &remote, &got_remote1);
+    std::thread remote3(wait_for_value, &store3, &remote, &got_remote3);
+    std::thread local1(wait_for_value, &store1, &local, &got_local);
+
+    // Give the waiters time to register, then put keys nobody waits for
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    store1.put(&other, Value::copy("x", 1));
+    store3.put(&local, Value::copy("local", 5));
+    store1.put(&remote, Value::copy("remote", 6));
+
+    remote1.join();
+    remote3.join();
+    local1.join();
+
+    assert(strcmp(got_local->c_str(), "local") == 0);
+    assert(strcmp(got_remote1->c_str(), "remote") == 0);
+    assert(strcmp(got_remote3->c_str(), "remote") == 0);
+    got_local->release();
+    got_remote1->release();
+    got_remote3->release();
+
+    store1.is_done();
+    store2.is_done();
+    store3.is_done();
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    while (!store1.is_shutdown()) {
+    }
+    while (!store2.is_shutdown()) {
+    }
+    while (!store3.is_shutdown()) {
+    }
+
+    return true;
+}
+
 // Test whether store can put and get a distributed data frame
 bool test_network_distributed_df() {
     char* master_ip = (char*)"127.0.0.1";
@@ -226,13 +715,456 @@ bool test_network_distributed_df_waitAndGet() {
     return true;
 }
 
+// Combiner that adds two serialized ints
+class SumCombiner : public Combiner {
+   public:
+    char* combine(char* left, char* right) {
+        Serializer serial;
+        return serial.serialize_int(atoi(left) + atoi(right));
+    }
+};
+
+// Runs every collective once on the given store and checks the results
+void run_collectives(Store* store, size_t num_nodes) {
+    store->barrier();
+
+    // Every node contributes its id + 1
+    Serializer serial;
+    char* my_value = serial.serialize_int(store->this_node() + 1);
+    SumCombiner sum;
+    char* total = store->allreduce(my_value, &sum);
+    assert(atoi(total) == (int)(num_nodes * (num_nodes + 1) / 2));
+    delete[] total;
+
+    Key root_key((char*)"gather-root", 1);
+    char** values = store->gather(&root_key, my_value);
+    if (store->this_node() == 1) {
+        for (size_t i = 0; i < num_nodes; i++) {
+            assert(atoi(values[i]) == (int)i + 1);
+            delete[] values[i];
+        }
+        delete[] values;
+    } else {
+        assert(values == nullptr);
+    }
+    delete[] my_value;
+
+    // Root broadcasts the value it has stored under the key
+    Key bcast_key((char*)"bcast", 2);
+    if (store->this_node() == 2) {
+        store->put_char_(&bcast_key, (char*)"42");
+    }
+    char* received = store->broadcast(&bcast_key, nullptr);
+    assert(atoi(received) == 42);
+    delete[] received;
+
+    store->barrier();
+}
+
+// Merges one sketch of each kind and a bitmap from every node on the given
+// store and checks the results
+void run_merges(Store* store, size_t num_nodes) {
+    // Each node sketches an overlapping range of 2000 ints
+    HyperLogLog hll;
+    KllSketch kll;
+    for (int i = 0; i < 2000; i++) {
+        hll.add((int)store->this_node() * 1000 + i);
+        kll.add((float)(store->this_node() * 1000 + i));
+    }
+    HyperLogLog* distinct = dynamic_cast<HyperLogLog*>(store->merge_sketch(&hll));
+    double expected = (num_nodes + 1) * 1000;
+    assert(distinct->estimate() > expected * 0.95 && distinct->estimate() < expected * 1.05);
+    delete distinct;
+
+    KllSketch* quantiles = dynamic_cast<KllSketch*>(store->merge_sketch(&kll));
+    assert(quantiles->n == num_nodes * 2000);
+    assert(quantiles->quantile(0) < 100);
+    assert(quantiles->quantile(1) > expected - 100);
+    delete quantiles;
+
+    // Each node counts its own id 10 times and 0 once
+    CountMinSketch cms;
+    for (int i = 0; i < 10; i++) {
+        cms.add((int)store->this_node());
+    }
+    cms.add(0);
+    CountMinSketch* counts = dynamic_cast<CountMinSketch*>(store->merge_sketch(&cms));
+    assert(counts->total == num_nodes * 11);
+    assert(counts->estimate(0) >= 10 + num_nodes);
+    assert(counts->estimate((int)num_nodes - 1) >= 10);
+    delete counts;
+
+    // Each node sets its id in its own container, and one value shared by all
+    Bitmap bitmap;
+    bitmap.add(store->this_node() << 16);
+    bitmap.add(7);
+    Bitmap* merged = store->merge_bitmap(&bitmap);
+    assert(merged->cardinality() == num_nodes + 1);
+    assert(merged->contains(7));
+    assert(merged->contains((num_nodes - 1) << 16));
+    delete merged;
+
+    store->barrier();
+}
+
+// Starts num_nodes stores and runs the given function on each, on its own
+// thread, then shuts them down
+void run_on_nodes(void (*run)(Store*, size_t), size_t num_nodes) {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store** stores = new Store*[num_nodes];
+    for (size_t i = 0; i < num_nodes; i++) {
+        stores[i] = new Store(i, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    }
+
+    // Wait for every node to learn about every other node
+    for (size_t i = 0; i < num_nodes; i++) {
+        while (stores[i]->num_nodes() != num_nodes) {
+        }
+    }
+
+    std::thread* threads = new std::thread[num_nodes];
+    for (size_t i = 0; i < num_nodes; i++) {
+        threads[i] = std::thread(run, stores[i], num_nodes);
+    }
+    for (size_t i = 0; i < num_nodes; i++) {
+        threads[i].join();
+        stores[i]->is_done();
+    }
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    for (size_t i = 0; i < num_nodes; i++) {
+        while (!stores[i]->is_shutdown()) {
+        }
+        delete stores[i];
+    }
+    delete[] stores;
+    delete[] threads;
+}
+
+// Test barrier, allreduce, gather and broadcast across several nodes
+bool test_collectives() {
+    run_on_nodes(run_collectives, 5);
+    return true;
+}
+
+// Test merging sketches and bitmaps across several nodes
+bool test_merges() {
+    run_on_nodes(run_merges, 5);
+    return true;
+}
+
+bool test_remove() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+
+    // Local and remote keys, one sealed and cached by store1
+    Key local((char*)"rm-local", 0);
+    Key remote((char*)"rm-remote", 1);
+    store1.put(&local, Value::copy("a", 1));
+    store1.put(&remote, Value::copy("b", 1));
+    assert(store1.seal(&remote));
+    assert(value_is(store1.get_value(&remote), "b"));
+    assert(store1.remove(&local));
+    assert(store1.remove(&remote));
+    assert(store1.get_value(&local) == nullptr);
+    assert(store1.get_value(&remote) == nullptr);
+    assert(!store1.remove(&remote));
+    assert(store1.map->size() == 0 && store2.map->size() == 0);
+
+    // Dropping a frame and a copy gotten from it leaves nothing behind
+    const size_t n = 3 * INTERNAL_CHUNK_SIZE;
+    float floats[n];
+    for (size_t i = 0; i < n; i++) {
+        floats[i] = i;
+    }
+    Key frame((char*)"rm-frame", 1);
+    delete DataFrame::fromArray(&frame, &store1, n, floats);
+    DistributedDataFrame* copy = store2.get(&frame);
+    assert(copy->get_float(0, n - 1) == n - 1);
+    store2.drop_chunks(copy);
+    delete copy;
+    assert(store1.drop_frame(&frame));
+    assert(!store1.drop_frame(&frame));
+    assert(store1.map->size() == 0 && store2.map->size() == 0);
+
+    // Scoped frames drop on the way out
+    delete DataFrame::fromArray(&frame, &store2, n, floats);
+    {
+        ScopedFrame scope(&store1, store1.get(&frame), &frame);
+        assert(scope.df->get_float(0, 1) == 1);
+    }
+    assert(store1.map->size() == 0 && store2.map->size() == 0);
+
+    // Expired keys go away on their own
+    store1.put(&remote, Value::copy("c", 1));
+    delete DataFrame::fromArray(&frame, &store1, n, floats);
+    store2.expire_after(&remote, 10);
+    store2.expire_frame_after(&frame, 20);
+    for (size_t i = 0; i < 500 && store1.map->size() + store2.map->size() > 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    assert(store1.get_value(&remote) == nullptr);
+    assert(store1.map->size() == 0 && store2.map->size() == 0);
+
+    store1.is_done();
+    store2.is_done();
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    while (!store1.is_shutdown()) {
+    }
+    while (!store2.is_shutdown()) {
+    }
+
+    return true;
+}
+
+// Confirm replicated keys and frames are kept on distinct nodes, read from a
+// local replica when there is one, and kept up to date by later puts
+bool test_replication() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store3(2, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    while (store1.num_nodes() != 3 || store2.num_nodes() != 3 || store3.num_nodes() != 3) {
+    }
+
+    // Homed on node 0 with a replica on node 1, put from node 2
+    Key key((char*)"rep-a", 0);
+    key.set_replicas(2);
+    store3.put(&key, Value::copy("one", 3));
+    Value* replica = store2.map->get(&key);
+    assert(value_is(replica, "one"));
+    assert(store3.map->size() == 0);
+
+    size_t remote_gets = store2.metrics->gets_remote.get();
+    assert(value_is(store2.get_value(&key), "one"));
+    assert(store2.metrics->gets_remote.get() == remote_gets);
+    assert(value_is(store3.get_value(&key), "one"));
+
+    // Puts update every replica to the home node's version, and replicas
+    // ignore older versions arriving late
+    store1.put(&key, Value::copy("two", 3));
+    uint64_t home_version = 0;
+    uint64_t replica_version = 0;
+    assert(value_is(store1.map->get(&key, &home_version), "two"));
+    assert(value_is(store2.map->get(&key, &replica_version), "two"));
+    assert(home_version == replica_version && home_version == 2);
+    assert(!store2.map->put_replica(&key, Value::copy("one", 3), 1));
+    assert(value_is(store3.get_value(&key), "two"));
+
+    // The home node keeps the key replicated, so puts through a Key that
+    // does not say so still update every replica, whoever makes them
+    Key plain((char*)"rep-a", 0);
+    store3.put(&plain, Value::copy("2a", 2));
+    remote_gets = store2.metrics->gets_remote.get();
+    assert(value_is(store2.get_value(&key), "2a"));
+    assert(store2.metrics->gets_remote.get() == remote_gets);
+    Key* plain_keys[] = {&plain};
+    Value* plain_values[] = {Value::copy("2b", 2)};
+    store3.put_many(plain_keys, plain_values, 1);
+    assert(value_is(store2.get_value(&key), "2b"));
+    store1.put(&plain, Value::copy("two", 3));
+    assert(value_is(store2.get_value(&key), "two"));
+
+    // Sealing seals the replicas too; removing removes them
+    assert(store3.seal(&key));
+    assert(value_is(store2.map->get(&key, &replica_version), "two"));
+    assert(replica_version & KEY_SEALED);
+
+    // A replica still holding a sealed version the home has overwritten and
+    // invalidated answers with it, but its answer is never cached
+    assert(value_is(store3.send_get_request_(&key, 0), "two"));
+    assert(store3.cache->count == 1);
+    store1.put_local_(&key, Value::copy("three", 5));
+    while (store3.cache->count != 0) {
+        std::this_thread::yield();
+    }
+    assert(value_is(store2.map->get(&key), "two"));
+    assert(value_is(store3.send_get_request_(&key, 1), "two"));
+    assert(store3.cache->count == 0);
+    assert(value_is(store3.send_get_request_(&key, 0), "three"));
+    assert(store3.remove(&key));
+    assert(store1.map->size() == 0 && store2.map->size() == 0);
+    store3.put(&key, Value::copy("four", 4));
+    assert(store3.remove(&plain));
+    assert(store1.map->size() == 0 && store2.map->size() == 0);
+
+    // A frame replicated on every node is read without going over the network
+    const size_t n = 3 * INTERNAL_CHUNK_SIZE;
+    float floats[n];
+    for (size_t i = 0; i < n; i++) {
+        floats[i] = i;
+    }
+    Key frame((char*)"rep-frame", 0);
+    frame.set_replicas(3);
+    delete DataFrame::fromArray(&frame, &store1, n, floats);
+    assert(store1.map->size() == store2.map->size() && store2.map->size() == store3.map->size());
+
+    // Getting it copies each chunk from a local replica, and puts the copy
+    // once rather than on every replica
+    remote_gets = store3.metrics->gets_remote.get();
+    size_t chunks = store1.map->size() - 1;  // every chunk, and the frame
+    size_t stored = store1.map->size() + store2.map->size() + store3.map->size();
+    DistributedDataFrame* copy = store3.get(&frame);
+    assert(store3.metrics->gets_remote.get() == remote_gets);
+    DistributedColumn* copy_col = dynamic_cast<DistributedColumn*>(copy->columns[0]);
+    assert(copy_col->chunk_keys[0]->replicas == 1);
+    size_t copied = store1.map->size() + store2.map->size() + store3.map->size() - stored;
+    assert(copied == chunks);
+    for (size_t i = 0; i < n; i++) {
+        assert(copy->get_float(0, i) == i);
+    }
+    store3.drop_chunks(copy);
+    delete copy;
+    assert(store3.drop_frame(&frame));
+    assert(store1.map->size() == 0 && store2.map->size() == 0 && store3.map->size() == 0);
+
+    store1.is_done();
+    store2.is_done();
+    store3.is_done();
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    while (!store1.is_shutdown()) {
+    }
+    while (!store2.is_shutdown()) {
+    }
+    while (!store3.is_shutdown()) {
+    }
+
+    return true;
+}
+
+// Confirm each node counts its gets and puts, and answers for them when asked
+bool test_stats() {
+    char* master_ip = (char*)"127.0.0.1";
+    int master_port = rand_port();
+    Server s(master_ip, master_port);
+    s.listen_for_clients();
+
+    Store store1(0, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    Store store2(1, (char*)"127.0.0.1", rand_port(), master_ip, master_port);
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/store_test_stats_%d.json", (int)getpid());
+    store2.set_stats_path(path);
+
+    Key local((char*)"hot-0", 0);
+    Key remote((char*)"hot-1", 1);
+    store1.put(&local, Value::copy("ab", 2));
+    store1.put(&remote, Value::copy("cd", 2));
+    assert(value_is(store1.get_value(&remote), "cd"));
+    assert(value_is(store1.get_value(&local), "ab"));
+
+    assert(store1.metrics->puts_local.get() == 1);
+    assert(store1.metrics->puts_remote.get() == 1);
+    assert(store1.metrics->gets_remote.get() == 1);
+    assert(store2.metrics->puts_served.get() == 1);
+    assert(store2.metrics->gets_served.get() == 1);
+    assert(store1.metrics->get_nanos.count == 2);
+
+    char* stats = store1.get_stats(1);
+    assert(strncmp(stats, "{\"node\": 1, \"keys\": 1,", 22) == 0);
+    assert(strstr(stats, "{\"prefix\": \"hot\", \"gets\": 1, \"puts\": 1, \"bytes\": 4}") != nullptr);
+    delete[] stats;
+    stats = store1.get_stats(0);
+    assert(strstr(stats, "\"gets_remote\": 1") != nullptr);
+    delete[] stats;
+
+    // A frame streamed to its home node is timed as it is serialized
+    Key frame((char*)"frame-1", 1);
+    DistributedIntColumn i_c(&store1);
+    i_c.push_back(5);
+    Schema empty_schema;
+    DistributedDataFrame df(&store1, empty_schema);
+    df.add_column(&i_c);
+    size_t puts_remote = store1.metrics->puts_remote.get();
+    size_t serialized = store1.metrics->serialize_nanos.count;
+    store1.put(&frame, &df);
+    assert(store1.metrics->puts_remote.get() == puts_remote + 1);
+    assert(store1.metrics->serialize_nanos.count == serialized + 1);
+
+    store1.is_done();
+    store2.is_done();
+
+    // shutdown system
+    s.shutdown();
+
+    // wait for nodes to finish
+    while (!store1.is_shutdown()) {
+    }
+    while (!store2.is_shutdown()) {
+    }
+
+    return true;
+}
+
+// Confirm a node writes its stats where asked once it is deleted
+bool test_stats_dump() {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/store_test_stats_%d.json", (int)getpid());
+    FILE* file = fopen(path, "r");
+    assert(file != nullptr);
+    char buf[128];
+    assert(fgets(buf, sizeof(buf), file) != nullptr);
+    assert(strncmp(buf, "{\"node\": 1,", 11) == 0);
+    fclose(file);
+    remove(path);
+    return true;
+}
+
 int main() {
     assert(test_simple_put_get());
     printf("========== test_simple_put_get PASSED =============\n");
     assert(test_network_put_get());
     printf("========== test_network_put_get PASSED =============\n");
+    assert(test_values());
+    printf("========== test_values PASSED =============\n");
+    assert(test_memory_budget());
+    printf("========== test_memory_budget PASSED =============\n");
+    assert(test_snapshot());
+    printf("========== test_snapshot PASSED =============\n");
+    assert(test_remote_cache());
+    printf("========== test_remote_cache PASSED =============\n");
+    assert(test_batches());
+    printf("========== test_batches PASSED =============\n");
+    assert(test_async());
+    printf("========== test_async PASSED =============\n");
+    assert(test_remove());
+    printf("========== test_remove PASSED =============\n");
+    assert(test_stats());
+    assert(test_stats_dump());
+    printf("========== test_stats PASSED =============\n");
+    assert(test_replication());
+    printf("========== test_replication PASSED =============\n");
+    assert(test_watch());
+    printf("========== test_watch PASSED =============\n");
     assert(test_network_distributed_df());
     printf("========== test_network_distributed_df PASSED =============\n");
     assert(test_network_distributed_df_waitAndGet());
     printf("========== test_network_distributed_df_waitAndGet PASSED =============\n");
+    assert(test_collectives());
+    printf("========== test_collectives PASSED =============\n");
+    assert(test_merges());
+    printf("========== test_merges PASSED =============\n");
 }
@@ -1,15 +1,37 @@
+#include <netinet/in.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <ctime>
 
 // Whether the rand() call in rand_port() has been seeded. Used to make sure
 // we only seed once.
 bool seeded = false;
 
+// Whether a server could bind the given port right now. Ports an earlier
+// test accepted connections on linger in TIME_WAIT and cannot be.
+bool port_is_free(int port) {
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    bool free = bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    close(sockfd);
+    return free;
+}
+
 int rand_port() {
     if (!seeded) {
         srand(time(NULL));
         seeded = true;
     }
 
-    return 4000 + rand() % 4000;
+    int port;
+    do {
+        port = 4000 + rand() % 4000;
+    } while (!port_is_free(port));
+    return port;
 }
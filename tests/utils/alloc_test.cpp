@@ -0,0 +1,113 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include "../../src/utils/arena.h"
+#include "../../src/utils/slab.h"
+
+// Confirm every size lands in a class big enough to hold it, and that
+// freed blocks are handed out again
+bool test_slab_classes() {
+    for (size_t size = 0; size <= SLAB_MAX_BLOCK; size++) {
+        size_t c = SlabAllocator::class_of(size);
+        assert(c < SLAB_CLASSES);
+        assert(SlabAllocator::class_size(c) >= size);
+        assert(c == 0 || SlabAllocator::class_size(c - 1) < size);
+    }
+
+    SlabAllocator slab;
+    void* a = slab.alloc(40);
+    void* b = slab.alloc(48);
+    assert(a != b);
+    assert((uintptr_t)a % 16 == 0 && (uintptr_t)b % 16 == 0);
+    assert(slab.in_use == 96);
+    slab.free(a, 40);
+    assert(slab.alloc(33) == a);
+    slab.free(a, 33);
+    slab.free(b, 48);
+    assert(slab.in_use == 0);
+    assert(slab.reserved == SLAB_BYTES);
+
+    // Blocks too big for any class go to the system allocator
+    char* big = (char*)slab.alloc(SLAB_MAX_BLOCK + 1);
+    memset(big, 'x', SLAB_MAX_BLOCK + 1);
+    slab.free(big, SLAB_MAX_BLOCK + 1);
+    assert(slab.in_use == 0);
+
+    char* copy = slab.duplicate("hello", 5);
+    assert(strcmp(copy, "hello") == 0);
+    slab.free(copy, 6);
+
+    return true;
+}
+
+// Confirm blocks stay distinct and whole when many threads churn them
+bool test_slab_concurrent() {
+    SlabAllocator slab;
+    std::thread* threads[8];
+    for (size_t t = 0; t < 8; t++) {
+        threads[t] = new std::thread([&slab, t] {
+            char* blocks[64];
+            for (size_t round = 0; round < 200; round++) {
+                for (size_t i = 0; i < 64; i++) {
+                    blocks[i] = (char*)slab.alloc(1 + (i * 37) % 300);
+                    memset(blocks[i], (int)t, 1 + (i * 37) % 300);
+                }
+                for (size_t i = 0; i < 64; i++) {
+                    assert(blocks[i][0] == (char)t && blocks[i][(i * 37) % 300] == (char)t);
+                    slab.free(blocks[i], 1 + (i * 37) % 300);
+                }
+            }
+        });
+    }
+    for (size_t t = 0; t < 8; t++) {
+        threads[t]->join();
+        delete threads[t];
+    }
+    assert(slab.in_use == 0);
+
+    return true;
+}
+
+// Confirm an arena aligns what it hands out, grows past its own bytes and
+// starts over when reset
+bool test_arena() {
+    Arena arena;
+    char* c = (char*)arena.alloc(1, 1);
+    int* ints = arena.alloc_array<int>(100);
+    assert((uintptr_t)ints % alignof(int) == 0);
+    assert((char*)ints > c);
+    for (int i = 0; i < 100; i++) {
+        ints[i] = i;
+    }
+    assert(arena.blocks == nullptr);
+
+    // Past the inline bytes, blocks come from the heap
+    char* big = (char*)arena.alloc(ARENA_INLINE_BYTES);
+    memset(big, 'y', ARENA_INLINE_BYTES);
+    assert(arena.blocks != nullptr);
+    assert((uintptr_t)big % ARENA_ALIGN == 0);
+    assert(ints[99] == 99);
+
+    char* copy = arena.duplicate("arena", 5);
+    assert(strcmp(copy, "arena") == 0);
+    size_t* made = arena.make<size_t>((size_t)42);
+    assert(*made == 42);
+
+    arena.reset();
+    assert(arena.blocks == nullptr);
+    assert(arena.alloc(1, 1) == arena.inline_);
+
+    return true;
+}
+
+int main() {
+    assert(test_slab_classes());
+    printf("========== test_slab_classes PASSED =============\n");
+    assert(test_slab_concurrent());
+    printf("========== test_slab_concurrent PASSED =============\n");
+    assert(test_arena());
+    printf("========== test_arena PASSED =============\n");
+}
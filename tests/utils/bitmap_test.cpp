@@ -0,0 +1,152 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#include <assert.h>
+#include <stdio.h>
+#include "../../src/utils/bitmap.h"
+
+// Confirm add/contains/remove on a sparse bitmap spanning several containers
+bool test_add_contains_remove() {
+    Bitmap b;
+    assert(b.is_empty());
+
+    assert(b.add(5));
+    assert(!b.add(5));
+    assert(b.add(70000));
+    assert(b.add(3));
+
+    assert(b.contains(3));
+    assert(b.contains(5));
+    assert(b.contains(70000));
+    assert(!b.contains(4));
+    assert(!b.contains(70001));
+    assert(b.cardinality() == 3);
+    assert(b.num_containers == 2);
+
+    assert(b.remove(70000));
+    assert(!b.remove(70000));
+    assert(b.num_containers == 1);
+    assert(b.cardinality() == 2);
+
+    return true;
+}
+
+// Confirm containers switch to a bitset when dense and back when sparse
+bool test_dense_container() {
+    Bitmap b;
+    for (uint32_t i = 0; i < 10000; i++) {
+        b.add(i * 2);
+    }
+
+    assert(b.cardinality() == 10000);
+    assert(b.containers[0]->is_bitset());
+    assert(b.contains(19998));
+    assert(!b.contains(19999));
+
+    for (uint32_t i = 0; i < 9000; i++) {
+        b.remove(i * 2);
+    }
+
+    assert(b.cardinality() == 1000);
+    assert(!b.containers[0]->is_bitset());
+    assert(b.contains(18000));
+    assert(!b.contains(0));
+
+    return true;
+}
+
+// Confirm union, intersection and difference across array and bitset containers
+bool test_set_operations() {
+    Bitmap evens;
+    Bitmap threes;
+    for (uint32_t i = 0; i < 30000; i++) {
+        if (i % 2 == 0) evens.add(i);
+        if (i % 3 == 0) threes.add(i);
+    }
+
+    Bitmap both(&evens);
+    both.intersect_with(&threes);
+    assert(both.cardinality() == 5000);
+    assert(both.contains(6));
+    assert(!both.contains(4));
+
+    Bitmap either(&evens);
+    either.union_with(&threes);
+    assert(either.cardinality() == 20000);
+    assert(either.contains(9));
+    assert(!either.contains(7));
+
+    Bitmap only_evens(&evens);
+    only_evens.subtract(&threes);
+    assert(only_evens.cardinality() == 10000);
+    assert(only_evens.contains(4));
+    assert(!only_evens.contains(6));
+
+    // Sparse union into a bitmap without a matching container
+    Bitmap sparse;
+    sparse.add(1 << 20);
+    either.union_with(&sparse);
+    assert(either.contains(1 << 20));
+    assert(either.cardinality() == 20001);
+
+    return true;
+}
+
+// Confirm iteration and to_array visit all values in ascending order
+bool test_iteration() {
+    Bitmap b;
+    b.add(1 << 17);
+    for (uint32_t i = 0; i < 5000; i++) {
+        b.add(i * 3);
+    }
+    b.add(1);
+
+    uint32_t* values = b.to_array();
+    size_t count = 0;
+    BitmapIterator it(&b);
+    while (it.has_next()) {
+        uint32_t v = it.next();
+        assert(v == values[count]);
+        if (count > 0) assert(values[count - 1] < v);
+        count++;
+    }
+
+    assert(count == b.cardinality());
+    assert(values[0] == 0);
+    assert(values[1] == 1);
+    assert(values[count - 1] == (1 << 17));
+
+    delete[] values;
+
+    Bitmap empty;
+    BitmapIterator empty_it(&empty);
+    assert(!empty_it.has_next());
+
+    return true;
+}
+
+// Confirm equality compares contents
+bool test_equals() {
+    Bitmap a;
+    Bitmap b;
+    a.add(10);
+    a.add(100000);
+    b.add(100000);
+    assert(!a.equals(&b));
+    b.add(10);
+    assert(a.equals(&b));
+
+    Bitmap* c = a.clone();
+    assert(c->equals(&a));
+    delete c;
+
+    return true;
+}
+
+int main() {
+    assert(test_add_contains_remove());
+    assert(test_dense_container());
+    assert(test_set_operations());
+    assert(test_iteration());
+    assert(test_equals());
+    printf("====== Bitmap tests PASSED ===========\n");
+}
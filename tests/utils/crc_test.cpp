@@ -0,0 +1,54 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "../../src/utils/crc32c.h"
+
+// Confirm checksums match the published CRC-32C check values
+bool test_known_values() {
+    assert(Crc32c::compute("", 0) == 0);
+    assert(Crc32c::compute("123456789", 9) == 0xE3069283u);
+
+    char zeros[32];
+    memset(zeros, 0, sizeof(zeros));
+    assert(Crc32c::compute(zeros, 32) == 0x8A9136AAu);
+    char ones[32];
+    memset(ones, 0xFF, sizeof(ones));
+    assert(Crc32c::compute(ones, 32) == 0x62A8AB43u);
+
+    return true;
+}
+
+// Confirm the instruction and the table agree at every length and
+// alignment, and that a checksum extended piece by piece matches the whole
+bool test_hardware_matches_table() {
+    unsigned char bytes[300];
+    srand(5);
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (unsigned char)rand();
+    }
+
+    for (size_t start = 0; start < 8; start++) {
+        for (size_t len = 0; start + len <= sizeof(bytes); len += 7) {
+            uint32_t table = ~Crc32c::extend_table_(~0u, bytes + start, len);
+            assert(Crc32c::compute(bytes + start, len) == table);
+        }
+    }
+
+    uint32_t whole = Crc32c::compute(bytes, sizeof(bytes));
+    for (size_t split = 0; split <= sizeof(bytes); split += 13) {
+        uint32_t crc = Crc32c::compute(bytes, split);
+        assert(Crc32c::extend(crc, bytes + split, sizeof(bytes) - split) == whole);
+    }
+    printf("crc32c hardware: %s\n", Crc32c::has_hardware() ? "yes" : "no");
+
+    return true;
+}
+
+int main() {
+    assert(test_known_values());
+    printf("========== test_known_values PASSED =============\n");
+    assert(test_hardware_matches_table());
+    printf("========== test_hardware_matches_table PASSED =============\n");
+}
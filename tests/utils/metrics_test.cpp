@@ -0,0 +1,134 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include "../../src/utils/metrics.h"
+
+// Confirm every value lands in a bucket whose bounds hold it, and that
+// bucket widths stay within the relative error promised
+bool test_buckets() {
+    for (uint64_t v = 0; v < 100000; v++) {
+        size_t idx = Histogram::bucket_of(v);
+        assert(idx < HISTOGRAM_BUCKETS);
+        assert(Histogram::bucket_low(idx) <= v);
+        assert(Histogram::bucket_low(idx + 1) > v);
+    }
+    uint64_t big = (uint64_t)1 << 62;
+    assert(Histogram::bucket_low(Histogram::bucket_of(big)) == big);
+    assert(Histogram::bucket_of(UINT64_MAX) == HISTOGRAM_BUCKETS - 1);
+
+    for (size_t idx = HISTOGRAM_SUB_BUCKETS; idx + 1 < HISTOGRAM_BUCKETS; idx++) {
+        uint64_t low = Histogram::bucket_low(idx);
+        uint64_t width = Histogram::bucket_low(idx + 1) - low;
+        assert(width * HISTOGRAM_SUB_BUCKETS <= low);
+    }
+
+    return true;
+}
+
+// Confirm percentiles come out within a bucket of the true values
+bool test_percentiles() {
+    Histogram empty;
+    assert(empty.percentile(0.5) == 0);
+    assert(empty.mean() == 0);
+
+    Histogram h;
+    for (uint64_t v = 1; v <= 10000; v++) {
+        h.record(v);
+    }
+    assert(h.count == 10000);
+    assert(h.max == 10000);
+    assert(h.mean() == 5000);
+    assert(h.percentile(0.5) >= 5000 && h.percentile(0.5) <= 5000 * 9 / 8);
+    assert(h.percentile(0.99) >= 9900 && h.percentile(0.99) <= 10000);
+    assert(h.percentile(1) == 10000);
+
+    Histogram timed;
+    int result = timed.timed([] { return 42; });
+    assert(result == 42);
+    {
+        LatencyTimer timer(&timed);
+    }
+    assert(timed.count == 2);
+
+    return true;
+}
+
+// Confirm counters and histograms lose no updates from many threads
+bool test_concurrent() {
+    Metrics metrics;
+    std::thread* threads[8];
+    for (size_t t = 0; t < 8; t++) {
+        threads[t] = new std::thread([&metrics, t] {
+            for (size_t i = 0; i < 10000; i++) {
+                metrics.gets_local.add();
+                metrics.get_nanos.record(i);
+                metrics.record_get(t % 2 == 0 ? "even-key" : "odd-key", 2);
+            }
+        });
+    }
+    for (size_t t = 0; t < 8; t++) {
+        threads[t]->join();
+        delete threads[t];
+    }
+
+    assert(metrics.gets_local.get() == 80000);
+    assert(metrics.get_nanos.count == 80000);
+    assert(metrics.prefixes.find("even-other")->gets.get() == 40000);
+    assert(metrics.prefixes.find("odd")->bytes.get() == 80000);
+
+    return true;
+}
+
+// Confirm keys group by prefix, with chunks and overflow counted together
+bool test_prefixes() {
+    PrefixTable table;
+    assert(table.find("users-3") == table.find("users-17"));
+    assert(table.find("users-3") != table.find("projects-3"));
+    assert(table.find("users") == table.find("users-3"));
+    assert(table.find("0-12-4") == table.find("3-1-0"));
+    assert(strcmp(table.find("0-12-4")->prefix, "chunk") == 0);
+
+    char name[16];
+    for (size_t i = 0; i < 2 * METRICS_MAX_PREFIXES; i++) {
+        snprintf(name, sizeof(name), "p%zu-x", i);
+        table.find(name)->puts.add();
+    }
+    assert(table.find("p-never-seen") == &table.other);
+    assert(table.other.puts.get() > 0);
+
+    return true;
+}
+
+// Confirm the JSON dump holds every section and the given fields
+bool test_json() {
+    Metrics metrics;
+    metrics.puts_local.add(3);
+    metrics.put_nanos.record(1000);
+    metrics.record_put("a\"quoted-key", 5);
+
+    char* json = metrics.to_json("\"node\": 7");
+    assert(strncmp(json, "{\"node\": 7, \"counters\": {", 25) == 0);
+    assert(strstr(json, "\"puts_local\": 3") != nullptr);
+    assert(strstr(json, "\"put\": {\"count\": 1, \"mean\": 1000") != nullptr);
+    assert(strstr(json, "{\"prefix\": \"a\\\"quoted\", \"gets\": 0, \"puts\": 1, \"bytes\": 5}") != nullptr);
+    assert(json[strlen(json) - 1] == '}');
+    delete[] json;
+
+    return true;
+}
+
+int main() {
+    assert(test_buckets());
+    printf("========== test_buckets PASSED =============\n");
+    assert(test_percentiles());
+    printf("========== test_percentiles PASSED =============\n");
+    assert(test_concurrent());
+    printf("========== test_concurrent PASSED =============\n");
+    assert(test_prefixes());
+    printf("========== test_prefixes PASSED =============\n");
+    assert(test_json());
+    printf("========== test_json PASSED =============\n");
+}
@@ -0,0 +1,103 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include "../../src/utils/sketch.h"
+
+// Confirm HyperLogLog estimates distinct counts within a few percent, and
+// that merging two halves matches a sketch of the whole
+bool test_hyperloglog() {
+    HyperLogLog small;
+    for (int i = 0; i < 100; i++) {
+        small.add(i % 10);
+    }
+    assert(fabs(small.estimate() - 10) < 1);
+
+    HyperLogLog all;
+    HyperLogLog low;
+    HyperLogLog high;
+    for (int i = 0; i < 100000; i++) {
+        all.add(i);
+        // Overlapping halves; duplicates must not be counted twice
+        if (i < 60000) low.add(i);
+        if (i >= 40000) high.add(i);
+    }
+
+    assert(fabs(all.estimate() - 100000) < 100000 * 0.05);
+    assert(low.merge(&high));
+    assert(low.equals(&all));
+
+    HyperLogLog other_precision(10);
+    assert(!low.merge(&other_precision));
+
+    return true;
+}
+
+// Confirm Count-Min never underestimates, finds the heavy hitter, and
+// merges by adding counts
+bool test_count_min() {
+    String heavy("the");
+    String rare("zebra");
+    CountMinSketch a;
+    CountMinSketch b;
+    for (int i = 0; i < 5000; i++) {
+        a.add(i);
+        b.add(&heavy);
+    }
+    a.add(&rare);
+
+    assert(a.estimate(&rare) >= 1);
+    assert(a.estimate(&rare) < 50);
+    assert(b.estimate(&heavy) == 5000);
+    assert(b.estimate(&rare) == 0);
+
+    assert(a.merge(&b));
+    assert(a.total == 10001);
+    assert(a.estimate(&heavy) >= 5000);
+    assert(a.is_heavy_hitter(&heavy, 0.4));
+    assert(!a.is_heavy_hitter(&rare, 0.4));
+
+    CountMinSketch narrow(16, 4);
+    assert(!a.merge(&narrow));
+
+    return true;
+}
+
+// Confirm KLL quantiles have small rank error, including after merging
+bool test_kll() {
+    KllSketch empty;
+    assert(empty.quantile(0.5) == 0);
+
+    KllSketch evens;
+    KllSketch odds;
+    for (int i = 0; i < 100000; i++) {
+        if (i % 2 == 0) {
+            evens.add(i);
+        } else {
+            odds.add((float)i);
+        }
+    }
+
+    assert(evens.n == 50000);
+    assert(evens.num_values() < 1000);
+    assert(fabs(evens.quantile(0.5) - 50000) < 100000 * 0.02);
+
+    assert(evens.merge(&odds));
+    assert(evens.n == 100000);
+    assert(evens.num_values() < 1000);
+    assert(fabs(evens.quantile(0.1) - 10000) < 100000 * 0.02);
+    assert(fabs(evens.quantile(0.9) - 90000) < 100000 * 0.02);
+    assert(evens.quantile(0) < 100000 * 0.02);
+    assert(evens.quantile(1) > 100000 * 0.98);
+    assert(fabs(evens.rank(25000) - 0.25) < 0.02);
+
+    return true;
+}
+
+int main() {
+    assert(test_hyperloglog());
+    assert(test_count_min());
+    assert(test_kll());
+    printf("====== Sketch tests PASSED ===========\n");
+}
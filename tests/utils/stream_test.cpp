@@ -0,0 +1,121 @@
+/* Authors: Ryan Heminway (heminway.r@husky.neu.edu)
+*           David Tandetnik (tandetnik.da@husky.neu.edu) */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../../src/utils/stream.h"
+
+// A Sink that gathers what it drains, noting the biggest piece
+class GatherSink : public Sink {
+   public:
+    Buffer out;
+    size_t pieces;
+    size_t largest;
+
+    GatherSink(size_t capacity) : Sink(capacity) {
+        pieces = 0;
+        largest = 0;
+    }
+
+    void drain_(const char* bytes, size_t n) {
+        out.append(bytes, n);
+        pieces++;
+        largest = n > largest ? n : largest;
+    }
+};
+
+// Confirm small appends are drained in pieces no bigger than the sink's,
+// and a big one straight through, in order
+bool test_sink_pieces() {
+    GatherSink sink(16);
+    Buffer expected;
+    for (size_t i = 0; i < 100; i++) {
+        sink.append_size_t(i * 1000);
+        sink.append(';');
+        expected.append_size_t(i * 1000);
+        expected.append(';');
+    }
+    assert(sink.largest <= 16);
+    assert(sink.len > 0);
+
+    char big[100];
+    memset(big, 'x', sizeof(big));
+    sink.append(big, sizeof(big));
+    expected.append(big, sizeof(big));
+    sink.append("end");
+    expected.append("end");
+    sink.flush();
+
+    assert(sink.len == 0);
+    assert(sink.written == expected.size());
+    assert(sink.out.size() == expected.size());
+    assert(strcmp(sink.out.buf, expected.buf) == 0);
+    assert(sink.largest == sizeof(big));
+
+    return true;
+}
+
+// Confirm tokens, bytes and big reads come back the same from memory
+bool test_array_source() {
+    const char* text = "schema~1;2;a,0;b,1~";
+    ArraySource source(text, strlen(text));
+    Buffer token;
+    assert(source.read_token(token, "~") == '~');
+    assert(strcmp(token.buf, "schema") == 0);
+    assert(source.read_token(token, ";~") == ';' && strcmp(token.buf, "1") == 0);
+    assert(source.get() == '2');
+    assert(source.get() == ';');
+    char bytes[4];
+    assert(source.read(bytes, 3) == 3 && memcmp(bytes, "a,0", 3) == 0);
+    assert(source.read_token(token, ";~") == ';' && token.size() == 0);
+    assert(source.read_token(token, ";~") == '~' && strcmp(token.buf, "b,1") == 0);
+    assert(source.read_token(token, ";~") == -1 && token.size() == 0);
+    assert(source.get() == -1);
+    assert(source.read(bytes, 4) == 0);
+
+    return true;
+}
+
+// Confirm bytes written to a pipe a piece at a time are read back from it
+// a smaller piece at a time, and that a source stops where it was told
+bool test_fd_stream() {
+    int fds[2];
+    assert(pipe(fds) == 0);
+
+    // Well under what a pipe holds, so writing does not wait for the reader
+    Buffer expected;
+    FdSink sink(fds[1], 100);
+    for (size_t i = 0; i < 2000; i++) {
+        sink.append_size_t(i);
+        sink.append(',');
+        expected.append_size_t(i);
+        expected.append(',');
+    }
+    sink.append("tail");
+    expected.append("tail");
+    sink.flush();
+    close(fds[1]);
+
+    FdSource source(fds[0], expected.size(), 64);
+    Buffer token;
+    for (size_t i = 0; i < 2000; i++) {
+        assert(source.read_token(token, ",") == ',');
+        assert((size_t)atol(token.buf) == i);
+    }
+    assert(source.read_token(token, ",") == -1);
+    assert(strcmp(token.buf, "tail") == 0);
+    assert(source.remaining == 0);
+    close(fds[0]);
+
+    return true;
+}
+
+int main() {
+    assert(test_sink_pieces());
+    printf("========== test_sink_pieces PASSED =============\n");
+    assert(test_array_source());
+    printf("========== test_array_source PASSED =============\n");
+    assert(test_fd_stream());
+    printf("========== test_fd_stream PASSED =============\n");
+}